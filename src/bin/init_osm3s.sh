@@ -21,7 +21,7 @@ if [[ -z $3 ]]; then
 {
   echo "Usage:  $0  Planet_File  Database_Dir  Executable_Dir  [--meta]"
   echo "        where"
-  echo "    Planet_File is the filename and path of the compressed planet file, including .bz2,"
+  echo "    Planet_File is the filename and path of the compressed planet file, including .bz2, or a .osm.pbf file,"
   echo "    Database_Dir is the directory the database should go into, and"
   echo "    Executable_Dir is the directory that contains the executable update_database."
   echo "    Add --meta in the end if you want to use meta data."
@@ -40,4 +40,8 @@ if [[ ! -s $PLANET_FILE ]]; then
 }; fi
 
 mkdir -p "$DB_DIR/"
-bunzip2 <$PLANET_FILE | $EXEC_DIR/bin/update_database --db-dir=$DB_DIR/ $META
+if [[ ${PLANET_FILE: -4} == ".pbf" ]]; then
+  $EXEC_DIR/bin/update_database --db-dir=$DB_DIR/ $META --pbf <$PLANET_FILE
+else
+  bunzip2 <$PLANET_FILE | $EXEC_DIR/bin/update_database --db-dir=$DB_DIR/ $META
+fi
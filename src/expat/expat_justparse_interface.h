@@ -128,6 +128,14 @@ struct Script_Parser
     result_buf = "";
   }
 
+  // Prepares the parser for another document.
+  void reset()
+  {
+    XML_ParserReset(p, NULL);
+    parser_online = true;
+    result_buf = "";
+  }
+
 private:
   XML_Parser p;
   bool parser_online;  
@@ -0,0 +1,112 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___OVERPASS_API__CORE__COMPACT_CODING_H
+#define DE__OSM3S___OVERPASS_API__CORE__COMPACT_CODING_H
+
+#include "../../template_db/types.h"
+
+
+/** Variable length integers: seven bits per byte, least significant group
+    first, the high bit set on all but the last byte. Signed differences are
+    zig-zag mapped first, such that small negative values also get short. */
+
+inline uint64 zigzag_encode(int64 value)
+{
+  return (((uint64)value)<<1) ^ (uint64)(value>>63);
+}
+
+
+inline int64 zigzag_decode(uint64 value)
+{
+  return (int64)(value>>1) ^ -(int64)(value & 1);
+}
+
+
+inline uint32 varint_size(uint64 value)
+{
+  uint32 size = 1;
+  while (value >= 0x80)
+  {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+
+inline uint8* write_varint(uint8* ptr, uint64 value)
+{
+  while (value >= 0x80)
+  {
+    *(ptr++) = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *(ptr++) = value;
+  return ptr;
+}
+
+
+inline const uint8* read_varint(const uint8* ptr, uint64& value)
+{
+  // Most deltas fit into one or two bytes, hence these are decoded without loop.
+  if (!(ptr[0] & 0x80))
+  {
+    value = ptr[0];
+    return ptr + 1;
+  }
+  if (!(ptr[1] & 0x80))
+  {
+    value = (ptr[0] & 0x7f) | (((uint64)ptr[1])<<7);
+    return ptr + 2;
+  }
+  value = (ptr[0] & 0x7f) | (((uint64)(ptr[1] & 0x7f))<<7);
+  ptr += 2;
+  uint32 shift = 14;
+  while (*ptr & 0x80)
+  {
+    value |= ((uint64)(*(ptr++) & 0x7f))<<shift;
+    shift += 7;
+  }
+  value |= ((uint64)*(ptr++))<<shift;
+  return ptr;
+}
+
+
+inline uint32 delta_size(uint64 previous, uint64 value)
+{
+  return varint_size(zigzag_encode((int64)(value - previous)));
+}
+
+
+inline uint8* write_delta(uint8* ptr, uint64 previous, uint64 value)
+{
+  return write_varint(ptr, zigzag_encode((int64)(value - previous)));
+}
+
+
+inline const uint8* read_delta(const uint8* ptr, uint64 previous, uint64& value)
+{
+  uint64 coded;
+  ptr = read_varint(ptr, coded);
+  value = previous + (uint64)zigzag_decode(coded);
+  return ptr;
+}
+
+
+#endif
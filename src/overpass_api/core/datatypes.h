@@ -250,6 +250,7 @@ class Osm_Backend_Callback
     virtual void flush_roles_finished() = 0;
     virtual void update_finished() = 0;
     virtual void partial_started() = 0;
+    virtual void partial_file_finished(const string& file_name) = 0;
     virtual void partial_finished() = 0;
     
     virtual void parser_started() = 0;
@@ -305,6 +306,20 @@ struct User_Data
 };
 
 
+/** The index of a user name in the file user_names. It is a FNV-1a hash of the name,
+    hence resolving a name to its user id needs only a lookup of a single index. */
+inline Uint32_Index user_name_index(const string& name)
+{
+  uint32 hash = 2166136261u;
+  for (string::size_type i = 0; i < name.size(); ++i)
+  {
+    hash ^= (unsigned char)name[i];
+    hash *= 16777619u;
+  }
+  return Uint32_Index(hash);
+}
+
+
 struct OSM_Element_Metadata
 {
   OSM_Element_Metadata() : user_id(0) {}
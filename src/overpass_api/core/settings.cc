@@ -36,9 +36,10 @@ template < typename TVal >
 struct OSM_File_Properties : public File_Properties
 {
   OSM_File_Properties(string file_base_name_, uint32 block_size_,
-		      uint32 map_block_size_)
+		      uint32 map_block_size_, uint32 compression_factor_)
     : file_base_name(file_base_name_), block_size(block_size_),
-      map_block_size(map_block_size_ > 0 ? map_block_size_*TVal::max_size_of() : 0) {}
+      map_block_size(map_block_size_ > 0 ? map_block_size_*TVal::max_size_of() : 0),
+      compression_factor(compression_factor_) {}
   
   string get_file_name_trunk() const { return file_base_name; }
   
@@ -66,17 +67,23 @@ struct OSM_File_Properties : public File_Properties
     return TVal::max_size_of();
   }
   
+  uint32 get_compression_factor() const { return compression_factor; }
+  uint32 get_compression_method() const { return basic_settings().compression_method; }
+  uint32 get_io_backend() const { return basic_settings().io_backend; }
+  uint32 get_checksum_method() const { return basic_settings().checksum_method; }
+  
   File_Blocks_Index_Base* new_data_index
-      (bool writeable, bool use_shadow, string db_dir, string file_name_extension)
-      const
+      (bool writeable, bool use_shadow, string db_dir, string file_name_extension,
+       const Index_Image* index_image) const
   {
     return new File_Blocks_Index< TVal >
-        (*this, writeable, use_shadow, db_dir, file_name_extension);
+        (*this, writeable, use_shadow, db_dir, file_name_extension, index_image);
   }
 
   string file_base_name;
   uint32 block_size;
   uint32 map_block_size;
+  uint32 compression_factor;
 };
 
 //-----------------------------------------------------------------------------
@@ -90,7 +97,15 @@ Basic_Settings::Basic_Settings()
 
   base_directory("./"),
   logfile_name("transactions.log"),
-  shared_name_base("/osm3s_v0.7.51")
+  shared_name_base("/osm3s_v0.7.51"),
+  compression_method(File_Blocks_Index_Base::NO_COMPRESSION),
+  io_backend(Block_Device::POSIX_IO),
+  checksum_method(File_Blocks_Index_Base::NO_CHECKSUM),
+  verify_checksums(false),
+  use_mmap(true),
+  prefetch_depth(8),
+  num_threads(1),
+  query_threads(1)
 {}
 
 Basic_Settings& basic_settings()
@@ -103,31 +118,31 @@ Basic_Settings& basic_settings()
 
 Osm_Base_Settings::Osm_Base_Settings()
 :
-  NODES(new OSM_File_Properties< Uint32_Index >("nodes", 512*1024, 64*1024)),
+  NODES(new OSM_File_Properties< Uint32_Index >("nodes", 512*1024, 64*1024, 8)),
   NODE_TAGS_LOCAL(new OSM_File_Properties< Tag_Index_Local >
-      ("node_tags_local", 512*1024, 0)),
+      ("node_tags_local", 512*1024, 0, 8)),
   NODE_TAGS_GLOBAL(new OSM_File_Properties< Tag_Index_Global >
-      ("node_tags_global", 512*1024, 0)),
+      ("node_tags_global", 512*1024, 0, 8)),
   NODE_KEYS(new OSM_File_Properties< Uint32_Index >
-      ("node_keys", 512*1024, 0)),
+      ("node_keys", 512*1024, 0, 8)),
       
-  WAYS(new OSM_File_Properties< Uint31_Index >("ways", 512*1024, 64*1024)),
+  WAYS(new OSM_File_Properties< Uint31_Index >("ways", 512*1024, 64*1024, 8)),
   WAY_TAGS_LOCAL(new OSM_File_Properties< Tag_Index_Local >
-      ("way_tags_local", 512*1024, 0)),
+      ("way_tags_local", 512*1024, 0, 8)),
   WAY_TAGS_GLOBAL(new OSM_File_Properties< Tag_Index_Global >
-      ("way_tags_global", 512*1024, 0)),
+      ("way_tags_global", 512*1024, 0, 8)),
   WAY_KEYS(new OSM_File_Properties< Uint32_Index >
-      ("way_keys", 512*1024, 0)),
+      ("way_keys", 512*1024, 0, 8)),
       
-  RELATIONS(new OSM_File_Properties< Uint31_Index >("relations", 1024*1024, 64*1024)),
+  RELATIONS(new OSM_File_Properties< Uint31_Index >("relations", 1024*1024, 64*1024, 16)),
   RELATION_ROLES(new OSM_File_Properties< Uint32_Index >
-      ("relation_roles", 512*1024, 0)),
+      ("relation_roles", 512*1024, 0, 8)),
   RELATION_TAGS_LOCAL(new OSM_File_Properties< Tag_Index_Local >
-      ("relation_tags_local", 512*1024, 0)),
+      ("relation_tags_local", 512*1024, 0, 8)),
   RELATION_TAGS_GLOBAL(new OSM_File_Properties< Tag_Index_Global >
-      ("relation_tags_global", 512*1024, 0)),
+      ("relation_tags_global", 512*1024, 0, 8)),
   RELATION_KEYS(new OSM_File_Properties< Uint32_Index >
-      ("relation_keys", 512*1024, 0)),
+      ("relation_keys", 512*1024, 0, 8)),
       
   shared_name(basic_settings().shared_name_base + "_osm_base"),
   max_num_processes(20),
@@ -147,12 +162,12 @@ const Osm_Base_Settings& osm_base_settings()
 Area_Settings::Area_Settings()
 :
   AREA_BLOCKS(new OSM_File_Properties< Uint31_Index >
-      ("area_blocks", 512*1024, 64*1024)),
-  AREAS(new OSM_File_Properties< Uint31_Index >("areas", 2*1024*1024, 64*1024)),
+      ("area_blocks", 512*1024, 64*1024, 8)),
+  AREAS(new OSM_File_Properties< Uint31_Index >("areas", 2*1024*1024, 64*1024, 32)),
   AREA_TAGS_LOCAL(new OSM_File_Properties< Tag_Index_Local >
-      ("area_tags_local", 256*1024, 0)),
+      ("area_tags_local", 256*1024, 0, 4)),
   AREA_TAGS_GLOBAL(new OSM_File_Properties< Tag_Index_Global >
-      ("area_tags_global", 512*1024, 0)),
+      ("area_tags_global", 512*1024, 0, 8)),
       
   shared_name(basic_settings().shared_name_base + "_areas"),
   max_num_processes(5),
@@ -172,15 +187,17 @@ const Area_Settings& area_settings()
 Meta_Settings::Meta_Settings()
 :
   USER_DATA(new OSM_File_Properties< Uint32_Index >
-      ("user_data", 512*1024, 0)),
+      ("user_data", 512*1024, 0, 8)),
   USER_INDICES(new OSM_File_Properties< Uint32_Index >
-      ("user_indices", 512*1024, 0)),
+      ("user_indices", 512*1024, 0, 8)),
+  USER_NAMES(new OSM_File_Properties< Uint32_Index >
+      ("user_names", 512*1024, 0, 8)),
   NODES_META(new OSM_File_Properties< Uint31_Index >
-      ("nodes_meta", 512*1024, 0)),
+      ("nodes_meta", 512*1024, 0, 8)),
   WAYS_META(new OSM_File_Properties< Uint31_Index >
-      ("ways_meta", 512*1024, 0)),
+      ("ways_meta", 512*1024, 0, 8)),
   RELATIONS_META(new OSM_File_Properties< Uint31_Index >
-      ("relations_meta", 512*1024, 0))
+      ("relations_meta", 512*1024, 0, 8))
 {}
 
 const Meta_Settings& meta_settings()
@@ -193,44 +210,44 @@ const Meta_Settings& meta_settings()
 
 Attic_Settings::Attic_Settings()
 :
-  NODES(new OSM_File_Properties< Uint31_Index >("nodes_attic", 512*1024, 64*1024)),
-  NODES_UNDELETED(new OSM_File_Properties< Uint31_Index >("nodes_attic_undeleted", 512*1024, 64*1024)),
+  NODES(new OSM_File_Properties< Uint31_Index >("nodes_attic", 512*1024, 64*1024, 8)),
+  NODES_UNDELETED(new OSM_File_Properties< Uint31_Index >("nodes_attic_undeleted", 512*1024, 64*1024, 8)),
   NODE_IDX_LIST(new OSM_File_Properties< Node::Id_Type >
-      ("node_attic_indexes", 512*1024, 0)),
+      ("node_attic_indexes", 512*1024, 0, 8)),
   NODE_TAGS_LOCAL(new OSM_File_Properties< Tag_Index_Local >
-      ("node_tags_local_attic", 512*1024, 0)),
+      ("node_tags_local_attic", 512*1024, 0, 8)),
   NODE_TAGS_GLOBAL(new OSM_File_Properties< Tag_Index_Global >
-      ("node_tags_global_attic", 2*1024*1024, 0)),
+      ("node_tags_global_attic", 2*1024*1024, 0, 32)),
   NODES_META(new OSM_File_Properties< Uint31_Index >
-      ("nodes_meta_attic", 512*1024, 0)),
+      ("nodes_meta_attic", 512*1024, 0, 8)),
   NODE_CHANGELOG(new OSM_File_Properties< Timestamp >
-      ("node_changelog", 512*1024, 0)),
+      ("node_changelog", 512*1024, 0, 8)),
       
-  WAYS(new OSM_File_Properties< Uint31_Index >("ways_attic", 512*1024, 64*1024)),
-  WAYS_UNDELETED(new OSM_File_Properties< Uint31_Index >("ways_attic_undeleted", 512*1024, 64*1024)),
+  WAYS(new OSM_File_Properties< Uint31_Index >("ways_attic", 512*1024, 64*1024, 8)),
+  WAYS_UNDELETED(new OSM_File_Properties< Uint31_Index >("ways_attic_undeleted", 512*1024, 64*1024, 8)),
   WAY_IDX_LIST(new OSM_File_Properties< Way::Id_Type >
-      ("way_attic_indexes", 512*1024, 0)),
+      ("way_attic_indexes", 512*1024, 0, 8)),
   WAY_TAGS_LOCAL(new OSM_File_Properties< Tag_Index_Local >
-      ("way_tags_local_attic", 512*1024, 0)),
+      ("way_tags_local_attic", 512*1024, 0, 8)),
   WAY_TAGS_GLOBAL(new OSM_File_Properties< Tag_Index_Global >
-      ("way_tags_global_attic", 2*1024*1024, 0)),
+      ("way_tags_global_attic", 2*1024*1024, 0, 32)),
   WAYS_META(new OSM_File_Properties< Uint31_Index >
-      ("ways_meta_attic", 512*1024, 0)),
+      ("ways_meta_attic", 512*1024, 0, 8)),
   WAY_CHANGELOG(new OSM_File_Properties< Timestamp >
-      ("way_changelog", 512*1024, 0)),
+      ("way_changelog", 512*1024, 0, 8)),
       
-  RELATIONS(new OSM_File_Properties< Uint31_Index >("relations_attic", 1024*1024, 64*1024)),
-  RELATIONS_UNDELETED(new OSM_File_Properties< Uint31_Index >("relations_attic_undeleted", 512*1024, 64*1024)),
+  RELATIONS(new OSM_File_Properties< Uint31_Index >("relations_attic", 1024*1024, 64*1024, 16)),
+  RELATIONS_UNDELETED(new OSM_File_Properties< Uint31_Index >("relations_attic_undeleted", 512*1024, 64*1024, 8)),
   RELATION_IDX_LIST(new OSM_File_Properties< Relation::Id_Type >
-      ("relation_attic_indexes", 512*1024, 0)),
+      ("relation_attic_indexes", 512*1024, 0, 8)),
   RELATION_TAGS_LOCAL(new OSM_File_Properties< Tag_Index_Local >
-      ("relation_tags_local_attic", 512*1024, 0)),
+      ("relation_tags_local_attic", 512*1024, 0, 8)),
   RELATION_TAGS_GLOBAL(new OSM_File_Properties< Tag_Index_Global >
-      ("relation_tags_global_attic", 2*1024*1024, 0)),
+      ("relation_tags_global_attic", 2*1024*1024, 0, 32)),
   RELATIONS_META(new OSM_File_Properties< Uint31_Index >
-      ("relations_meta_attic", 512*1024, 0)),
+      ("relations_meta_attic", 512*1024, 0, 8)),
   RELATION_CHANGELOG(new OSM_File_Properties< Timestamp >
-      ("relation_changelog", 512*1024, 0))
+      ("relation_changelog", 512*1024, 0, 8))
 {}
 
 const Attic_Settings& attic_settings()
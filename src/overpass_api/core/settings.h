@@ -36,6 +36,30 @@ struct Basic_Settings
   string logfile_name;
   string shared_name_base;
   
+  // Applies to data files that are created from scratch.
+  uint32 compression_method;
+  
+  // How data files are accessed, one of the Block_Device constants.
+  uint32 io_backend;
+  
+  // Applies to data files that are created from scratch.
+  uint32 checksum_method;
+  
+  // Processes compare the checksum of each block they read from the disk.
+  bool verify_checksums;
+  
+  // Query processes map uncompressed data files into memory instead of reading them.
+  bool use_mmap;
+  
+  // Number of blocks query processes announce to the kernel ahead of reading them.
+  uint32 prefetch_depth;
+  
+  // Number of threads the updater uses to merge the partial files of a large update.
+  uint32 num_threads;
+  
+  // Number of threads a query may use to evaluate independent statements in parallel.
+  uint32 query_threads;
+  
   Basic_Settings();
 };
 
@@ -87,6 +111,7 @@ struct Meta_Settings
 {
   File_Properties* USER_DATA;
   File_Properties* USER_INDICES;
+  File_Properties* USER_NAMES;
   File_Properties* NODES_META;
   File_Properties* WAYS_META;
   File_Properties* RELATIONS_META;
@@ -0,0 +1,214 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___OVERPASS_API__CORE__TAG_DICTIONARY_H
+#define DE__OSM3S___OVERPASS_API__CORE__TAG_DICTIONARY_H
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include <pthread.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "../../template_db/types.h"
+
+
+/** The key dictionary of a database. The file is a sequence of entries
+    [length:2][key], and the code of a key is the position of its entry.
+    Entries are only ever appended, such that a code once written stays valid
+    for all readers. Writers append new keys under an exclusive file lock
+    before any data referring to them is written. */
+
+class Tag_Key_Dictionary
+{
+public:
+  static const uint32 NO_CODE = 0xffffffff;
+
+  Tag_Key_Dictionary() : loaded_size(0) { pthread_mutex_init(&mutex, 0); }
+  ~Tag_Key_Dictionary() { pthread_mutex_destroy(&mutex); }
+
+  // Binds the dictionary to the database in db_dir and loads the existing entries.
+  void attach(const std::string& db_dir);
+  bool is_attached() const { return !file_name.empty(); }
+
+  // Returns the key with the given code. Codes added by other processes are found
+  // by rereading the tail of the file.
+  std::string key(uint32 code);
+
+  // Returns the code of key or NO_CODE if the key is not yet in the dictionary.
+  uint32 find(const std::string& key);
+
+  // Returns the code of key, appending it to the dictionary if necessary.
+  uint32 code(const std::string& key);
+
+private:
+  std::string file_name;
+  std::deque< std::string > keys;
+  std::map< std::string, uint32 > codes;
+  uint64 loaded_size;
+  pthread_mutex_t mutex;
+
+  void load_tail(const Raw_File& file);
+};
+
+
+inline Tag_Key_Dictionary& tag_key_dictionary()
+{
+  static Tag_Key_Dictionary dictionary;
+  return dictionary;
+}
+
+
+/** Whether tag keys are written as dictionary codes. Reading always understands both forms. */
+inline bool& dictionary_tag_encoding()
+{
+  static bool value = false;
+  return value;
+}
+
+
+inline void Tag_Key_Dictionary::load_tail(const Raw_File& file)
+{
+  uint64 size = file.size("Tag_Key_Dictionary::load_tail::1");
+  if (size <= loaded_size)
+    return;
+
+  std::string buf(size - loaded_size, 0);
+  file.seek(loaded_size, "Tag_Key_Dictionary::load_tail::2");
+  file.read((uint8*)&buf[0], buf.size(), "Tag_Key_Dictionary::load_tail::3");
+
+  // An entry still being written by another process is left for the next call.
+  std::string::size_type pos = 0;
+  while (pos + 2 <= buf.size() && pos + 2 + *(uint16*)&buf[pos] <= buf.size())
+  {
+    uint16 length = *(uint16*)&buf[pos];
+    codes[buf.substr(pos + 2, length)] = keys.size();
+    keys.push_back(buf.substr(pos + 2, length));
+    pos += 2 + length;
+  }
+  loaded_size += pos;
+}
+
+
+inline void Tag_Key_Dictionary::attach(const std::string& db_dir)
+{
+  pthread_mutex_lock(&mutex);
+  if (file_name != db_dir + "tag_key_dictionary")
+  {
+    file_name = db_dir + "tag_key_dictionary";
+    keys.clear();
+    codes.clear();
+    loaded_size = 0;
+  }
+  try
+  {
+    if (file_exists(file_name))
+      load_tail(Raw_File(file_name, O_RDONLY, S_666, "Tag_Key_Dictionary::attach::1"));
+  }
+  catch (File_Error e)
+  {
+    pthread_mutex_unlock(&mutex);
+    throw e;
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+inline std::string Tag_Key_Dictionary::key(uint32 code)
+{
+  pthread_mutex_lock(&mutex);
+  try
+  {
+    if (code >= keys.size() && is_attached())
+      load_tail(Raw_File(file_name, O_RDONLY, S_666, "Tag_Key_Dictionary::key::1"));
+    if (code >= keys.size())
+      throw File_Error(0, is_attached() ? file_name : "tag_key_dictionary", "Tag_Key_Dictionary::key::2");
+  }
+  catch (File_Error e)
+  {
+    pthread_mutex_unlock(&mutex);
+    throw e;
+  }
+  std::string result = keys[code];
+  pthread_mutex_unlock(&mutex);
+  return result;
+}
+
+
+inline uint32 Tag_Key_Dictionary::find(const std::string& key)
+{
+  pthread_mutex_lock(&mutex);
+  std::map< std::string, uint32 >::const_iterator it = codes.find(key);
+  uint32 result = (it == codes.end() ? NO_CODE : it->second);
+  pthread_mutex_unlock(&mutex);
+  return result;
+}
+
+
+inline uint32 Tag_Key_Dictionary::code(const std::string& key)
+{
+  pthread_mutex_lock(&mutex);
+  std::map< std::string, uint32 >::const_iterator it = codes.find(key);
+  if (it != codes.end())
+  {
+    uint32 result = it->second;
+    pthread_mutex_unlock(&mutex);
+    return result;
+  }
+  if (!is_attached() || key.size() >= 0xffff)
+  {
+    pthread_mutex_unlock(&mutex);
+    return NO_CODE;
+  }
+
+  try
+  {
+    Raw_File file(file_name, O_RDWR|O_CREAT|O_APPEND, S_666, "Tag_Key_Dictionary::code::1");
+    if (flock(file.fd(), LOCK_EX) != 0)
+      throw File_Error(errno, file_name, "Tag_Key_Dictionary::code::2");
+
+    // Another process may have added the key in the meantime.
+    load_tail(file);
+    it = codes.find(key);
+    if (it == codes.end())
+    {
+      std::string entry(2, 0);
+      *(uint16*)&entry[0] = key.size();
+      entry += key;
+      file.write((uint8*)&entry[0], entry.size(), "Tag_Key_Dictionary::code::3");
+      loaded_size += entry.size();
+      it = codes.insert(std::make_pair(key, (uint32)keys.size())).first;
+      keys.push_back(key);
+    }
+    flock(file.fd(), LOCK_UN);
+  }
+  catch (File_Error e)
+  {
+    pthread_mutex_unlock(&mutex);
+    throw e;
+  }
+
+  uint32 result = it->second;
+  pthread_mutex_unlock(&mutex);
+  return result;
+}
+
+
+#endif
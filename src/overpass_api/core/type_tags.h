@@ -25,6 +25,8 @@
 #include <vector>
 
 #include "basic_types.h"
+#include "compact_coding.h"
+#include "tag_dictionary.h"
 
 
 struct Unsupported_Error
@@ -44,24 +46,40 @@ struct Tag_Entry
 };
 
 
+/** The key is either stored as string, or, flagged by KEY_CODED in the key length,
+    as a varint code from the Tag_Key_Dictionary. Both forms can appear in the same file. */
+const uint16 KEY_CODED = 0xffff;
+
+
 struct Tag_Index_Local
 {
   uint32 index;
   std::string key;
   std::string value;
+  // The dictionary code of key if it has been read in coded form, otherwise NO_CODE.
+  uint32 key_code;
   
-  Tag_Index_Local() {}
+  Tag_Index_Local() : key_code(Tag_Key_Dictionary::NO_CODE) {}
   
   template< typename Id_Type >
   Tag_Index_Local(const Tag_Entry< Id_Type >& entry)
-      : index(entry.index), key(entry.key), value(entry.value) {}
+      : index(entry.index), key(entry.key), value(entry.value), key_code(Tag_Key_Dictionary::NO_CODE) {}
   
   Tag_Index_Local(Uint31_Index index_, std::string key_, std::string value_)
-      : index(index_.val() & 0x7fffff00), key(key_), value(value_) {}
+      : index(index_.val() & 0x7fffff00), key(key_), value(value_), key_code(Tag_Key_Dictionary::NO_CODE) {}
   
-  Tag_Index_Local(void* data)
+  Tag_Index_Local(void* data) : key_code(Tag_Key_Dictionary::NO_CODE)
   {
     index = (*((uint32*)data + 1))<<8;
+    if (*(uint16*)data == KEY_CODED)
+    {
+      uint64 code;
+      const uint8* value_ptr = read_varint((uint8*)data + 7, code);
+      key_code = code;
+      key = tag_key_dictionary().key(key_code);
+      value = std::string((const char*)value_ptr, *((uint16*)data + 1));
+      return;
+    }
     key = std::string(((int8*)data + 7), *(uint16*)data);
     value = std::string(((int8*)data + 7 + key.length()),
 		   *((uint16*)data + 1));
@@ -69,19 +87,35 @@ struct Tag_Index_Local
   
   uint32 size_of() const
   {
+    uint32 code = encoding_code();
+    if (code != Tag_Key_Dictionary::NO_CODE)
+      return 7 + varint_size(code) + value.length();
     return 7 + key.length() + value.length();
   }
   
   static uint32 size_of(void* data)
   {
+    if (*(uint16*)data == KEY_CODED)
+    {
+      uint64 code;
+      return (read_varint((uint8*)data + 7, code) - (uint8*)data) + *((uint16*)data + 1);
+    }
     return (*((uint16*)data) + *((uint16*)data + 1) + 7);
   }
   
   void to_data(void* data) const
   {
-    *(uint16*)data = key.length();
     *((uint16*)data + 1) = value.length();
     *((uint32*)data + 1) = index>>8;
+    uint32 code = encoding_code();
+    if (code != Tag_Key_Dictionary::NO_CODE)
+    {
+      *(uint16*)data = KEY_CODED;
+      uint8* value_ptr = write_varint((uint8*)data + 7, code);
+      memcpy(value_ptr, value.data(), value.length());
+      return;
+    }
+    *(uint16*)data = key.length();
     memcpy(((uint8*)data + 7), key.data(), key.length());
     memcpy(((uint8*)data + 7 + key.length()), value.data(),
 	   value.length());
@@ -93,7 +127,7 @@ struct Tag_Index_Local
       return ((index & 0x7fffffff) < (a.index & 0x7fffffff));
     if (index != a.index)
       return (index < a.index);
-    if (key != a.key)
+    if (!same_code(key_code, a.key_code) && key != a.key)
       return (key < a.key);
     return (value < a.value);
   }
@@ -102,7 +136,7 @@ struct Tag_Index_Local
   {
     if (index != a.index)
       return false;
-    if (key != a.key)
+    if (!same_code(key_code, a.key_code) && key != a.key)
       return false;
     return (value == a.value);
   }
@@ -112,6 +146,17 @@ struct Tag_Index_Local
     throw Unsupported_Error("static uint32 Tag_Index_Local::max_size_of()");
     return 0;
   }
+  
+private:
+  static bool same_code(uint32 lhs, uint32 rhs)
+  {
+    return lhs == rhs && lhs != Tag_Key_Dictionary::NO_CODE;
+  }
+  
+  uint32 encoding_code() const
+  {
+    return dictionary_tag_encoding() ? tag_key_dictionary().code(key) : Tag_Key_Dictionary::NO_CODE;
+  }
 };
 
 
@@ -183,34 +228,63 @@ struct Tag_Index_Global
 {
   std::string key;
   std::string value;
+  // The dictionary code of key if it has been read in coded form, otherwise NO_CODE.
+  uint32 key_code;
   
-  Tag_Index_Global() {}
+  Tag_Index_Global() : key_code(Tag_Key_Dictionary::NO_CODE) {}
   
-  Tag_Index_Global(void* data)
+  Tag_Index_Global(void* data) : key_code(Tag_Key_Dictionary::NO_CODE)
   {
+    if (*(uint16*)data == KEY_CODED)
+    {
+      uint64 code;
+      const uint8* value_ptr = read_varint((uint8*)data + 4, code);
+      key_code = code;
+      key = tag_key_dictionary().key(key_code);
+      value = std::string((const char*)value_ptr, *((uint16*)data + 1));
+      return;
+    }
     key = std::string(((int8*)data + 4), *(uint16*)data);
     value = std::string(((int8*)data + 4 + key.length()),
 		   *((uint16*)data + 1));
   }
   
-  Tag_Index_Global(const Tag_Index_Local& tag_idx) : key(tag_idx.key), value(tag_idx.value) {}
+  Tag_Index_Global(const Tag_Index_Local& tag_idx)
+      : key(tag_idx.key), value(tag_idx.value), key_code(tag_idx.key_code) {}
   
-  Tag_Index_Global(const std::string& key_, const std::string& value_) : key(key_), value(value_) {}
+  Tag_Index_Global(const std::string& key_, const std::string& value_)
+      : key(key_), value(value_), key_code(Tag_Key_Dictionary::NO_CODE) {}
   
   uint32 size_of() const
   {
+    uint32 code = encoding_code();
+    if (code != Tag_Key_Dictionary::NO_CODE)
+      return 4 + varint_size(code) + value.length();
     return 4 + key.length() + value.length();
   }
   
   static uint32 size_of(void* data)
   {
+    if (*(uint16*)data == KEY_CODED)
+    {
+      uint64 code;
+      return (read_varint((uint8*)data + 4, code) - (uint8*)data) + *((uint16*)data + 1);
+    }
     return (*((uint16*)data) + *((uint16*)data + 1) + 4);
   }
   
   void to_data(void* data) const
   {
-    *(uint16*)data = key.length();
     *((uint16*)data + 1) = value.length();
+    uint32 code = encoding_code();
+    if (code != Tag_Key_Dictionary::NO_CODE)
+    {
+      *(uint16*)data = KEY_CODED;
+      uint8* value_ptr = write_varint((uint8*)data + 4, code);
+      memcpy(value_ptr, value.data(), value.length());
+      return;
+    }
+    *(uint16*)data = key.length();
     memcpy(((uint8*)data + 4), key.data(), key.length());
     memcpy(((uint8*)data + 4 + key.length()), value.data(),
 	   value.length());
@@ -218,14 +292,14 @@ struct Tag_Index_Global
   
   bool operator<(const Tag_Index_Global& a) const
   {
-    if (key != a.key)
+    if (!same_code(key_code, a.key_code) && key != a.key)
       return (key < a.key);
     return (value < a.value);
   }
   
   bool operator==(const Tag_Index_Global& a) const
   {
-    if (key != a.key)
+    if (!same_code(key_code, a.key_code) && key != a.key)
       return false;
     return (value == a.value);
   }
@@ -235,9 +309,31 @@ struct Tag_Index_Global
     throw Unsupported_Error("static uint32 Tag_Index_Global::max_size_of()");
     return 0;
   }
+  
+private:
+  static bool same_code(uint32 lhs, uint32 rhs)
+  {
+    return lhs == rhs && lhs != Tag_Key_Dictionary::NO_CODE;
+  }
+  
+  uint32 encoding_code() const
+  {
+    return dictionary_tag_encoding() ? tag_key_dictionary().code(key) : Tag_Key_Dictionary::NO_CODE;
+  }
 };
 
 
+/** Whether idx has the given key. Keys that both have been read in coded form
+    are compared by their codes only. */
+template< typename Tag_Index >
+inline bool has_key(const Tag_Index& idx, const std::string& key, uint32 key_code)
+{
+  if (idx.key_code != Tag_Key_Dictionary::NO_CODE && key_code != Tag_Key_Dictionary::NO_CODE)
+    return idx.key_code == key_code;
+  return idx.key == key;
+}
+
+
 template< typename Id_Type >
 struct Tag_Object_Global
 {
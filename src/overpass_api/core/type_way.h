@@ -20,6 +20,7 @@
 #define DE__OSM3S___OVERPASS_API__CORE__TYPE_WAY_H
 
 #include "basic_types.h"
+#include "compact_coding.h"
 #include "index_computations.h"
 #include "type_node.h"
 
@@ -83,6 +84,42 @@ struct Way_Equal_Id {
 struct Way_Delta;
 
 
+/** If true, Way_Skeleton and Way_Delta write the compact encoding: node ids and
+    coordinates as zig-zag coded differences to their predecessor in varints.
+    Both encodings are always readable, hence a file may contain a mix of both. */
+inline bool& compact_way_encoding()
+{
+  static bool compact = false;
+  return compact;
+}
+
+
+inline uint32 compact_nds_size(const std::vector< Node::Id_Type >& nds)
+{
+  uint32 size = 0;
+  uint64 previous = 0;
+  for (std::vector< Node::Id_Type >::const_iterator it = nds.begin(); it != nds.end(); ++it)
+  {
+    size += delta_size(previous, it->val());
+    previous = it->val();
+  }
+  return size;
+}
+
+
+inline uint32 compact_geometry_size(const std::vector< Quad_Coord >& geometry)
+{
+  uint32 size = 0;
+  Quad_Coord previous;
+  for (std::vector< Quad_Coord >::const_iterator it = geometry.begin(); it != geometry.end(); ++it)
+  {
+    size += delta_size(previous.ll_upper, it->ll_upper) + delta_size(previous.ll_lower, it->ll_lower);
+    previous = *it;
+  }
+  return size;
+}
+
+
 struct Way_Skeleton
 {
   typedef Way::Id_Type Id_Type;
@@ -92,12 +129,38 @@ struct Way_Skeleton
   std::vector< Node::Id_Type > nds;
   std::vector< Quad_Coord > geometry;
   
+  // Set in the node count of the compact encoding. The compact encoding has
+  // after the two counts a uint32 with the size of the coded data.
+  static const uint16 COMPACT_FLAG = 0x8000;
+  
   Way_Skeleton() : id(0u) {}
   
   Way_Skeleton(Way::Id_Type id_) : id(id_) {}
   
   Way_Skeleton(void* data) : id(*(uint32*)data)
   {
+    if (*((uint16*)data + 2) & COMPACT_FLAG)
+    {
+      nds.resize(*((uint16*)data + 2) & ~COMPACT_FLAG);
+      geometry.resize(*((uint16*)data + 3));
+      const uint8* ptr = ((const uint8*)data) + 12;
+      uint64 value = 0;
+      for (std::vector< Node::Id_Type >::iterator it = nds.begin(); it != nds.end(); ++it)
+      {
+        ptr = read_delta(ptr, value, value);
+        *it = value;
+      }
+      uint64 upper = 0;
+      uint64 lower = 0;
+      for (std::vector< Quad_Coord >::iterator it = geometry.begin(); it != geometry.end(); ++it)
+      {
+        ptr = read_delta(ptr, upper, upper);
+        ptr = read_delta(ptr, lower, lower);
+        *it = Quad_Coord(upper, lower);
+      }
+      return;
+    }
+    
     nds.reserve(*((uint16*)data + 2));
     for (int i(0); i < *((uint16*)data + 2); ++i)
       nds.push_back(*(uint64*)((uint16*)data + 4 + 4*i));
@@ -113,19 +176,50 @@ struct Way_Skeleton
   Way_Skeleton(uint32 id_, const std::vector< Node::Id_Type >& nds_, const std::vector< Quad_Coord >& geometry_)
       : id(id_), nds(nds_), geometry(geometry_) {}
   
+  bool is_compact() const
+  {
+    return compact_way_encoding() && nds.size() < COMPACT_FLAG && geometry.size() < COMPACT_FLAG;
+  }
+  
   uint32 size_of() const
   {
+    if (is_compact())
+      return 12 + compact_nds_size(nds) + compact_geometry_size(geometry);
     return 8 + 8*nds.size() + 8*geometry.size();
   }
   
   static uint32 size_of(void* data)
   {
+    if (*((uint16*)data + 2) & COMPACT_FLAG)
+      return 12 + *((uint32*)data + 2);
     return (8 + 8 * *((uint16*)data + 2) + 8 * *((uint16*)data + 3));
   }
   
   void to_data(void* data) const
   {
     *(uint32*)data = id.val();
+    if (is_compact())
+    {
+      *((uint16*)data + 2) = nds.size() | COMPACT_FLAG;
+      *((uint16*)data + 3) = geometry.size();
+      uint8* ptr = ((uint8*)data) + 12;
+      uint64 previous = 0;
+      for (std::vector< Node::Id_Type >::const_iterator it = nds.begin(); it != nds.end(); ++it)
+      {
+        ptr = write_delta(ptr, previous, it->val());
+        previous = it->val();
+      }
+      Quad_Coord previous_coord;
+      for (std::vector< Quad_Coord >::const_iterator it = geometry.begin(); it != geometry.end(); ++it)
+      {
+        ptr = write_delta(ptr, previous_coord.ll_upper, it->ll_upper);
+        ptr = write_delta(ptr, previous_coord.ll_lower, it->ll_lower);
+        previous_coord = *it;
+      }
+      *((uint32*)data + 2) = ptr - (((uint8*)data) + 12);
+      return;
+    }
+    
     *((uint16*)data + 2) = nds.size();
     *((uint16*)data + 3) = geometry.size();
     for (uint i(0); i < nds.size(); ++i)
@@ -163,9 +257,76 @@ struct Way_Delta
   
   Way_Delta() : id(0u), full(false) {}
   
+  // Values of the second uint32 of the encodings. In the compact encoding
+  // follows after the counts a uint32 with the size of the coded data.
+  static const uint32 FULL = 0xffffffff;
+  static const uint32 COMPACT_FULL = 0xfffffffe;
+  static const uint32 COMPACT_FLAG = 0x80000000;
+  
   Way_Delta(void* data) : id(*(uint32*)data), full(false)
   {
-    if (*((uint32*)data + 1) == 0xffffffff)
+    if (*((uint32*)data + 1) == COMPACT_FULL)
+    {
+      full = true;
+      nds_added.resize(*((uint32*)data + 2));
+      geometry_added.resize(*((uint32*)data + 3), std::make_pair(0, Quad_Coord()));
+      
+      const uint8* ptr = ((const uint8*)data) + 20;
+      uint64 value = 0;
+      for (uint i = 0; i < nds_added.size(); ++i)
+      {
+        ptr = read_delta(ptr, value, value);
+        nds_added[i] = std::make_pair(i, Node::Id_Type(value));
+      }
+      uint64 upper = 0;
+      uint64 lower = 0;
+      for (uint i = 0; i < geometry_added.size(); ++i)
+      {
+        ptr = read_delta(ptr, upper, upper);
+        ptr = read_delta(ptr, lower, lower);
+        geometry_added[i] = std::make_pair(i, Quad_Coord(upper, lower));
+      }
+    }
+    else if (*((uint32*)data + 1) != FULL && (*((uint32*)data + 1) & COMPACT_FLAG))
+    {
+      nds_removed.resize(*((uint32*)data + 1) & ~COMPACT_FLAG);
+      nds_added.resize(*((uint32*)data + 2));
+      geometry_removed.resize(*((uint32*)data + 3));
+      geometry_added.resize(*((uint32*)data + 4), std::make_pair(0, Quad_Coord()));
+      
+      const uint8* ptr = ((const uint8*)data) + 24;
+      uint64 pos = 0;
+      for (uint i = 0; i < nds_removed.size(); ++i)
+      {
+        ptr = read_delta(ptr, pos, pos);
+        nds_removed[i] = pos;
+      }
+      pos = 0;
+      uint64 value = 0;
+      for (uint i = 0; i < nds_added.size(); ++i)
+      {
+        ptr = read_delta(ptr, pos, pos);
+        ptr = read_delta(ptr, value, value);
+        nds_added[i] = std::make_pair(pos, Node::Id_Type(value));
+      }
+      pos = 0;
+      for (uint i = 0; i < geometry_removed.size(); ++i)
+      {
+        ptr = read_delta(ptr, pos, pos);
+        geometry_removed[i] = pos;
+      }
+      pos = 0;
+      uint64 upper = 0;
+      uint64 lower = 0;
+      for (uint i = 0; i < geometry_added.size(); ++i)
+      {
+        ptr = read_delta(ptr, pos, pos);
+        ptr = read_delta(ptr, upper, upper);
+        ptr = read_delta(ptr, lower, lower);
+        geometry_added[i] = std::make_pair(pos, Quad_Coord(upper, lower));
+      }
+    }
+    else if (*((uint32*)data + 1) == FULL)
     {
       full = true;
       nds_removed.clear();
@@ -286,6 +447,8 @@ struct Way_Delta
   
   uint32 size_of() const
   {
+    if (compact_way_encoding())
+      return (full ? 20 : 24) + compact_size();
     if (full)
       return 16 + 8*nds_added.size() + 8*geometry_added.size();
     else
@@ -295,8 +458,12 @@ struct Way_Delta
   
   static uint32 size_of(void* data)
   {
-    if (*((uint32*)data + 1) == 0xffffffff)
+    if (*((uint32*)data + 1) == COMPACT_FULL)
+      return 20 + *((uint32*)data + 4);
+    else if (*((uint32*)data + 1) == FULL)
       return 16 + 8 * *((uint32*)data + 2) + 8 * *((uint32*)data + 3);
+    else if (*((uint32*)data + 1) & COMPACT_FLAG)
+      return 24 + *((uint32*)data + 5);
     else
       return 20 + 4 * *((uint32*)data + 1) + 12 * *((uint32*)data + 2)
           + 4 * *((uint32*)data + 3) + 12 * *((uint32*)data + 4);
@@ -305,9 +472,27 @@ struct Way_Delta
   void to_data(void* data) const
   {
     *(uint32*)data = id.val();
-    if (full)
+    if (compact_way_encoding())
     {
-      *((uint32*)data + 1) = 0xffffffff;
+      if (full)
+      {
+        *((uint32*)data + 1) = COMPACT_FULL;
+        *((uint32*)data + 2) = nds_added.size();
+        *((uint32*)data + 3) = geometry_added.size();
+        *((uint32*)data + 4) = write_compact(((uint8*)data) + 20) - (((uint8*)data) + 20);
+      }
+      else
+      {
+        *((uint32*)data + 1) = nds_removed.size() | COMPACT_FLAG;
+        *((uint32*)data + 2) = nds_added.size();
+        *((uint32*)data + 3) = geometry_removed.size();
+        *((uint32*)data + 4) = geometry_added.size();
+        *((uint32*)data + 5) = write_compact(((uint8*)data) + 24) - (((uint8*)data) + 24);
+      }
+    }
+    else if (full)
+    {
+      *((uint32*)data + 1) = FULL;
       *((uint32*)data + 2) = nds_added.size();
       *((uint32*)data + 3) = geometry_added.size();
       
@@ -371,6 +556,85 @@ struct Way_Delta
   {
     return this->id == a.id;
   }
+  
+private:
+  // A full delta codes only the values, because the positions are consecutive.
+  uint32 compact_size() const
+  {
+    uint32 size = 0;
+    uint64 pos = 0;
+    for (uint i = 0; i < nds_removed.size(); ++i)
+    {
+      size += delta_size(pos, nds_removed[i]);
+      pos = nds_removed[i];
+    }
+    pos = 0;
+    uint64 value = 0;
+    for (uint i = 0; i < nds_added.size(); ++i)
+    {
+      if (!full)
+        size += delta_size(pos, nds_added[i].first);
+      size += delta_size(value, nds_added[i].second.val());
+      pos = nds_added[i].first;
+      value = nds_added[i].second.val();
+    }
+    pos = 0;
+    for (uint i = 0; i < geometry_removed.size(); ++i)
+    {
+      size += delta_size(pos, geometry_removed[i]);
+      pos = geometry_removed[i];
+    }
+    pos = 0;
+    Quad_Coord coord;
+    for (uint i = 0; i < geometry_added.size(); ++i)
+    {
+      if (!full)
+        size += delta_size(pos, geometry_added[i].first);
+      size += delta_size(coord.ll_upper, geometry_added[i].second.ll_upper)
+          + delta_size(coord.ll_lower, geometry_added[i].second.ll_lower);
+      pos = geometry_added[i].first;
+      coord = geometry_added[i].second;
+    }
+    return size;
+  }
+  
+  uint8* write_compact(uint8* ptr) const
+  {
+    uint64 pos = 0;
+    for (uint i = 0; i < nds_removed.size(); ++i)
+    {
+      ptr = write_delta(ptr, pos, nds_removed[i]);
+      pos = nds_removed[i];
+    }
+    pos = 0;
+    uint64 value = 0;
+    for (uint i = 0; i < nds_added.size(); ++i)
+    {
+      if (!full)
+        ptr = write_delta(ptr, pos, nds_added[i].first);
+      ptr = write_delta(ptr, value, nds_added[i].second.val());
+      pos = nds_added[i].first;
+      value = nds_added[i].second.val();
+    }
+    pos = 0;
+    for (uint i = 0; i < geometry_removed.size(); ++i)
+    {
+      ptr = write_delta(ptr, pos, geometry_removed[i]);
+      pos = geometry_removed[i];
+    }
+    pos = 0;
+    Quad_Coord coord;
+    for (uint i = 0; i < geometry_added.size(); ++i)
+    {
+      if (!full)
+        ptr = write_delta(ptr, pos, geometry_added[i].first);
+      ptr = write_delta(ptr, coord.ll_upper, geometry_added[i].second.ll_upper);
+      ptr = write_delta(ptr, coord.ll_lower, geometry_added[i].second.ll_lower);
+      pos = geometry_added[i].first;
+      coord = geometry_added[i].second;
+    }
+    return ptr;
+  }
 };
 
 
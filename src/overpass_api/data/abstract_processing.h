@@ -363,9 +363,12 @@ std::pair< std::vector< Index >, std::vector< Index > > get_indexes
   
   Random_File< Index > current(rman.get_transaction()->random_index
       (current_skeleton_file_properties< Skeleton >()));
+  std::vector< typename Random_File< Index >::size_t > pos;
+  pos.reserve(ids.size());
   for (typename std::vector< std::pair< typename Skeleton::Id_Type, uint64 > >::const_iterator
       it = ids.begin(); it != ids.end(); ++it)
-    result.first.push_back(current.get(it->first.val()));
+    pos.push_back(it->first.val());
+  current.get(pos, result.first);
   
   std::sort(result.first.begin(), result.first.end());
   result.first.erase(std::unique(result.first.begin(), result.first.end()), result.first.end());
@@ -49,7 +49,7 @@ void reconstruct_items(const Statement* stmt, Resource_Manager& rman,
     {
       count = 0;
       if (stmt)
-        rman.health_check(*stmt, 0, eval_map(result));
+        rman.health_check(*stmt);
     }
     if (timestamp < timestamp_of(it.object()))
     {
@@ -269,7 +269,7 @@ void collect_items_discrete(const Statement* stmt, Resource_Manager& rman,
     {
       count = 0;
       if (stmt)
-        rman.health_check(*stmt, 0, eval_map(result));
+        rman.health_check(*stmt);
     }
     if (predicate.match(it.object()))
       result[it.index()].push_back(it.object());
@@ -329,7 +329,7 @@ void collect_items_range(const Statement* stmt, Resource_Manager& rman,
     if (++count >= 256*1024 && stmt)
     {
       count = 0;
-      rman.health_check(*stmt, 0, eval_map(result));
+      rman.health_check(*stmt);
     }
     if (predicate.match(it.object()))
       result[it.index()].push_back(it.object());
@@ -368,7 +368,7 @@ void collect_items_flat(const Statement& stmt, Resource_Manager& rman,
     if (++count >= 256*1024)
     {
       count = 0;
-      rman.health_check(stmt, 0, eval_map(result));
+      rman.health_check(stmt);
     }
     if (predicate.match(it.object()))
       result[it.index()].push_back(it.object());
@@ -404,9 +404,12 @@ std::vector< Index > get_indexes_
   
   Random_File< Index > current(rman.get_transaction()->random_index
       (current_skeleton_file_properties< Skeleton >()));
+  std::vector< typename Random_File< Index >::size_t > pos;
+  pos.reserve(ids.size());
   for (typename std::vector< typename Skeleton::Id_Type >::const_iterator
       it = ids.begin(); it != ids.end(); ++it)
-    result.push_back(current.get(it->val()));
+    pos.push_back(it->val());
+  current.get(pos, result);
   
   std::sort(result.begin(), result.end());
   result.erase(std::unique(result.begin(), result.end()), result.end());
@@ -175,9 +175,12 @@ std::vector< Uint31_Index > collect_relation_req
   
   Random_File< Uint31_Index > random
       (rman.get_transaction()->random_index(osm_base_settings().RELATIONS));
+  std::vector< Random_File< Uint31_Index >::size_t > pos;
+  pos.reserve(map_ids.size());
   for (std::vector< Relation::Id_Type >::const_iterator
       it(map_ids.begin()); it != map_ids.end(); ++it)
-    req.push_back(random.get(it->val()));
+    pos.push_back(it->val());
+  random.get(pos, req);
   
   rman.health_check(stmt);
   sort(req.begin(), req.end());
@@ -218,9 +221,7 @@ std::vector< Uint31_Index > collect_way_req
   
   Random_File< Uint31_Index > random
       (rman.get_transaction()->random_index(osm_base_settings().WAYS));
-  for (std::vector< uint32 >::const_iterator
-      it(map_ids.begin()); it != map_ids.end(); ++it)
-    req.push_back(random.get(*it));
+  random.get(map_ids, req);
   
   for (std::vector< Uint31_Index >::const_iterator it = children_idxs.begin();
       it != children_idxs.end(); ++it)
@@ -245,12 +246,15 @@ std::set< std::pair< Uint32_Index, Uint32_Index > > collect_node_req
   
   Random_File< Uint32_Index > random
       (rman.get_transaction()->random_index(osm_base_settings().NODES));
+  std::vector< Random_File< Uint32_Index >::size_t > pos;
+  pos.reserve(map_ids.size());
   for (std::vector< Node::Id_Type >::const_iterator
       it(map_ids.begin()); it != map_ids.end(); ++it)
-  {
-    Uint32_Index idx = random.get(it->val());
-    req.insert(make_pair(idx, idx.val() + 1));
-  }
+    pos.push_back(it->val());
+  std::vector< Uint32_Index > idxs;
+  random.get(pos, idxs);
+  for (std::vector< Uint32_Index >::const_iterator it = idxs.begin(); it != idxs.end(); ++it)
+    req.insert(make_pair(*it, it->val() + 1));
   
   if (stmt)
     rman.health_check(*stmt);
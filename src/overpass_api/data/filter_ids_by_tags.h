@@ -31,6 +31,7 @@ void filter_ids_by_tags
    int bitmask = 0x7fffff00)
 {
   string last_key, last_value;  
+  uint32 last_key_code = Tag_Key_Dictionary::NO_CODE;
   bool key_relevant = false;
   bool valid = false;
   map< string, vector< Regular_Expression* > >::const_iterator key_it = keys.begin();
@@ -43,7 +44,7 @@ void filter_ids_by_tags
   while ((!(tag_it == items_db.range_end())) &&
       (((tag_it.index().index) & bitmask) == coarse_index))
   {
-    if (tag_it.index().key != last_key)
+    if (!has_key(tag_it.index(), last_key, last_key_code))
     {
       last_value = void_tag_value() + " ";
       
@@ -55,6 +56,7 @@ void filter_ids_by_tags
 	break;
       
       last_key = tag_it.index().key;
+      last_key_code = tag_it.index().key_code;
       if (key_it != keys.end() && last_key >= key_it->first)
       {
 	if (last_key > key_it->first)
@@ -351,14 +353,16 @@ void filter_ids_by_tags
     tag_listeners.push_back(&*it);
   
   std::string current_key = void_tag_value();
+  uint32 current_key_code = Tag_Key_Dictionary::NO_CODE;
   std::string current_value;
   std::vector< std::pair< uint64, bool > > relevant_listeners;
   while ((!(tag_it == items_db.range_end())) &&
       ((tag_it.index().index) & 0x7fffff00) == coarse_index)
   {
-    if (current_key != tag_it.index().key)
+    if (!has_key(tag_it.index(), current_key, current_key_code))
     {
       current_key = tag_it.index().key;
+      current_key_code = tag_it.index().key_code;
       update_listeners_keys(tag_listeners, relevant_listeners, current_key);
       current_value = void_tag_value() + " ";
     }
@@ -380,12 +384,14 @@ void filter_ids_by_tags
   }
 
   current_key = void_tag_value();
+  current_key_code = Tag_Key_Dictionary::NO_CODE;
   while ((!(attic_tag_it == attic_items_db.range_end())) &&
       ((attic_tag_it.index().index) & 0x7fffff00) == coarse_index)
   {
-    if (current_key != attic_tag_it.index().key)
+    if (!has_key(attic_tag_it.index(), current_key, current_key_code))
     {
       current_key = attic_tag_it.index().key;
+      current_key_code = attic_tag_it.index().key_code;
       update_listeners_keys(tag_listeners, relevant_listeners, current_key);
       current_value = void_tag_value() + " ";
     }
@@ -17,6 +17,8 @@
 */
 
 #include "../../expat/expat_justparse_interface.h"
+#include "../../template_db/block_device.h"
+#include "../../template_db/crc32c.h"
 #include "../../template_db/dispatcher.h"
 #include "../frontend/console_output.h"
 #include "../frontend/user_interface.h"
@@ -26,12 +28,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
@@ -151,6 +155,129 @@ const OSM_Element_Metadata_Skeleton< Id_Type >* Flat_Meta_Collector< TIndex, Id_
 
 //-----------------------------------------------------------------------------
 
+/** Verifies the block checksums of one data file. The blocks are sorted by
+    their position and handed out in chunks to the threads, such that each
+    thread reads mostly sequentially through its own file descriptor. */
+struct Checksum_Verifier
+{
+  public:
+    Checksum_Verifier(File_Blocks_Index_Base& index, uint32 num_threads_);
+    
+    // Returns the number of blocks with a wrong checksum.
+    uint32 run();
+    
+  private:
+    static const uint32 CHUNK_SIZE = 256;
+    
+    uint32 io_backend;
+    string file_name;
+    uint64 unit_size;
+    bool compressed;
+    uint32 num_threads;
+    vector< File_Blocks_Index_Base::Block_Location > locations;
+    volatile uint32 next_chunk;
+    volatile uint32 mismatches;
+    pthread_mutex_t output_mutex;
+    
+    static void* work(void* self);
+    void verify_chunks();
+};
+
+bool operator<(const File_Blocks_Index_Base::Block_Location& a,
+	       const File_Blocks_Index_Base::Block_Location& b)
+{
+  return a.pos < b.pos;
+}
+
+Checksum_Verifier::Checksum_Verifier(File_Blocks_Index_Base& index, uint32 num_threads_)
+  : io_backend(index.get_io_backend()), file_name(index.get_data_file_name()),
+    unit_size(index.get_unit_size()),
+    compressed(index.get_compression_method() != File_Blocks_Index_Base::NO_COMPRESSION),
+    num_threads(num_threads_), locations(index.get_block_locations()),
+    next_chunk(0), mismatches(0)
+{
+  sort(locations.begin(), locations.end());
+  pthread_mutex_init(&output_mutex, 0);
+}
+
+uint32 Checksum_Verifier::run()
+{
+  vector< pthread_t > threads;
+  for (uint32 i = 1; i < num_threads; ++i)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, 0, &Checksum_Verifier::work, this) == 0)
+      threads.push_back(thread);
+  }
+  verify_chunks();
+  for (vector< pthread_t >::const_iterator it = threads.begin(); it != threads.end(); ++it)
+    pthread_join(*it, 0);
+  
+  pthread_mutex_destroy(&output_mutex);
+  return mismatches;
+}
+
+void* Checksum_Verifier::work(void* self)
+{
+  ((Checksum_Verifier*)self)->verify_chunks();
+  return 0;
+}
+
+void Checksum_Verifier::verify_chunks()
+{
+  Block_Device* data_file = 0;
+  try
+  {
+    data_file = new_block_device(io_backend, file_name, false, "Checksum_Verifier::1");
+    
+    vector< uint8 > buffer;
+    uint32 chunk = __sync_fetch_and_add(&next_chunk, 1);
+    while ((uint64)chunk*CHUNK_SIZE < locations.size())
+    {
+      uint32 end = min((uint64)(chunk+1)*CHUNK_SIZE, (uint64)locations.size());
+      for (uint32 i = chunk*CHUNK_SIZE; i < end; ++i)
+      {
+	uint64 length = compressed ? locations[i].size*unit_size : unit_size;
+	if (buffer.size() < length)
+	  buffer.resize(length);
+	data_file->read(locations[i].pos*unit_size, &buffer[0], length, "Checksum_Verifier::2");
+	if (crc32c(&buffer[0], length) != locations[i].checksum)
+	{
+	  __sync_fetch_and_add(&mismatches, 1);
+	  pthread_mutex_lock(&output_mutex);
+	  cout<<"Checksum mismatch in "<<file_name<<" at block "<<dec<<locations[i].pos<<'\n';
+	  pthread_mutex_unlock(&output_mutex);
+	}
+      }
+      chunk = __sync_fetch_and_add(&next_chunk, 1);
+    }
+  }
+  catch (File_Error e)
+  {
+    __sync_fetch_and_add(&mismatches, 1);
+    pthread_mutex_lock(&output_mutex);
+    cout<<"Error reading "<<e.filename<<": "<<strerror(e.error_number)<<' '<<e.origin<<'\n';
+    pthread_mutex_unlock(&output_mutex);
+  }
+  delete data_file;
+}
+
+uint32 verify_checksums(Transaction& transaction, File_Properties* file_prop, uint32 num_threads)
+{
+  File_Blocks_Index_Base* index = transaction.data_index(file_prop);
+  if (!index || index->get_checksum_method() == File_Blocks_Index_Base::NO_CHECKSUM)
+  {
+    cout<<"No checksums for "<<file_prop->get_file_name_trunk()<<".\n";
+    return 0;
+  }
+  uint32 mismatches = Checksum_Verifier(*index, num_threads).run();
+  cout<<"Verified "<<index->get_block_locations().size()<<" blocks of "
+      <<file_prop->get_file_name_trunk()<<", "<<mismatches<<" errors.\n";
+  return mismatches;
+}
+
+//-----------------------------------------------------------------------------
+
 int main(int argc, char *argv[])
 { 
   // read command line arguments
@@ -158,7 +285,9 @@ int main(int argc, char *argv[])
   uint log_level = Error_Output::ASSISTING;
 
   const int META = 1;
+  const int CHECKSUMS = 2;
   int mode = META;
+  uint32 num_threads = 1;
   int area_level = 0;
 
   int argpos = 1;
@@ -172,6 +301,14 @@ int main(int argc, char *argv[])
     }
     else if (!(strcmp(argv[argpos], "--meta")))
       mode = META;
+    else if (!(strcmp(argv[argpos], "--checksums")))
+      mode = CHECKSUMS;
+    else if (!(strncmp(argv[argpos], "--threads=", 10)))
+    {
+      num_threads = atoi(((string)argv[argpos]).substr(10).c_str());
+      if (num_threads == 0)
+	num_threads = 1;
+    }
     else if (!(strcmp(argv[argpos], "--quiet")))
       log_level = Error_Output::QUIET;
     else if (!(strcmp(argv[argpos], "--concise")))
@@ -194,6 +331,35 @@ int main(int argc, char *argv[])
 			       24*60*60, 1024*1024*1024);
     Resource_Manager& rman = dispatcher.resource_manager();
     
+    if (mode == CHECKSUMS)
+    {
+      vector< File_Properties* > files;
+      files.push_back(osm_base_settings().NODES);
+      files.push_back(osm_base_settings().NODE_TAGS_LOCAL);
+      files.push_back(osm_base_settings().NODE_TAGS_GLOBAL);
+      files.push_back(osm_base_settings().WAYS);
+      files.push_back(osm_base_settings().WAY_TAGS_LOCAL);
+      files.push_back(osm_base_settings().WAY_TAGS_GLOBAL);
+      files.push_back(osm_base_settings().RELATIONS);
+      files.push_back(osm_base_settings().RELATION_TAGS_LOCAL);
+      files.push_back(osm_base_settings().RELATION_TAGS_GLOBAL);
+      files.push_back(meta_settings().NODES_META);
+      files.push_back(meta_settings().WAYS_META);
+      files.push_back(meta_settings().RELATIONS_META);
+      files.push_back(meta_settings().USER_DATA);
+      files.push_back(meta_settings().USER_INDICES);
+      files.push_back(meta_settings().USER_NAMES);
+      
+      uint32 mismatches = 0;
+      for (vector< File_Properties* >::const_iterator it = files.begin(); it != files.end(); ++it)
+      {
+	mismatches += verify_checksums(*rman.get_transaction(), *it, num_threads);
+	dispatcher.ping();
+      }
+      cout<<"done\n";
+      return (mismatches == 0 ? 0 : 4);
+    }
+    
     // perform check
     {
       uint32 count = 0;
@@ -0,0 +1,65 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resource_manager.h"
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+
+// Replaces the global operator new and delete such that global_heap_bytes() counts the
+// memory actually held. All other forms of operator new and delete of the standard library
+// forward to these two.
+
+namespace
+{
+  inline uint64 allocated_size(void* ptr)
+  {
+#ifdef __APPLE__
+    return malloc_size(ptr);
+#else
+    return malloc_usable_size(ptr);
+#endif
+  }
+}
+
+
+void* operator new(std::size_t size)
+{
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (!ptr)
+    throw std::bad_alloc();
+  __sync_fetch_and_add(&global_heap_bytes(), allocated_size(ptr));
+  return ptr;
+}
+
+
+void operator delete(void* ptr) throw()
+{
+  if (!ptr)
+    return;
+  __sync_fetch_and_sub(&global_heap_bytes(), allocated_size(ptr));
+  free(ptr);
+}
@@ -132,6 +132,8 @@ int main(int argc, char* argv[])
   uint64 max_allowed_space = 0;
   uint64 max_allowed_time_units = 0;
   int rate_limit = -1;
+  uint64 block_cache_size = 0;
+  uint32 queue_timeout = 0;
   
   int argpos(1);
   while (argpos < argc)
@@ -166,6 +168,10 @@ int main(int argc, char* argv[])
       max_allowed_time_units = atoll(((string)argv[argpos]).substr(7).c_str());
     else if (!(strncmp(argv[argpos], "--rate-limit=", 13)))
       rate_limit = atoll(((string)argv[argpos]).substr(13).c_str());
+    else if (!(strncmp(argv[argpos], "--block-cache=", 14)))
+      block_cache_size = atoll(((string)argv[argpos]).substr(14).c_str());
+    else if (!(strncmp(argv[argpos], "--queue-timeout=", 16)))
+      queue_timeout = atoll(((string)argv[argpos]).substr(16).c_str());
     else
     {
       cout<<"Unknown argument: "<<argv[argpos]<<"\n\n"
@@ -183,7 +189,11 @@ int main(int argc, char* argv[])
       "  --query_token: Returns the pid of a running query for the same client IP.\n"
       "  --space=number: Set the memory limit for the total of all running processes to this value in bytes.\n"
       "  --time=number: Set the time unit  limit for the total of all running processes to this value in bytes.\n"
-      "  --rate-limit=number: Set the maximum allowed number of concurrent accesses from a single IP.\n";
+      "  --rate-limit=number: Set the maximum allowed number of concurrent accesses from a single IP.\n"
+      "  --block-cache=number: When starting a dispatcher, share a cache of this size in bytes\n"
+      "        for data blocks between all reading processes.\n"
+      "  --queue-timeout=number: When starting a dispatcher, let a query wait at most this number\n"
+      "        of seconds for free resources. The default is 15 seconds.\n";
       
       return 0;
     }
@@ -317,6 +327,7 @@ int main(int argc, char* argv[])
     files_to_manage.push_back(meta_settings().RELATIONS_META);
     files_to_manage.push_back(meta_settings().USER_DATA);
     files_to_manage.push_back(meta_settings().USER_INDICES);
+    files_to_manage.push_back(meta_settings().USER_NAMES);
   }
   if (attic)
   {
@@ -374,6 +385,10 @@ int main(int argc, char* argv[])
 	 files_to_manage, &disp_logger);
     if (rate_limit > -1)
       dispatcher.set_rate_limit(rate_limit);
+    if (block_cache_size > 0)
+      dispatcher.set_block_cache_size(block_cache_size);
+    if (queue_timeout > 0)
+      dispatcher.set_max_queue_wait(queue_timeout*1000);
     dispatcher.standby_loop(0);
   }
   catch (File_Error e)
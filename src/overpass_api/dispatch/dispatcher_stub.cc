@@ -63,17 +63,41 @@ string de_escape(string input)
 }
 
 
+void Warm_Readers::clear()
+{
+  delete transaction;
+  transaction = 0;
+  delete area_transaction;
+  area_transaction = 0;
+  delete dispatcher_client;
+  dispatcher_client = 0;
+  delete area_dispatcher_client;
+  area_dispatcher_client = 0;
+}
+
+
 Dispatcher_Stub::Dispatcher_Stub
     (string db_dir_, Error_Output* error_output_, string xml_raw, meta_modes meta_, int area_level,
-     uint32 max_allowed_time, uint64 max_allowed_space)
+     uint32 max_allowed_time, uint64 max_allowed_space, Warm_Readers* warm_readers_)
     : db_dir(db_dir_), error_output(error_output_),
       dispatcher_client(0), area_dispatcher_client(0),
-      transaction(0), area_transaction(0), rman(0), meta(meta_)
+      transaction(0), area_transaction(0), rman(0), meta(meta_),
+      warm_readers(db_dir_ == "" ? warm_readers_ : 0), area_is_warm(false)
 {
+  gettimeofday(&start_time, 0);
+  // The counters shall describe this query even if the process runs several.
+  global_read_counter() = 0;
+  global_read_bytes() = 0;
+  
   if (db_dir == "")
   {
     uint32 client_token = probe_client_token();
-    dispatcher_client = new Dispatcher_Client(osm_base_settings().shared_name);
+    if (warm_readers && warm_readers->dispatcher_client)
+      dispatcher_client = warm_readers->dispatcher_client;
+    else
+      dispatcher_client = new Dispatcher_Client(osm_base_settings().shared_name);
+    if (warm_readers)
+      warm_readers->dispatcher_client = dispatcher_client;
     Logger logger(dispatcher_client->get_db_dir());
     try
     {
@@ -91,9 +115,37 @@ Dispatcher_Stub::Dispatcher_Stub
       logger.annotated_log(out.str());
       throw;
     }
-    transaction = new Nonsynced_Transaction
-        (false, false, dispatcher_client->get_db_dir(), "");
+    // Commits are blocked while this process reads the index. Hence the generation
+    // cannot change before read_idx_finished().
+    uint32 generation = dispatcher_client->get_generation();
+    if (warm_readers && warm_readers->transaction && warm_readers->generation == generation)
+    {
+      // The client has attached a new index image for this registration.
+      transaction = warm_readers->transaction;
+      transaction->set_index_image(dispatcher_client->get_index_image());
+    }
+    else
+    {
+      if (warm_readers)
+      {
+        delete warm_readers->transaction;
+        warm_readers->transaction = 0;
+      }
+      transaction = new Nonsynced_Transaction
+          (false, false, dispatcher_client->get_db_dir(), "");
+      transaction->set_block_cache(dispatcher_client->get_block_cache());
+      transaction->set_index_image(dispatcher_client->get_index_image());
+      transaction->set_use_mmap(basic_settings().use_mmap);
+      transaction->set_verify_checksums(basic_settings().verify_checksums);
+      transaction->set_prefetch_depth(basic_settings().prefetch_depth);
+      if (warm_readers)
+      {
+        warm_readers->transaction = transaction;
+        warm_readers->generation = generation;
+      }
+    }
   
+    // Indexes already loaded by an earlier query are not loaded again.
     transaction->data_index(osm_base_settings().NODES);
     transaction->random_index(osm_base_settings().NODES);
     transaction->data_index(osm_base_settings().NODE_TAGS_LOCAL);
@@ -118,6 +170,7 @@ Dispatcher_Stub::Dispatcher_Stub
       transaction->data_index(meta_settings().RELATIONS_META);
       transaction->data_index(meta_settings().USER_DATA);
       transaction->data_index(meta_settings().USER_INDICES);
+      transaction->data_index(meta_settings().USER_NAMES);
     }
     
     if (meta == keep_attic)
@@ -167,7 +220,14 @@ Dispatcher_Stub::Dispatcher_Stub
     
     if (area_level > 0)
     {
-      area_dispatcher_client = new Dispatcher_Client(area_settings().shared_name);
+      // Only reading processes can keep their area connection.
+      area_is_warm = (warm_readers && area_level == 1);
+      if (area_is_warm && warm_readers->area_dispatcher_client)
+        area_dispatcher_client = warm_readers->area_dispatcher_client;
+      else
+        area_dispatcher_client = new Dispatcher_Client(area_settings().shared_name);
+      if (area_is_warm)
+        warm_readers->area_dispatcher_client = area_dispatcher_client;
       Logger logger(area_dispatcher_client->get_db_dir());
       
       if (area_level == 1)
@@ -185,8 +245,33 @@ Dispatcher_Stub::Dispatcher_Stub
 	  logger.annotated_log(out.str());
 	  throw;
 	}
-	area_transaction = new Nonsynced_Transaction
-            (false, false, area_dispatcher_client->get_db_dir(), "");
+	uint32 area_generation = area_dispatcher_client->get_generation();
+	if (area_is_warm && warm_readers->area_transaction
+	    && warm_readers->area_generation == area_generation)
+	{
+	  area_transaction = warm_readers->area_transaction;
+	  area_transaction->set_index_image(area_dispatcher_client->get_index_image());
+	}
+	else
+	{
+	  if (area_is_warm)
+	  {
+	    delete warm_readers->area_transaction;
+	    warm_readers->area_transaction = 0;
+	  }
+	  area_transaction = new Nonsynced_Transaction
+              (false, false, area_dispatcher_client->get_db_dir(), "");
+	  area_transaction->set_block_cache(area_dispatcher_client->get_block_cache());
+	  area_transaction->set_index_image(area_dispatcher_client->get_index_image());
+	  area_transaction->set_use_mmap(basic_settings().use_mmap);
+	  area_transaction->set_verify_checksums(basic_settings().verify_checksums);
+	  area_transaction->set_prefetch_depth(basic_settings().prefetch_depth);
+	  if (area_is_warm)
+	  {
+	    warm_readers->area_transaction = area_transaction;
+	    warm_readers->area_generation = area_generation;
+	  }
+	}
 	{
 	  ifstream version((area_dispatcher_client->get_db_dir() +   
 	      "area_version").c_str());
@@ -250,9 +335,15 @@ Dispatcher_Stub::Dispatcher_Stub
   else
   {
     transaction = new Nonsynced_Transaction(false, false, db_dir, "");
+    transaction->set_use_mmap(basic_settings().use_mmap);
+    transaction->set_verify_checksums(basic_settings().verify_checksums);
+    transaction->set_prefetch_depth(basic_settings().prefetch_depth);
     if (area_level > 0)
     {
       area_transaction = new Nonsynced_Transaction(area_level == 2, false, db_dir, "");
+      area_transaction->set_use_mmap(basic_settings().use_mmap);
+      area_transaction->set_verify_checksums(basic_settings().verify_checksums);
+      area_transaction->set_prefetch_depth(basic_settings().prefetch_depth);
       rman = new Resource_Manager(*transaction, area_level == 2 ? error_output : 0,
 	  *area_transaction, this, area_level == 2 ? new Area_Updater(*area_transaction) : 0);
     }
@@ -277,6 +368,10 @@ Dispatcher_Stub::Dispatcher_Stub
       area_timestamp = de_escape(timestamp);
     }
   }
+  
+  // Rule runs update the areas and hence stay on a single thread.
+  if (area_level != 2)
+    rman->set_max_threads(basic_settings().query_threads);
 }
 
 
@@ -289,13 +384,58 @@ void Dispatcher_Stub::ping() const
 }
 
 
+void Dispatcher_Stub::write_metrics() const
+{
+  Metrics metrics;
+  metrics.declare("overpass_query_total", "counter", "Queries completed.");
+  metrics.add("overpass_query_total", 1);
+  metrics.declare("overpass_query_duration_seconds", "histogram",
+      "Wall time of queries, including the wait for admission.");
+  metrics.observe("overpass_query_duration_seconds", milliseconds_since(start_time)/1000.,
+      Metrics::seconds_buckets());
+  metrics.declare("overpass_query_block_reads_total", "counter",
+      "Blocks read from the data files.");
+  metrics.add("overpass_query_block_reads_total", global_read_counter());
+  metrics.declare("overpass_query_read_bytes_total", "counter",
+      "Bytes read from the data files, before decompression.");
+  metrics.add("overpass_query_read_bytes_total", global_read_bytes());
+  metrics.declare("overpass_query_peak_space_bytes", "histogram",
+      "Largest memory use of a query.");
+  metrics.observe("overpass_query_peak_space_bytes", rman->get_peak_space(),
+      Metrics::bytes_buckets());
+  metrics.declare("overpass_query_statement_seconds_total", "counter",
+      "Wall time spent in statements, without their substatements.");
+  for (map< string, double >::const_iterator it = rman->get_statement_seconds().begin();
+      it != rman->get_statement_seconds().end(); ++it)
+    metrics.add("overpass_query_statement_seconds_total", it->second,
+        "statement=\"" + it->first + "\"");
+  
+  metrics.merge_into(dispatcher_client->get_db_dir() + "osm3s_query.metrics");
+}
+
+
 Dispatcher_Stub::~Dispatcher_Stub()
 {
+  if (dispatcher_client)
+  {
+    try
+    {
+      write_metrics();
+    }
+    catch (const File_Error& e)
+    {
+      Logger logger(dispatcher_client->get_db_dir());
+      ostringstream out;
+      out<<e.origin<<' '<<e.filename<<' '<<e.error_number<<' '<<strerror(e.error_number);
+      logger.annotated_log(out.str());
+    }
+  }
+  
   bool areas_written = (rman->area_updater() != 0);
   delete rman;
-  if (transaction)
+  if (transaction && !warm_readers)
     delete transaction;
-  if (area_transaction)
+  if (area_transaction && !area_is_warm)
     delete area_transaction;
   if (dispatcher_client)
   {
@@ -314,7 +454,8 @@ Dispatcher_Stub::~Dispatcher_Stub()
       out<<e.origin<<' '<<e.filename<<' '<<e.error_number<<' '<<strerror(e.error_number);
       logger.annotated_log(out.str());
     }
-    delete dispatcher_client;
+    if (!warm_readers)
+      delete dispatcher_client;
   }
   if (area_dispatcher_client)
   {
@@ -352,6 +493,7 @@ Dispatcher_Stub::~Dispatcher_Stub()
         logger.annotated_log(out.str());
       }
     }
-    delete area_dispatcher_client;
+    if (!area_is_warm)
+      delete area_dispatcher_client;
   }
 }
@@ -40,15 +40,40 @@
 
 struct Exit_Error {};
 
+
+/** Keeps the connections to the dispatchers and the read transactions of a long-running
+    process from one query to the next. A transaction is reused only while the database
+    has the generation the transaction has been opened for. The process registers with
+    the dispatcher for every query nevertheless. */
+struct Warm_Readers
+{
+  Warm_Readers() : dispatcher_client(0), area_dispatcher_client(0),
+      transaction(0), area_transaction(0), generation(0), area_generation(0) {}
+  ~Warm_Readers() { clear(); }
+  
+  // Closes all connections and transactions. Must be called after a query has failed.
+  void clear();
+  
+  Dispatcher_Client* dispatcher_client;
+  Dispatcher_Client* area_dispatcher_client;
+  Nonsynced_Transaction* transaction;
+  Nonsynced_Transaction* area_transaction;
+  uint32 generation;
+  uint32 area_generation;
+};
+
+
 class Dispatcher_Stub : public Watchdog_Callback
 {
   public:
     // Opens the connection to the database, sets db_dir accordingly
     // and registers the process. error_output_ must remain valid over the
-    // entire lifetime of this object.
+    // entire lifetime of this object. If warm_readers_ is given, the connections
+    // and transactions are taken from and left in there.
     Dispatcher_Stub(string db_dir_, Error_Output* error_output_, string xml_raw,
 		    meta_modes meta_, int area_level,
-		    uint32 max_allowed_time, uint64 max_allowed_space);
+		    uint32 max_allowed_time, uint64 max_allowed_space,
+		    Warm_Readers* warm_readers_ = 0);
     
     // Called once per minute from the resource manager
     virtual void ping() const;
@@ -69,6 +94,11 @@ class Dispatcher_Stub : public Watchdog_Callback
     Nonsynced_Transaction* area_transaction;
     Resource_Manager* rman;
     meta_modes meta;
+    struct timeval start_time;
+    Warm_Readers* warm_readers;
+    bool area_is_warm;
+    
+    void write_metrics() const;
 };
 
 
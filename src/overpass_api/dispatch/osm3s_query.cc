@@ -54,6 +54,8 @@ int main(int argc, char *argv[])
   Debug_Level debug_level = parser_execute;
   int area_level = 0;
   bool respect_timeout = true;
+  bool reencode_ways = false;
+  bool reencode_tags = false;
   
   int argpos = 1;
   while (argpos < argc)
@@ -91,6 +93,38 @@ int main(int argc, char *argv[])
       if ((clone_db_dir.size() > 0) && (clone_db_dir[clone_db_dir.size()-1] != '/'))
 	clone_db_dir += '/';
     }
+    else if (!(strcmp(argv[argpos], "--clone-compression=gz")))
+      basic_settings().compression_method = File_Blocks_Index_Base::ZLIB_COMPRESSION;
+    else if (!(strcmp(argv[argpos], "--clone-compression=no")))
+      basic_settings().compression_method = File_Blocks_Index_Base::NO_COMPRESSION;
+    else if (!(strcmp(argv[argpos], "--clone-way-encoding=compact")))
+    {
+      compact_way_encoding() = true;
+      reencode_ways = true;
+    }
+    else if (!(strcmp(argv[argpos], "--clone-way-encoding=plain")))
+    {
+      compact_way_encoding() = false;
+      reencode_ways = true;
+    }
+    else if (!(strcmp(argv[argpos], "--clone-tag-encoding=dictionary")))
+    {
+      dictionary_tag_encoding() = true;
+      reencode_tags = true;
+    }
+    else if (!(strcmp(argv[argpos], "--clone-tag-encoding=plain")))
+    {
+      dictionary_tag_encoding() = false;
+      reencode_tags = true;
+    }
+    else if (!(strcmp(argv[argpos], "--verify-checksums")))
+      basic_settings().verify_checksums = true;
+    else if (!(strncmp(argv[argpos], "--threads=", 10)))
+    {
+      basic_settings().query_threads = atoi(((string)argv[argpos]).substr(10).c_str());
+      if (basic_settings().query_threads == 0)
+	basic_settings().query_threads = 1;
+    }
     else
     {
       cout<<"Unknown argument: "<<argv[argpos]<<"\n\n"
@@ -103,6 +137,15 @@ int main(int argc, char *argv[])
       "  --dump-bbox-map-ql: Don't execute the query but only dump the query in a suitable form\n"
       "        for an OpenLayers slippy map.\n"
       "  --clone=$TARGET_DIR: Write a consistent copy of the entire database to the given $TARGET_DIR.\n"
+      "  --clone-compression=no|gz: Store the data files of the clone uncompressed or compressed.\n"
+      "        This converts a database between both formats.\n"
+      "  --clone-way-encoding=plain|compact: Write the ways of the clone with fixed size or with\n"
+      "        delta coded node ids and coordinates. This converts a database between both formats.\n"
+      "  --clone-tag-encoding=plain|dictionary: Write the tag keys of the clone as strings or as\n"
+      "        codes from the key dictionary. This converts a database between both formats.\n"
+      "  --verify-checksums: Compare the checksum of each block read with the index, if the\n"
+      "        database has checksums, and abort on a mismatch.\n"
+      "  --threads=$N: Execute independent statements of the query on up to $N threads.\n"
       "  --rules: Ignore all time limits and allow area creation by this query.\n"
       "  --quiet: Don't print anything on stderr.\n"
       "  --concise: Print concise information on stderr.\n"
@@ -127,7 +170,7 @@ int main(int argc, char *argv[])
       Dispatcher_Stub dispatcher(db_dir, error_output, "-- clone database --",
 				 get_uses_meta_data(), area_level, 24*60*60, 1024*1024*1024);
       
-      clone_database(*dispatcher.resource_manager().get_transaction(), clone_db_dir);
+      clone_database(*dispatcher.resource_manager().get_transaction(), clone_db_dir, reencode_ways, reencode_tags);
       return 0;
     }
     
@@ -0,0 +1,171 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "parallel_executor.h"
+
+#include <pthread.h>
+
+#include <new>
+
+using namespace std;
+
+
+namespace
+{
+  /** Hands out the tasks one by one to the threads and keeps the first error.
+      The views are kept until all threads have finished, such that their
+      statistics are merged in the order of the tasks. */
+  struct Parallel_Run
+  {
+    public:
+      Parallel_Run(Resource_Manager& rman_, const vector< Parallel_Task* >& tasks_);
+      ~Parallel_Run();
+
+      void run();
+
+    private:
+      static const int NO_ERROR = 0;
+      static const int RESOURCE_ERROR = 1;
+      static const int FILE_ERROR = 2;
+      static const int MEMORY_ERROR = 3;
+
+      Resource_Manager& rman;
+      const vector< Parallel_Task* >& tasks;
+      vector< Resource_Manager* > views;
+      volatile uint32 next_task;
+      volatile int error_kind;
+      Resource_Error resource_error;
+      File_Error file_error;
+      pthread_mutex_t error_mutex;
+
+      static void* work(void* self);
+      void execute_tasks();
+      void record_error(int kind, const Resource_Error* resource_error_, const File_Error* file_error_);
+  };
+
+
+  Parallel_Run::Parallel_Run(Resource_Manager& rman_, const vector< Parallel_Task* >& tasks_)
+    : rman(rman_), tasks(tasks_), views(tasks_.size(), 0), next_task(0), error_kind(NO_ERROR),
+      file_error(0, "", "")
+  {
+    pthread_mutex_init(&error_mutex, 0);
+  }
+
+
+  Parallel_Run::~Parallel_Run()
+  {
+    for (vector< Resource_Manager* >::iterator it = views.begin(); it != views.end(); ++it)
+      delete *it;
+    pthread_mutex_destroy(&error_mutex);
+  }
+
+
+  void Parallel_Run::run()
+  {
+    vector< pthread_t > threads;
+    for (uint32 i = 1; i < rman.get_max_threads() && i < tasks.size(); ++i)
+    {
+      pthread_t thread;
+      if (pthread_create(&thread, 0, &Parallel_Run::work, this) == 0)
+        threads.push_back(thread);
+    }
+    execute_tasks();
+    for (vector< pthread_t >::const_iterator it = threads.begin(); it != threads.end(); ++it)
+      pthread_join(*it, 0);
+
+    for (vector< Resource_Manager* >::const_iterator it = views.begin(); it != views.end(); ++it)
+    {
+      if (*it)
+        rman.merge_statistics(**it);
+    }
+
+    if (error_kind == RESOURCE_ERROR)
+      throw resource_error;
+    else if (error_kind == FILE_ERROR)
+      throw file_error;
+    else if (error_kind == MEMORY_ERROR)
+      throw std::bad_alloc();
+  }
+
+
+  void* Parallel_Run::work(void* self)
+  {
+    ((Parallel_Run*)self)->execute_tasks();
+    return 0;
+  }
+
+
+  void Parallel_Run::execute_tasks()
+  {
+    uint32 task = __sync_fetch_and_add(&next_task, 1);
+    while (task < tasks.size() && error_kind == NO_ERROR)
+    {
+      try
+      {
+        views[task] = new Resource_Manager(&rman);
+        tasks[task]->execute(*views[task]);
+      }
+      catch (const Resource_Error& e)
+      {
+        record_error(RESOURCE_ERROR, &e, 0);
+      }
+      catch (const File_Error& e)
+      {
+        record_error(FILE_ERROR, 0, &e);
+      }
+      catch (const std::bad_alloc& e)
+      {
+        record_error(MEMORY_ERROR, 0, 0);
+      }
+      catch (const Cancelled_Error& e)
+      {
+        // Another task has already failed.
+      }
+      catch (...)
+      {
+        File_Error e(0, "", "execute_in_parallel::1");
+        record_error(FILE_ERROR, 0, &e);
+      }
+      task = __sync_fetch_and_add(&next_task, 1);
+    }
+  }
+
+
+  // Keeps the error if it is the first one and cancels the other tasks.
+  void Parallel_Run::record_error
+      (int kind, const Resource_Error* resource_error_, const File_Error* file_error_)
+  {
+    pthread_mutex_lock(&error_mutex);
+    if (error_kind == NO_ERROR)
+    {
+      if (resource_error_)
+        resource_error = *resource_error_;
+      if (file_error_)
+        file_error = *file_error_;
+      error_kind = kind;
+      rman.cancel_views();
+    }
+    pthread_mutex_unlock(&error_mutex);
+  }
+}
+
+
+void execute_in_parallel(Resource_Manager& rman, const vector< Parallel_Task* >& tasks)
+{
+  Parallel_Run(rman, tasks).run();
+}
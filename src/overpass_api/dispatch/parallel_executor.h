@@ -0,0 +1,45 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___OVERPASS_API__DISPATCH__PARALLEL_EXECUTOR_H
+#define DE__OSM3S___OVERPASS_API__DISPATCH__PARALLEL_EXECUTOR_H
+
+#include "resource_manager.h"
+
+#include <vector>
+
+using namespace std;
+
+
+/** A piece of work that does not depend on any other task of the same run.
+    It must keep its results in its own members, because the view it gets
+    is discarded after the run. */
+struct Parallel_Task
+{
+  virtual void execute(Resource_Manager& rman) = 0;
+  virtual ~Parallel_Task() {}
+};
+
+
+/** Executes the tasks on up to rman.get_max_threads() threads, the calling thread included.
+    Each task gets a fresh view on rman. If a task fails, the others are cancelled at their
+    next health check and the first error is rethrown once all threads have finished. */
+void execute_in_parallel(Resource_Manager& rman, const vector< Parallel_Task* >& tasks);
+
+
+#endif
@@ -0,0 +1,283 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dispatcher_stub.h"
+#include "scripting_core.h"
+#include "web_query_core.h"
+#include "../frontend/fastcgi.h"
+#include "../../template_db/types.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+extern char** environ;
+
+
+namespace
+{
+  volatile sig_atomic_t termination_requested = 0;
+
+  void request_termination(int)
+  {
+    termination_requested = 1;
+  }
+
+
+  void report(const File_Error& e)
+  {
+    cerr<<"File_Error "<<e.error_number<<' '<<strerror(e.error_number)<<' '<<e.filename<<' '<<e.origin<<'\n';
+  }
+
+
+  int open_listen_socket(const string& socket_name)
+  {
+    int socket_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_descriptor == -1)
+      throw File_Error(errno, socket_name, "Query_Pool::open_listen_socket::1");
+
+    struct sockaddr_un local;
+    if (socket_name.size() >= sizeof(local.sun_path))
+      throw File_Error(ENAMETOOLONG, socket_name, "Query_Pool::open_listen_socket::2");
+    local.sun_family = AF_UNIX;
+    strcpy(local.sun_path, socket_name.c_str());
+
+    unlink(socket_name.c_str());
+    if (bind(socket_descriptor, (struct sockaddr*)&local,
+	sizeof(local.sun_family) + strlen(local.sun_path)) == -1)
+      throw File_Error(errno, socket_name, "Query_Pool::open_listen_socket::3");
+    // The web server usually runs as a different user.
+    if (chmod(socket_name.c_str(), S_666) == -1)
+      throw File_Error(errno, socket_name, "Query_Pool::open_listen_socket::4");
+    if (listen(socket_descriptor, SOMAXCONN) == -1)
+      throw File_Error(errno, socket_name, "Query_Pool::open_listen_socket::5");
+
+    return socket_descriptor;
+  }
+
+
+  // Runs one request with the CGI environment and streams of the FastCGI request.
+  void serve_request(Fastcgi_Connection& connection, const vector< string >& base_environment,
+		     Warm_Readers& warm_readers)
+  {
+    clearenv();
+    for (vector< string >::const_iterator it = base_environment.begin();
+        it != base_environment.end(); ++it)
+      putenv(const_cast< char* >(it->c_str()));
+    for (vector< pair< string, string > >::const_iterator it = connection.get_params().begin();
+        it != connection.get_params().end(); ++it)
+      setenv(it->first.c_str(), it->second.c_str(), 1);
+
+    istringstream input(connection.get_input());
+    streambuf* cin_buffer = cin.rdbuf(input.rdbuf());
+    streambuf* cout_buffer = cout.rdbuf(connection.output_buffer());
+    cin.clear();
+    cout.clear();
+
+    reset_scripting_state();
+    process_web_query(&warm_readers);
+
+    cout.flush();
+    cout.rdbuf(cout_buffer);
+    cin.rdbuf(cin_buffer);
+    cout.clear();
+    cin.clear();
+  }
+
+
+  // Serves requests until max_queries are done or termination is requested.
+  void run_worker(int listen_descriptor, const string& socket_name, uint32 max_queries)
+  {
+    // Keep a copy because clearenv() invalidates the strings of environ.
+    vector< string > base_environment;
+    for (char** it = environ; it && *it; ++it)
+      base_environment.push_back(*it);
+
+    Warm_Readers warm_readers;
+    uint32 query_count = 0;
+    while (query_count < max_queries && !termination_requested)
+    {
+      int socket_descriptor = accept(listen_descriptor, 0, 0);
+      if (socket_descriptor == -1)
+      {
+        if (errno != EINTR && errno != ECONNABORTED)
+          report(File_Error(errno, socket_name, "Query_Pool::run_worker::1"));
+        continue;
+      }
+
+      Fastcgi_Connection connection(socket_descriptor, socket_name);
+      try
+      {
+        while (query_count < max_queries && connection.read_request())
+        {
+          ++query_count;
+          serve_request(connection, base_environment, warm_readers);
+          connection.finish_request();
+          if (!connection.keeps_connection() || termination_requested)
+            break;
+        }
+      }
+      catch (File_Error e)
+      {
+        report(e);
+      }
+    }
+  }
+
+
+  pid_t start_worker(int listen_descriptor, const string& socket_name, uint32 max_queries)
+  {
+    pid_t pid = fork();
+    if (pid == -1)
+      throw File_Error(errno, socket_name, "Query_Pool::start_worker::1");
+    if (pid == 0)
+    {
+      run_worker(listen_descriptor, socket_name, max_queries);
+      exit(0);
+    }
+    return pid;
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  // read command line arguments
+  string socket_name;
+  uint32 num_workers = 4;
+  uint32 max_queries = 1000;
+
+  int argpos(1);
+  while (argpos < argc)
+  {
+    if (!(strncmp(argv[argpos], "--socket=", 9)))
+      socket_name = ((string)argv[argpos]).substr(9);
+    else if (!(strncmp(argv[argpos], "--workers=", 10)))
+      num_workers = atoll(((string)argv[argpos]).substr(10).c_str());
+    else if (!(strncmp(argv[argpos], "--max-queries=", 14)))
+      max_queries = atoll(((string)argv[argpos]).substr(14).c_str());
+    else if (!(strncmp(argv[argpos], "--threads=", 10)))
+    {
+      basic_settings().query_threads = atoll(((string)argv[argpos]).substr(10).c_str());
+      if (basic_settings().query_threads == 0)
+        basic_settings().query_threads = 1;
+    }
+    else
+    {
+      cout<<"Unknown argument: "<<argv[argpos]<<"\n\n"
+      "Accepted arguments are:\n"
+      "  --socket=$SOCKET: Accept FastCGI connections on the unix domain socket $SOCKET.\n"
+      "  --workers=number: Run this many queries in parallel. The default is 4.\n"
+      "  --max-queries=number: Replace a worker after it has run this many queries.\n"
+      "        The default is 1000.\n"
+      "  --threads=number: Let each query execute independent statements on this many threads.\n"
+      "        The default is 1.\n";
+
+      return 0;
+    }
+    ++argpos;
+  }
+
+  if (socket_name.empty() || num_workers == 0 || max_queries == 0)
+  {
+    cout<<"\"--socket\" is required, \"--workers\" and \"--max-queries\" must be positive.\n";
+    return 0;
+  }
+
+  int listen_descriptor = -1;
+  try
+  {
+    listen_descriptor = open_listen_socket(socket_name);
+  }
+  catch (File_Error e)
+  {
+    report(e);
+    return 1;
+  }
+
+  // A client that has gone away must not terminate a worker.
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_termination;
+  sigaction(SIGTERM, &action, 0);
+  sigaction(SIGINT, &action, 0);
+
+  map< pid_t, struct timeval > workers;
+  while (!termination_requested)
+  {
+    try
+    {
+      while (workers.size() < num_workers)
+      {
+        struct timeval start_time;
+        gettimeofday(&start_time, 0);
+        workers[start_worker(listen_descriptor, socket_name, max_queries)] = start_time;
+      }
+    }
+    catch (File_Error e)
+    {
+      report(e);
+      sleep(1);
+    }
+
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid <= 0)
+      continue;
+
+    map< pid_t, struct timeval >::iterator it = workers.find(pid);
+    if (it == workers.end())
+      continue;
+    // Don't restart a worker that fails immediately at full speed.
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      cerr<<"Worker "<<pid<<" terminated abnormally with status "<<status<<".\n";
+      if (milliseconds_since(it->second) < 1000)
+        sleep(1);
+    }
+    workers.erase(it);
+  }
+
+  // Workers finish their current query before they exit.
+  for (map< pid_t, struct timeval >::const_iterator it = workers.begin(); it != workers.end(); ++it)
+    kill(it->first, SIGTERM);
+  while (wait(0) > 0 || errno == EINTR)
+    ;
+
+  close(listen_descriptor);
+  unlink(socket_name.c_str());
+
+  return 0;
+}
@@ -23,6 +23,13 @@
 
 using namespace std;
 
+
+uint64& global_heap_bytes()
+{
+  static uint64 heap_bytes = 0;
+  return heap_bytes;
+}
+
 uint count_set(const Set& set_)
 {
   uint size(0);
@@ -54,89 +61,10 @@ uint count_set(const Set& set_)
 }
 
 
-uint64 eval_map(const std::map< Uint32_Index, vector< Node_Skeleton > >& nodes)
-{
-  uint64 size(0);
-  for (map< Uint32_Index, vector< Node_Skeleton > >::const_iterator
-      it(nodes.begin()); it != nodes.end(); ++it)
-    size += it->second.size()*8 + 64;
-  return size;
-}
-
-
-uint64 eval_map(const std::map< Uint31_Index, vector< Way_Skeleton > >& ways)
-{
-  uint64 size(0);
-  for (map< Uint31_Index, vector< Way_Skeleton > >::const_iterator
-      it(ways.begin()); it != ways.end(); ++it)
-    size += it->second.size()*128 + 64;
-  return size;
-}
-
-
-uint64 eval_map(const std::map< Uint31_Index, vector< Relation_Skeleton > >& relations)
-{
-  uint64 size(0);
-  for (map< Uint31_Index, vector< Relation_Skeleton > >::const_iterator
-      it(relations.begin()); it != relations.end(); ++it)
-    size += it->second.size()*192 + 64;
-  return size;
-}
-
-
-uint64 eval_map(const std::map< Uint32_Index, vector< Attic< Node_Skeleton > > >& nodes)
-{
-  uint64 size(0);
-  for (map< Uint32_Index, vector< Attic< Node_Skeleton > > >::const_iterator
-      it(nodes.begin()); it != nodes.end(); ++it)
-    size += it->second.size()*16 + 64;
-  return size;
-}
-
-
-uint64 eval_map(const std::map< Uint31_Index, vector< Attic< Way_Skeleton > > >& ways)
-{
-  uint64 size(0);
-  for (map< Uint31_Index, vector< Attic< Way_Skeleton > > >::const_iterator
-      it(ways.begin()); it != ways.end(); ++it)
-    size += it->second.size()*136 + 64;
-  return size;
-}
-
-
-uint64 eval_map(const std::map< Uint31_Index, vector< Attic< Relation_Skeleton > > >& relations)
-{
-  uint64 size(0);
-  for (map< Uint31_Index, vector< Attic< Relation_Skeleton > > >::const_iterator
-      it(relations.begin()); it != relations.end(); ++it)
-    size += it->second.size()*200 + 64;
-  return size;
-}
-
-
-uint64 eval_map(const std::map< Uint31_Index, vector< Area_Skeleton > >& areas)
-{
-  uint64 size(0);
-  for (map< Uint31_Index, vector< Area_Skeleton > >::const_iterator
-      it(areas.begin()); it != areas.end(); ++it)
-    size += it->second.size()*128 + 64;
-  return size;
-}
-
-
-uint64 eval_set(const Set& set_)
-{
-  return eval_map(set_.nodes) + eval_map(set_.ways) + eval_map(set_.relations)
-      + eval_map(set_.attic_nodes) + eval_map(set_.attic_ways)
-      + eval_map(set_.attic_relations) + eval_map(set_.areas);
-}
-
-
 void Resource_Manager::push_reference(const Set& set_)
 {
   set_stack.push_back(&set_);
   stack_progress.push_back(make_pair(0, count_set(set_)));
-  set_stack_sizes.push_back(eval_set(set_));
 }
 
 
@@ -144,7 +72,6 @@ void Resource_Manager::pop_reference()
 {
   set_stack.pop_back();
   stack_progress.pop_back();
-  set_stack_sizes.pop_back();
 }
 
 
@@ -166,11 +93,32 @@ void Resource_Manager::log_and_display_error(std::string message)
 
 void Resource_Manager::health_check(const Statement& stmt, uint32 extra_time, uint64 extra_space)
 {
+  struct timeval now;
+  gettimeofday(&now, 0);
+  statement_seconds[stmt.get_name()] += (now.tv_sec - last_check_time.tv_sec)
+      + (now.tv_usec - last_check_time.tv_usec)/1000000.;
+  last_check_time = now;
+  
+  if (parent && parent->views_cancelled)
+    throw Cancelled_Error();
+  
   uint32 elapsed_time = 0;
   if (max_allowed_time > 0)
     elapsed_time = time(NULL) - start_time + extra_time;
   
-  if (elapsed_time >= last_ping_time + 5)
+  if (parent)
+  {
+    // The views of a parallel evaluation keep the watchdog of their parent alive.
+    pthread_mutex_lock(&parent->view_mutex);
+    if (elapsed_time >= parent->last_ping_time + 5)
+    {
+      if (parent->watchdog)
+        parent->watchdog->ping();
+      parent->last_ping_time = elapsed_time;
+    }
+    pthread_mutex_unlock(&parent->view_mutex);
+  }
+  else if (elapsed_time >= last_ping_time + 5)
   {
     if (watchdog)
       watchdog->ping();
@@ -188,17 +136,14 @@ void Resource_Manager::health_check(const Statement& stmt, uint32 extra_time, ui
     }
   }
   
+  // The sets and all temporary data of the statements live on the heap. Hence the growth
+  // of the heap since the start of the query is its memory use.
   uint64 size = 0;
   if (max_allowed_space > 0)
   {
-    size = extra_space;
-    
-    for (map< string, Set >::const_iterator it(sets_.begin()); it != sets_.end();
-        ++it)
-      size += eval_set(it->second);
-    for (vector< long long >::const_iterator it = set_stack_sizes.begin();
-        it != set_stack_sizes.end(); ++it)
-      size += *it;
+    uint64 heap_bytes = __sync_add_and_fetch(&global_heap_bytes(), 0);
+    size = extra_space + (heap_bytes > heap_bytes_at_start ? heap_bytes - heap_bytes_at_start : 0);
+    peak_space = max(peak_space, size);
   }
 
   if (elapsed_time > max_allowed_time)
@@ -251,3 +196,15 @@ void Resource_Manager::health_check(const Statement& stmt, uint32 extra_time, ui
     throw *error;
   }  
 }
+
+
+void Resource_Manager::merge_statistics(const Resource_Manager& view)
+{
+  for (map< string, double >::const_iterator it = view.statement_seconds.begin();
+      it != view.statement_seconds.end(); ++it)
+    statement_seconds[it->first] += it->second;
+  peak_space = max(peak_space, view.peak_space);
+  
+  // The time of the parallel evaluation is already charged to the statements in the views.
+  gettimeofday(&last_check_time, 0);
+}
@@ -19,6 +19,8 @@
 #ifndef DE__OSM3S___OVERPASS_API__DISPATCH__RESOURCE_MANAGER_H
 #define DE__OSM3S___OVERPASS_API__DISPATCH__RESOURCE_MANAGER_H
 
+#include <pthread.h>
+#include <sys/time.h>
 #include <ctime>
 #include "../../template_db/transaction.h"
 #include "../core/datatypes.h"
@@ -28,6 +30,12 @@ using namespace std;
 
 class Statement;
 
+/** The bytes allocated by operator new and not yet freed in this process. Programs that
+    run queries link counting_allocator.cc to maintain it on every allocation and
+    deallocation. In all other programs it stays zero. */
+uint64& global_heap_bytes();
+
+
 struct Watchdog_Callback
 {
   virtual void ping() const = 0;
@@ -42,8 +50,15 @@ public:
         area_transaction(0), area_updater_(0),
         watchdog(watchdog_),
 	start_time(time(NULL)), last_ping_time(0), last_report_time(0),
-	max_allowed_time(0), max_allowed_space(0),
-	desired_timestamp(NOW), diff_from_timestamp(NOW), diff_to_timestamp(NOW) {}
+	max_allowed_time(0), max_allowed_space(0), peak_space(0),
+	heap_bytes_at_start(global_heap_bytes()),
+	desired_timestamp(NOW), diff_from_timestamp(NOW), diff_to_timestamp(NOW),
+	parent(0), max_threads(1), views_cancelled(0)
+  {
+    tag_key_dictionary().attach(transaction_.get_db_dir());
+    gettimeofday(&last_check_time, 0);
+    pthread_mutex_init(&view_mutex, 0);
+  }
   
   Resource_Manager(Transaction& transaction_, Error_Output* error_output_,
 		   Transaction& area_transaction_, Watchdog_Callback* watchdog_,
@@ -52,14 +67,41 @@ public:
         area_transaction(&area_transaction_),
         area_updater_(area_updater__),
 	watchdog(watchdog_), start_time(time(NULL)), last_ping_time(0), last_report_time(0),
-	max_allowed_time(0), max_allowed_space(0),
-	desired_timestamp(NOW), diff_from_timestamp(NOW), diff_to_timestamp(NOW) {}
+	max_allowed_time(0), max_allowed_space(0), peak_space(0),
+	heap_bytes_at_start(global_heap_bytes()),
+	desired_timestamp(NOW), diff_from_timestamp(NOW), diff_to_timestamp(NOW),
+	parent(0), max_threads(1), views_cancelled(0)
+  {
+    tag_key_dictionary().attach(transaction_.get_db_dir());
+    gettimeofday(&last_check_time, 0);
+    pthread_mutex_init(&view_mutex, 0);
+  }
+	
+  /** Creates a view on parent for one thread of a parallel evaluation. The view shares
+      the transactions, timestamps and limits of its parent but has its own sets.
+      It does neither display progress nor update areas, and it does not evaluate
+      in parallel again. */
+  explicit Resource_Manager(Resource_Manager* parent_)
+      : transaction(parent_->transaction), error_output(0),
+        area_transaction(parent_->area_transaction), area_updater_(0),
+        watchdog(0), start_time(parent_->start_time), last_ping_time(0), last_report_time(0),
+	max_allowed_time(parent_->max_allowed_time), max_allowed_space(parent_->max_allowed_space),
+	peak_space(0), heap_bytes_at_start(parent_->heap_bytes_at_start),
+	desired_timestamp(parent_->desired_timestamp),
+	diff_from_timestamp(parent_->diff_from_timestamp),
+	diff_to_timestamp(parent_->diff_to_timestamp),
+	parent(parent_), max_threads(1), views_cancelled(0)
+  {
+    gettimeofday(&last_check_time, 0);
+    pthread_mutex_init(&view_mutex, 0);
+  }
 	
   ~Resource_Manager()
   {
     if (area_updater_)
       delete area_updater_;
     area_updater_ = 0;
+    pthread_mutex_destroy(&view_mutex);
   }
   
   map< string, Set >& sets()
@@ -97,11 +139,34 @@ public:
   void set_diff_from_timestamp(uint64 timestamp) { diff_from_timestamp = timestamp; }
   void set_diff_to_timestamp(uint64 timestamp) { diff_to_timestamp = timestamp; }
   
+  /** The wall time spent per statement name. The time between two health checks
+      is charged to the statement that does the second check. As every statement
+      checks at its end, this is the time spent in the statement itself without
+      its substatements. */
+  const map< string, double >& get_statement_seconds() const { return statement_seconds; }
+  
+  /** The largest memory use seen by a health check. Only measured if
+      a space limit is set. */
+  uint64 get_peak_space() const { return peak_space; }
+  
+  /** The number of threads a statement may use to evaluate independent
+      substatements in parallel. */
+  uint32 get_max_threads() const { return max_threads; }
+  void set_max_threads(uint32 max_threads_) { max_threads = (max_threads_ > 0 ? max_threads_ : 1); }
+  
+  /** Lets the health checks of all views on this resource manager throw
+      a Cancelled_Error. */
+  void cancel_views() { __sync_fetch_and_or(&views_cancelled, 1); }
+  
+  /** Adds the statement times and the peak memory use of a view that has finished.
+      The statement times of parallel views add up, hence their sum may exceed
+      the wall time of the query. */
+  void merge_statistics(const Resource_Manager& view);
+  
 private:
   map< string, Set > sets_;
   vector< const Set* > set_stack;
   vector< pair< uint, uint > > stack_progress;
-  vector< long long > set_stack_sizes;
   Transaction* transaction;
   Error_Output* error_output;
   Transaction* area_transaction;
@@ -112,24 +177,25 @@ private:
   uint32 last_report_time;
   uint32 max_allowed_time;
   uint64 max_allowed_space;
+  uint64 peak_space;
+  uint64 heap_bytes_at_start;
+  struct timeval last_check_time;
+  map< string, double > statement_seconds;
   
   uint64 desired_timestamp;
   uint64 diff_from_timestamp;
   uint64 diff_to_timestamp;
+  
+  Resource_Manager* parent;
+  uint32 max_threads;
+  volatile uint32 views_cancelled;
+  pthread_mutex_t view_mutex;
+  
+  Resource_Manager(const Resource_Manager&);
+  Resource_Manager& operator=(const Resource_Manager&);
 };
 
 
-uint64 eval_map(const std::map< Uint32_Index, vector< Node_Skeleton > >& nodes);
-uint64 eval_map(const std::map< Uint31_Index, vector< Way_Skeleton > >& ways);
-uint64 eval_map(const std::map< Uint31_Index, vector< Relation_Skeleton > >& relations);
-
-uint64 eval_map(const std::map< Uint32_Index, vector< Attic< Node_Skeleton > > >& nodes);
-uint64 eval_map(const std::map< Uint31_Index, vector< Attic< Way_Skeleton > > >& ways);
-uint64 eval_map(const std::map< Uint31_Index, vector< Attic< Relation_Skeleton > > >& relations);
-
-uint64 eval_map(const std::map< Uint31_Index, vector< Area_Skeleton > >& areas);
-
-
 struct Resource_Error
 {
   bool timed_out;
@@ -139,4 +205,9 @@ struct Resource_Error
   uint runtime;
 };
 
+
+/** Thrown by the health check of a view after its parent has cancelled its views,
+    because another thread of the same evaluation has failed. */
+struct Cancelled_Error {};
+
 #endif
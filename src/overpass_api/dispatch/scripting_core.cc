@@ -23,6 +23,7 @@
 #include "../frontend/map_ql_parser.h"
 #include "../frontend/user_interface.h"
 #include "../statements/area_query.h"
+#include "../statements/changed.h"
 #include "../statements/coord_query.h"
 #include "../statements/id_query.h"
 #include "../statements/make_area.h"
@@ -244,6 +245,24 @@ vector< Statement* >* get_statement_stack()
   return &statement_stack_;
 }
 
+
+void reset_scripting_state()
+{
+  // The statements themselves belong to the factory of the previous query.
+  statement_stack_.clear();
+  statement_dump_stack_.clear();
+  text_stack.clear();
+  xml_parser.reset();
+  
+  Area_Query_Statement::reset_usage();
+  Changed_Statement::reset_usage();
+  Coord_Query_Statement::reset_usage();
+  Id_Query_Statement::reset_usage();
+  Make_Area_Statement::reset_usage();
+  Map_To_Area_Statement::reset_usage();
+  Query_Statement::reset_usage();
+}
+
 meta_modes get_uses_meta_data()
 {
   return keep_attic;
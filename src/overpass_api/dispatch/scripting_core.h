@@ -55,4 +55,8 @@ meta_modes get_uses_meta_data();
 
 int determine_area_level(Error_Output* error_output, int area_level);
 
+/** Forgets the statements and usage flags of the previous query. Processes that
+    execute more than one query must call this before parsing the next one. */
+void reset_scripting_state();
+
 #endif
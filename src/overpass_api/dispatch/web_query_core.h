@@ -0,0 +1,34 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___OVERPASS_API__DISPATCH__WEB_QUERY_CORE_H
+#define DE__OSM3S___OVERPASS_API__DISPATCH__WEB_QUERY_CORE_H
+
+#include "dispatcher_stub.h"
+
+
+/** Executes the query of a CGI request. The request is taken from the environment and
+    standard input, the response is written to standard output. Errors are reported
+    to the client as part of the response.
+    
+    Processes that execute several queries pass their warm_readers here and call
+    reset_scripting_state() before each query. */
+void process_web_query(Warm_Readers* warm_readers = 0);
+
+
+#endif
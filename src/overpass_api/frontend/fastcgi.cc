@@ -0,0 +1,338 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fastcgi.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+namespace
+{
+  // Record types and constants of the FastCGI specification 1.0.
+  const uint8 FCGI_VERSION_1 = 1;
+  const uint8 FCGI_BEGIN_REQUEST = 1;
+  const uint8 FCGI_ABORT_REQUEST = 2;
+  const uint8 FCGI_END_REQUEST = 3;
+  const uint8 FCGI_PARAMS = 4;
+  const uint8 FCGI_STDIN = 5;
+  const uint8 FCGI_STDOUT = 6;
+  const uint8 FCGI_GET_VALUES = 9;
+  const uint8 FCGI_GET_VALUES_RESULT = 10;
+  const uint8 FCGI_UNKNOWN_TYPE = 11;
+
+  const uint16 FCGI_RESPONDER = 1;
+  const uint8 FCGI_KEEP_CONN = 1;
+
+  const uint8 FCGI_REQUEST_COMPLETE = 0;
+  const uint8 FCGI_CANT_MPX_CONN = 1;
+  const uint8 FCGI_UNKNOWN_ROLE = 3;
+
+  const uint32 MAX_CONTENT_LENGTH = 65535;
+
+
+  // Returns false if the length does not fit into data.
+  bool read_length(const string& data, uint32& pos, uint32& length)
+  {
+    if (pos >= data.size())
+      return false;
+    if (!((uint8)data[pos] & 0x80))
+    {
+      length = (uint8)data[pos++];
+      return true;
+    }
+    if (pos + 4 > data.size())
+      return false;
+    length = (((uint8)data[pos] & 0x7f)<<24) | ((uint8)data[pos+1]<<16)
+        | ((uint8)data[pos+2]<<8) | (uint8)data[pos+3];
+    pos += 4;
+    return true;
+  }
+
+
+  void append_length(string& data, uint32 length)
+  {
+    if (length < 0x80)
+      data += (char)length;
+    else
+    {
+      data += (char)((length>>24) | 0x80);
+      data += (char)(length>>16);
+      data += (char)(length>>8);
+      data += (char)length;
+    }
+  }
+
+
+  vector< pair< string, string > > decode_name_value_pairs(const string& data)
+  {
+    vector< pair< string, string > > result;
+    uint32 pos = 0;
+    uint32 name_length = 0;
+    uint32 value_length = 0;
+    while (read_length(data, pos, name_length) && read_length(data, pos, value_length)
+        && pos + (uint64)name_length + value_length <= data.size())
+    {
+      result.push_back(make_pair(data.substr(pos, name_length),
+          data.substr(pos + name_length, value_length)));
+      pos += name_length + value_length;
+    }
+    return result;
+  }
+
+
+  string end_request_body(uint8 protocol_status)
+  {
+    // application status 0, then the protocol status and three reserved bytes
+    string body(8, '\0');
+    body[4] = protocol_status;
+    return body;
+  }
+}
+
+
+Fastcgi_Connection::Output_Buffer::Output_Buffer(Fastcgi_Connection& connection_)
+  : connection(connection_), request_id(0)
+{
+  setp(buffer, buffer + sizeof(buffer));
+}
+
+
+void Fastcgi_Connection::Output_Buffer::start_request(uint16 request_id_)
+{
+  request_id = request_id_;
+  setp(buffer, buffer + sizeof(buffer));
+}
+
+
+int Fastcgi_Connection::Output_Buffer::overflow(int c)
+{
+  sync();
+  if (c != traits_type::eof())
+  {
+    *pptr() = c;
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+
+int Fastcgi_Connection::Output_Buffer::sync()
+{
+  if (pptr() > pbase())
+    connection.write_record(FCGI_STDOUT, request_id, pbase(), pptr() - pbase());
+  setp(buffer, buffer + sizeof(buffer));
+  return 0;
+}
+
+
+Fastcgi_Connection::Fastcgi_Connection(int socket_descriptor_, const string& socket_name_)
+  : socket_descriptor(socket_descriptor_), socket_name(socket_name_),
+    request_id(0), keep_connection(false), broken(false), output(*this) {}
+
+
+Fastcgi_Connection::~Fastcgi_Connection()
+{
+  close(socket_descriptor);
+}
+
+
+bool Fastcgi_Connection::read_exactly(void* buf, uint32 size)
+{
+  uint32 pos = 0;
+  while (pos < size)
+  {
+    int result = read(socket_descriptor, (uint8*)buf + pos, size - pos);
+    if (result < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw File_Error(errno, socket_name, "Fastcgi_Connection::read_exactly::1");
+    }
+    if (result == 0)
+    {
+      if (pos == 0)
+        return false;
+      throw File_Error(0, socket_name, "Fastcgi_Connection::read_exactly::2");
+    }
+    pos += result;
+  }
+  return true;
+}
+
+
+void Fastcgi_Connection::write_record
+    (uint8 type, uint16 request_id, const char* content, uint32 size)
+{
+  // Large contents are split, and an empty content still needs one record.
+  uint32 pos = 0;
+  do
+  {
+    if (broken)
+      return;
+
+    uint32 length = min(size - pos, MAX_CONTENT_LENGTH);
+    string record(8, '\0');
+    record[0] = FCGI_VERSION_1;
+    record[1] = type;
+    record[2] = request_id>>8;
+    record[3] = request_id;
+    record[4] = length>>8;
+    record[5] = length;
+    record.append(content + pos, length);
+    pos += length;
+
+    uint32 written = 0;
+    while (written < record.size())
+    {
+      int result = write(socket_descriptor, record.data() + written, record.size() - written);
+      if (result < 0 && errno == EINTR)
+        continue;
+      if (result <= 0)
+      {
+        broken = true;
+        break;
+      }
+      written += result;
+    }
+  }
+  while (pos < size);
+}
+
+
+void Fastcgi_Connection::answer_management_record(uint8 type, const string& content)
+{
+  if (type == FCGI_GET_VALUES)
+  {
+    string result;
+    vector< pair< string, string > > names = decode_name_value_pairs(content);
+    for (vector< pair< string, string > >::const_iterator it = names.begin();
+        it != names.end(); ++it)
+    {
+      if (it->first == "FCGI_MPXS_CONNS")
+      {
+        append_length(result, it->first.size());
+        append_length(result, 1);
+        result += it->first + '0';
+      }
+    }
+    write_record(FCGI_GET_VALUES_RESULT, 0, result.data(), result.size());
+  }
+  else
+  {
+    string body(8, '\0');
+    body[0] = type;
+    write_record(FCGI_UNKNOWN_TYPE, 0, body.data(), body.size());
+  }
+}
+
+
+bool Fastcgi_Connection::read_request()
+{
+  request_id = 0;
+  params.clear();
+  input.clear();
+
+  string param_data;
+  bool params_complete = false;
+  bool input_complete = false;
+  while (!params_complete || !input_complete)
+  {
+    uint8 header[8];
+    if (!read_exactly(header, 8))
+      return false;
+    if (header[0] != FCGI_VERSION_1)
+      throw File_Error(0, socket_name, "Fastcgi_Connection::read_request::1");
+
+    uint8 type = header[1];
+    uint16 id = (header[2]<<8) | header[3];
+    uint32 length = (header[4]<<8) | header[5];
+    string content(length + header[6], '\0');
+    if (!content.empty() && !read_exactly(&content[0], content.size()))
+      throw File_Error(0, socket_name, "Fastcgi_Connection::read_request::2");
+    content.resize(length);
+
+    if (id == 0)
+      answer_management_record(type, content);
+    else if (type == FCGI_BEGIN_REQUEST && length >= 3)
+    {
+      uint16 role = ((uint8)content[0]<<8) | (uint8)content[1];
+      if (request_id != 0)
+      {
+        string body = end_request_body(FCGI_CANT_MPX_CONN);
+        write_record(FCGI_END_REQUEST, id, body.data(), body.size());
+      }
+      else if (role != FCGI_RESPONDER)
+      {
+        string body = end_request_body(FCGI_UNKNOWN_ROLE);
+        write_record(FCGI_END_REQUEST, id, body.data(), body.size());
+      }
+      else
+      {
+        request_id = id;
+        keep_connection = ((uint8)content[2] & FCGI_KEEP_CONN);
+      }
+    }
+    // Records of other requests can only belong to requests already rejected.
+    else if (id != request_id)
+      ;
+    else if (type == FCGI_ABORT_REQUEST)
+    {
+      string body = end_request_body(FCGI_REQUEST_COMPLETE);
+      write_record(FCGI_END_REQUEST, id, body.data(), body.size());
+      request_id = 0;
+      param_data.clear();
+      input.clear();
+      params_complete = false;
+      input_complete = false;
+      if (!keep_connection)
+        return false;
+    }
+    else if (type == FCGI_PARAMS)
+    {
+      if (length == 0)
+        params_complete = true;
+      param_data += content;
+    }
+    else if (type == FCGI_STDIN)
+    {
+      if (length == 0)
+        input_complete = true;
+      input += content;
+    }
+  }
+
+  params = decode_name_value_pairs(param_data);
+  output.start_request(request_id);
+  return true;
+}
+
+
+void Fastcgi_Connection::finish_request()
+{
+  output.pubsync();
+  write_record(FCGI_STDOUT, request_id, "", 0);
+  string body = end_request_body(FCGI_REQUEST_COMPLETE);
+  write_record(FCGI_END_REQUEST, request_id, body.data(), body.size());
+  request_id = 0;
+}
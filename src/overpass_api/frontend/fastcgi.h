@@ -0,0 +1,96 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___OVERPASS_API__FRONTEND__FASTCGI_H
+#define DE__OSM3S___OVERPASS_API__FRONTEND__FASTCGI_H
+
+#include "../../template_db/types.h"
+
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/** A connection from a web server that speaks FastCGI in the responder role.
+    Requests on the same connection are served one after another, multiplexing
+    is declined. The connection takes ownership of the socket. */
+class Fastcgi_Connection
+{
+  Fastcgi_Connection(const Fastcgi_Connection&);
+  Fastcgi_Connection& operator=(const Fastcgi_Connection&);
+
+  public:
+    Fastcgi_Connection(int socket_descriptor_, const string& socket_name_);
+    ~Fastcgi_Connection();
+
+    /** Reads the next request up to the end of its input. Returns false if the web server
+        has closed the connection. Throws File_Error on socket errors. */
+    bool read_request();
+
+    /** The CGI environment of the current request. */
+    const vector< pair< string, string > >& get_params() const { return params; }
+
+    /** The request body of the current request. */
+    const string& get_input() const { return input; }
+
+    /** Everything written to this buffer goes to the web server as output of
+        the current request. Write errors are silently dropped because they mean
+        that the client has gone away. */
+    streambuf* output_buffer() { return &output; }
+
+    /** Sends the remaining output and ends the current request. */
+    void finish_request();
+
+    /** Whether the web server wants to send further requests on this connection. */
+    bool keeps_connection() const { return keep_connection; }
+
+  private:
+    class Output_Buffer : public streambuf
+    {
+      public:
+        Output_Buffer(Fastcgi_Connection& connection_);
+        void start_request(uint16 request_id_);
+
+      protected:
+        virtual int overflow(int c);
+        virtual int sync();
+
+      private:
+        Fastcgi_Connection& connection;
+        uint16 request_id;
+        char buffer[16*1024];
+    };
+
+    int socket_descriptor;
+    string socket_name;
+    uint16 request_id;
+    bool keep_connection;
+    bool broken;
+    vector< pair< string, string > > params;
+    string input;
+    Output_Buffer output;
+
+    bool read_exactly(void* buf, uint32 size);
+    void write_record(uint8 type, uint16 request_id, const char* content, uint32 size);
+    void answer_management_record(uint8 type, const string& content);
+};
+
+
+#endif
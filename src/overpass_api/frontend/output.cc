@@ -62,6 +62,7 @@ class Verbose_Osm_Backend_Callback : public Osm_Backend_Callback
     virtual void flush_roles_finished() { cerr<<'.'; }
     virtual void update_finished() { cerr<<" done.\n"; }
     virtual void partial_started() { cerr<<"Reorganizing the database ..."; }
+    virtual void partial_file_finished(const string& file_name) { cerr<<' '<<file_name; }
     virtual void partial_finished() { cerr<<" done.\n"; }
     
     virtual void parser_started() { cerr<<"Reading XML file ..."; }
@@ -72,7 +73,15 @@ class Verbose_Osm_Backend_Callback : public Osm_Backend_Callback
     virtual void relation_elapsed(Relation::Id_Type id) { cerr<<" elapsed relation "<<id.val()<<". "; }
     virtual void relations_finished() { cerr<<" finished reading relations. "; }
 
-    virtual void parser_succeeded() { cerr<<"Update complete.\n"; }
+    virtual void parser_succeeded()
+    {
+      cerr<<"Update complete.\n";
+      const Write_Statistics& stats = global_write_statistics();
+      if (stats.net_bytes > 0)
+        cerr<<"Wrote "<<stats.blocks<<" blocks ("<<stats.superseded<<" superseded) with "
+            <<stats.write_calls<<" write calls, "<<stats.written_bytes<<" of "<<stats.net_bytes
+            <<" bytes, write amplification "<<double(stats.written_bytes)/stats.net_bytes<<".\n";
+    }
 };
 
 
@@ -95,6 +104,7 @@ class Quiet_Osm_Backend_Callback : public Osm_Backend_Callback
     virtual void flush_roles_finished() {}
     virtual void update_finished() {}
     virtual void partial_started() {}
+    virtual void partial_file_finished(const string& file_name) {}
     virtual void partial_finished() {}
     
     virtual void parser_started() {}
@@ -71,6 +71,41 @@ void clone_bin_file(const File_Properties& file_prop, Transaction& transaction,
   }
 }
 
+template< class TIndex, class TObject >
+void clone_reencoded_file(const File_Properties& file_prop, Transaction& transaction, string dest_db_dir)
+{
+  try
+  {
+    Block_Backend< TIndex, TObject > src_db(transaction.data_index(&file_prop));
+    File_Blocks_Index< TIndex > dest_idx(file_prop, true, false, dest_db_dir, "");
+    
+    map< TIndex, set< TObject > > to_delete;
+    map< TIndex, set< TObject > > to_insert;
+    uint32 count = 0;
+    for (typename Block_Backend< TIndex, TObject >::Flat_Iterator it(src_db.flat_begin());
+        !(it == src_db.flat_end()); ++it)
+    {
+      // Write in portions to bound the memory, but never split an index.
+      if (count >= 1024*1024 && to_insert.find(it.index()) == to_insert.end())
+      {
+        Block_Backend< TIndex, TObject > dest_db(&dest_idx);
+        dest_db.update(to_delete, to_insert);
+        to_insert.clear();
+        count = 0;
+      }
+      to_insert[it.index()].insert(it.object());
+      ++count;
+    }
+    
+    Block_Backend< TIndex, TObject > dest_db(&dest_idx);
+    dest_db.update(to_delete, to_insert);
+  }
+  catch (File_Error e)
+  {
+    cout<<e.origin<<' '<<e.error_number<<' '<<strerror(e.error_number)<<' '<<e.filename<<'\n';
+  }
+}
+
 template< class TIndex >
 void clone_map_file(const File_Properties& file_prop, Transaction& transaction, string dest_db_dir)
 {
@@ -102,25 +137,92 @@ void clone_map_file(const File_Properties& file_prop, Transaction& transaction,
   }
 }
 
-void clone_database(Transaction& transaction, string dest_db_dir)
+template< class TObject >
+void clone_tag_files(const File_Properties& local_prop, const File_Properties& global_prop,
+                     Transaction& transaction, string dest_db_dir, bool reencode_tags)
+{
+  if (reencode_tags)
+  {
+    clone_reencoded_file< Tag_Index_Local, typename TObject::Id_Type >
+        (local_prop, transaction, dest_db_dir);
+    clone_reencoded_file< Tag_Index_Global, Tag_Object_Global< typename TObject::Id_Type > >
+        (global_prop, transaction, dest_db_dir);
+  }
+  else
+  {
+    clone_bin_file< Tag_Index_Local >(local_prop, transaction, dest_db_dir);
+    clone_bin_file< Tag_Index_Global >(global_prop, transaction, dest_db_dir);
+  }
+}
+
+template< class TObject >
+void clone_attic_tag_files(const File_Properties& local_prop, const File_Properties& global_prop,
+                           Transaction& transaction, string dest_db_dir, bool reencode_tags)
+{
+  if (reencode_tags)
+  {
+    clone_reencoded_file< Tag_Index_Local, Attic< typename TObject::Id_Type > >
+        (local_prop, transaction, dest_db_dir);
+    clone_reencoded_file< Tag_Index_Global, Attic< Tag_Object_Global< typename TObject::Id_Type > > >
+        (global_prop, transaction, dest_db_dir);
+  }
+  else
+  {
+    clone_bin_file< Tag_Index_Local >(local_prop, transaction, dest_db_dir);
+    clone_bin_file< Tag_Index_Global >(global_prop, transaction, dest_db_dir);
+  }
+}
+
+void clone_tag_key_dictionary(Transaction& transaction, string dest_db_dir)
+{
+  try
+  {
+    string src_name = transaction.get_db_dir() + "tag_key_dictionary";
+    if (file_exists(src_name))
+    {
+      Raw_File src_file(src_name, O_RDONLY, S_666, "clone_tag_key_dictionary:1");
+      uint64 size = src_file.size("clone_tag_key_dictionary:2");
+      Void_Pointer< uint8 > buf(size > 0 ? size : 1);
+      src_file.read(buf.ptr, size, "clone_tag_key_dictionary:3");
+      
+      Raw_File dest_file(dest_db_dir + "tag_key_dictionary", O_RDWR|O_CREAT|O_TRUNC, S_666,
+                         "clone_tag_key_dictionary:4");
+      dest_file.write(buf.ptr, size, "clone_tag_key_dictionary:5");
+    }
+    // From here on, codes are resolved with and added to the copy.
+    tag_key_dictionary().attach(dest_db_dir);
+  }
+  catch (File_Error e)
+  {
+    cout<<e.origin<<' '<<e.error_number<<' '<<strerror(e.error_number)<<' '<<e.filename<<'\n';
+  }
+}
+
+void clone_database(Transaction& transaction, string dest_db_dir, bool reencode_ways, bool reencode_tags)
 {
+  clone_tag_key_dictionary(transaction, dest_db_dir);
+  
   clone_bin_file< Uint32_Index >(*osm_base_settings().NODES, transaction, dest_db_dir);
   clone_map_file< Uint32_Index >(*osm_base_settings().NODES, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Local >(*osm_base_settings().NODE_TAGS_LOCAL, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Global >(*osm_base_settings().NODE_TAGS_GLOBAL, transaction, dest_db_dir);
+  clone_tag_files< Node >(*osm_base_settings().NODE_TAGS_LOCAL,
+      *osm_base_settings().NODE_TAGS_GLOBAL, transaction, dest_db_dir, reencode_tags);
   clone_bin_file< Uint32_Index >(*osm_base_settings().NODE_KEYS, transaction, dest_db_dir);
   
-  clone_bin_file< Uint31_Index >(*osm_base_settings().WAYS, transaction, dest_db_dir);
+  if (reencode_ways)
+    clone_reencoded_file< Uint31_Index, Way_Skeleton >
+        (*osm_base_settings().WAYS, transaction, dest_db_dir);
+  else
+    clone_bin_file< Uint31_Index >(*osm_base_settings().WAYS, transaction, dest_db_dir);
   clone_map_file< Uint31_Index >(*osm_base_settings().WAYS, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Local >(*osm_base_settings().WAY_TAGS_LOCAL, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Global >(*osm_base_settings().WAY_TAGS_GLOBAL, transaction, dest_db_dir);
+  clone_tag_files< Way >(*osm_base_settings().WAY_TAGS_LOCAL,
+      *osm_base_settings().WAY_TAGS_GLOBAL, transaction, dest_db_dir, reencode_tags);
   clone_bin_file< Uint32_Index >(*osm_base_settings().WAY_KEYS, transaction, dest_db_dir);
   
   clone_bin_file< Uint31_Index >(*osm_base_settings().RELATIONS, transaction, dest_db_dir);
   clone_map_file< Uint31_Index >(*osm_base_settings().RELATIONS, transaction, dest_db_dir);
   clone_bin_file< Uint32_Index >(*osm_base_settings().RELATION_ROLES, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Local >(*osm_base_settings().RELATION_TAGS_LOCAL, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Global >(*osm_base_settings().RELATION_TAGS_GLOBAL, transaction, dest_db_dir);
+  clone_tag_files< Relation >(*osm_base_settings().RELATION_TAGS_LOCAL,
+      *osm_base_settings().RELATION_TAGS_GLOBAL, transaction, dest_db_dir, reencode_tags);
   clone_bin_file< Uint32_Index >(*osm_base_settings().RELATION_KEYS, transaction, dest_db_dir);
   
   clone_bin_file< Uint31_Index >(*meta_settings().NODES_META, transaction, dest_db_dir);
@@ -128,22 +230,27 @@ void clone_database(Transaction& transaction, string dest_db_dir)
   clone_bin_file< Uint31_Index >(*meta_settings().RELATIONS_META, transaction, dest_db_dir);
   clone_bin_file< Uint32_Index >(*meta_settings().USER_DATA, transaction, dest_db_dir);
   clone_bin_file< Uint32_Index >(*meta_settings().USER_INDICES, transaction, dest_db_dir);
+  clone_bin_file< Uint32_Index >(*meta_settings().USER_NAMES, transaction, dest_db_dir);
   
   clone_bin_file< Uint31_Index >(*attic_settings().NODES, transaction, dest_db_dir);
   clone_map_file< Uint31_Index >(*attic_settings().NODES, transaction, dest_db_dir);
   clone_bin_file< Uint31_Index >(*attic_settings().NODES_UNDELETED, transaction, dest_db_dir);
   clone_bin_file< Node::Id_Type >(*attic_settings().NODE_IDX_LIST, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Local >(*attic_settings().NODE_TAGS_LOCAL, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Global >(*attic_settings().NODE_TAGS_GLOBAL, transaction, dest_db_dir);
+  clone_attic_tag_files< Node >(*attic_settings().NODE_TAGS_LOCAL,
+      *attic_settings().NODE_TAGS_GLOBAL, transaction, dest_db_dir, reencode_tags);
   clone_bin_file< Uint31_Index >(*attic_settings().NODES_META, transaction, dest_db_dir);
   clone_bin_file< Timestamp >(*attic_settings().NODE_CHANGELOG, transaction, dest_db_dir);
   
-  clone_bin_file< Uint31_Index >(*attic_settings().WAYS, transaction, dest_db_dir);
+  if (reencode_ways)
+    clone_reencoded_file< Uint31_Index, Attic< Way_Delta > >
+        (*attic_settings().WAYS, transaction, dest_db_dir);
+  else
+    clone_bin_file< Uint31_Index >(*attic_settings().WAYS, transaction, dest_db_dir);
   clone_map_file< Uint31_Index >(*attic_settings().WAYS, transaction, dest_db_dir);
   clone_bin_file< Uint31_Index >(*attic_settings().WAYS_UNDELETED, transaction, dest_db_dir);
   clone_bin_file< Way::Id_Type >(*attic_settings().WAY_IDX_LIST, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Local >(*attic_settings().WAY_TAGS_LOCAL, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Global >(*attic_settings().WAY_TAGS_GLOBAL, transaction, dest_db_dir);
+  clone_attic_tag_files< Way >(*attic_settings().WAY_TAGS_LOCAL,
+      *attic_settings().WAY_TAGS_GLOBAL, transaction, dest_db_dir, reencode_tags);
   clone_bin_file< Uint31_Index >(*attic_settings().WAYS_META, transaction, dest_db_dir);
   clone_bin_file< Timestamp >(*attic_settings().WAY_CHANGELOG, transaction, dest_db_dir);
   
@@ -151,8 +258,8 @@ void clone_database(Transaction& transaction, string dest_db_dir)
   clone_map_file< Uint31_Index >(*attic_settings().RELATIONS, transaction, dest_db_dir);
   clone_bin_file< Uint31_Index >(*attic_settings().RELATIONS_UNDELETED, transaction, dest_db_dir);
   clone_bin_file< Relation::Id_Type >(*attic_settings().RELATION_IDX_LIST, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Local >(*attic_settings().RELATION_TAGS_LOCAL, transaction, dest_db_dir);
-  clone_bin_file< Tag_Index_Global >(*attic_settings().RELATION_TAGS_GLOBAL, transaction, dest_db_dir);
+  clone_attic_tag_files< Relation >(*attic_settings().RELATION_TAGS_LOCAL,
+      *attic_settings().RELATION_TAGS_GLOBAL, transaction, dest_db_dir, reencode_tags);
   clone_bin_file< Uint31_Index >(*attic_settings().RELATIONS_META, transaction, dest_db_dir);
   clone_bin_file< Timestamp >(*attic_settings().RELATION_CHANGELOG, transaction, dest_db_dir);
 }
@@ -25,6 +25,13 @@
 
 using namespace std;
 
-void clone_database(Transaction& transaction, string dest_db_dir);
+/* Copies all data files of the transaction to dest_db_dir. The blocks are
+ * copied as they are, hence the objects keep their encoding. If reencode_ways
+ * is true, the ways and attic ways are instead decoded and written again in
+ * the encoding selected by compact_way_encoding(). Likewise, reencode_tags
+ * rewrites all tag files as selected by dictionary_tag_encoding(). The tag key
+ * dictionary is copied first and extended only in dest_db_dir. */
+void clone_database(Transaction& transaction, string dest_db_dir,
+                    bool reencode_ways = false, bool reencode_tags = false);
 
 #endif
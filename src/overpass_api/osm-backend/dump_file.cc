@@ -66,6 +66,7 @@ int main(int argc, char* args[])
   try
   {    
     Nonsynced_Transaction transaction(false, false, db_dir, "");
+    tag_key_dictionary().attach(transaction.get_db_dir());
 
     if (std::string("--nodes") == args[2])
     {
@@ -22,6 +22,7 @@
 #include <vector>
 
 #include <cstdio>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include "../../template_db/block_backend.h"
@@ -33,9 +34,68 @@
 using namespace std;
 
 
+void update_user_names(Transaction& transaction, const map< uint32, string >& user_by_id)
+{
+  map< Uint32_Index, set< User_Data > > db_to_delete;
+  map< Uint32_Index, set< User_Data > > db_to_insert;
+  
+  bool names_exist = false;
+  {
+    Block_Backend< Uint32_Index, User_Data > names_db
+        (transaction.data_index(meta_settings().USER_NAMES));
+    names_exist = !(names_db.flat_begin() == names_db.flat_end());
+  }
+  
+  Block_Backend< Uint32_Index, User_Data > user_db
+      (transaction.data_index(meta_settings().USER_DATA));
+  if (names_exist)
+  {
+    // Remove the entries for the old names of the changed users.
+    set< Uint32_Index > req;
+    for (map< uint32, string >::const_iterator it = user_by_id.begin();
+        it != user_by_id.end(); ++it)
+      req.insert(Uint32_Index(it->first & 0xffffff00));
+    
+    for (Block_Backend< Uint32_Index, User_Data >::Discrete_Iterator
+        it(user_db.discrete_begin(req.begin(), req.end()));
+        !(it == user_db.discrete_end()); ++it)
+    {
+      if (user_by_id.find(it.object().id) != user_by_id.end())
+	db_to_delete[user_name_index(it.object().name)].insert(it.object());
+    }
+  }
+  else
+  {
+    // The database predates the file of user names. Hence we build it from scratch.
+    for (Block_Backend< Uint32_Index, User_Data >::Flat_Iterator
+        it(user_db.flat_begin()); !(it == user_db.flat_end()); ++it)
+    {
+      if (user_by_id.find(it.object().id) == user_by_id.end())
+	db_to_insert[user_name_index(it.object().name)].insert(it.object());
+    }
+  }
+  
+  for (map< uint32, string >::const_iterator it = user_by_id.begin();
+      it != user_by_id.end(); ++it)
+  {
+    User_Data user_data;
+    user_data.id = it->first;
+    user_data.name = it->second;
+    db_to_insert[user_name_index(it->second)].insert(user_data);
+  }
+  
+  Block_Backend< Uint32_Index, User_Data > names_db
+      (transaction.data_index(meta_settings().USER_NAMES));
+  names_db.update(db_to_delete, db_to_insert);
+}
+
+
 void process_user_data(Transaction& transaction, map< uint32, string >& user_by_id,
 		       map< uint32, vector< uint32 > >& idxs_by_user_id)
 {
+  if (!user_by_id.empty())
+    update_user_names(transaction, user_by_id);
+  
   {
     map< Uint32_Index, set< User_Data > > db_to_delete;
     map< Uint32_Index, set< User_Data > > db_to_insert;
@@ -139,3 +199,71 @@ void rename_referred_file(const string& db_dir, const string& from, const string
       + file_prop.get_file_name_trunk() + to
       + file_prop.get_data_suffix()).c_str());
 }
+
+
+struct Merge_Worker_State
+{
+  Merge_Worker_State(const vector< Merge_Task* >& tasks_, Osm_Backend_Callback* callback_)
+    : tasks(&tasks_), callback(callback_), next_task(0)
+  {
+    pthread_mutex_init(&mutex, 0);
+  }
+  
+  ~Merge_Worker_State() { pthread_mutex_destroy(&mutex); }
+  
+  const vector< Merge_Task* >* tasks;
+  Osm_Backend_Callback* callback;
+  uint32 next_task;
+  // Protects errors and the calls to callback.
+  pthread_mutex_t mutex;
+  vector< File_Error > errors;
+};
+
+void* merge_worker(void* arg)
+{
+  Merge_Worker_State& state = *(Merge_Worker_State*)arg;
+  uint32 i = __sync_fetch_and_add(&state.next_task, 1);
+  while (i < state.tasks->size())
+  {
+    try
+    {
+      (*state.tasks)[i]->run();
+      pthread_mutex_lock(&state.mutex);
+      state.callback->partial_file_finished((*state.tasks)[i]->file_name());
+      pthread_mutex_unlock(&state.mutex);
+    }
+    catch (File_Error e)
+    {
+      pthread_mutex_lock(&state.mutex);
+      state.errors.push_back(e);
+      pthread_mutex_unlock(&state.mutex);
+    }
+    i = __sync_fetch_and_add(&state.next_task, 1);
+  }
+  return 0;
+}
+
+void run_merge_tasks(const vector< Merge_Task* >& tasks, uint32 num_threads,
+                     Osm_Backend_Callback* callback)
+{
+  Merge_Worker_State state(tasks, callback);
+  if (num_threads > tasks.size())
+    num_threads = tasks.size();
+  
+  // The calling thread is the first worker.
+  vector< pthread_t > threads;
+  for (uint32 i = 1; i < num_threads; ++i)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, 0, &merge_worker, &state) == 0)
+      threads.push_back(thread);
+  }
+  merge_worker(&state);
+  for (vector< pthread_t >::const_iterator it = threads.begin(); it != threads.end(); ++it)
+    pthread_join(*it, 0);
+  
+  for (vector< Merge_Task* >::const_iterator it = tasks.begin(); it != tasks.end(); ++it)
+    delete *it;
+  if (!state.errors.empty())
+    throw state.errors.front();
+}
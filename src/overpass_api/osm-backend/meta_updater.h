@@ -320,6 +320,47 @@ void merge_files
   from_transaction.remove_referred_files(file_prop);
 }
 
+/* One call of merge_files, to be run on a worker thread by run_merge_tasks. */
+class Merge_Task
+{
+  public:
+    virtual ~Merge_Task() {}
+    virtual void run() = 0;
+    virtual string file_name() const = 0;
+};
+
+template < typename TIndex, typename TObject >
+class Merge_Files_Task : public Merge_Task
+{
+  public:
+    Merge_Files_Task(Transaction_Collection& from_transaction_, Transaction& into_transaction_,
+                     const File_Properties& file_prop_)
+      : from_transaction(&from_transaction_), into_transaction(&into_transaction_),
+        file_prop(&file_prop_)
+    {
+      // Transactions open their indexes on first use, and that must not happen
+      // from several threads at once. Hence we open them here in advance.
+      for (vector< Transaction* >::const_iterator it = from_transaction->transactions.begin();
+          it != from_transaction->transactions.end(); ++it)
+        (*it)->data_index(file_prop);
+      into_transaction->data_index(file_prop);
+    }
+    
+    void run() { merge_files< TIndex, TObject >(*from_transaction, *into_transaction, *file_prop); }
+    string file_name() const { return file_prop->get_file_name_trunk(); }
+    
+  private:
+    Transaction_Collection* from_transaction;
+    Transaction* into_transaction;
+    const File_Properties* file_prop;
+};
+
+/* Runs the tasks on up to num_threads threads, each task on its own file, and
+ * reports every finished file to the callback. The tasks are deleted afterwards.
+ * If a task fails, the first File_Error is rethrown once all threads have ended. */
+void run_merge_tasks(const vector< Merge_Task* >& tasks, uint32 num_threads,
+                     Osm_Backend_Callback* callback);
+
 //-----------------------------------------------------------------------------
 
 template < class TObject, class TCompFunc, class TEqualFunc >
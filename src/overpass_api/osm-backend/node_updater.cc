@@ -718,10 +718,10 @@ void Node_Updater::update(Osm_Backend_Callback* callback, bool partial,
       from[2] += i;
       froms.push_back(from);
     }
-    merge_files(froms, "");
+    merge_files(froms, "", callback);
     
     if (update_counter >= 256)
-      merge_files(vector< string >(1, ".2"), ".1");
+      merge_files(vector< string >(1, ".2"), ".1", callback);
     if (update_counter >= 16)
     {
       vector< string > froms;
@@ -731,9 +731,9 @@ void Node_Updater::update(Osm_Backend_Callback* callback, bool partial,
 	from[2] += i;
 	froms.push_back(from);
       }
-      merge_files(froms, ".1");
+      merge_files(froms, ".1", callback);
       
-      merge_files(vector< string >(1, ".1"), "");
+      merge_files(vector< string >(1, ".1"), "", callback);
     }
     update_counter = 0;
     callback->partial_finished();
@@ -763,7 +763,7 @@ void Node_Updater::update(Osm_Backend_Callback* callback, bool partial,
 	from[2] += i;
 	froms.push_back(from);
       }
-      merge_files(froms, to);
+      merge_files(froms, to, callback);
       callback->partial_finished();
     }
     if (update_counter % 256 == 0)
@@ -777,7 +777,7 @@ void Node_Updater::update(Osm_Backend_Callback* callback, bool partial,
 	from[2] += i;
 	froms.push_back(from);
       }
-      merge_files(froms, ".2");
+      merge_files(froms, ".2", callback);
       callback->partial_finished();
     }
   }
@@ -810,19 +810,23 @@ void Node_Updater::update_node_ids
 }
 
 
-void Node_Updater::merge_files(const vector< string >& froms, string into)
+void Node_Updater::merge_files(const vector< string >& froms, string into,
+                               Osm_Backend_Callback* callback)
 {
   Transaction_Collection from_transactions(false, false, db_dir, froms);
   Nonsynced_Transaction into_transaction(true, false, db_dir, into);
-  ::merge_files< Uint32_Index, Node_Skeleton >
-      (from_transactions, into_transaction, *osm_base_settings().NODES);
-  ::merge_files< Tag_Index_Local, Node::Id_Type >
-      (from_transactions, into_transaction, *osm_base_settings().NODE_TAGS_LOCAL);
-  ::merge_files< Tag_Index_Global, Tag_Object_Global< Node::Id_Type > >
-      (from_transactions, into_transaction, *osm_base_settings().NODE_TAGS_GLOBAL);
+  
+  vector< Merge_Task* > tasks;
+  tasks.push_back(new Merge_Files_Task< Uint32_Index, Node_Skeleton >
+      (from_transactions, into_transaction, *osm_base_settings().NODES));
+  tasks.push_back(new Merge_Files_Task< Tag_Index_Local, Node::Id_Type >
+      (from_transactions, into_transaction, *osm_base_settings().NODE_TAGS_LOCAL));
+  tasks.push_back(new Merge_Files_Task< Tag_Index_Global, Tag_Object_Global< Node::Id_Type > >
+      (from_transactions, into_transaction, *osm_base_settings().NODE_TAGS_GLOBAL));
   if (meta)
   {
-    ::merge_files< Uint31_Index, OSM_Element_Metadata_Skeleton< Node::Id_Type > >
-        (from_transactions, into_transaction, *meta_settings().NODES_META);
+    tasks.push_back(new Merge_Files_Task< Uint31_Index, OSM_Element_Metadata_Skeleton< Node::Id_Type > >
+        (from_transactions, into_transaction, *meta_settings().NODES_META));
   }
+  run_merge_tasks(tasks, basic_settings().num_threads, callback);
 }
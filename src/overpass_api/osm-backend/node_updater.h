@@ -357,7 +357,7 @@ private:
   void update_node_ids(map< uint32, vector< Node::Id_Type > >& to_delete, bool record_minuscule_moves,
       const std::vector< std::pair< Node_Skeleton::Id_Type, Uint31_Index > >& new_idx_positions);
   
-  void merge_files(const vector< string >& froms, string into);
+  void merge_files(const vector< string >& froms, string into, Osm_Backend_Callback* callback);
 };
 
 
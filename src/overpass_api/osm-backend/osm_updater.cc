@@ -18,6 +18,7 @@
 
 #include "node_updater.h"
 #include "osm_updater.h"
+#include "pbf_reader.h"
 #include "relation_updater.h"
 #include "tags_updater.h"
 #include "way_updater.h"
@@ -32,10 +33,12 @@
 #include "../frontend/output.h"
 
 #include <dirent.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <cstdio>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -50,6 +53,62 @@
 
 namespace
 {
+  /* The elements parsed since the last update, in document order, and the update
+     the parser has asked for after them. The writer thread replays a batch on the
+     updaters while the parser already fills the next one. */
+  struct Parsed_Batch
+  {
+    enum Element { NODE, DELETED_NODE, WAY, DELETED_WAY, RELATION, DELETED_RELATION };
+    enum Action { NO_UPDATE, NODES_ELAPSED, WAYS_ELAPSED, RELATIONS_ELAPSED,
+        NODES_FINISHED, WAYS_FINISHED, ALL_FINISHED };
+    
+    Parsed_Batch() : action(NO_UPDATE), elapsed_id(0), state(0) {}
+    
+    vector< uint8 > order;
+    vector< Node > nodes;
+    vector< Way > ways;
+    vector< Relation > relations;
+    // The member roles are resolved to ids on the writer thread.
+    vector< vector< string > > roles;
+    vector< OSM_Element_Metadata > metas;
+    
+    Action action;
+    uint64 elapsed_id;
+    int state;
+  };
+  
+  void apply_batch(Parsed_Batch& batch);
+  
+  /* Runs apply_batch on a writer thread. At most capacity batches are in flight,
+     the one being written included, such that with capacity 1 the parser can fill
+     exactly one batch ahead. If the thread cannot be started, push applies the
+     batches synchronously. */
+  class Update_Pipeline
+  {
+    public:
+      Update_Pipeline(uint32 capacity);
+      ~Update_Pipeline();
+      
+      // Takes ownership of batch. Rethrows a File_Error of the writer thread.
+      void push(Parsed_Batch* batch);
+      // Waits until all batches are written. Rethrows a File_Error of the writer thread.
+      void close();
+      
+    private:
+      pthread_t thread;
+      bool running;
+      pthread_mutex_t mutex;
+      pthread_cond_t changed;
+      deque< Parsed_Batch* > batches;
+      uint32 capacity;
+      bool busy;
+      bool closing;
+      vector< File_Error > errors;
+      
+      static void* writer(void* arg);
+      void write_batches();
+  };
+  
   Node_Updater* node_updater;
   Update_Node_Logger* update_node_logger;
   Node current_node;
@@ -67,6 +126,10 @@ namespace
   const int DELETE = 1;
   uint flush_limit = 4*1024*1024;
   OSM_Element_Metadata* meta;
+  vector< string > current_roles;
+  
+  Parsed_Batch* batch;
+  Update_Pipeline* pipeline;
   
   uint32 osm_element_count;
   Osm_Backend_Callback* callback;
@@ -130,16 +193,22 @@ namespace
 	entry.type = Relation_Entry::WAY;
       else if (type == "relation")
 	entry.type = Relation_Entry::RELATION;
-      entry.role = relation_updater->get_role_id(role);
       current_relation.members.push_back(entry);
+      current_roles.push_back(role);
     }
   }
 
 
-  inline void node_start(const char **attr)
+  inline void start_nodes()
   {
     if (state == 0)
       state = IN_NODES;
+  }
+  
+  
+  inline void node_start(const char **attr)
+  {
+    start_nodes();
     if (meta)
       *meta = OSM_Element_Metadata();
     
@@ -177,36 +246,48 @@ namespace
   }
   
   
+  inline void submit_batch(Parsed_Batch::Action action, uint64 elapsed_id = 0)
+  {
+    batch->action = action;
+    batch->elapsed_id = elapsed_id;
+    batch->state = state;
+    Parsed_Batch* full_batch = batch;
+    batch = new Parsed_Batch();
+    pipeline->push(full_batch);
+  }
+  
+  
   inline void node_end()
   {
-    if (modify_mode == DELETE)
-      node_updater->set_id_deleted(current_node.id, meta);
-    else
-      node_updater->set_node(current_node, meta);
+    batch->order.push_back(modify_mode == DELETE ? Parsed_Batch::DELETED_NODE : Parsed_Batch::NODE);
+    batch->nodes.push_back(current_node);
+    if (meta)
+      batch->metas.push_back(*meta);
     if (osm_element_count >= flush_limit)
     {
-      callback->node_elapsed(current_node.id);
-      node_updater->update(callback, true, update_node_logger);
-      callback->parser_started();
+      submit_batch(Parsed_Batch::NODES_ELAPSED, current_node.id.val());
       osm_element_count = 0;
     }
     current_node.id = Node::Id_Type();
   }
   
   
-  inline void way_start(const char **attr)
+  inline void start_ways()
   {
     if (state == IN_NODES)
     {
-      callback->nodes_finished();
-      node_updater->update(callback, false, update_node_logger);
-      //way_updater->update_moved_idxs(callback, node_updater->get_moved_nodes(), update_way_logger);
-      callback->parser_started();
+      submit_batch(Parsed_Batch::NODES_FINISHED);
       osm_element_count = 0;
       state = IN_WAYS;
     }
     else if (state == 0)
       state = IN_WAYS;
+  }
+  
+  
+  inline void way_start(const char **attr)
+  {
+    start_ways();
     if (meta)
       *meta = OSM_Element_Metadata();
     
@@ -240,17 +321,13 @@ namespace
 
   inline void way_end()
   {
-    if (modify_mode == DELETE)
-      way_updater->set_id_deleted(current_way.id, meta);
-    else
-      way_updater->set_way(current_way, meta);
+    batch->order.push_back(modify_mode == DELETE ? Parsed_Batch::DELETED_WAY : Parsed_Batch::WAY);
+    batch->ways.push_back(current_way);
+    if (meta)
+      batch->metas.push_back(*meta);
     if (osm_element_count >= flush_limit)
     {
-      callback->way_elapsed(current_way.id);
-      way_updater->update(callback, true, update_way_logger,
-                          node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
-                          node_updater->get_new_attic_skeletons());
-      callback->parser_started();
+      submit_batch(Parsed_Batch::WAYS_ELAPSED, current_way.id.val());
       osm_element_count = 0;
     }
     current_way.id = 0u;
@@ -259,51 +336,43 @@ namespace
   
   inline void relation_end()
   {
-    if (modify_mode == DELETE)
-      relation_updater->set_id_deleted(current_relation.id, meta);
-    else
-      relation_updater->set_relation(current_relation, meta);
+    batch->order.push_back(modify_mode == DELETE ? Parsed_Batch::DELETED_RELATION : Parsed_Batch::RELATION);
+    batch->relations.push_back(current_relation);
+    batch->roles.push_back(vector< string >());
+    batch->roles.back().swap(current_roles);
+    if (meta)
+      batch->metas.push_back(*meta);
     if (osm_element_count >= flush_limit)
     {
-      callback->relation_elapsed(current_relation.id);
-      relation_updater->update(callback, update_relation_logger,
-                          node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
-                          node_updater->get_new_attic_skeletons(),
-                          way_updater->get_new_skeletons(), way_updater->get_attic_skeletons(),
-                          way_updater->get_new_attic_skeletons());
-      callback->parser_started();
+      submit_batch(Parsed_Batch::RELATIONS_ELAPSED, current_relation.id.val());
       osm_element_count = 0;
     }
     current_relation.id = 0u;
   }  
 
 
-  inline void relation_start(const char **attr)
+  inline void start_relations()
   {
     if (state == IN_NODES)
     {
-      callback->nodes_finished();
-      node_updater->update(callback, false, update_node_logger);
-//       relation_updater->update_moved_idxs
-//           (node_updater->get_moved_nodes(), way_updater->get_moved_ways(), update_relation_logger);
-      callback->parser_started();
+      submit_batch(Parsed_Batch::NODES_FINISHED);
       osm_element_count = 0;
       state = IN_RELATIONS;
     }
     else if (state == IN_WAYS)
     {
-      callback->ways_finished();
-      way_updater->update(callback, false, update_way_logger,
-                          node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
-                          node_updater->get_new_attic_skeletons());
-//       relation_updater->update_moved_idxs
-//           (node_updater->get_moved_nodes(), way_updater->get_moved_ways(), update_relation_logger);
-      callback->parser_started();
+      submit_batch(Parsed_Batch::WAYS_FINISHED);
       osm_element_count = 0;
       state = IN_RELATIONS;
     }
     else if (state == 0)
       state = IN_RELATIONS;
+  }
+  
+  
+  inline void relation_start(const char **attr)
+  {
+    start_relations();
     if (meta)
       *meta = OSM_Element_Metadata();
     
@@ -332,6 +401,289 @@ namespace
 	meta->user_id = atoi(attr[i+1]);
     }
     current_relation = Relation(id.val());
+    current_roles.clear();
+  }
+  
+  
+  /* The callbacks for parse_pbf. They take the same path as the XML elements, and
+     they count every tag, node reference and member as one element towards the
+     flush limit as the XML parser does. */
+  
+  void pbf_node(const Node& node, const OSM_Element_Metadata* element_meta, bool deleted)
+  {
+    start_nodes();
+    if (meta)
+      *meta = (element_meta ? *element_meta : OSM_Element_Metadata());
+    current_node = node;
+    modify_mode = (deleted ? DELETE : 0);
+    node_end();
+    modify_mode = 0;
+    osm_element_count += 1 + node.tags.size();
+  }
+  
+  
+  void pbf_way(const Way& way, const OSM_Element_Metadata* element_meta, bool deleted)
+  {
+    start_ways();
+    if (meta)
+      *meta = (element_meta ? *element_meta : OSM_Element_Metadata());
+    current_way = way;
+    modify_mode = (deleted ? DELETE : 0);
+    way_end();
+    modify_mode = 0;
+    osm_element_count += 1 + way.tags.size() + way.nds.size();
+  }
+  
+  
+  void pbf_relation(const Relation& relation, const vector< string >& roles,
+                    const OSM_Element_Metadata* element_meta, bool deleted)
+  {
+    start_relations();
+    if (meta)
+      *meta = (element_meta ? *element_meta : OSM_Element_Metadata());
+    current_relation = relation;
+    current_roles = roles;
+    modify_mode = (deleted ? DELETE : 0);
+    relation_end();
+    modify_mode = 0;
+    osm_element_count += 1 + relation.tags.size() + relation.members.size();
+  }
+  
+  
+  void apply_batch(Parsed_Batch& batch)
+  {
+    vector< Node >::const_iterator node_it = batch.nodes.begin();
+    vector< Way >::const_iterator way_it = batch.ways.begin();
+    vector< Relation >::iterator relation_it = batch.relations.begin();
+    vector< vector< string > >::const_iterator roles_it = batch.roles.begin();
+    vector< OSM_Element_Metadata >::const_iterator meta_it = batch.metas.begin();
+    for (vector< uint8 >::const_iterator it = batch.order.begin(); it != batch.order.end(); ++it)
+    {
+      const OSM_Element_Metadata* element_meta = (meta_it == batch.metas.end() ? 0 : &*(meta_it++));
+      if (*it == Parsed_Batch::NODE)
+        node_updater->set_node(*(node_it++), element_meta);
+      else if (*it == Parsed_Batch::DELETED_NODE)
+        node_updater->set_id_deleted((node_it++)->id, element_meta);
+      else if (*it == Parsed_Batch::WAY)
+        way_updater->set_way(*(way_it++), element_meta);
+      else if (*it == Parsed_Batch::DELETED_WAY)
+        way_updater->set_id_deleted((way_it++)->id, element_meta);
+      else
+      {
+        for (uint i = 0; i < relation_it->members.size(); ++i)
+          relation_it->members[i].role = relation_updater->get_role_id((*roles_it)[i]);
+        if (*it == Parsed_Batch::RELATION)
+          relation_updater->set_relation(*relation_it, element_meta);
+        else
+          relation_updater->set_id_deleted(relation_it->id, element_meta);
+        ++relation_it;
+        ++roles_it;
+      }
+    }
+    
+    // The elements are now owned by the updaters.
+    vector< uint8 >().swap(batch.order);
+    vector< Node >().swap(batch.nodes);
+    vector< Way >().swap(batch.ways);
+    vector< Relation >().swap(batch.relations);
+    vector< vector< string > >().swap(batch.roles);
+    vector< OSM_Element_Metadata >().swap(batch.metas);
+    
+    if (batch.action == Parsed_Batch::NODES_ELAPSED)
+    {
+      callback->node_elapsed(batch.elapsed_id);
+      node_updater->update(callback, true, update_node_logger);
+      callback->parser_started();
+    }
+    else if (batch.action == Parsed_Batch::WAYS_ELAPSED)
+    {
+      callback->way_elapsed((uint32)batch.elapsed_id);
+      way_updater->update(callback, true, update_way_logger,
+                          node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
+                          node_updater->get_new_attic_skeletons());
+      callback->parser_started();
+    }
+    else if (batch.action == Parsed_Batch::RELATIONS_ELAPSED)
+    {
+      callback->relation_elapsed((uint32)batch.elapsed_id);
+      relation_updater->update(callback, update_relation_logger,
+                          node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
+                          node_updater->get_new_attic_skeletons(),
+                          way_updater->get_new_skeletons(), way_updater->get_attic_skeletons(),
+                          way_updater->get_new_attic_skeletons());
+      callback->parser_started();
+    }
+    else if (batch.action == Parsed_Batch::NODES_FINISHED)
+    {
+      callback->nodes_finished();
+      node_updater->update(callback, false, update_node_logger);
+      //way_updater->update_moved_idxs(callback, node_updater->get_moved_nodes(), update_way_logger);
+      callback->parser_started();
+    }
+    else if (batch.action == Parsed_Batch::WAYS_FINISHED)
+    {
+      callback->ways_finished();
+      way_updater->update(callback, false, update_way_logger,
+                          node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
+                          node_updater->get_new_attic_skeletons());
+//       relation_updater->update_moved_idxs
+//           (node_updater->get_moved_nodes(), way_updater->get_moved_ways(), update_relation_logger);
+      callback->parser_started();
+    }
+    else if (batch.action == Parsed_Batch::ALL_FINISHED)
+    {
+      int state = batch.state;
+      if (state == IN_NODES)
+        callback->nodes_finished();
+      else if (state == IN_WAYS)
+        callback->ways_finished();
+      else if (state == IN_RELATIONS)
+        callback->relations_finished();
+      
+      if (state == IN_NODES)
+      {
+        node_updater->update(callback, false, update_node_logger);
+        //way_updater->update_moved_idxs(callback, node_updater->get_moved_nodes(), update_way_logger);
+        state = IN_WAYS;
+      }
+      if (state == IN_WAYS)
+      {  
+        way_updater->update(callback, false, update_way_logger,
+                            node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
+                            node_updater->get_new_attic_skeletons());
+//         relation_updater->update_moved_idxs
+//             (node_updater->get_moved_nodes(), way_updater->get_moved_ways(), update_relation_logger);
+        state = IN_RELATIONS;
+      }
+      if (state == IN_RELATIONS)
+        relation_updater->update(callback, update_relation_logger,
+                            node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
+                            node_updater->get_new_attic_skeletons(),
+                            way_updater->get_new_skeletons(), way_updater->get_attic_skeletons(),
+                            way_updater->get_new_attic_skeletons());
+    }
+  }
+  
+  
+  Update_Pipeline::Update_Pipeline(uint32 capacity_)
+    : running(false), capacity(capacity_), busy(false), closing(false)
+  {
+    pthread_mutex_init(&mutex, 0);
+    pthread_cond_init(&changed, 0);
+    running = (pthread_create(&thread, 0, &Update_Pipeline::writer, this) == 0);
+  }
+  
+  
+  Update_Pipeline::~Update_Pipeline()
+  {
+    try
+    {
+      close();
+    }
+    catch (File_Error e) {}
+    for (deque< Parsed_Batch* >::const_iterator it = batches.begin(); it != batches.end(); ++it)
+      delete *it;
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+  }
+  
+  
+  void Update_Pipeline::push(Parsed_Batch* batch)
+  {
+    if (!running)
+    {
+      try
+      {
+        apply_batch(*batch);
+      }
+      catch (File_Error e)
+      {
+        delete batch;
+        throw e;
+      }
+      delete batch;
+      return;
+    }
+    
+    pthread_mutex_lock(&mutex);
+    while (errors.empty() && batches.size() + (busy ? 1 : 0) >= capacity)
+      pthread_cond_wait(&changed, &mutex);
+    if (!errors.empty())
+    {
+      File_Error e = errors.front();
+      pthread_mutex_unlock(&mutex);
+      delete batch;
+      throw e;
+    }
+    batches.push_back(batch);
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+  }
+  
+  
+  void Update_Pipeline::close()
+  {
+    if (running)
+    {
+      pthread_mutex_lock(&mutex);
+      closing = true;
+      pthread_cond_broadcast(&changed);
+      pthread_mutex_unlock(&mutex);
+      pthread_join(thread, 0);
+      running = false;
+    }
+    if (!errors.empty())
+    {
+      File_Error e = errors.front();
+      errors.clear();
+      throw e;
+    }
+  }
+  
+  
+  void* Update_Pipeline::writer(void* arg)
+  {
+    ((Update_Pipeline*)arg)->write_batches();
+    return 0;
+  }
+  
+  
+  void Update_Pipeline::write_batches()
+  {
+    pthread_mutex_lock(&mutex);
+    while (true)
+    {
+      while (batches.empty() && !closing)
+        pthread_cond_wait(&changed, &mutex);
+      if (batches.empty())
+        break;
+      Parsed_Batch* batch = batches.front();
+      batches.pop_front();
+      busy = true;
+      bool failed = !errors.empty();
+      pthread_mutex_unlock(&mutex);
+      
+      // After an error the remaining batches are discarded.
+      if (!failed)
+      {
+        try
+        {
+          apply_batch(*batch);
+        }
+        catch (File_Error e)
+        {
+          pthread_mutex_lock(&mutex);
+          errors.push_back(e);
+          pthread_mutex_unlock(&mutex);
+        }
+      }
+      delete batch;
+      
+      pthread_mutex_lock(&mutex);
+      busy = false;
+      pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&mutex);
   }
 }
 
@@ -575,10 +927,14 @@ void complete_user_data(Transaction& transaction,
   update_way_logger.request_user_names(user_names);
   update_relation_logger.request_user_names(user_names);
    
+  set< Uint32_Index > req;
+  for (map< uint32, string >::const_iterator it = user_names.begin(); it != user_names.end(); ++it)
+    req.insert(Uint32_Index(it->first & 0xffffff00));
+  
   Block_Backend< Uint32_Index, User_Data > user_db
       (transaction.data_index(meta_settings().USER_DATA));
-  for (Block_Backend< Uint32_Index, User_Data >::Flat_Iterator
-      it(user_db.flat_begin()); !(it == user_db.flat_end()); ++it)
+  for (Block_Backend< Uint32_Index, User_Data >::Discrete_Iterator
+      it(user_db.discrete_begin(req.begin(), req.end())); !(it == user_db.discrete_end()); ++it)
   {
     map< uint32, string >::iterator mit = user_names.find(it.object().id);
     if (mit != user_names.end())
@@ -1634,34 +1990,8 @@ void print_augmented_diff(Update_Node_Logger& update_node_logger,
 
 void Osm_Updater::finish_updater()
 {
-  if (state == IN_NODES)
-    callback->nodes_finished();
-  else if (state == IN_WAYS)
-    callback->ways_finished();
-  else if (state == IN_RELATIONS)
-    callback->relations_finished();
-  
-  if (state == IN_NODES)
-  {
-    node_updater->update(callback, false, update_node_logger);
-    //way_updater->update_moved_idxs(callback, node_updater->get_moved_nodes(), update_way_logger);
-    state = IN_WAYS;
-  }
-  if (state == IN_WAYS)
-  {  
-    way_updater->update(callback, false, update_way_logger,
-                        node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
-                        node_updater->get_new_attic_skeletons());
-//     relation_updater->update_moved_idxs
-//         (node_updater->get_moved_nodes(), way_updater->get_moved_ways(), update_relation_logger);
-    state = IN_RELATIONS;
-  }
-  if (state == IN_RELATIONS)
-    relation_updater->update(callback, update_relation_logger,
-                          node_updater->get_new_skeletons(), node_updater->get_attic_skeletons(),
-                          node_updater->get_new_attic_skeletons(),
-                          way_updater->get_new_skeletons(), way_updater->get_attic_skeletons(),
-                          way_updater->get_new_attic_skeletons());
+  submit_batch(Parsed_Batch::ALL_FINISHED);
+  pipeline->close();
   
   flush();
   callback->parser_succeeded();
@@ -1675,6 +2005,14 @@ void Osm_Updater::parse_file_completely(FILE* in)
   finish_updater();
 }
 
+void Osm_Updater::parse_pbf_completely(FILE* in)
+{
+  callback->parser_started();
+  parse_pbf(in, pbf_node, pbf_way, pbf_relation, basic_settings().num_threads);
+  
+  finish_updater();
+}
+
 void parse_nodes_only(FILE* in)
 {
   parse(in, node_start, node_end);
@@ -1690,6 +2028,21 @@ void parse_relations_only(FILE* in)
   parse(in, relation_start, relation_end);
 }
 
+void parse_pbf_nodes_only(FILE* in)
+{
+  parse_pbf(in, pbf_node, 0, 0, basic_settings().num_threads);
+}
+
+void parse_pbf_ways_only(FILE* in)
+{
+  parse_pbf(in, 0, pbf_way, 0, basic_settings().num_threads);
+}
+
+void parse_pbf_relations_only(FILE* in)
+{
+  parse_pbf(in, 0, 0, pbf_relation, basic_settings().num_threads);
+}
+
 Osm_Updater::Osm_Updater(Osm_Backend_Callback* callback_, const string& data_version_,
 			 meta_modes meta_, bool produce_augmented_diffs, unsigned int flush_limit_)
   : dispatcher_client(0), meta(meta_)
@@ -1701,6 +2054,7 @@ Osm_Updater::Osm_Updater(Osm_Backend_Callback* callback_, const string& data_ver
   logger.annotated_log("write_start() end");
   transaction = new Nonsynced_Transaction
       (true, true, dispatcher_client->get_db_dir(), "");
+  tag_key_dictionary().attach(dispatcher_client->get_db_dir());
   {
     ofstream version((dispatcher_client->get_db_dir()
         + "osm_base_version.shadow").c_str());
@@ -1728,6 +2082,8 @@ Osm_Updater::Osm_Updater(Osm_Backend_Callback* callback_, const string& data_ver
   callback = callback_;
   if (meta)
     ::meta = new OSM_Element_Metadata();
+  ::batch = new Parsed_Batch();
+  ::pipeline = new Update_Pipeline(1);
 }
 
 Osm_Updater::Osm_Updater
@@ -1735,6 +2091,7 @@ Osm_Updater::Osm_Updater
      meta_modes meta_, bool produce_augmented_diffs, unsigned int flush_limit_)
   : transaction(0), dispatcher_client(0), db_dir_(db_dir), meta(meta_)
 {
+  tag_key_dictionary().attach(db_dir);
   {
     ofstream version((db_dir + "osm_base_version").c_str());
     version<<data_version_<<'\n';
@@ -1761,6 +2118,8 @@ Osm_Updater::Osm_Updater
   callback = callback_;
   if (meta)
     ::meta = new OSM_Element_Metadata();
+  ::batch = new Parsed_Batch();
+  ::pipeline = new Update_Pipeline(1);
 }
 
 void Osm_Updater::flush()
@@ -1796,6 +2155,12 @@ void Osm_Updater::flush()
 
 Osm_Updater::~Osm_Updater()
 {
+  // The writer thread must have ended before the updaters go away.
+  delete ::pipeline;
+  ::pipeline = 0;
+  delete ::batch;
+  ::batch = 0;
+  
   delete node_updater_;
   delete update_node_logger_;
   delete way_updater_;
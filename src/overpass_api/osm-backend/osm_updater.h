@@ -43,6 +43,7 @@ class Osm_Updater
 
     void finish_updater();
     void parse_file_completely(FILE* in);
+    void parse_pbf_completely(FILE* in);
     
   private:
     Nonsynced_Transaction* transaction;
@@ -63,4 +64,8 @@ void parse_nodes_only(FILE* in);
 void parse_ways_only(FILE* in);
 void parse_relations_only(FILE* in);
 
+void parse_pbf_nodes_only(FILE* in);
+void parse_pbf_ways_only(FILE* in);
+void parse_pbf_relations_only(FILE* in);
+
 #endif
@@ -0,0 +1,866 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../../template_db/types.h"
+#include "../../template_db/zlib_wrapper.h"
+#include "../core/compact_coding.h"
+#include "../core/datatypes.h"
+#include "pbf_reader.h"
+
+
+namespace
+{
+  const uint32 MAX_BLOB_HEADER_SIZE = 64*1024;
+  const uint32 MAX_BLOB_SIZE = 32*1024*1024;
+
+
+  /* A cursor over the fields of one protobuf message. */
+  class Pbf_Message
+  {
+    public:
+      Pbf_Message(const uint8* begin, const uint8* end_)
+        : pos(begin), end(end_), field(0), wire_type(0) {}
+
+      // Advances to the next field. Returns false at the end of the message.
+      bool next()
+      {
+        if (pos == end)
+          return false;
+        uint64 key = varint();
+        field = key>>3;
+        wire_type = key & 0x7;
+        return true;
+      }
+
+      uint32 tag() const { return field; }
+
+      uint64 varint()
+      {
+        uint64 value = 0;
+        for (uint32 shift = 0; shift < 64; shift += 7)
+        {
+          if (pos == end)
+            throw File_Error(0, "(pbf)", "parse_pbf:1");
+          uint8 byte = *(pos++);
+          value |= ((uint64)(byte & 0x7f))<<shift;
+          if (!(byte & 0x80))
+            return value;
+        }
+        throw File_Error(0, "(pbf)", "parse_pbf:2");
+      }
+
+      int64 svarint() { return zigzag_decode(varint()); }
+
+      Pbf_Message message()
+      {
+        const uint8* begin = 0;
+        const uint8* stop = 0;
+        bytes(begin, stop);
+        return Pbf_Message(begin, stop);
+      }
+
+      string string_value()
+      {
+        const uint8* begin = 0;
+        const uint8* stop = 0;
+        bytes(begin, stop);
+        return string((const char*)begin, stop - begin);
+      }
+
+      void bytes(const uint8*& begin, const uint8*& stop)
+      {
+        if (wire_type != 2)
+          throw File_Error(0, "(pbf)", "parse_pbf:3");
+        uint64 size = varint();
+        if (size > uint64(end - pos))
+          throw File_Error(0, "(pbf)", "parse_pbf:4");
+        begin = pos;
+        pos += size;
+        stop = pos;
+      }
+
+      // Repeated integer fields may come packed or one value per field.
+      void append_varints(vector< uint64 >& values)
+      {
+        if (wire_type == 0)
+          values.push_back(varint());
+        else
+        {
+          Pbf_Message packed = message();
+          while (packed.pos != packed.end)
+            values.push_back(packed.varint());
+        }
+      }
+
+      void skip()
+      {
+        if (wire_type == 0)
+          varint();
+        else if (wire_type == 2)
+        {
+          const uint8* begin = 0;
+          const uint8* stop = 0;
+          bytes(begin, stop);
+        }
+        else if ((wire_type == 1 && end - pos >= 8) || (wire_type == 5 && end - pos >= 4))
+          pos += (wire_type == 1 ? 8 : 4);
+        else
+          throw File_Error(0, "(pbf)", "parse_pbf:5");
+      }
+
+    private:
+      const uint8* pos;
+      const uint8* end;
+      uint32 field;
+      uint32 wire_type;
+  };
+
+
+  struct Pbf_Block_Context
+  {
+    Pbf_Block_Context() : granularity(100), lat_offset(0), lon_offset(0), date_granularity(1000) {}
+
+    vector< string > strings;
+    int64 granularity;
+    int64 lat_offset;
+    int64 lon_offset;
+    int64 date_granularity;
+
+    const string& string_at(uint64 index) const
+    {
+      if (index >= strings.size())
+        throw File_Error(0, "(pbf)", "parse_pbf:6");
+      return strings[index];
+    }
+
+    double lat(int64 value) const { return .000000001*(lat_offset + granularity*value); }
+    double lon(int64 value) const { return .000000001*(lon_offset + granularity*value); }
+
+    uint64 timestamp(int64 value) const
+    {
+      time_t seconds = value*date_granularity/1000;
+      struct tm time;
+      gmtime_r(&seconds, &time);
+      return Timestamp(time.tm_year + 1900, time.tm_mon + 1, time.tm_mday,
+          time.tm_hour, time.tm_min, time.tm_sec).timestamp;
+    }
+  };
+
+
+  /* The decoded elements of one data blob, in file order. */
+  struct Pbf_Block
+  {
+    enum Element { NODE, WAY, RELATION };
+
+    vector< uint8 > order;
+    vector< Node > nodes;
+    vector< Way > ways;
+    vector< Relation > relations;
+    vector< vector< string > > roles;
+    // The following are indexed like order.
+    vector< OSM_Element_Metadata > metas;
+    vector< bool > has_meta;
+    vector< bool > deleted;
+
+    void push_back(Element type, const OSM_Element_Metadata& meta, bool with_meta, bool visible)
+    {
+      order.push_back(type);
+      metas.push_back(meta);
+      has_meta.push_back(with_meta);
+      deleted.push_back(!visible);
+    }
+  };
+
+
+  OSM_Element_Metadata empty_meta()
+  {
+    OSM_Element_Metadata meta;
+    meta.version = 0;
+    meta.timestamp = 0;
+    meta.changeset = 0;
+    meta.user_id = 0;
+    return meta;
+  }
+
+
+  void read_info(Pbf_Message info, const Pbf_Block_Context& context,
+                 OSM_Element_Metadata& meta, bool& visible)
+  {
+    while (info.next())
+    {
+      if (info.tag() == 1)
+        meta.version = info.varint();
+      else if (info.tag() == 2)
+        meta.timestamp = context.timestamp(info.varint());
+      else if (info.tag() == 3)
+        meta.changeset = info.varint();
+      else if (info.tag() == 4)
+        meta.user_id = info.varint();
+      else if (info.tag() == 5)
+        meta.user_name = context.string_at(info.varint());
+      else if (info.tag() == 6)
+        visible = (info.varint() != 0);
+      else
+        info.skip();
+    }
+  }
+
+
+  void set_tags(const vector< uint64 >& keys, const vector< uint64 >& vals,
+                const Pbf_Block_Context& context, vector< pair< string, string > >& tags)
+  {
+    if (keys.size() != vals.size())
+      throw File_Error(0, "(pbf)", "parse_pbf:7");
+    for (uint i = 0; i < keys.size(); ++i)
+      tags.push_back(make_pair(context.string_at(keys[i]), context.string_at(vals[i])));
+  }
+
+
+  void decode_node(Pbf_Message message, const Pbf_Block_Context& context, Pbf_Block& block)
+  {
+    int64 id = 0;
+    int64 lat = 0;
+    int64 lon = 0;
+    vector< uint64 > keys;
+    vector< uint64 > vals;
+    OSM_Element_Metadata meta = empty_meta();
+    bool with_meta = false;
+    bool visible = true;
+
+    while (message.next())
+    {
+      if (message.tag() == 1)
+        id = message.svarint();
+      else if (message.tag() == 2)
+        message.append_varints(keys);
+      else if (message.tag() == 3)
+        message.append_varints(vals);
+      else if (message.tag() == 4)
+      {
+        read_info(message.message(), context, meta, visible);
+        with_meta = true;
+      }
+      else if (message.tag() == 8)
+        lat = message.svarint();
+      else if (message.tag() == 9)
+        lon = message.svarint();
+      else
+        message.skip();
+    }
+
+    block.nodes.push_back(Node(id, context.lat(lat), context.lon(lon)));
+    set_tags(keys, vals, context, block.nodes.back().tags);
+    block.push_back(Pbf_Block::NODE, meta, with_meta, visible);
+  }
+
+
+  void decode_dense_nodes(Pbf_Message message, const Pbf_Block_Context& context, Pbf_Block& block)
+  {
+    vector< uint64 > ids;
+    vector< uint64 > lats;
+    vector< uint64 > lons;
+    vector< uint64 > keys_vals;
+    vector< uint64 > versions;
+    vector< uint64 > timestamps;
+    vector< uint64 > changesets;
+    vector< uint64 > user_ids;
+    vector< uint64 > user_sids;
+    vector< uint64 > visibles;
+
+    while (message.next())
+    {
+      if (message.tag() == 1)
+        message.append_varints(ids);
+      else if (message.tag() == 5)
+      {
+        Pbf_Message info = message.message();
+        while (info.next())
+        {
+          if (info.tag() == 1)
+            info.append_varints(versions);
+          else if (info.tag() == 2)
+            info.append_varints(timestamps);
+          else if (info.tag() == 3)
+            info.append_varints(changesets);
+          else if (info.tag() == 4)
+            info.append_varints(user_ids);
+          else if (info.tag() == 5)
+            info.append_varints(user_sids);
+          else if (info.tag() == 6)
+            info.append_varints(visibles);
+          else
+            info.skip();
+        }
+      }
+      else if (message.tag() == 8)
+        message.append_varints(lats);
+      else if (message.tag() == 9)
+        message.append_varints(lons);
+      else if (message.tag() == 10)
+        message.append_varints(keys_vals);
+      else
+        message.skip();
+    }
+
+    bool with_meta = !versions.empty();
+    if (lats.size() != ids.size() || lons.size() != ids.size()
+        || (with_meta && (versions.size() != ids.size() || timestamps.size() != ids.size()
+            || changesets.size() != ids.size() || user_ids.size() != ids.size()
+            || user_sids.size() != ids.size()))
+        || (!visibles.empty() && visibles.size() != ids.size()))
+      throw File_Error(0, "(pbf)", "parse_pbf:8");
+
+    int64 id = 0;
+    int64 lat = 0;
+    int64 lon = 0;
+    int64 timestamp = 0;
+    int64 changeset = 0;
+    int64 user_id = 0;
+    int64 user_sid = 0;
+    vector< uint64 >::const_iterator kv_it = keys_vals.begin();
+    for (uint i = 0; i < ids.size(); ++i)
+    {
+      id += zigzag_decode(ids[i]);
+      lat += zigzag_decode(lats[i]);
+      lon += zigzag_decode(lons[i]);
+      block.nodes.push_back(Node(id, context.lat(lat), context.lon(lon)));
+
+      // The tags of all nodes follow each other, each node's list terminated by a zero.
+      while (kv_it != keys_vals.end() && *kv_it != 0)
+      {
+        if (kv_it + 1 == keys_vals.end())
+          throw File_Error(0, "(pbf)", "parse_pbf:9");
+        block.nodes.back().tags.push_back
+            (make_pair(context.string_at(*kv_it), context.string_at(*(kv_it + 1))));
+        kv_it += 2;
+      }
+      if (kv_it != keys_vals.end())
+        ++kv_it;
+
+      OSM_Element_Metadata meta = empty_meta();
+      if (with_meta)
+      {
+        timestamp += zigzag_decode(timestamps[i]);
+        changeset += zigzag_decode(changesets[i]);
+        user_id += zigzag_decode(user_ids[i]);
+        user_sid += zigzag_decode(user_sids[i]);
+        meta.version = versions[i];
+        meta.timestamp = context.timestamp(timestamp);
+        meta.changeset = changeset;
+        meta.user_id = user_id;
+        meta.user_name = context.string_at(user_sid);
+      }
+      block.push_back(Pbf_Block::NODE, meta, with_meta, visibles.empty() || visibles[i] != 0);
+    }
+  }
+
+
+  void decode_way(Pbf_Message message, const Pbf_Block_Context& context, Pbf_Block& block)
+  {
+    int64 id = 0;
+    vector< uint64 > keys;
+    vector< uint64 > vals;
+    vector< uint64 > refs;
+    OSM_Element_Metadata meta = empty_meta();
+    bool with_meta = false;
+    bool visible = true;
+
+    while (message.next())
+    {
+      if (message.tag() == 1)
+        id = message.varint();
+      else if (message.tag() == 2)
+        message.append_varints(keys);
+      else if (message.tag() == 3)
+        message.append_varints(vals);
+      else if (message.tag() == 4)
+      {
+        read_info(message.message(), context, meta, visible);
+        with_meta = true;
+      }
+      else if (message.tag() == 8)
+        message.append_varints(refs);
+      else
+        message.skip();
+    }
+
+    block.ways.push_back(Way(id));
+    Way& way = block.ways.back();
+    set_tags(keys, vals, context, way.tags);
+    int64 ref = 0;
+    for (vector< uint64 >::const_iterator it = refs.begin(); it != refs.end(); ++it)
+    {
+      ref += zigzag_decode(*it);
+      way.nds.push_back(ref);
+    }
+    block.push_back(Pbf_Block::WAY, meta, with_meta, visible);
+  }
+
+
+  void decode_relation(Pbf_Message message, const Pbf_Block_Context& context, Pbf_Block& block)
+  {
+    int64 id = 0;
+    vector< uint64 > keys;
+    vector< uint64 > vals;
+    vector< uint64 > role_sids;
+    vector< uint64 > member_ids;
+    vector< uint64 > types;
+    OSM_Element_Metadata meta = empty_meta();
+    bool with_meta = false;
+    bool visible = true;
+
+    while (message.next())
+    {
+      if (message.tag() == 1)
+        id = message.varint();
+      else if (message.tag() == 2)
+        message.append_varints(keys);
+      else if (message.tag() == 3)
+        message.append_varints(vals);
+      else if (message.tag() == 4)
+      {
+        read_info(message.message(), context, meta, visible);
+        with_meta = true;
+      }
+      else if (message.tag() == 8)
+        message.append_varints(role_sids);
+      else if (message.tag() == 9)
+        message.append_varints(member_ids);
+      else if (message.tag() == 10)
+        message.append_varints(types);
+      else
+        message.skip();
+    }
+    if (role_sids.size() != member_ids.size() || types.size() != member_ids.size())
+      throw File_Error(0, "(pbf)", "parse_pbf:10");
+
+    block.relations.push_back(Relation(id));
+    Relation& relation = block.relations.back();
+    set_tags(keys, vals, context, relation.tags);
+    block.roles.push_back(vector< string >());
+    int64 ref = 0;
+    for (uint i = 0; i < member_ids.size(); ++i)
+    {
+      ref += zigzag_decode(member_ids[i]);
+      Relation_Entry entry;
+      entry.ref = ref;
+      if (types[i] == 0)
+        entry.type = Relation_Entry::NODE;
+      else if (types[i] == 1)
+        entry.type = Relation_Entry::WAY;
+      else if (types[i] == 2)
+        entry.type = Relation_Entry::RELATION;
+      relation.members.push_back(entry);
+      block.roles.back().push_back(context.string_at(role_sids[i]));
+    }
+    block.push_back(Pbf_Block::RELATION, meta, with_meta, visible);
+  }
+
+
+  struct Pbf_Filter
+  {
+    bool nodes;
+    bool ways;
+    bool relations;
+  };
+
+
+  void decode_primitive_block(const string& data, const Pbf_Filter& filter, Pbf_Block& block)
+  {
+    const uint8* begin = (const uint8*)data.data();
+    const uint8* end = begin + data.size();
+    Pbf_Block_Context context;
+
+    // The groups are decoded in a second pass because they depend on all other fields.
+    Pbf_Message message(begin, end);
+    while (message.next())
+    {
+      if (message.tag() == 1)
+      {
+        Pbf_Message string_table = message.message();
+        while (string_table.next())
+        {
+          if (string_table.tag() == 1)
+            context.strings.push_back(string_table.string_value());
+          else
+            string_table.skip();
+        }
+      }
+      else if (message.tag() == 17)
+        context.granularity = message.varint();
+      else if (message.tag() == 18)
+        context.date_granularity = message.varint();
+      else if (message.tag() == 19)
+        context.lat_offset = message.varint();
+      else if (message.tag() == 20)
+        context.lon_offset = message.varint();
+      else
+        message.skip();
+    }
+
+    message = Pbf_Message(begin, end);
+    while (message.next())
+    {
+      if (message.tag() != 2)
+      {
+        message.skip();
+        continue;
+      }
+      Pbf_Message group = message.message();
+      while (group.next())
+      {
+        if (group.tag() == 1 && filter.nodes)
+          decode_node(group.message(), context, block);
+        else if (group.tag() == 2 && filter.nodes)
+          decode_dense_nodes(group.message(), context, block);
+        else if (group.tag() == 3 && filter.ways)
+          decode_way(group.message(), context, block);
+        else if (group.tag() == 4 && filter.relations)
+          decode_relation(group.message(), context, block);
+        else
+          group.skip();
+      }
+    }
+  }
+
+
+  // Returns the uncompressed content of a Blob message.
+  string blob_content(const string& blob)
+  {
+    Pbf_Message message((const uint8*)blob.data(), (const uint8*)blob.data() + blob.size());
+    uint64 raw_size = 0;
+    const uint8* raw_begin = 0;
+    const uint8* raw_end = 0;
+    const uint8* zlib_begin = 0;
+    const uint8* zlib_end = 0;
+    while (message.next())
+    {
+      if (message.tag() == 1)
+        message.bytes(raw_begin, raw_end);
+      else if (message.tag() == 2)
+        raw_size = message.varint();
+      else if (message.tag() == 3)
+        message.bytes(zlib_begin, zlib_end);
+      else if (message.tag() >= 4 && message.tag() <= 7)
+        // lzma, bzip2, lz4 and zstd are not supported.
+        throw File_Error(0, "(pbf)", "parse_pbf:11");
+      else
+        message.skip();
+    }
+
+    if (raw_begin)
+      return string((const char*)raw_begin, raw_end - raw_begin);
+    if (!zlib_begin || raw_size > MAX_BLOB_SIZE)
+      throw File_Error(0, "(pbf)", "parse_pbf:12");
+
+    string result(raw_size, 0);
+    if (raw_size > 0)
+    {
+      Zlib_Inflate inflate;
+      if (inflate.decompress(zlib_begin, zlib_end - zlib_begin, &result[0], raw_size) != raw_size)
+        throw File_Error(0, "(pbf)", "parse_pbf:13");
+    }
+    return result;
+  }
+
+
+  void check_header_block(const string& data)
+  {
+    Pbf_Message message((const uint8*)data.data(), (const uint8*)data.data() + data.size());
+    while (message.next())
+    {
+      if (message.tag() == 4)
+      {
+        string feature = message.string_value();
+        if (feature != "OsmSchema-V0.6" && feature != "DenseNodes" && feature != "HistoricalInformation")
+          throw File_Error(0, "(pbf) " + feature, "parse_pbf:14");
+      }
+      else
+        message.skip();
+    }
+  }
+
+
+  // Reads the next blob. Returns false at the end of the file.
+  bool read_blob(FILE* in, string& type, string& blob)
+  {
+    uint8 size_buf[4];
+    size_t size_read = fread(size_buf, 1, 4, in);
+    if (size_read == 0 && feof(in))
+      return false;
+    if (size_read != 4)
+      throw File_Error(ferror(in) ? errno : 0, "(pbf)", "parse_pbf:15");
+    uint32 header_size = (uint32(size_buf[0])<<24) | (uint32(size_buf[1])<<16)
+        | (uint32(size_buf[2])<<8) | uint32(size_buf[3]);
+    if (header_size > MAX_BLOB_HEADER_SIZE)
+      throw File_Error(0, "(pbf)", "parse_pbf:16");
+
+    string header(header_size, 0);
+    if (header_size > 0 && fread(&header[0], 1, header_size, in) != header_size)
+      throw File_Error(ferror(in) ? errno : 0, "(pbf)", "parse_pbf:17");
+    uint64 data_size = 0;
+    type = "";
+    Pbf_Message message((const uint8*)header.data(), (const uint8*)header.data() + header.size());
+    while (message.next())
+    {
+      if (message.tag() == 1)
+        type = message.string_value();
+      else if (message.tag() == 3)
+        data_size = message.varint();
+      else
+        message.skip();
+    }
+    if (data_size > MAX_BLOB_SIZE)
+      throw File_Error(0, "(pbf)", "parse_pbf:18");
+
+    blob.assign(data_size, 0);
+    if (data_size > 0 && fread(&blob[0], 1, data_size, in) != data_size)
+      throw File_Error(ferror(in) ? errno : 0, "(pbf)", "parse_pbf:19");
+    return true;
+  }
+
+
+  struct Pbf_Slot
+  {
+    enum Status { READ, DECODING, DECODED };
+
+    Pbf_Slot() : status(READ) {}
+
+    string blob;
+    Status status;
+    Pbf_Block block;
+    vector< File_Error > errors;
+  };
+
+
+  void decode_slot(Pbf_Slot& slot, const Pbf_Filter& filter)
+  {
+    try
+    {
+      decode_primitive_block(blob_content(slot.blob), filter, slot.block);
+    }
+    catch (File_Error e)
+    {
+      slot.errors.push_back(e);
+    }
+    string().swap(slot.blob);
+  }
+
+
+  /* The blobs read ahead, in file order. Decoder threads take the first blob not yet
+     taken, and the reading thread consumes them from the front. */
+  struct Pbf_Decoder_State
+  {
+    Pbf_Decoder_State(const Pbf_Filter& filter_) : filter(filter_), closing(false)
+    {
+      pthread_mutex_init(&mutex, 0);
+      pthread_cond_init(&changed, 0);
+    }
+
+    ~Pbf_Decoder_State()
+    {
+      for (deque< Pbf_Slot* >::const_iterator it = slots.begin(); it != slots.end(); ++it)
+        delete *it;
+      pthread_cond_destroy(&changed);
+      pthread_mutex_destroy(&mutex);
+    }
+
+    Pbf_Filter filter;
+    deque< Pbf_Slot* > slots;
+    bool closing;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+  };
+
+
+  // Must be called with the mutex held.
+  Pbf_Slot* next_undecoded(Pbf_Decoder_State& state)
+  {
+    for (deque< Pbf_Slot* >::const_iterator it = state.slots.begin(); it != state.slots.end(); ++it)
+    {
+      if ((*it)->status == Pbf_Slot::READ)
+        return *it;
+    }
+    return 0;
+  }
+
+
+  void* pbf_decoder(void* arg)
+  {
+    Pbf_Decoder_State& state = *(Pbf_Decoder_State*)arg;
+    pthread_mutex_lock(&state.mutex);
+    while (!state.closing)
+    {
+      Pbf_Slot* slot = next_undecoded(state);
+      if (!slot)
+      {
+        pthread_cond_wait(&state.changed, &state.mutex);
+        continue;
+      }
+      slot->status = Pbf_Slot::DECODING;
+      pthread_mutex_unlock(&state.mutex);
+
+      decode_slot(*slot, state.filter);
+
+      pthread_mutex_lock(&state.mutex);
+      slot->status = Pbf_Slot::DECODED;
+      pthread_cond_broadcast(&state.changed);
+    }
+    pthread_mutex_unlock(&state.mutex);
+    return 0;
+  }
+
+
+  void stop_decoders(Pbf_Decoder_State& state, const vector< pthread_t >& threads)
+  {
+    pthread_mutex_lock(&state.mutex);
+    state.closing = true;
+    pthread_cond_broadcast(&state.changed);
+    pthread_mutex_unlock(&state.mutex);
+    for (vector< pthread_t >::const_iterator it = threads.begin(); it != threads.end(); ++it)
+      pthread_join(*it, 0);
+  }
+
+
+  void deliver_block(const Pbf_Block& block,
+      void (*node_callback)(const Node&, const OSM_Element_Metadata*, bool),
+      void (*way_callback)(const Way&, const OSM_Element_Metadata*, bool),
+      void (*relation_callback)(const Relation&, const vector< string >&,
+                                const OSM_Element_Metadata*, bool))
+  {
+    vector< Node >::const_iterator node_it = block.nodes.begin();
+    vector< Way >::const_iterator way_it = block.ways.begin();
+    vector< Relation >::const_iterator relation_it = block.relations.begin();
+    vector< vector< string > >::const_iterator roles_it = block.roles.begin();
+    for (uint i = 0; i < block.order.size(); ++i)
+    {
+      const OSM_Element_Metadata* meta = (block.has_meta[i] ? &block.metas[i] : 0);
+      if (block.order[i] == Pbf_Block::NODE)
+        node_callback(*(node_it++), meta, block.deleted[i]);
+      else if (block.order[i] == Pbf_Block::WAY)
+        way_callback(*(way_it++), meta, block.deleted[i]);
+      else
+        relation_callback(*(relation_it++), *(roles_it++), meta, block.deleted[i]);
+    }
+  }
+}
+
+
+void parse_pbf(FILE* in,
+    void (*node_callback)(const Node& node, const OSM_Element_Metadata* meta, bool deleted),
+    void (*way_callback)(const Way& way, const OSM_Element_Metadata* meta, bool deleted),
+    void (*relation_callback)(const Relation& relation, const vector< string >& roles,
+                              const OSM_Element_Metadata* meta, bool deleted),
+    uint32 num_threads)
+{
+  Pbf_Filter filter;
+  filter.nodes = (node_callback != 0);
+  filter.ways = (way_callback != 0);
+  filter.relations = (relation_callback != 0);
+
+  Pbf_Decoder_State state(filter);
+  vector< pthread_t > threads;
+  for (uint32 i = 0; i < num_threads; ++i)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, 0, &pbf_decoder, &state) == 0)
+      threads.push_back(thread);
+  }
+  // Enough blobs are read ahead to keep all decoders busy while the front one is delivered.
+  uint32 read_ahead = 2*threads.size() + 1;
+
+  try
+  {
+    bool eof = false;
+    while (true)
+    {
+      while (!eof && state.slots.size() < read_ahead)
+      {
+        string type;
+        string blob;
+        eof = !read_blob(in, type, blob);
+        if (eof)
+          break;
+        if (type == "OSMHeader")
+          check_header_block(blob_content(blob));
+        else if (type == "OSMData")
+        {
+          Pbf_Slot* slot = new Pbf_Slot();
+          slot->blob.swap(blob);
+          pthread_mutex_lock(&state.mutex);
+          state.slots.push_back(slot);
+          pthread_cond_broadcast(&state.changed);
+          pthread_mutex_unlock(&state.mutex);
+        }
+        // Blobs of other types are skipped as the format demands.
+      }
+
+      pthread_mutex_lock(&state.mutex);
+      if (state.slots.empty())
+      {
+        pthread_mutex_unlock(&state.mutex);
+        break;
+      }
+      Pbf_Slot* slot = state.slots.front();
+      if (slot->status == Pbf_Slot::READ)
+      {
+        // No decoder has got to it yet, hence we decode it ourselves.
+        slot->status = Pbf_Slot::DECODING;
+        pthread_mutex_unlock(&state.mutex);
+        decode_slot(*slot, filter);
+        pthread_mutex_lock(&state.mutex);
+        slot->status = Pbf_Slot::DECODED;
+      }
+      while (slot->status != Pbf_Slot::DECODED)
+        pthread_cond_wait(&state.changed, &state.mutex);
+      state.slots.pop_front();
+      pthread_mutex_unlock(&state.mutex);
+
+      if (!slot->errors.empty())
+      {
+        File_Error e = slot->errors.front();
+        delete slot;
+        throw e;
+      }
+      try
+      {
+        deliver_block(slot->block, node_callback, way_callback, relation_callback);
+      }
+      catch (File_Error e)
+      {
+        delete slot;
+        throw e;
+      }
+      delete slot;
+    }
+  }
+  catch (File_Error e)
+  {
+    stop_decoders(state, threads);
+    throw e;
+  }
+  stop_decoders(state, threads);
+}
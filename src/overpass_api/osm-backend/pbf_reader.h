@@ -0,0 +1,51 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Overpass_API.
+*
+* Overpass_API is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Overpass_API is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___OVERPASS_API__OSM_BACKEND__PBF_READER_H
+#define DE__OSM3S___OVERPASS_API__OSM_BACKEND__PBF_READER_H
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "../core/datatypes.h"
+
+using namespace std;
+
+
+/** Reads an OSM PBF file and passes its elements in file order to the callbacks,
+    in the same manner as parse() does for XML. The blobs are decompressed and decoded
+    on num_threads worker threads while the calling thread runs the callbacks, hence
+    the callbacks need not be thread safe.
+
+    An element type whose callback is 0 is skipped without decoding. meta is 0 if
+    the file has no metadata for the element. Elements with visible=false in a history
+    file are passed as deleted. The roles of a relation are passed as strings alongside
+    the members; the role ids in the members are left unset.
+
+    Throws File_Error on malformed or unsupported input. */
+void parse_pbf(FILE* in,
+    void (*node_callback)(const Node& node, const OSM_Element_Metadata* meta, bool deleted),
+    void (*way_callback)(const Way& way, const OSM_Element_Metadata* meta, bool deleted),
+    void (*relation_callback)(const Relation& relation, const vector< string >& roles,
+                              const OSM_Element_Metadata* meta, bool deleted),
+    uint32 num_threads);
+
+
+#endif
@@ -39,6 +39,7 @@ int main(int argc, char* argv[])
   bool transactional = true;
   meta_modes meta = only_data;
   bool produce_augmented_diffs = false;
+  bool pbf = false;
   bool abort = false;
   unsigned int flush_limit = 16*1024*1024;
   
@@ -66,6 +67,76 @@ int main(int argc, char* argv[])
       if (flush_limit == 0)
         flush_limit = std::numeric_limits< unsigned int >::max();
     }
+    else if (!(strncmp(argv[argpos], "--compression-method=", 21)))
+    {
+      if (string(argv[argpos]).substr(21) == "gz")
+        basic_settings().compression_method = File_Blocks_Index_Base::ZLIB_COMPRESSION;
+      else if (string(argv[argpos]).substr(21) == "no")
+        basic_settings().compression_method = File_Blocks_Index_Base::NO_COMPRESSION;
+      else
+      {
+        cerr<<"Unknown compression method: "<<string(argv[argpos]).substr(21)<<'\n';
+        abort = true;
+      }
+    }
+    else if (!(strncmp(argv[argpos], "--checksum-method=", 18)))
+    {
+      if (string(argv[argpos]).substr(18) == "crc32c")
+        basic_settings().checksum_method = File_Blocks_Index_Base::CRC32C_CHECKSUM;
+      else if (string(argv[argpos]).substr(18) == "no")
+        basic_settings().checksum_method = File_Blocks_Index_Base::NO_CHECKSUM;
+      else
+      {
+        cerr<<"Unknown checksum method: "<<string(argv[argpos]).substr(18)<<'\n';
+        abort = true;
+      }
+    }
+    else if (!(strncmp(argv[argpos], "--io-backend=", 13)))
+    {
+      if (string(argv[argpos]).substr(13) == "posix")
+        basic_settings().io_backend = Block_Device::POSIX_IO;
+      else if (string(argv[argpos]).substr(13) == "direct")
+        basic_settings().io_backend = Block_Device::DIRECT_IO;
+      else if (string(argv[argpos]).substr(13) == "uring")
+        basic_settings().io_backend = Block_Device::URING_IO;
+      else
+      {
+        cerr<<"Unknown io backend: "<<string(argv[argpos]).substr(13)<<'\n';
+        abort = true;
+      }
+    }
+    else if (!(strncmp(argv[argpos], "--way-encoding=", 15)))
+    {
+      if (string(argv[argpos]).substr(15) == "compact")
+        compact_way_encoding() = true;
+      else if (string(argv[argpos]).substr(15) == "plain")
+        compact_way_encoding() = false;
+      else
+      {
+        cerr<<"Unknown way encoding: "<<string(argv[argpos]).substr(15)<<'\n';
+        abort = true;
+      }
+    }
+    else if (!(strncmp(argv[argpos], "--tag-encoding=", 15)))
+    {
+      if (string(argv[argpos]).substr(15) == "dictionary")
+        dictionary_tag_encoding() = true;
+      else if (string(argv[argpos]).substr(15) == "plain")
+        dictionary_tag_encoding() = false;
+      else
+      {
+        cerr<<"Unknown tag encoding: "<<string(argv[argpos]).substr(15)<<'\n';
+        abort = true;
+      }
+    }
+    else if (!(strcmp(argv[argpos], "--pbf")))
+      pbf = true;
+    else if (!(strncmp(argv[argpos], "--threads=", 10)))
+    {
+      basic_settings().num_threads = atoi(string(argv[argpos]).substr(10).c_str());
+      if (basic_settings().num_threads == 0)
+        basic_settings().num_threads = 1;
+    }
     else
     {
       cerr<<"Unkown argument: "<<argv[argpos]<<'\n';
@@ -80,7 +151,7 @@ int main(int argc, char* argv[])
   }
   if (abort)
   {
-    cerr<<"Usage: "<<argv[0]<<" [--db-dir=DIR] [--version=VER] [--meta|--keep-attic] [--produce-diff]\n";
+    cerr<<"Usage: "<<argv[0]<<" [--db-dir=DIR] [--version=VER] [--meta|--keep-attic] [--produce-diff] [--compression-method=no|gz] [--checksum-method=no|crc32c] [--io-backend=posix|direct|uring] [--way-encoding=plain|compact] [--tag-encoding=plain|dictionary] [--threads=N] [--pbf]\n";
     return 0;
   }
   
@@ -91,14 +162,20 @@ int main(int argc, char* argv[])
       Osm_Updater osm_updater(get_verbatim_callback(), data_version, meta,
                               produce_augmented_diffs, flush_limit);
       //reading the main document
-      osm_updater.parse_file_completely(stdin);
+      if (pbf)
+        osm_updater.parse_pbf_completely(stdin);
+      else
+        osm_updater.parse_file_completely(stdin);
     }
     else
     {
       Osm_Updater osm_updater(get_verbatim_callback(), db_dir, data_version, meta,
                               produce_augmented_diffs, flush_limit);
       //reading the main document
-      osm_updater.parse_file_completely(stdin);
+      if (pbf)
+        osm_updater.parse_pbf_completely(stdin);
+      else
+        osm_updater.parse_file_completely(stdin);
     }
   }
   catch (File_Error e)
@@ -42,18 +42,21 @@ struct Node_Caller
 {
   public:
     static void parse(FILE* osc_file) { parse_nodes_only(osc_file); }
+    static void parse_pbf(FILE* pbf_file) { parse_pbf_nodes_only(pbf_file); }
 };
 
 struct Way_Caller
 {
   public:
     static void parse(FILE* osc_file) { parse_ways_only(osc_file); }
+    static void parse_pbf(FILE* pbf_file) { parse_pbf_ways_only(pbf_file); }
 };
 
 struct Relation_Caller
 {
   public:
     static void parse(FILE* osc_file) { parse_relations_only(osc_file); }
+    static void parse_pbf(FILE* pbf_file) { parse_pbf_relations_only(pbf_file); }
 };
 
 template < class Caller >
@@ -72,7 +75,10 @@ void process_source_files(const string& source_dir,
     if (osc_file)
     {
       //reading the main document
-      Caller::parse(osc_file);
+      if (it->size() > 4 && it->substr(it->size() - 4) == ".pbf")
+        Caller::parse_pbf(osc_file);
+      else
+        Caller::parse(osc_file);
       
       fclose(osc_file);
     }
@@ -121,6 +127,12 @@ int main(int argc, char* argv[])
       if (flush_limit == 0)
         flush_limit = std::numeric_limits< unsigned int >::max();
     }
+    else if (!(strncmp(argv[argpos], "--threads=", 10)))
+    {
+      basic_settings().num_threads = atoi(string(argv[argpos]).substr(10).c_str());
+      if (basic_settings().num_threads == 0)
+        basic_settings().num_threads = 1;
+    }
     else
     {
       cerr<<"Unkown argument: "<<argv[argpos]<<'\n';
@@ -136,7 +148,7 @@ int main(int argc, char* argv[])
   if (abort)
   {
     cerr<<"Usage: "<<argv[0]<<" --osc-dir=DIR"
-          " [--db-dir=DIR] [--version=VER] [--meta|--keep-attic] [--produce-diff]\n";
+          " [--db-dir=DIR] [--version=VER] [--meta|--keep-attic] [--produce-diff] [--threads=N]\n";
     return -1;
   }
   
@@ -1061,10 +1061,10 @@ void Way_Updater::update(Osm_Backend_Callback* callback, bool partial,
       from[2] += i;
       froms.push_back(from);
     }
-    merge_files(froms, "");
+    merge_files(froms, "", callback);
     
     if (update_counter >= 256)
-      merge_files(vector< string >(1, ".2"), ".1");
+      merge_files(vector< string >(1, ".2"), ".1", callback);
     if (update_counter >= 16)
     {
       vector< string > froms;
@@ -1074,9 +1074,9 @@ void Way_Updater::update(Osm_Backend_Callback* callback, bool partial,
        from[2] += i;
        froms.push_back(from);
       }
-      merge_files(froms, ".1");
+      merge_files(froms, ".1", callback);
       
-      merge_files(vector< string >(1, ".1"), "");
+      merge_files(vector< string >(1, ".1"), "", callback);
     }
     update_counter = 0;
     callback->partial_finished();
@@ -1106,7 +1106,7 @@ void Way_Updater::update(Osm_Backend_Callback* callback, bool partial,
        from[2] += i;
        froms.push_back(from);
       }
-      merge_files(froms, to);
+      merge_files(froms, to, callback);
       callback->partial_finished();
     }
     if (update_counter % 256 == 0)
@@ -1120,26 +1120,30 @@ void Way_Updater::update(Osm_Backend_Callback* callback, bool partial,
        from[2] += i;
        froms.push_back(from);
       }
-      merge_files(froms, ".2");
+      merge_files(froms, ".2", callback);
       callback->partial_finished();
     }
   }  
 }
 
 
-void Way_Updater::merge_files(const vector< string >& froms, string into)
+void Way_Updater::merge_files(const vector< string >& froms, string into,
+                              Osm_Backend_Callback* callback)
 {
   Transaction_Collection from_transactions(false, false, db_dir, froms);
   Nonsynced_Transaction into_transaction(true, false, db_dir, into);
-  ::merge_files< Uint31_Index, Way_Skeleton >
-      (from_transactions, into_transaction, *osm_base_settings().WAYS);
-  ::merge_files< Tag_Index_Local, Way::Id_Type >
-      (from_transactions, into_transaction, *osm_base_settings().WAY_TAGS_LOCAL);
-  ::merge_files< Tag_Index_Global, Tag_Object_Global< Way::Id_Type > >
-      (from_transactions, into_transaction, *osm_base_settings().WAY_TAGS_GLOBAL);
+  
+  vector< Merge_Task* > tasks;
+  tasks.push_back(new Merge_Files_Task< Uint31_Index, Way_Skeleton >
+      (from_transactions, into_transaction, *osm_base_settings().WAYS));
+  tasks.push_back(new Merge_Files_Task< Tag_Index_Local, Way::Id_Type >
+      (from_transactions, into_transaction, *osm_base_settings().WAY_TAGS_LOCAL));
+  tasks.push_back(new Merge_Files_Task< Tag_Index_Global, Tag_Object_Global< Way::Id_Type > >
+      (from_transactions, into_transaction, *osm_base_settings().WAY_TAGS_GLOBAL));
   if (meta)
   {
-    ::merge_files< Uint31_Index, OSM_Element_Metadata_Skeleton< Way::Id_Type > >
-        (from_transactions, into_transaction, *meta_settings().WAYS_META);
+    tasks.push_back(new Merge_Files_Task< Uint31_Index, OSM_Element_Metadata_Skeleton< Way::Id_Type > >
+        (from_transactions, into_transaction, *meta_settings().WAYS_META));
   }
+  run_merge_tasks(tasks, basic_settings().num_threads, callback);
 }
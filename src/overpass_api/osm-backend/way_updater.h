@@ -388,7 +388,7 @@ private:
   
   Key_Storage keys;
   
-  void merge_files(const vector< string >& froms, string into);
+  void merge_files(const vector< string >& froms, string into, Osm_Backend_Callback* callback);
 };
 
 #endif
@@ -310,6 +310,44 @@ bool Area_Constraint::delivers_data(Resource_Manager& rman)
 }
 
 
+namespace
+{
+  // Decides for coordinates of the index ll_index whether they are inside one of the areas.
+  // Each area block is decoded once and tested against all coordinates together.
+  void check_inside_areas
+      (uint32 ll_index, const map< Area_Skeleton::Id_Type, vector< Area_Block > >& areas,
+       const vector< uint32 >& coord_lats, const vector< int32 >& coord_lons, bool add_border,
+       vector< bool >& inside)
+  {
+    inside.assign(coord_lats.size(), false);
+    vector< int > area_state;
+    vector< int > checks;
+    for (map< Area_Skeleton::Id_Type, vector< Area_Block > >::const_iterator it = areas.begin();
+         it != areas.end(); ++it)
+    {
+      area_state.assign(coord_lats.size(), 0);
+      for (vector< Area_Block >::const_iterator it2 = it->second.begin(); it2 != it->second.end();
+           ++it2)
+      {
+        Coord_Query_Statement::check_area_block(ll_index, *it2, coord_lats, coord_lons, checks);
+        for (vector< int >::size_type i = 0; i < checks.size(); ++i)
+        {
+          if (checks[i] == Coord_Query_Statement::HIT && add_border)
+            inside[i] = true;
+          else if (checks[i] != 0)
+            area_state[i] ^= checks[i];
+        }
+      }
+      for (vector< int >::size_type i = 0; i < area_state.size(); ++i)
+      {
+        if (area_state[i] != 0)
+          inside[i] = true;
+      }
+    }
+  }
+}
+
+
 void Area_Query_Statement::collect_nodes
     (const set< pair< Uint32_Index, Uint32_Index > >& nodes_req,
      const set< Uint31_Index >& req,
@@ -325,6 +363,12 @@ void Area_Query_Statement::collect_nodes
       area_it(area_blocks_db.discrete_begin(req.begin(), req.end()));
   Block_Backend< Uint32_Index, Node_Skeleton >::Range_Iterator
       nodes_it(nodes_db.range_begin(nodes_req.begin(), nodes_req.end()));
+  
+  vector< pair< Uint32_Index, Node_Skeleton > > candidates;
+  vector< uint32 > coord_lats;
+  vector< int32 > coord_lons;
+  vector< bool > inside;
+  
   uint32 current_idx(0);
   if (!(area_it == area_blocks_db.discrete_end()))
     current_idx = area_it.index().val();
@@ -340,45 +384,29 @@ void Area_Query_Statement::collect_nodes
 	areas[area_it.object().id].push_back(area_it.object());
       ++area_it;
     }
+    
+    candidates.clear();
+    coord_lats.clear();
+    coord_lons.clear();
     while ((!(nodes_it == nodes_db.range_end())) &&
         ((nodes_it.index().val() & 0xffffff00) == current_idx))
     {
-      if ((ids != 0) &&
-	  (!binary_search(ids->begin(), ids->end(), nodes_it.object().id)))
-      {
-	++nodes_it;
-	continue;
-      }
-      
-      uint32 ilat((::lat(nodes_it.index().val(), nodes_it.object().ll_lower)
-          + 91.0)*10000000+0.5);
-      int32 ilon(::lon(nodes_it.index().val(), nodes_it.object().ll_lower)*10000000
-          + (::lon(nodes_it.index().val(), nodes_it.object().ll_lower) > 0
-	      ? 0.5 : -0.5));
-      for (map< Area_Skeleton::Id_Type, vector< Area_Block > >::const_iterator it = areas.begin();
-	   it != areas.end(); ++it)
+      if ((ids == 0) ||
+	  (binary_search(ids->begin(), ids->end(), nodes_it.object().id)))
       {
-        int inside = 0;
-        for (vector< Area_Block >::const_iterator it2 = it->second.begin(); it2 != it->second.end();
-	     ++it2)
-        {
-	  int check(Coord_Query_Statement::check_area_block(current_idx, *it2, ilat, ilon));
-	  if (check == Coord_Query_Statement::HIT)
-	  {
-	    inside = 1;
-	    break;
-	  }
-	  else if (check != 0)
-	    inside ^= check;
-        }
-        if (inside)
-	{
-	  nodes[nodes_it.index()].push_back(nodes_it.object());
-	  break;
-	}
+        candidates.push_back(make_pair(nodes_it.index(), nodes_it.object()));
+        coord_lats.push_back(::ilat(nodes_it.index().val(), nodes_it.object().ll_lower));
+        coord_lons.push_back(::ilon(nodes_it.index().val(), nodes_it.object().ll_lower));
       }
       ++nodes_it;
     }
+    
+    check_inside_areas(current_idx, areas, coord_lats, coord_lons, true, inside);
+    for (vector< bool >::size_type i = 0; i < inside.size(); ++i)
+    {
+      if (inside[i])
+        nodes[candidates[i].first].push_back(candidates[i].second);
+    }
     current_idx = area_it.index().val();
   }
 }
@@ -397,6 +425,10 @@ void Area_Query_Statement::collect_nodes
 
   typename std::map< Uint32_Index, vector< Node_Skeleton > >::iterator nodes_it = nodes.begin();
   
+  vector< uint32 > coord_lats;
+  vector< int32 > coord_lons;
+  vector< bool > inside;
+  
   uint32 current_idx(0);
   while (!(area_it == area_blocks_db.discrete_end()))
   {
@@ -417,42 +449,35 @@ void Area_Query_Statement::collect_nodes
       nodes_it->second.clear();
       ++nodes_it;
     }
-    while (nodes_it != nodes.end() &&
-        (nodes_it->first.val() & 0xffffff00) == current_idx)
+    
+    // Decode the coordinates of all nodes of this index first to test them together.
+    coord_lats.clear();
+    coord_lons.clear();
+    typename std::map< Uint32_Index, vector< Node_Skeleton > >::iterator index_end = nodes_it;
+    while (index_end != nodes.end() &&
+        (index_end->first.val() & 0xffffff00) == current_idx)
+    {
+      for (typename std::vector< Node_Skeleton >::const_iterator iit = index_end->second.begin();
+          iit != index_end->second.end(); ++iit)
+      {
+        coord_lats.push_back(::ilat(index_end->first.val(), iit->ll_lower));
+        coord_lons.push_back(::ilon(index_end->first.val(), iit->ll_lower));
+      }
+      ++index_end;
+    }
+    check_inside_areas(current_idx, areas, coord_lats, coord_lons, add_border, inside);
+    
+    vector< bool >::const_iterator inside_it = inside.begin();
+    for (; nodes_it != index_end; ++nodes_it)
     {
       std::vector< Node_Skeleton > into;
       for (typename std::vector< Node_Skeleton >::const_iterator iit = nodes_it->second.begin();
-          iit != nodes_it->second.end(); ++iit)
+          iit != nodes_it->second.end(); ++iit, ++inside_it)
       {
-        uint32 ilat((::lat(nodes_it->first.val(), iit->ll_lower)
-            + 91.0)*10000000+0.5);
-        int32 ilon(::lon(nodes_it->first.val(), iit->ll_lower)*10000000
-            + (::lon(nodes_it->first.val(), iit->ll_lower) > 0 ? 0.5 : -0.5));
-        for (map< Area_Skeleton::Id_Type, vector< Area_Block > >::const_iterator it = areas.begin();
-	     it != areas.end(); ++it)
-        {
-          int inside = 0;
-          for (vector< Area_Block >::const_iterator it2 = it->second.begin(); it2 != it->second.end();
-	       ++it2)
-          {
-	    int check(Coord_Query_Statement::check_area_block(current_idx, *it2, ilat, ilon));
-	    if (check == Coord_Query_Statement::HIT && add_border)
-	    {
-	      inside = 1;
-	      break;
-	    }
-	    else if (check != 0)
-	      inside ^= check;
-          }
-          if (inside)
-	  {
-	    into.push_back(*iit);
-	    break;
-	  }
-        }
+        if (*inside_it)
+	  into.push_back(*iit);
       }
-      nodes_it->second.swap(into);      
-      ++nodes_it;
+      nodes_it->second.swap(into);
     }
   }
   while (nodes_it != nodes.end())
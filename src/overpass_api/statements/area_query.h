@@ -38,6 +38,7 @@ class Area_Query_Statement : public Output_Statement
     static Generic_Statement_Maker< Area_Query_Statement > statement_maker;
     
     virtual Query_Constraint* get_query_constraint();
+    virtual bool is_self_contained() const { return !areas_from_input(); }
     
     void get_ranges
       (set< pair< Uint32_Index, Uint32_Index > >& nodes_req,
@@ -74,6 +75,7 @@ class Area_Query_Statement : public Output_Statement
     string get_input() const { return input; }
     
     static bool is_used() { return is_used_; }
+    static void reset_usage() { is_used_ = false; }
   
   private:
     string input;
@@ -655,6 +655,7 @@ Prepared_Segment::Prepared_Segment
   first_cartesian = cartesian(first_lat, first_lon);
   second_cartesian = cartesian(second_lat, second_lon);
   norm = cross_prod(first_cartesian, second_cartesian);
+  length = great_circle_dist(first_lat, first_lon, second_lat, second_lon);
 }
 
 
@@ -666,6 +667,66 @@ Prepared_Point::Prepared_Point
 }
 
 
+// Covers the rounding errors of great_circle_dist, in particular of acos close to 1.
+const double BBOX_MARGIN = 1e-5;
+
+
+Lat_Lon_Bbox::Lat_Lon_Bbox
+  (double first_lat, double first_lon, double second_lat, double second_lon, double dist)
+{
+  // The latitude differs at most by the distance.
+  double delta = dist*(360.0/(40000.0*1000.0)) + BBOX_MARGIN;
+  south = max(max(first_lat, second_lat) - delta, -90.0);
+  north = min(min(first_lat, second_lat) + delta, 90.0);
+  
+  // By the haversine formula, hav(delta) >= cos(lat_1)*cos(lat_2)*hav(lon_1 - lon_2).
+  // We bound cos(lat_2) by its minimum within the latitude range.
+  west = -180.0;
+  east = 180.0;
+  if (delta >= 180.0)
+    return;
+  double max_abs_lat = max(abs(south), abs(north));
+  double hav_delta = sin(delta/180.0*acos(0))*sin(delta/180.0*acos(0));
+  double coords[2][2] = { { first_lat, first_lon }, { second_lat, second_lon } };
+  for (int i = 0; i < 2; ++i)
+  {
+    double ratio = hav_delta/(cos(coords[i][0]/90.0*acos(0))*cos(max_abs_lat/90.0*acos(0)));
+    if (!(ratio < 1.0))
+      continue;
+    double dlon = asin(sqrt(ratio))/acos(0)*180.0 + BBOX_MARGIN;
+    // A range across the date line gives no bound here.
+    if (coords[i][1] - dlon < -180.0 || coords[i][1] + dlon > 180.0)
+      continue;
+    west = max(west, coords[i][1] - dlon);
+    east = min(east, coords[i][1] + dlon);
+  }
+}
+
+
+// Enumerates the indexes ll_upper_ & 0xffffff00 that intersect the bounding box.
+// Returns false without result if these are too many to be useful.
+bool bbox_indexes(const Lat_Lon_Bbox& bbox, vector< Uint32_Index >& result)
+{
+  const uint32 MAX_INDEXES = 4096;
+  
+  uint32 isouth = ::ilat_(bbox.south) & 0xfff00000;
+  uint32 inorth = ::ilat_(bbox.north);
+  int64 iwest = ((int64)::ilon_(bbox.west)) & ~(int64)0xfffff;
+  int64 ieast = ::ilon_(bbox.east);
+  if (inorth < isouth || ieast < iwest)
+    return true;
+  if (((inorth - isouth)/0x100000 + 1)*((ieast - iwest)/0x100000 + 1) > MAX_INDEXES)
+    return false;
+  
+  for (uint32 ilat = isouth; ilat <= inorth; ilat += 0x100000)
+  {
+    for (int64 ilon = iwest; ilon <= ieast; ilon += 0x100000)
+      result.push_back(Uint32_Index(::ll_upper_(ilat, (int32)ilon) & 0xffffff00));
+  }
+  return true;
+}
+
+
 double great_circle_line_dist(const Prepared_Segment& segment, const vector< double >& cartesian)
 {
   double scalar_prod_ = abs(scalar_prod(cartesian, segment.norm))
@@ -914,6 +975,7 @@ void Around_Statement::calc_lat_lons(const Set& input, Statement& query, Resourc
   if (lat < 100.0)
   {
     add_coord(lat, lon, radius, radius_lat_lons, simple_lat_lons);
+    build_spatial_index();
     return;
   }
   
@@ -942,6 +1004,40 @@ void Around_Statement::calc_lat_lons(const Set& input, Statement& query, Resourc
         = relation_way_members(&query, rman, input.attic_relations, timestamp);
     add_ways(way_members, Way_Geometry_Store(way_members, timestamp, query, rman));
   }
+  
+  build_spatial_index();
+}
+
+
+void Around_Statement::build_spatial_index()
+{
+  segment_bboxes.clear();
+  segments_by_idx.clear();
+  wide_segments.clear();
+  points_by_idx.clear();
+  
+  for (uint32 i = 0; i < simple_lat_lons.size(); ++i)
+    points_by_idx[Uint32_Index(::ll_upper_(simple_lat_lons[i].lat, simple_lat_lons[i].lon)
+        & 0xffffff00)].push_back(i);
+  
+  // A coordinate is only close to a segment if it is within this limit to both endpoints.
+  vector< Uint32_Index > indexes;
+  for (uint32 i = 0; i < simple_segments.size(); ++i)
+  {
+    const Prepared_Segment& segment = simple_segments[i];
+    segment_bboxes.push_back(Lat_Lon_Bbox(segment.first_lat, segment.first_lon,
+        segment.second_lat, segment.second_lon,
+        sqrt(segment.length*segment.length + radius*radius)));
+    
+    indexes.clear();
+    if (bbox_indexes(segment_bboxes.back(), indexes))
+    {
+      for (vector< Uint32_Index >::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
+        segments_by_idx[*it].push_back(i);
+    }
+    else
+      wide_segments.push_back(i);
+  }
 }
 
 
@@ -960,18 +1056,33 @@ bool Around_Statement::is_inside(double lat, double lon) const
     }
   }
   
-  vector< double > coord_cartesian = cartesian(lat, lon);
-  for (vector< Prepared_Segment >::const_iterator
-      it = simple_segments.begin(); it != simple_segments.end(); ++it)
+  if (simple_segments.empty())
+    return false;
+  
+  vector< double > coord_cartesian;
+  map< Uint32_Index, vector< uint32 > >::const_iterator sit
+      = segments_by_idx.find(::ll_upper_(lat, lon) & 0xffffff00);
+  const vector< uint32 >* candidates[2] =
+      { &wide_segments, sit == segments_by_idx.end() ? 0 : &sit->second };
+  for (int i = 0; i < 2; ++i)
   {
-    if (great_circle_line_dist(*it, coord_cartesian) <= radius)
+    if (!candidates[i])
+      continue;
+    for (vector< uint32 >::const_iterator it = candidates[i]->begin(); it != candidates[i]->end(); ++it)
     {
-      double gcdist = great_circle_dist
-          (it->first_lat, it->first_lon, it->second_lat, it->second_lon);
-      double limit = sqrt(gcdist*gcdist + radius*radius);
-      if (great_circle_dist(lat, lon, it->first_lat, it->first_lon) <= limit &&
-          great_circle_dist(lat, lon, it->second_lat, it->second_lon) <= limit)
-	return true;
+      if (!segment_bboxes[*it].contains(lat, lon))
+        continue;
+      
+      const Prepared_Segment& segment = simple_segments[*it];
+      if (coord_cartesian.empty())
+        coord_cartesian = cartesian(lat, lon);
+      if (great_circle_line_dist(segment, coord_cartesian) <= radius)
+      {
+        double limit = sqrt(segment.length*segment.length + radius*radius);
+        if (great_circle_dist(lat, lon, segment.first_lat, segment.first_lon) <= limit &&
+            great_circle_dist(lat, lon, segment.second_lat, segment.second_lon) <= limit)
+	  return true;
+      }
     }
   }
   
@@ -982,24 +1093,66 @@ bool Around_Statement::is_inside
     (double first_lat, double first_lon, double second_lat, double second_lon) const
 {
   Prepared_Segment segment(first_lat, first_lon, second_lat, second_lon);
+  double limit = sqrt(segment.length*segment.length + radius*radius);
   
-  for (vector< Prepared_Point >::const_iterator cit = simple_lat_lons.begin();
-      cit != simple_lat_lons.end(); ++cit)
+  // Only points within limit to both endpoints count.
+  Lat_Lon_Bbox point_bbox(first_lat, first_lon, second_lat, second_lon, limit);
+  vector< Uint32_Index > indexes;
+  vector< uint32 > candidates;
+  if (bbox_indexes(point_bbox, indexes))
   {
-    if (great_circle_line_dist(segment, cit->cartesian) <= radius)
+    for (vector< Uint32_Index >::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
     {
-      double gcdist = great_circle_dist(first_lat, first_lon, second_lat, second_lon);
-      double limit = sqrt(gcdist*gcdist + radius*radius);
-      if (great_circle_dist(cit->lat, cit->lon, first_lat, first_lon) <= limit &&
-	  great_circle_dist(cit->lat, cit->lon, second_lat, second_lon) <= limit)
+      map< Uint32_Index, vector< uint32 > >::const_iterator pit = points_by_idx.find(*it);
+      if (pit != points_by_idx.end())
+        candidates.insert(candidates.end(), pit->second.begin(), pit->second.end());
+    }
+  }
+  else
+  {
+    for (uint32 i = 0; i < simple_lat_lons.size(); ++i)
+      candidates.push_back(i);
+  }
+  
+  for (vector< uint32 >::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
+  {
+    const Prepared_Point& point = simple_lat_lons[*it];
+    if (!point_bbox.contains(point.lat, point.lon))
+      continue;
+    if (great_circle_line_dist(segment, point.cartesian) <= radius)
+    {
+      if (great_circle_dist(point.lat, point.lon, first_lat, first_lon) <= limit &&
+	  great_circle_dist(point.lat, point.lon, second_lat, second_lon) <= limit)
         return true;
     }
   }
   
-  for (vector< Prepared_Segment >::const_iterator
-      cit = simple_segments.begin(); cit != simple_segments.end(); ++cit)
+  // An intersection point is at most the length of the segment away from its endpoints.
+  // Each segment is listed for all indexes that its points within the radius touch.
+  Lat_Lon_Bbox segment_bbox(first_lat, first_lon, second_lat, second_lon, segment.length);
+  candidates = wide_segments;
+  indexes.clear();
+  if (bbox_indexes(segment_bbox, indexes))
+  {
+    for (vector< Uint32_Index >::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
+    {
+      map< Uint32_Index, vector< uint32 > >::const_iterator sit = segments_by_idx.find(*it);
+      if (sit != segments_by_idx.end())
+        candidates.insert(candidates.end(), sit->second.begin(), sit->second.end());
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+  }
+  else
+  {
+    candidates.clear();
+    for (uint32 i = 0; i < simple_segments.size(); ++i)
+      candidates.push_back(i);
+  }
+  
+  for (vector< uint32 >::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
   {
-    if (intersect(*cit, segment))
+    if (intersect(simple_segments[*it], segment))
       return true;
   }
   
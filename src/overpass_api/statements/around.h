@@ -38,6 +38,7 @@ struct Prepared_Segment
   vector< double > first_cartesian;
   vector< double > second_cartesian;
   vector< double > norm;
+  double length;
   
   Prepared_Segment(double first_lat, double first_lon, double second_lat, double second_lon);
 };
@@ -53,6 +54,24 @@ struct Prepared_Point
 };
 
 
+/** A range of latitudes and longitudes that contains for sure all points within a given
+    distance of both endpoints of a segment. Coordinates outside can be ruled out
+    without any great circle computation. */
+struct Lat_Lon_Bbox
+{
+  double south;
+  double north;
+  double west;
+  double east;
+  
+  Lat_Lon_Bbox(double first_lat, double first_lon, double second_lat, double second_lon,
+	       double dist);
+  
+  bool contains(double lat, double lon) const
+  { return south <= lat && lat <= north && west <= lon && lon <= east; }
+};
+
+
 class Around_Statement : public Output_Statement
 {
   public:
@@ -93,6 +112,16 @@ class Around_Statement : public Output_Statement
     vector< Prepared_Point > simple_lat_lons;
     vector< Prepared_Segment > simple_segments;
     vector< Query_Constraint* > constraints;
+    
+    // Positions in simple_segments and simple_lat_lons by the index ll_upper_ & 0xffffff00.
+    // A segment is listed for all indexes its Lat_Lon_Bbox touches, or in
+    // wide_segments if these are too many.
+    vector< Lat_Lon_Bbox > segment_bboxes;
+    map< Uint32_Index, vector< uint32 > > segments_by_idx;
+    vector< uint32 > wide_segments;
+    map< Uint32_Index, vector< uint32 > > points_by_idx;
+    
+    void build_spatial_index();
 };
 
 #endif
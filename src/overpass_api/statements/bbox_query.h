@@ -36,6 +36,7 @@ class Bbox_Query_Statement : public Output_Statement
     static Generic_Statement_Maker< Bbox_Query_Statement > statement_maker;
     
     virtual Query_Constraint* get_query_constraint();
+    virtual bool is_self_contained() const { return true; }
     
     const set< pair< Uint32_Index, Uint32_Index > >& get_ranges_32();
     const set< pair< Uint31_Index, Uint31_Index > >& get_ranges_31();
@@ -37,10 +37,12 @@ class Changed_Statement : public Output_Statement
     static Generic_Statement_Maker< Changed_Statement > statement_maker;
 
     virtual Query_Constraint* get_query_constraint();
+    virtual bool is_self_contained() const { return true; }
     uint64 get_since(Resource_Manager& rman) const;
     uint64 get_until(Resource_Manager& rman) const;
     
     static bool area_query_exists() { return area_query_exists_; }
+    static void reset_usage() { area_query_exists_ = false; }
     
   private:
     uint64 since, until;
@@ -16,6 +16,7 @@
 * along with Overpass_API.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cctype>
 #include <fstream>
 #include <iostream>
@@ -29,6 +30,10 @@
 
 #include <iomanip>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "../../template_db/block_backend.h"
 #include "coord_query.h"
 
@@ -86,8 +91,8 @@ Coord_Query_Statement::Coord_Query_Statement
   the coordinates to the southern end of the block. If it is odd, the coordinate
   is inside the area, if not, they are not.
 */
-int Coord_Query_Statement::check_area_block
-    (uint32 ll_index, const Area_Block& area_block,
+int Coord_Query_Statement::check_segment
+    (uint32 last_lat, int32 last_lon, uint32 lat, int32 lon,
      uint32 coord_lat, int32 coord_lon)
 {
   // An area block is a chain of segments. We consider each
@@ -103,6 +108,74 @@ int Coord_Query_Statement::check_area_block
   // (4) A special case is if one endpoint is the intersection point. We then toggle
   // only either the western or the eastern side. We are part of the area if in the
   // end the western or eastern side have an odd state.
+  if (last_lon < lon)
+  {
+    if (lon < coord_lon)
+      return 0; // case (1)
+    else if (last_lon > coord_lon)
+      return 0; // case (1)
+    else if (lon == coord_lon)
+    {
+      if (lat < coord_lat)
+        return TOGGLE_WEST; // case (4)
+      else if (lat == coord_lat)
+        return HIT; // case (2)
+      return 0; // case (1)
+    }
+    else if (last_lon == coord_lon)
+    {
+      if (last_lat < coord_lat)
+        return TOGGLE_EAST; // case (4)
+      else if (last_lat == coord_lat)
+        return HIT; // case (2)
+      return 0; // case (1)
+    }
+  }
+  else if (last_lon > lon)
+  {
+    if (lon > coord_lon)
+      return 0; // case (1)
+    else if (last_lon < coord_lon)
+      return 0; // case (1)
+    else if (lon == coord_lon)
+    {
+      if (lat < coord_lat)
+        return TOGGLE_EAST; // case (4)
+      else if (lat == coord_lat)
+        return HIT; // case (2)
+      return 0; // case (1)
+    }
+    else if (last_lon == coord_lon)
+    {
+      if (last_lat < coord_lat)
+        return TOGGLE_WEST; // case (4)
+      else if (last_lat == coord_lat)
+        return HIT; // case (2)
+      return 0; // case (1)
+    }
+  }
+  else // last_lon == lon
+  {
+    if (lon == coord_lon &&
+        ((last_lat <= coord_lat && coord_lat <= lat) || (lat <= coord_lat && coord_lat <= last_lat)))
+      return HIT; // case (2)
+    return 0; // else: case (1)
+  }
+  
+  uint32 intersect_lat = lat +
+      ((int64)coord_lon - lon)*((int64)last_lat - lat)/((int64)last_lon - lon);
+  if (coord_lat > intersect_lat)
+    return (TOGGLE_EAST | TOGGLE_WEST); // case (3)
+  else if (coord_lat == intersect_lat)
+    return HIT; // case (2)
+  return 0; // case (1)
+}
+
+
+int Coord_Query_Statement::check_area_block
+    (uint32 ll_index, const Area_Block& area_block,
+     uint32 coord_lat, int32 coord_lon)
+{
   int state = 0;
   vector< uint64 >::const_iterator it(area_block.coors.begin());
   uint32 lat = ::ilat(ll_index | (((*it)>>32)&0xff), (*it & 0xffffffff));
@@ -114,73 +187,123 @@ int Coord_Query_Statement::check_area_block
     lon = ::ilon(ll_index | (((*it)>>32)&0xff), (*it & 0xffffffff));
     lat = ::ilat(ll_index | (((*it)>>32)&0xff), (*it & 0xffffffff));
     
-    if (last_lon < lon)
+    int check = check_segment(last_lat, last_lon, lat, lon, coord_lat, coord_lon);
+    if (check == HIT)
+      return HIT;
+    state ^= check;
+  }
+  return state;
+}
+
+
+namespace
+{
+  // A segment can only contribute for coordinates within its longitude range and
+  // not south of both its endpoints. Everything else is case (1) in check_segment.
+  inline void check_segment_scalar
+      (uint32 last_lat, int32 last_lon, uint32 lat, int32 lon,
+       const uint32* coord_lats, const int32* coord_lons, uint32 begin, uint32 end, int* states)
+  {
+    int32 min_lon = std::min(last_lon, lon);
+    int32 max_lon = std::max(last_lon, lon);
+    uint32 min_lat = std::min(last_lat, lat);
+    for (uint32 i = begin; i < end; ++i)
     {
-      if (lon < coord_lon)
-	continue; // case (1)
-      else if (last_lon > coord_lon)
-	continue; // case (1)
-      else if (lon == coord_lon)
-      {
-	if (lat < coord_lat)
-	  state ^= TOGGLE_WEST; // case (4)
-	else if (lat == coord_lat)
-	  return HIT; // case (2)
-	// else: case (1)
-	continue;
-      }
-      else if (last_lon == coord_lon)
-      {
-	if (last_lat < coord_lat)
-	  state ^= TOGGLE_EAST; // case (4)
-	else if (last_lat == coord_lat)
-	  return HIT; // case (2)
-	// else: case (1)
-	continue;
-      }
+      if (coord_lons[i] < min_lon || max_lon < coord_lons[i] || coord_lats[i] < min_lat)
+        continue;
+      int check = Coord_Query_Statement::check_segment
+          (last_lat, last_lon, lat, lon, coord_lats[i], coord_lons[i]);
+      // Hits are kept in their own bit while the toggles keep being counted.
+      if (check == Coord_Query_Statement::HIT)
+        states[i] |= Coord_Query_Statement::HIT;
+      else
+        states[i] ^= check;
     }
-    else if (last_lon > lon)
+  }
+  
+  
+#if defined(__x86_64__)
+  // Tests eight coordinates per step against the bounding box of the segment.
+  // Only coordinates within it are passed to the exact scalar test. All values
+  // are below 2^31, hence the signed comparisons are correct also for latitudes.
+  __attribute__((target("avx2")))
+  void check_segment_avx2
+      (uint32 last_lat, int32 last_lon, uint32 lat, int32 lon,
+       const uint32* coord_lats, const int32* coord_lons, uint32 size, int* states)
+  {
+    __m256i min_lon = _mm256_set1_epi32(std::min(last_lon, lon) - 1);
+    __m256i max_lon = _mm256_set1_epi32(std::max(last_lon, lon) + 1);
+    __m256i min_lat = _mm256_set1_epi32((int32)std::min(last_lat, lat) - 1);
+    uint32 i = 0;
+    for (; i + 8 <= size; i += 8)
     {
-      if (lon > coord_lon)
-	continue; // case (1)
-      else if (last_lon < coord_lon)
-	continue; // case (1)
-      else if (lon == coord_lon)
+      __m256i lons = _mm256_loadu_si256((const __m256i*)(coord_lons + i));
+      __m256i lats = _mm256_loadu_si256((const __m256i*)(coord_lats + i));
+      __m256i candidates = _mm256_and_si256(
+          _mm256_and_si256(_mm256_cmpgt_epi32(lons, min_lon), _mm256_cmpgt_epi32(max_lon, lons)),
+          _mm256_cmpgt_epi32(lats, min_lat));
+      int mask = _mm256_movemask_ps(_mm256_castsi256_ps(candidates));
+      while (mask)
       {
-	if (lat < coord_lat)
-	  state ^= TOGGLE_EAST; // case (4)
-	else if (lat == coord_lat)
-	  return HIT; // case (2)
-	// else: case (1)
-	continue;
-      }
-      else if (last_lon == coord_lon)
-      {
-	if (last_lat < coord_lat)
-	  state ^= TOGGLE_WEST; // case (4)
-	else if (last_lat == coord_lat)
-	  return HIT; // case (2)
-	// else: case (1)
-	continue;
+        int j = i + __builtin_ctz(mask);
+        mask &= mask - 1;
+        int check = Coord_Query_Statement::check_segment
+            (last_lat, last_lon, lat, lon, coord_lats[j], coord_lons[j]);
+        if (check == Coord_Query_Statement::HIT)
+          states[j] |= Coord_Query_Statement::HIT;
+        else
+          states[j] ^= check;
       }
     }
-    else // last_lon == lon
+    check_segment_scalar(last_lat, last_lon, lat, lon, coord_lats, coord_lons, i, size, states);
+  }
+  
+  
+  bool has_avx2()
+  {
+    static bool result = __builtin_cpu_supports("avx2");
+    return result;
+  }
+#endif
+}
+
+
+void Coord_Query_Statement::check_area_block
+    (uint32 ll_index, const Area_Block& area_block,
+     const vector< uint32 >& coord_lats, const vector< int32 >& coord_lons,
+     vector< int >& results)
+{
+  uint32 size = coord_lats.size();
+  results.assign(size, 0);
+  if (size == 0 || area_block.coors.empty())
+    return;
+  
+  vector< uint64 >::const_iterator it(area_block.coors.begin());
+  uint32 lat = ::ilat(ll_index | (((*it)>>32)&0xff), (*it & 0xffffffff));
+  int32 lon = ::ilon(ll_index | (((*it)>>32)&0xff), (*it & 0xffffffff));
+  while (++it != area_block.coors.end())
+  {
+    uint32 last_lat = lat;
+    int32 last_lon = lon;
+    lon = ::ilon(ll_index | (((*it)>>32)&0xff), (*it & 0xffffffff));
+    lat = ::ilat(ll_index | (((*it)>>32)&0xff), (*it & 0xffffffff));
+    
+#if defined(__x86_64__)
+    if (has_avx2())
     {
-      if (lon == coord_lon &&
-          ((last_lat <= coord_lat && coord_lat <= lat) || (lat <= coord_lat && coord_lat <= last_lat)))
-        return HIT; // case (2)
-      continue; // else: case (1)
+      check_segment_avx2(last_lat, last_lon, lat, lon, &coord_lats[0], &coord_lons[0], size, &results[0]);
+      continue;
     }
-    
-    uint32 intersect_lat = lat +
-        ((int64)coord_lon - lon)*((int64)last_lat - lat)/((int64)last_lon - lon);
-    if (coord_lat > intersect_lat)
-      state ^= (TOGGLE_EAST | TOGGLE_WEST); // case (3)
-    else if (coord_lat == intersect_lat)
-      return HIT; // case (2)
-    // else: case (1)
+#endif
+    check_segment_scalar(last_lat, last_lon, lat, lon, &coord_lats[0], &coord_lons[0], 0, size, &results[0]);
+  }
+  
+  // A hit ends the evaluation of a coordinate in the unbatched version.
+  for (uint32 i = 0; i < size; ++i)
+  {
+    if (results[i] & HIT)
+      results[i] = HIT;
   }
-  return state;
 }
 
 
@@ -232,6 +355,12 @@ void Coord_Query_Statement::execute(Resource_Manager& rman)
   map< Uint31_Index, vector< pair< double, double > > >::const_iterator coord_block_it = coord_per_req.begin();
   Uint31_Index last_idx = req.empty() ? Uint31_Index(0u) : *req.begin();
   
+  // The coordinates of the current index, converted once for all its area blocks.
+  const vector< pair< double, double > >* decoded_coords = 0;
+  vector< uint32 > coord_lats;
+  vector< int32 > coord_lons;
+  vector< int > checks;
+  
   Block_Backend< Uint31_Index, Area_Block > area_blocks_db
       (rman.get_area_transaction()->data_index(area_settings().AREA_BLOCKS));
   for (Block_Backend< Uint31_Index, Area_Block >::Discrete_Iterator
@@ -260,13 +389,25 @@ void Coord_Query_Statement::execute(Resource_Manager& rman)
         break;
     }
 
+    if (decoded_coords != &coord_block_it->second)
+    {
+      decoded_coords = &coord_block_it->second;
+      coord_lats.clear();
+      coord_lons.clear();
+      for (vector< pair< double, double > >::const_iterator coord_it = decoded_coords->begin();
+	   coord_it != decoded_coords->end(); ++coord_it)
+      {
+        coord_lats.push_back((coord_it->first + 91.0)*10000000+0.5);
+        coord_lons.push_back(coord_it->second*10000000 + (coord_it->second > 0 ? 0.5 : -0.5));
+      }
+    }
+    check_area_block(it.index().val(), it.object(), coord_lats, coord_lons, checks);
+    
+    vector< int >::const_iterator check_it = checks.begin();
     for (vector< pair< double, double > >::const_iterator coord_it = coord_block_it->second.begin();
-	 coord_it != coord_block_it->second.end(); ++coord_it)
+	 coord_it != coord_block_it->second.end(); ++coord_it, ++check_it)
     {
-      uint32 ilat((coord_it->first + 91.0)*10000000+0.5);
-      int32 ilon(coord_it->second*10000000 + (coord_it->second > 0 ? 0.5 : -0.5));
-  
-      int check = check_area_block(it.index().val(), it.object(), ilat, ilon);
+      int check = *check_it;
       if (check == HIT)
         areas_found.insert(it.object().id);
       else if (check != 0)
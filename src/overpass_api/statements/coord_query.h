@@ -45,6 +45,15 @@ class Coord_Query_Statement : public Output_Statement
         (uint32 ll_index, const Area_Block& area_block,
 	 uint32 coord_lat, int32 coord_lon);
     
+    /** Evaluates check_area_block for many coordinates at once: results[i] gets the
+        value of check_area_block(ll_index, area_block, coord_lats[i], coord_lons[i]).
+        The block is decoded only once, and each segment is tested against eight
+        coordinates per step if the processor supports AVX2. */
+    static void check_area_block
+        (uint32 ll_index, const Area_Block& area_block,
+         const vector< uint32 >& coord_lats, const vector< int32 >& coord_lons,
+         vector< int >& results);
+    
     // Used as bitmasks.
     const static int HIT = 1;
     const static int TOGGLE_EAST = 2;
@@ -52,6 +61,7 @@ class Coord_Query_Statement : public Output_Statement
     const static int INTERSECT = 8;
     
     static bool is_used() { return is_used_; }
+    static void reset_usage() { is_used_ = false; }
   
   private:
     string input;
@@ -38,11 +38,13 @@ class Id_Query_Statement : public Output_Statement
     static Generic_Statement_Maker< Id_Query_Statement > statement_maker;
 
     virtual Query_Constraint* get_query_constraint();
+    virtual bool is_self_contained() const { return true; }
     Uint64 get_lower() const { return lower; }
     Uint64 get_upper() const { return upper; }
     int get_type() const { return type; }
     
     static bool area_query_exists() { return area_query_exists_; }
+    static void reset_usage() { area_query_exists_ = false; }
     
   private:
     int type;
@@ -37,6 +37,7 @@ class Map_To_Area_Statement : public Output_Statement
     static Generic_Statement_Maker< Map_To_Area_Statement > statement_maker;
       
     static bool is_used() { return is_used_; }
+    static void reset_usage() { is_used_ = false; }
   
   private:
     string input;
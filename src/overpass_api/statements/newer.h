@@ -40,6 +40,7 @@ class Newer_Statement : public Statement
     static Generic_Statement_Maker< Newer_Statement > statement_maker;
     
     virtual Query_Constraint* get_query_constraint();
+    virtual bool is_self_contained() const { return true; }
     
     uint64 get_timestamp() const { return than_timestamp; }
 
@@ -41,6 +41,7 @@ class Polygon_Query_Statement : public Output_Statement
     static Generic_Statement_Maker< Polygon_Query_Statement > statement_maker;
     
     virtual Query_Constraint* get_query_constraint();
+    virtual bool is_self_contained() const { return true; }
     
     set< pair< Uint32_Index, Uint32_Index > > calc_ranges();
 
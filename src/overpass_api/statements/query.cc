@@ -25,6 +25,7 @@
 #include "../data/filter_by_tags.h"
 #include "../data/filter_ids_by_tags.h"
 #include "../data/regular_expression.h"
+#include "../dispatch/parallel_executor.h"
 #include "meta_collector.h"
 #include "area_query.h"
 #include "query.h"
@@ -41,7 +42,7 @@ Generic_Statement_Maker< Query_Statement > Query_Statement::statement_maker("que
 
 Query_Statement::Query_Statement
     (int line_number_, const map< string, string >& input_attributes, Query_Constraint* bbox_limitation)
-    : Output_Statement(line_number_)
+    : Output_Statement(line_number_), self_contained(true)
 {
   map< string, string > attributes;
   
@@ -116,7 +117,10 @@ void Query_Statement::add_statement(Statement* statement, string text)
   
   Query_Constraint* constraint = statement->get_query_constraint();
   if (constraint)
+  {
     constraints.push_back(constraint);
+    self_contained &= statement->is_self_contained();
+  }
   else
     substatement_error(get_name(), statement);
 }
@@ -139,6 +143,33 @@ public:
 };
 
 
+/** Evaluates a key regex only once per dictionary code. Keys read in plain form
+    are passed to the regex each time. */
+template< typename Key_Regex >
+class Key_Match_Cache
+{
+public:
+  Key_Match_Cache(const Key_Regex& regex_) : regex(&regex_) {}
+  
+  template< typename Tag_Index >
+  bool matches(const Tag_Index& idx)
+  {
+    if (idx.key_code == Tag_Key_Dictionary::NO_CODE)
+      return regex->matches(idx.key);
+    if (idx.key_code >= results.size())
+      results.resize(idx.key_code + 1, UNKNOWN);
+    if (results[idx.key_code] == UNKNOWN)
+      results[idx.key_code] = regex->matches(idx.key) ? MATCHES : DOESNT_MATCH;
+    return results[idx.key_code] == MATCHES;
+  }
+  
+private:
+  enum { UNKNOWN, MATCHES, DOESNT_MATCH };
+  const Key_Regex* regex;
+  std::vector< uint8 > results;
+};
+
+
 template< typename Id_Type, typename Iterator, typename Key_Regex, typename Val_Regex >
 void filter_id_list(
     std::vector< std::pair< Id_Type, Uint31_Index > >& new_ids, bool& filtered,
@@ -146,10 +177,11 @@ void filter_id_list(
 {
   std::vector< std::pair< Id_Type, Uint31_Index > > old_ids;
   old_ids.swap(new_ids);
+  Key_Match_Cache< Key_Regex > key_matches(key_regex);
   
   for (Iterator it = begin; !(it == end); ++it)
   {
-    if (key_regex.matches(it.index().key) && val_regex.matches(it.index().value) && (!filtered ||
+    if (key_matches.matches(it.index()) && val_regex.matches(it.index().value) && (!filtered ||
 	binary_search(old_ids.begin(), old_ids.end(), std::make_pair(it.object().id, Uint31_Index(0u)))))
       new_ids.push_back(std::make_pair(it.object().id, it.object().idx));
   }
@@ -166,10 +198,11 @@ void filter_id_list(
 {
   std::vector< Id_Type > old_ids;
   old_ids.swap(new_ids);
+  Key_Match_Cache< Key_Regex > key_matches(key_regex);
   
   for (Iterator it = begin; !(it == end); ++it)
   {
-    if (key_regex.matches(it.index().key) && val_regex.matches(it.index().value) &&
+    if (key_matches.matches(it.index()) && val_regex.matches(it.index().value) &&
 	(!filtered || binary_search(old_ids.begin(), old_ids.end(), it.object())))
       new_ids.push_back(it.object());
   }
@@ -543,6 +576,7 @@ void filter_ids_by_ntags
 {
   vector< Id_Type > removed_ids;
   string last_key, last_value;  
+  uint32 last_key_code = Tag_Key_Dictionary::NO_CODE;
   bool key_relevant = false;
   bool valid = false;
   map< string, pair< vector< Regular_Expression* >, vector< string > > >::const_iterator
@@ -551,7 +585,7 @@ void filter_ids_by_ntags
   while ((!(tag_it == items_db.range_end())) &&
       (((tag_it.index().index) & 0x7fffff00) == coarse_index))
   {
-    if (tag_it.index().key != last_key)
+    if (!has_key(tag_it.index(), last_key, last_key_code))
     {
       last_value = void_tag_value() + " ";
       
@@ -566,6 +600,7 @@ void filter_ids_by_ntags
       key_relevant = false;
       
       last_key = tag_it.index().key;
+      last_key_code = tag_it.index().key_code;
       while (key_it != keys.end() && last_key > key_it->first)
         ++key_it;
       
@@ -629,6 +664,7 @@ void filter_ids_by_ntags
     std::map< Id_Type, std::pair< uint64, uint64 > > timestamps;
     for (typename std::vector< Id_Type >::const_iterator it = new_ids.begin(); it != new_ids.end(); ++it)
       timestamps[*it];
+    uint32 key_code = tag_key_dictionary().find(key_it->first);
     
     while ((!(tag_it == items_db.range_end())) &&
         ((tag_it.index().index) & 0x7fffff00) == coarse_index &&
@@ -643,7 +679,7 @@ void filter_ids_by_ntags
     std::string last_value = void_tag_value() + " ";
     while ((!(tag_it == items_db.range_end())) &&
         ((tag_it.index().index) & 0x7fffff00) == coarse_index &&
-        tag_it.index().key == key_it->first)
+        has_key(tag_it.index(), key_it->first, key_code))
     {
       if (std::binary_search(new_ids.begin(), new_ids.end(), tag_it.object()))
       {
@@ -671,7 +707,7 @@ void filter_ids_by_ntags
     last_value = void_tag_value() + " ";
     while ((!(attic_tag_it == attic_items_db.range_end())) &&
         ((attic_tag_it.index().index) & 0x7fffff00) == coarse_index &&
-        attic_tag_it.index().key == key_it->first)
+        has_key(attic_tag_it.index(), key_it->first, key_code))
     {
       if (std::binary_search(new_ids.begin(), new_ids.end(), Id_Type(attic_tag_it.object())))
       {
@@ -1239,6 +1275,74 @@ std::set< std::pair< Index, Index > > intersect_ranges
 }
 
 
+/** Evaluates the ids and ranges of a constraint on a separate thread. Afterwards it hands
+    them out in place of the constraint, each of them once. */
+class Evaluated_Constraint : public Query_Constraint, public Parallel_Task
+{
+  public:
+    Evaluated_Constraint(Query_Constraint* constraint_, int type_)
+        : constraint(constraint_), type(type_),
+          node_ids_found(false), ids_found(false), ranges_32_found(false), ranges_31_found(false) {}
+    
+    virtual void execute(Resource_Manager& rman)
+    {
+      if (type == QUERY_NODE)
+      {
+        node_ids_found = constraint->get_node_ids(rman, node_ids);
+        ranges_32_found = constraint->get_ranges(rman, ranges_32);
+      }
+      else
+      {
+        if (type == QUERY_WAY)
+          ids_found = constraint->get_way_ids(rman, ids);
+        else
+          ids_found = constraint->get_relation_ids(rman, ids);
+        ranges_31_found = constraint->get_ranges(rman, ranges_31);
+      }
+    }
+    
+    bool delivers_data(Resource_Manager& rman) { return constraint->delivers_data(rman); }
+    
+    bool get_node_ids(Resource_Manager& rman, vector< Node_Skeleton::Id_Type >& ids_)
+    {
+      ids_.swap(node_ids);
+      return node_ids_found;
+    }
+    bool get_way_ids(Resource_Manager& rman, vector< Way_Skeleton::Id_Type >& ids_)
+    {
+      ids_.swap(ids);
+      return ids_found;
+    }
+    bool get_relation_ids(Resource_Manager& rman, vector< Relation_Skeleton::Id_Type >& ids_)
+    {
+      ids_.swap(ids);
+      return ids_found;
+    }
+    bool get_ranges(Resource_Manager& rman, set< pair< Uint32_Index, Uint32_Index > >& ranges)
+    {
+      ranges.swap(ranges_32);
+      return ranges_32_found;
+    }
+    bool get_ranges(Resource_Manager& rman, set< pair< Uint31_Index, Uint31_Index > >& ranges)
+    {
+      ranges.swap(ranges_31);
+      return ranges_31_found;
+    }
+    
+  private:
+    Query_Constraint* constraint;
+    int type;
+    vector< Node_Skeleton::Id_Type > node_ids;
+    vector< Uint32_Index > ids;
+    set< pair< Uint32_Index, Uint32_Index > > ranges_32;
+    set< pair< Uint31_Index, Uint31_Index > > ranges_31;
+    bool node_ids_found;
+    bool ids_found;
+    bool ranges_32_found;
+    bool ranges_31_found;
+};
+
+
 void Query_Statement::execute(Resource_Manager& rman)
 {
   Answer_State answer_state = nothing;
@@ -1294,11 +1398,31 @@ void Query_Statement::execute(Resource_Manager& rman)
     
     set_progress(2);
     rman.health_check(*this);
+    
+    // The ids and ranges of the constraints do not depend on each other. If no constraint
+    // reads a set, they are evaluated in parallel and only then intersected below.
+    vector< Evaluated_Constraint > evaluated;
+    vector< Query_Constraint* > evaluated_ptrs;
+    if (rman.get_max_threads() > 1 && constraints.size() > 1 && is_self_contained()
+        && answer_state < data_collected
+        && (type == QUERY_NODE || type == QUERY_WAY || type == QUERY_RELATION))
+    {
+      for (vector< Query_Constraint* >::iterator it = constraints.begin(); it != constraints.end(); ++it)
+        evaluated.push_back(Evaluated_Constraint(*it, type));
+      vector< Parallel_Task* > tasks;
+      for (vector< Evaluated_Constraint >::iterator it = evaluated.begin(); it != evaluated.end(); ++it)
+      {
+        tasks.push_back(&*it);
+        evaluated_ptrs.push_back(&*it);
+      }
+      execute_in_parallel(rman, tasks);
+    }
+    vector< Query_Constraint* >& id_range_constraints = (evaluated.empty() ? constraints : evaluated_ptrs);
 
     if (type == QUERY_NODE)
     {
-      for (vector< Query_Constraint* >::iterator it = constraints.begin();
-          it != constraints.end() && answer_state < data_collected; ++it)
+      for (vector< Query_Constraint* >::iterator it = id_range_constraints.begin();
+          it != id_range_constraints.end() && answer_state < data_collected; ++it)
       {
 	vector< Node::Id_Type > constraint_node_ids;
 	if ((*it)->get_node_ids(rman, constraint_node_ids))
@@ -1321,8 +1445,8 @@ void Query_Statement::execute(Resource_Manager& rman)
     }
     else if (type == QUERY_WAY)
     {
-      for (vector< Query_Constraint* >::iterator it = constraints.begin();
-          it != constraints.end() && answer_state < data_collected; ++it)
+      for (vector< Query_Constraint* >::iterator it = id_range_constraints.begin();
+          it != id_range_constraints.end() && answer_state < data_collected; ++it)
       {
 	vector< Way::Id_Type > constraint_way_ids;
 	if ((*it)->get_way_ids(rman, constraint_way_ids))
@@ -1345,8 +1469,8 @@ void Query_Statement::execute(Resource_Manager& rman)
     }
     else if (type == QUERY_RELATION)
     {
-      for (vector< Query_Constraint* >::iterator it = constraints.begin();
-          it != constraints.end() && answer_state < data_collected; ++it)
+      for (vector< Query_Constraint* >::iterator it = id_range_constraints.begin();
+          it != id_range_constraints.end() && answer_state < data_collected; ++it)
       {
 	vector< Relation::Id_Type > constraint_relation_ids;
 	if ((*it)->get_relation_ids(rman, constraint_relation_ids))
@@ -1370,8 +1494,8 @@ void Query_Statement::execute(Resource_Manager& rman)
 
     if (type == QUERY_NODE)
     {
-      for (vector< Query_Constraint* >::iterator it = constraints.begin();
-          it != constraints.end() && answer_state < data_collected; ++it)
+      for (vector< Query_Constraint* >::iterator it = id_range_constraints.begin();
+          it != id_range_constraints.end() && answer_state < data_collected; ++it)
       {
         set< pair< Uint32_Index, Uint32_Index > > range_req;
         if ((*it)->get_ranges(rman, range_req))
@@ -1399,8 +1523,8 @@ void Query_Statement::execute(Resource_Manager& rman)
     }
     else if (type == QUERY_WAY || type == QUERY_RELATION)
     {
-      for (vector< Query_Constraint* >::iterator it = constraints.begin();
-          it != constraints.end() && answer_state < data_collected; ++it)
+      for (vector< Query_Constraint* >::iterator it = id_range_constraints.begin();
+          it != id_range_constraints.end() && answer_state < data_collected; ++it)
       {
         set< pair< Uint31_Index, Uint31_Index > > range_req;
 	if ((*it)->get_ranges(rman, range_req))
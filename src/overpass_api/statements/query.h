@@ -47,10 +47,12 @@ class Query_Statement : public Output_Statement
     virtual void add_statement(Statement* statement, string text);
     virtual string get_name() const { return "query"; }
     virtual void execute(Resource_Manager& rman);
+    virtual bool is_self_contained() const { return self_contained; }
     
     static Generic_Statement_Maker< Query_Statement > statement_maker;
     
     static bool area_query_exists() { return area_query_exists_; }
+    static void reset_usage() { area_query_exists_ = false; }
     
   private:
     int type;
@@ -62,6 +64,7 @@ class Query_Statement : public Output_Statement
     vector< pair< string, Regular_Expression* > > key_nregexes;    
     vector< pair< Regular_Expression*, Regular_Expression* > > regkey_nregexes;    
     vector< Query_Constraint* > constraints;
+    bool self_contained;
     
     static bool area_query_exists_;
     
@@ -32,6 +32,10 @@
 
 using namespace std;
 
+// The number of threads the tests let the statements use. Can be set by an optional
+// last argument to test the parallel evaluation of the constraints.
+uint32 max_threads = 1;
+
 template < class TStatement >
 class SProxy
 {
@@ -74,6 +78,7 @@ void perform_query(string type, string key, string value, string db_dir)
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", type);
@@ -119,6 +124,7 @@ void perform_query
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", type);
@@ -191,6 +197,7 @@ void perform_query
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", type);
@@ -253,6 +260,7 @@ void perform_regex_query
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", type);
@@ -296,6 +304,7 @@ void perform_key_regex_query
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", type);
@@ -386,6 +395,7 @@ void perform_query_with_around
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       ostringstream buf;
       if (id_type == "node" && type == "node")
@@ -507,6 +517,7 @@ void perform_query_with_around
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       string lat, lon;
       if (type == "node")
@@ -567,6 +578,7 @@ void perform_query_with_bbox
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", type);
@@ -618,6 +630,7 @@ void perform_multi_query_with_bbox
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", type);
@@ -691,6 +704,7 @@ void perform_query_with_recurse
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Id_Query_Statement > stmt1;
       if (recurse_type == "way-node")
@@ -800,6 +814,7 @@ void perform_query_with_role_recurse
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Id_Query_Statement > stmt1;
       if (recurse_type == "relation-node")
@@ -848,6 +863,7 @@ void perform_query_with_id_query
   {
     Nonsynced_Transaction transaction(false, false, db_dir, "");
     Resource_Manager rman(transaction);
+    rman.set_max_threads(max_threads);
     {
       SProxy< Query_Statement > stmt1;
       stmt1("type", query_type);
@@ -892,10 +908,12 @@ int main(int argc, char* args[])
 {
   if (argc < 5)
   {
-    cout<<"Usage: "<<args[0]<<" test_to_execute pattern_size db_dir node_id_offset\n";
+    cout<<"Usage: "<<args[0]<<" test_to_execute pattern_size db_dir node_id_offset [threads]\n";
     return 0;
   }
   string test_to_execute = args[1];
+  if (argc > 5)
+    max_threads = atoi(args[5]);
   uint pattern_size = 0;
   pattern_size = atoi(args[2]);
   uint64 global_node_offset = atoll(args[4]);
@@ -120,6 +120,11 @@ class Statement
     // object.
     virtual Query_Constraint* get_query_constraint() { return 0; }
     
+    // True if the statement reads no sets and writes no set other than its result set.
+    // Such a statement does not depend on its siblings and may be executed in parallel
+    // to them.
+    virtual bool is_self_contained() const { return false; }
+    
     virtual ~Statement() {}
 
     int get_progress() const { return progress; }
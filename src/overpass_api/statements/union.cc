@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "../data/abstract_processing.h"
+#include "../dispatch/parallel_executor.h"
 #include "union.h"
 
 
@@ -62,19 +63,26 @@ void Union_Statement::add_statement(Statement* statement, string text)
 }
 
 
-void Union_Statement::execute(Resource_Manager& rman)
+namespace
 {
-  Set base_set;
-  
-  for (vector< Statement* >::iterator it(substatements.begin());
-       it != substatements.end(); ++it)
+  /** Executes a substatement on its own view and keeps its result set. */
+  struct Substatement_Task : public Parallel_Task
   {
-    rman.push_reference(base_set);
-    (*it)->execute(rman);
-    rman.pop_reference();
+    Substatement_Task(Statement* stmt_) : stmt(stmt_) {}
     
-    Set& summand(rman.sets()[(*it)->get_result_name()]);
-
+    virtual void execute(Resource_Manager& rman)
+    {
+      stmt->execute(rman);
+      result.swap(rman.sets()[stmt->get_result_name()]);
+    }
+    
+    Statement* stmt;
+    Set result;
+  };
+  
+  
+  void add_to_union(Set& base_set, Set& summand)
+  {
     indexed_set_union(base_set.nodes, summand.nodes);
     indexed_set_union(base_set.attic_nodes, summand.attic_nodes);
     
@@ -86,6 +94,51 @@ void Union_Statement::execute(Resource_Manager& rman)
     
     indexed_set_union(base_set.areas, summand.areas);
   }
+}
+
+
+void Union_Statement::execute(Resource_Manager& rman)
+{
+  Set base_set;
+  
+  vector< Statement* >::iterator it = substatements.begin();
+  while (it != substatements.end())
+  {
+    // Consecutive substatements that read no sets do not depend on each other.
+    // Hence they are executed in parallel and their results are then processed
+    // in the order of the substatements as if they had been executed one after another.
+    vector< Statement* >::iterator run_end = it;
+    while (rman.get_max_threads() > 1 && run_end != substatements.end()
+        && (*run_end)->is_self_contained())
+      ++run_end;
+    
+    if (run_end - it > 1)
+    {
+      vector< Substatement_Task > tasks;
+      for (vector< Statement* >::iterator sit = it; sit != run_end; ++sit)
+        tasks.push_back(Substatement_Task(*sit));
+      vector< Parallel_Task* > task_ptrs;
+      for (vector< Substatement_Task >::iterator tit = tasks.begin(); tit != tasks.end(); ++tit)
+        task_ptrs.push_back(&*tit);
+      execute_in_parallel(rman, task_ptrs);
+      
+      for (vector< Substatement_Task >::iterator tit = tasks.begin(); tit != tasks.end(); ++tit)
+      {
+        Set& summand(rman.sets()[tit->stmt->get_result_name()]);
+        summand.swap(tit->result);
+        add_to_union(base_set, summand);
+      }
+      it = run_end;
+      continue;
+    }
+    
+    rman.push_reference(base_set);
+    (*it)->execute(rman);
+    rman.pop_reference();
+    
+    add_to_union(base_set, rman.sets()[(*it)->get_result_name()]);
+    ++it;
+  }
   
   transfer_output(rman, base_set);
   rman.health_check(*this);
@@ -29,6 +29,10 @@
 
 using namespace std;
 
+// The number of threads the tests let the statements use. Can be set by an optional
+// last argument to test the parallel execution of independent substatements.
+uint32 max_threads = 1;
+
 string to_string_(uint64 val)
 {
   ostringstream buf;
@@ -40,10 +44,12 @@ int main(int argc, char* args[])
 {
   if (argc < 4)
   {
-    cout<<"Usage: "<<args[0]<<" test_to_execute db_dir node_id_offset\n";
+    cout<<"Usage: "<<args[0]<<" test_to_execute db_dir node_id_offset [threads]\n";
     return 0;
   }
   string test_to_execute = args[1];
+  if (argc > 4)
+    max_threads = atoi(args[4]);
   uint64 global_node_offset = atoll(args[3]);
   
   cout<<
@@ -58,6 +64,7 @@ int main(int argc, char* args[])
       {
 	Nonsynced_Transaction transaction(false, false, args[2], "");
 	Resource_Manager rman(transaction);
+rman.set_max_threads(max_threads);
 	
 	const char* attributes[] = { 0 };
 	Union_Statement stmt(0, convert_c_pairs(attributes));
@@ -101,6 +108,7 @@ int main(int argc, char* args[])
     {
       Nonsynced_Transaction transaction(false, false, args[2], "");
       Resource_Manager rman(transaction);
+      rman.set_max_threads(max_threads);
       
       const char* attributes[] = { 0 };
       Union_Statement stmt(0, convert_c_pairs(attributes));
@@ -135,6 +143,7 @@ int main(int argc, char* args[])
     {
       Nonsynced_Transaction transaction(false, false, args[2], "");
       Resource_Manager rman(transaction);
+      rman.set_max_threads(max_threads);
       
       const char* attributes[] = { "into", "A", 0 };
       Union_Statement stmt(0, convert_c_pairs(attributes));
@@ -177,6 +186,7 @@ int main(int argc, char* args[])
     {
       Nonsynced_Transaction transaction(false, false, args[2], "");
       Resource_Manager rman(transaction);
+      rman.set_max_threads(max_threads);
       {
 	const char* attributes[] = { "type", "way", "ref", "1", "into", "A", 0 };
 	Id_Query_Statement stmt(0, convert_c_pairs(attributes));
@@ -219,6 +229,7 @@ int main(int argc, char* args[])
     {
       Nonsynced_Transaction transaction(false, false, args[2], "");
       Resource_Manager rman(transaction);
+      rman.set_max_threads(max_threads);
       {
 	const char* attributes[] = { "type", "way", "ref", "1", "into", "A", 0 };
 	Id_Query_Statement stmt(0, convert_c_pairs(attributes));
@@ -261,6 +272,7 @@ int main(int argc, char* args[])
     {
       Nonsynced_Transaction transaction(false, false, args[2], "");
       Resource_Manager rman(transaction);
+      rman.set_max_threads(max_threads);
       {
 	const char* attributes[] = { "type", "way", "ref", "1", "into", "A", 0 };
 	Id_Query_Statement stmt(0, convert_c_pairs(attributes));
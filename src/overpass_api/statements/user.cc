@@ -174,6 +174,29 @@ User_Statement::~User_Statement()
 
 uint32 get_user_id(const string& user_name, Transaction& transaction)
 {
+  // Databases since the introduction of user_names resolve the name by a single lookup.
+  File_Blocks_Index_Base* names_index = transaction.data_index(meta_settings().USER_NAMES);
+  if (names_index && file_exists(names_index->get_data_file_name()))
+  {
+    set< Uint32_Index > req;
+    req.insert(user_name_index(user_name));
+    
+    Block_Backend< Uint32_Index, User_Data > names_db(names_index);
+    if (!(names_db.flat_begin() == names_db.flat_end()))
+    {
+      // Like the scan below, prefer the smallest id if stale entries share the name.
+      uint32 result = numeric_limits< uint32 >::max();
+      for (Block_Backend< Uint32_Index, User_Data >::Discrete_Iterator
+          user_it = names_db.discrete_begin(req.begin(), req.end());
+          !(user_it == names_db.discrete_end()); ++user_it)
+      {
+        if (user_it.object().name == user_name && user_it.object().id < result)
+          result = user_it.object().id;
+      }
+      return result;
+    }
+  }
+  
   Block_Backend< Uint32_Index, User_Data > user_db
       (transaction.data_index(meta_settings().USER_DATA));
   for (Block_Backend< Uint32_Index, User_Data >::Flat_Iterator
@@ -39,6 +39,7 @@ class User_Statement : public Output_Statement
     static Generic_Statement_Maker< User_Statement > statement_maker;
     
     virtual Query_Constraint* get_query_constraint();
+    virtual bool is_self_contained() const { return true; }
     
     void calc_ranges
         (set< pair< Uint32_Index, Uint32_Index > >& node_req,
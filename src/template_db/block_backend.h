@@ -58,7 +58,7 @@ struct Index_Collection
 template< class TIndex, class TObject >
 struct Block_Backend_Basic_Iterator
 {
-  Block_Backend_Basic_Iterator(uint32 block_size_, bool is_end);
+  Block_Backend_Basic_Iterator(uint32 block_size_, bool is_end, bool mapped_);
   Block_Backend_Basic_Iterator(const Block_Backend_Basic_Iterator& it);
   ~Block_Backend_Basic_Iterator();
   
@@ -72,7 +72,11 @@ struct Block_Backend_Basic_Iterator
   TIndex* current_index;
   TObject* current_object;
   
+  // If mapped is true, block points into the memory mapped data file and
+  // buffer is empty. Otherwise block always points to buffer.
+  bool mapped;
   Void_Pointer< uint8 > buffer;
+  uint8* block;
 };
 
 template< class TIndex, class TObject, class TIterator >
@@ -118,14 +122,16 @@ struct Block_Backend_Discrete_Iterator : Block_Backend_Basic_Iterator< TIndex, T
   
   Block_Backend_Discrete_Iterator
       (const File_Blocks_& file_blocks_, uint32 block_size_)
-    : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, true),
+    : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, true, file_blocks_.is_mapped()),
       file_blocks(file_blocks_), file_it(file_blocks_.discrete_end()),
-      file_end(file_blocks_.discrete_end()), index_it(), index_end() {}
+      file_end(file_blocks_.discrete_end()), index_it(), index_end(),
+      prefetch_it(file_end), prefetch_distance(0) {}
   
   Block_Backend_Discrete_Iterator(const Block_Backend_Discrete_Iterator& it)
     : Block_Backend_Basic_Iterator< TIndex, TObject >(it),
       file_blocks(it.file_blocks), file_it(it.file_it), file_end(it.file_end),
-      index_it(it.index_it), index_end(it.index_end) {}
+      index_it(it.index_it), index_end(it.index_end),
+      prefetch_it(it.prefetch_it), prefetch_distance(it.prefetch_distance) {}
   
   ~Block_Backend_Discrete_Iterator() {}
   
@@ -140,6 +146,10 @@ struct Block_Backend_Discrete_Iterator : Block_Backend_Basic_Iterator< TIndex, T
   TIterator index_it;
   TIterator index_end;
   
+  // Runs ahead of file_it to announce the blocks to read next.
+  typename File_Blocks_::Discrete_Iterator prefetch_it;
+  uint32 prefetch_distance;
+  
 private:
   bool search_next_index();
   bool read_block();
@@ -156,14 +166,16 @@ struct Block_Backend_Range_Iterator : Block_Backend_Basic_Iterator< TIndex, TObj
        const Default_Range_Iterator< TIndex >& index_end_, uint32 block_size_);
   
   Block_Backend_Range_Iterator(const File_Blocks_& file_blocks_, uint32 block_size_)
-    : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, true),
+    : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, true, file_blocks_.is_mapped()),
       file_blocks(file_blocks_), file_it(file_blocks_.range_end()),
-      file_end(file_blocks_.range_end()), index_it(), index_end() {}
+      file_end(file_blocks_.range_end()), index_it(), index_end(),
+      prefetch_it(file_end), prefetch_distance(0) {}
   
   Block_Backend_Range_Iterator(const Block_Backend_Range_Iterator& it)
     : Block_Backend_Basic_Iterator< TIndex, TObject >(it),
       file_blocks(it.file_blocks), file_it(it.file_it), file_end(it.file_end),
-      index_it(it.index_it), index_end(it.index_end) {}
+      index_it(it.index_it), index_end(it.index_end),
+      prefetch_it(it.prefetch_it), prefetch_distance(it.prefetch_distance) {}
   
   const Block_Backend_Range_Iterator& operator=
       (const Block_Backend_Range_Iterator& it);
@@ -176,6 +188,10 @@ struct Block_Backend_Range_Iterator : Block_Backend_Basic_Iterator< TIndex, TObj
   Default_Range_Iterator< TIndex > index_it;
   Default_Range_Iterator< TIndex > index_end;
   
+  // Runs ahead of file_it to announce the blocks to read next.
+  typename File_Blocks_::Range_Iterator prefetch_it;
+  uint32 prefetch_distance;
+  
 private:
   // returns true if we have found something
   bool search_next_index();
@@ -271,9 +287,9 @@ struct Block_Backend
 
 template< class TIndex, class TObject >
 Block_Backend_Basic_Iterator< TIndex, TObject >::
-    Block_Backend_Basic_Iterator(uint32 block_size_, bool is_end)
+    Block_Backend_Basic_Iterator(uint32 block_size_, bool is_end, bool mapped_)
 : block_size(block_size_), pos(0), current_idx_pos(0), current_index(0),
-  current_object(0), buffer(block_size)
+  current_object(0), mapped(mapped_), buffer(mapped ? 0 : block_size), block(mapped ? 0 : buffer.ptr)
 {
   if (is_end)
     return;
@@ -283,10 +299,12 @@ template< class TIndex, class TObject >
 Block_Backend_Basic_Iterator< TIndex, TObject >::
     Block_Backend_Basic_Iterator(const Block_Backend_Basic_Iterator& it)
 : block_size(it.block_size), pos(it.pos),
-  current_idx_pos(0), current_index(0), current_object(0), buffer(block_size)
+  current_idx_pos(0), current_index(0), current_object(0),
+  mapped(it.mapped), buffer(mapped ? 0 : block_size), block(mapped ? it.block : buffer.ptr)
 {
-  memcpy(buffer.ptr, it.buffer.ptr, block_size);
-  current_idx_pos = (uint32*)(buffer.ptr + ((uint8*)it.current_idx_pos - it.buffer.ptr));
+  if (!mapped)
+    memcpy(buffer.ptr, it.buffer.ptr, block_size);
+  current_idx_pos = (uint32*)(block + ((uint8*)it.current_idx_pos - it.block));
 }
 
 template< class TIndex, class TObject >
@@ -307,7 +325,7 @@ Block_Backend_Basic_Iterator< TIndex, TObject >::~Block_Backend_Basic_Iterator()
 template< class TIndex, class TObject >
 bool Block_Backend_Basic_Iterator< TIndex, TObject >::advance()
 {
-  pos += TObject::size_of((void*)(buffer.ptr + pos));
+  pos += TObject::size_of((void*)(block + pos));
   
   // invalidate cached object
   if (current_object != 0)
@@ -342,7 +360,7 @@ template< class TIndex, class TObject >
 const TObject& Block_Backend_Basic_Iterator< TIndex, TObject >::object()
 {
   if (current_object == 0)
-    current_object = new TObject((void*)(buffer.ptr + pos));
+    current_object = new TObject((void*)(block + pos));
   return *current_object;
 }
 
@@ -352,7 +370,7 @@ template< class TIndex, class TObject, class TIterator >
 Block_Backend_Flat_Iterator< TIndex, TObject, TIterator >::
     Block_Backend_Flat_Iterator
     (File_Blocks_& file_blocks_, uint32 block_size_, bool is_end)
-  : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, is_end),
+  : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, is_end, file_blocks_.is_mapped()),
     file_blocks(file_blocks_), file_it(file_blocks_.flat_begin()),
     file_end(file_blocks_.flat_end())
 {
@@ -417,8 +435,8 @@ template< class TIndex, class TObject, class TIterator >
 bool Block_Backend_Flat_Iterator< TIndex, TObject, TIterator >::search_next_index()
 {
   // search for the next suitable index
-  this->current_idx_pos = (uint32*)((this->buffer.ptr) + this->pos);
-  if (this->pos < *(uint32*)(this->buffer.ptr))
+  this->current_idx_pos = (uint32*)((this->block) + this->pos);
+  if (this->pos < *(uint32*)(this->block))
   {
     if (this->current_index)
       delete this->current_index;
@@ -429,7 +447,7 @@ bool Block_Backend_Flat_Iterator< TIndex, TObject, TIterator >::search_next_inde
 		file_blocks.get_index().get_data_file_name(),
 	        "Block_Backend: index out of range.");
     this->pos += 4;
-    this->pos += TIndex::size_of((void*)((this->buffer.ptr) + this->pos));
+    this->pos += TIndex::size_of((void*)((this->block) + this->pos));
     return true;
   }
     
@@ -448,7 +466,7 @@ bool Block_Backend_Flat_Iterator< TIndex, TObject, TIterator >::read_block()
     return true;
   }
   this->pos = 4;
-  file_blocks.read_block(file_it, this->buffer.ptr);
+  this->block = file_blocks.access_block(file_it, this->buffer.ptr, true);
   
   return false;
 }
@@ -461,11 +479,12 @@ Block_Backend_Discrete_Iterator< TIndex, TObject, TIterator >::
     (File_Blocks_& file_blocks_,
      const TIterator& index_it_, const TIterator& index_end_,
      uint32 block_size_)
-    : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, false),
+    : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, false, file_blocks_.is_mapped()),
       file_blocks(file_blocks_),
       file_it(file_blocks_.discrete_begin(index_it_, index_end_)),
       file_end(file_blocks_.discrete_end()),
-      index_it(index_it_), index_end(index_end_)
+      index_it(index_it_), index_end(index_end_),
+      prefetch_it(file_it), prefetch_distance(0)
 {
   if (read_block())
     return;
@@ -523,14 +542,14 @@ template< class TIndex, class TObject, class TIterator >
 bool Block_Backend_Discrete_Iterator< TIndex, TObject, TIterator >::search_next_index()
 {
   // search for the next suitable index
-  this->current_idx_pos = (uint32*)((this->buffer.ptr) + this->pos);
-  while (this->pos < *(uint32*)(this->buffer.ptr))
+  this->current_idx_pos = (uint32*)((this->block) + this->pos);
+  while (this->pos < *(uint32*)(this->block))
   {
     this->pos += 4;
     
     if (this->current_index)
       delete this->current_index;
-    this->current_index = new TIndex((void*)((this->buffer.ptr) + this->pos));
+    this->current_index = new TIndex((void*)((this->block) + this->pos));
     while ((index_it != index_end) && (*index_it < *(this->current_index)))
       ++index_it;
     if (index_it == index_end)
@@ -543,14 +562,14 @@ bool Block_Backend_Discrete_Iterator< TIndex, TObject, TIterator >::search_next_
     if (*index_it == *(this->current_index))
     {
       // we have reached the next valid index
-      this->pos += TIndex::size_of((void*)((this->buffer.ptr) + this->pos));
+      this->pos += TIndex::size_of((void*)((this->block) + this->pos));
       return true;
     }
     delete this->current_index;
     this->current_index = 0;
     
     this->pos = *(this->current_idx_pos);
-    this->current_idx_pos = (uint32*)((this->buffer.ptr) + this->pos);
+    this->current_idx_pos = (uint32*)((this->block) + this->pos);
   }
   
   return false;
@@ -572,7 +591,8 @@ bool Block_Backend_Discrete_Iterator< TIndex, TObject, TIterator >::read_block()
     return true;
   }
   this->pos = 4;
-  file_blocks.read_block(file_it, this->buffer.ptr);
+  file_blocks.prefetch(file_it, prefetch_it, prefetch_distance);
+  this->block = file_blocks.access_block(file_it, this->buffer.ptr, false);
   
   return false;
 }
@@ -584,11 +604,12 @@ Block_Backend_Range_Iterator< TIndex, TObject, TIterator >::Block_Backend_Range_
     (File_Blocks_& file_blocks_,
      const Default_Range_Iterator< TIndex >& index_it_,
      const Default_Range_Iterator< TIndex >& index_end_, uint32 block_size_)
-  : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, false),
+  : Block_Backend_Basic_Iterator< TIndex, TObject >(block_size_, false, file_blocks_.is_mapped()),
     file_blocks(file_blocks_),
     file_it(file_blocks_.range_begin(index_it_, index_end_)),
     file_end(file_blocks_.range_end()),
-    index_it(index_it_), index_end(index_end_)
+    index_it(index_it_), index_end(index_end_),
+    prefetch_it(file_it), prefetch_distance(0)
 {
   if (read_block())
     return;
@@ -645,14 +666,14 @@ template< class TIndex, class TObject, class TIterator >
 bool Block_Backend_Range_Iterator< TIndex, TObject, TIterator >::search_next_index()
 {
   // search for the next suitable index
-  this->current_idx_pos = (uint32*)((this->buffer.ptr) + this->pos);
-  while (this->pos < *(uint32*)(this->buffer.ptr))
+  this->current_idx_pos = (uint32*)((this->block) + this->pos);
+  while (this->pos < *(uint32*)(this->block))
   {
     this->pos += 4;
     
     if (this->current_index)
       delete this->current_index;
-    this->current_index = new TIndex((void*)((this->buffer.ptr) + this->pos));
+    this->current_index = new TIndex((void*)((this->block) + this->pos));
     while ((index_it != index_end) &&
       (!(*(this->current_index) < index_it.upper_bound())))
       ++(index_it);
@@ -666,14 +687,14 @@ bool Block_Backend_Range_Iterator< TIndex, TObject, TIterator >::search_next_ind
     if (!(*(this->current_index) < index_it.lower_bound()))
     {
       // we have reached the next valid index
-      this->pos += TIndex::size_of((void*)((this->buffer.ptr) + this->pos));
+      this->pos += TIndex::size_of((void*)((this->block) + this->pos));
       return true;
     }
     delete this->current_index;
     this->current_index = 0;
     
     this->pos = *(this->current_idx_pos);
-    this->current_idx_pos = (uint32*)((this->buffer.ptr) + this->pos);
+    this->current_idx_pos = (uint32*)((this->block) + this->pos);
   }
   
   return false;
@@ -691,7 +712,8 @@ bool Block_Backend_Range_Iterator< TIndex, TObject, TIterator >::read_block()
     return true;
   }
   this->pos = 4;
-  file_blocks.read_block(file_it, this->buffer.ptr);
+  file_blocks.prefetch(file_it, prefetch_it, prefetch_distance);
+  this->block = file_blocks.access_block(file_it, this->buffer.ptr, false);
   
   return false;
 }
@@ -23,6 +23,7 @@
 #include <cstdio>
 
 #include "block_backend.h"
+#include "block_cache.h"
 #include "transaction.h"
 
 using namespace std;
@@ -132,6 +133,14 @@ struct IntRangeIterator : list< pair< IntIndex, IntIndex > >::const_iterator
 string BASE_DIRECTORY("./");
 string DATA_SUFFIX(".bin");
 string INDEX_SUFFIX(".idx");
+uint32 COMPRESSION_METHOD(File_Blocks_Index_Base::NO_COMPRESSION);
+uint32 IO_BACKEND(Block_Device::POSIX_IO);
+uint32 CHECKSUM_METHOD(File_Blocks_Index_Base::NO_CHECKSUM);
+Shared_Block_Cache* BLOCK_CACHE(0);
+bool USE_MMAP(false);
+uint32 PREFETCH_DEPTH(0);
+bool USE_INDEX_IMAGE(false);
+Index_Image* INDEX_IMAGE(0);
 
 struct Test_File : File_Properties
 {
@@ -191,12 +200,32 @@ struct Test_File : File_Properties
     return 0;
   }
   
+  uint32 get_compression_factor() const
+  {
+    return 4;
+  }
+  
+  uint32 get_compression_method() const
+  {
+    return COMPRESSION_METHOD;
+  }
+  
+  uint32 get_io_backend() const
+  {
+    return IO_BACKEND;
+  }
+  
+  uint32 get_checksum_method() const
+  {
+    return CHECKSUM_METHOD;
+  }
+  
   File_Blocks_Index_Base* new_data_index
-      (bool writeable, bool use_shadow, string db_dir, string file_name_extension)
-      const
+      (bool writeable, bool use_shadow, string db_dir, string file_name_extension,
+       const Index_Image* index_image) const
   {
     return new File_Blocks_Index< IntIndex >
-        (*this, writeable, use_shadow, db_dir, file_name_extension);
+        (*this, writeable, use_shadow, db_dir, file_name_extension, index_image);
   }
 };
 
@@ -225,6 +254,18 @@ void fill_db
     
     throw;
   }
+  
+  // Same as the dispatcher does on write_commit
+  if (BLOCK_CACHE)
+    BLOCK_CACHE->increment_generation();
+  if (USE_INDEX_IMAGE)
+  {
+    delete INDEX_IMAGE;
+    INDEX_IMAGE = 0;
+    Test_File tf;
+    vector< File_Properties* > files(1, &tf);
+    INDEX_IMAGE = new Index_Image("/template_db_block_backend_test_index", BASE_DIRECTORY, files);
+  }
 }
 
 void read_loop
@@ -304,6 +345,11 @@ void read_test(unsigned int step)
   try
   {
     Nonsynced_Transaction transaction(false, false, BASE_DIRECTORY, "");
+    transaction.set_block_cache(BLOCK_CACHE);
+    transaction.set_use_mmap(USE_MMAP);
+    transaction.set_prefetch_depth(PREFETCH_DEPTH);
+    transaction.set_index_image(INDEX_IMAGE);
+    transaction.set_verify_checksums(CHECKSUM_METHOD != File_Blocks_Index_Base::NO_CHECKSUM);
     Test_File tf;
     Block_Backend< IntIndex, IntObject >
 	db_backend(transaction.data_index(&tf));
@@ -421,6 +467,27 @@ int main(int argc, char* args[])
   string test_to_execute;
   if (argc > 1)
     test_to_execute = args[1];
+  for (int i = 2; i < argc; ++i)
+  {
+    if (string(args[i]) == "--compressed")
+      COMPRESSION_METHOD = File_Blocks_Index_Base::ZLIB_COMPRESSION;
+    else if (string(args[i]) == "--cached")
+      BLOCK_CACHE = new Shared_Block_Cache("/template_db_block_backend_test", 64*1024, 512);
+    else if (string(args[i]) == "--mapped")
+      USE_MMAP = true;
+    else if (string(args[i]) == "--prefetch")
+      PREFETCH_DEPTH = 3;
+    else if (string(args[i]) == "--index-image")
+      USE_INDEX_IMAGE = true;
+    else if (string(args[i]) == "--memory-io")
+      IO_BACKEND = Block_Device::MEMORY_IO;
+    else if (string(args[i]) == "--direct-io")
+      IO_BACKEND = Block_Device::DIRECT_IO;
+    else if (string(args[i]) == "--uring-io")
+      IO_BACKEND = Block_Device::URING_IO;
+    else if (string(args[i]) == "--checksums")
+      CHECKSUM_METHOD = File_Blocks_Index_Base::CRC32C_CHECKSUM;
+  }
   
   if ((test_to_execute == "") || (test_to_execute == "1"))
     cout<<"** Test the behaviour for non-exsiting files\n";
@@ -624,5 +691,8 @@ int main(int argc, char* args[])
   remove((BASE_DIRECTORY + Test_File().get_file_name_trunk()
       + Test_File().get_data_suffix()).c_str());
   
+  delete INDEX_IMAGE;
+  delete BLOCK_CACHE;
+  
   return 0;
 }
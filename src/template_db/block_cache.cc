@@ -0,0 +1,285 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "block_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstring>
+
+
+namespace
+{
+  const uint32 BLOCK_CACHE_MAGIC = 0x4f534243;
+  const uint32 ALIGNMENT = 64;
+
+  inline uint64 aligned(uint64 size)
+  {
+    return (size + ALIGNMENT - 1)/ALIGNMENT*ALIGNMENT;
+  }
+}
+
+
+struct Shared_Block_Cache::Header
+{
+  uint32 magic;
+  uint32 slot_size;
+  uint32 num_sets;
+  uint32 slot_stride;
+  volatile uint32 generation;
+  uint32 unused;
+  volatile uint64 hits;
+  volatile uint64 misses;
+};
+
+
+// A slot is stable if its sequence number is even. A writer increments it
+// before and after it changes the slot.
+struct Shared_Block_Cache::Slot
+{
+  volatile uint32 sequence;
+  volatile uint32 referenced;
+  volatile uint32 generation;
+  volatile uint32 pos;
+  volatile uint64 file_id;
+
+  uint8* data() { return ((uint8*)this) + aligned(sizeof(Slot)); }
+};
+
+
+Shared_Block_Cache::Shared_Block_Cache
+    (const string& share_name_, uint64 total_size, uint32 slot_size)
+  : share_name(share_name_), is_owner(true), shm_fd(-1), shm_size(0), shm_ptr(0), generation(0)
+{
+  uint64 slot_stride = aligned(sizeof(Slot)) + aligned(slot_size);
+  uint64 num_sets = total_size / (slot_stride * WAYS);
+  if (num_sets == 0)
+    throw File_Error(0, share_name, "Shared_Block_Cache::1");
+  shm_size = aligned(sizeof(Header)) + aligned(num_sets*sizeof(uint32))
+      + num_sets*WAYS*slot_stride;
+
+  shm_fd = shm_open(share_name.c_str(), O_RDWR|O_CREAT|O_TRUNC, S_666);
+  if (shm_fd < 0)
+    throw File_Error(errno, share_name, "Shared_Block_Cache::2");
+  fchmod(shm_fd, S_666);
+  if (ftruncate(shm_fd, shm_size) != 0)
+  {
+    close(shm_fd);
+    shm_unlink(share_name.c_str());
+    throw File_Error(errno, share_name, "Shared_Block_Cache::3");
+  }
+  void* ptr = mmap(0, shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  if (ptr == MAP_FAILED)
+  {
+    close(shm_fd);
+    shm_unlink(share_name.c_str());
+    throw File_Error(errno, share_name, "Shared_Block_Cache::4");
+  }
+  shm_ptr = (uint8*)ptr;
+
+  // A fresh segment is zero filled, hence all slots are empty and stable.
+  header()->slot_size = aligned(slot_size);
+  header()->num_sets = num_sets;
+  header()->slot_stride = slot_stride;
+  header()->generation = 1;
+  header()->hits = 0;
+  header()->misses = 0;
+  __sync_synchronize();
+  header()->magic = BLOCK_CACHE_MAGIC;
+  generation = 1;
+}
+
+
+Shared_Block_Cache::Shared_Block_Cache(const string& share_name_)
+  : share_name(share_name_), is_owner(false), shm_fd(-1), shm_size(0), shm_ptr(0), generation(0)
+{
+  shm_fd = shm_open(share_name.c_str(), O_RDWR, S_666);
+  if (shm_fd < 0)
+    throw File_Error(errno, share_name, "Shared_Block_Cache::5");
+  struct stat stat_buf;
+  if (fstat(shm_fd, &stat_buf) != 0 || (uint64)stat_buf.st_size < sizeof(Header))
+  {
+    close(shm_fd);
+    throw File_Error(errno, share_name, "Shared_Block_Cache::6");
+  }
+  shm_size = stat_buf.st_size;
+  void* ptr = mmap(0, shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  if (ptr == MAP_FAILED)
+  {
+    close(shm_fd);
+    throw File_Error(errno, share_name, "Shared_Block_Cache::7");
+  }
+  shm_ptr = (uint8*)ptr;
+  if (header()->magic != BLOCK_CACHE_MAGIC)
+  {
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    throw File_Error(0, share_name, "Shared_Block_Cache::8");
+  }
+  generation = header()->generation;
+}
+
+
+Shared_Block_Cache::~Shared_Block_Cache()
+{
+  munmap(shm_ptr, shm_size);
+  close(shm_fd);
+  if (is_owner)
+    shm_unlink(share_name.c_str());
+}
+
+
+Shared_Block_Cache::Slot* Shared_Block_Cache::slot(uint32 set, uint32 way) const
+{
+  return (Slot*)(shm_ptr + aligned(sizeof(Header)) + aligned(header()->num_sets*sizeof(uint32))
+      + ((uint64)set*WAYS + way)*header()->slot_stride);
+}
+
+
+uint32 Shared_Block_Cache::set_of(uint64 file_id, uint32 pos) const
+{
+  uint64 hash = (file_id ^ pos) * 0x9e3779b97f4a7c15ull;
+  return (hash>>32) % header()->num_sets;
+}
+
+
+bool Shared_Block_Cache::lookup(uint64 file_id, uint32 pos, void* buffer, uint32 buffer_size)
+{
+  uint32 set = set_of(file_id, pos);
+  for (uint32 way = 0; way < WAYS; ++way)
+  {
+    Slot* it = slot(set, way);
+    uint32 sequence = it->sequence;
+    __sync_synchronize();
+    if ((sequence & 1) || it->generation != generation || it->pos != pos || it->file_id != file_id)
+      continue;
+
+    uint32 size = *(uint32*)it->data();
+    if (size < sizeof(uint32) || size > buffer_size || size > header()->slot_size)
+      continue;
+    memcpy(buffer, it->data(), size);
+    __sync_synchronize();
+    if (it->sequence != sequence)
+      continue;
+
+    it->referenced = 1;
+    __sync_fetch_and_add(&header()->hits, 1);
+    return true;
+  }
+  __sync_fetch_and_add(&header()->misses, 1);
+  return false;
+}
+
+
+void Shared_Block_Cache::insert(uint64 file_id, uint32 pos, const void* buffer)
+{
+  uint32 size = *(uint32*)buffer;
+  if (size < sizeof(uint32) || size > header()->slot_size)
+    return;
+
+  uint32 set = set_of(file_id, pos);
+  uint32* hand = ((uint32*)(shm_ptr + aligned(sizeof(Header)))) + set;
+  uint32 current_generation = header()->generation;
+
+  // Choose a slot by the CLOCK algorithm. Slots of outdated generations are free.
+  // Each slot is visited at most twice, so the loop always terminates.
+  for (uint32 i = 0; i < 2*WAYS; ++i)
+  {
+    Slot* it = slot(set, __sync_fetch_and_add(hand, 1) % WAYS);
+    uint32 sequence = it->sequence;
+    if (sequence & 1)
+      continue;
+    if (it->generation == current_generation && it->referenced)
+    {
+      it->referenced = 0;
+      continue;
+    }
+
+    if (!__sync_bool_compare_and_swap(&it->sequence, sequence, sequence + 1))
+      return;
+    __sync_synchronize();
+    it->generation = generation;
+    it->pos = pos;
+    it->file_id = file_id;
+    it->referenced = 0;
+    memcpy(it->data(), buffer, size);
+    __sync_synchronize();
+    it->sequence = sequence + 2;
+    return;
+  }
+}
+
+
+void Shared_Block_Cache::increment_generation()
+{
+  generation = __sync_add_and_fetch(&header()->generation, 1);
+}
+
+
+void Shared_Block_Cache::refresh_generation()
+{
+  generation = header()->generation;
+}
+
+
+uint32 Shared_Block_Cache::get_slot_count() const
+{
+  return header()->num_sets * WAYS;
+}
+
+
+uint32 Shared_Block_Cache::get_slot_size() const
+{
+  return header()->slot_size;
+}
+
+
+uint32 Shared_Block_Cache::get_generation() const
+{
+  return header()->generation;
+}
+
+
+uint64 Shared_Block_Cache::get_hits() const
+{
+  return header()->hits;
+}
+
+
+uint64 Shared_Block_Cache::get_misses() const
+{
+  return header()->misses;
+}
+
+
+uint64 Shared_Block_Cache::file_id(const string& file_name)
+{
+  // FNV-1a
+  uint64 hash = 0xcbf29ce484222325ull;
+  for (string::size_type i = 0; i < file_name.size(); ++i)
+  {
+    hash ^= (uint8)file_name[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
@@ -0,0 +1,101 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___TEMPLATE_DB__BLOCK_CACHE_H
+#define DE__OSM3S___TEMPLATE_DB__BLOCK_CACHE_H
+
+#include "types.h"
+
+#include <string>
+
+using namespace std;
+
+
+/** A cache for decoded data blocks that lives in a shared memory segment and
+    is shared by all reading processes of a database.
+
+    Blocks are keyed by their file, their position in the file and the
+    generation of the index files. The dispatcher increments the generation on
+    every write_commit, so all blocks cached before become invalid at once.
+
+    The cache is set associative: a key maps to a set of WAYS slots, and the
+    slot to replace within a set is chosen by the CLOCK algorithm. Each slot is
+    guarded by a sequence counter instead of a lock. Hence a reading process
+    that gets killed while copying a block can never block the others. */
+class Shared_Block_Cache
+{
+  Shared_Block_Cache(const Shared_Block_Cache&);
+  Shared_Block_Cache& operator=(const Shared_Block_Cache&);
+
+  public:
+    static const uint32 WAYS = 8;
+
+    /** Creates and initializes the shared memory segment share_name. It holds
+        as many slots of slot_size bytes as fit into total_size bytes. The
+        segment is removed again by the destructor. */
+    Shared_Block_Cache(const string& share_name, uint64 total_size, uint32 slot_size);
+
+    /** Attaches to the existing shared memory segment share_name. */
+    Shared_Block_Cache(const string& share_name);
+
+    ~Shared_Block_Cache();
+
+    /** Copies the block at pos of the file file_id into buffer and returns
+        true if it is cached for the current generation. Otherwise returns
+        false and leaves buffer in an undefined state. */
+    bool lookup(uint64 file_id, uint32 pos, void* buffer, uint32 buffer_size);
+
+    /** Stores the block in buffer. Its net size is taken from its first four
+        bytes. Blocks larger than the slot size are silently not cached. */
+    void insert(uint64 file_id, uint32 pos, const void* buffer);
+
+    /** Invalidates all cached blocks. */
+    void increment_generation();
+
+    /** Fixes the generation this process works with to the current one.
+        A reading process must call this while it is registered as reading
+        the index, because write_commits are blocked in that state. */
+    void refresh_generation();
+
+    uint32 get_slot_count() const;
+    uint32 get_slot_size() const;
+    uint32 get_generation() const;
+    uint64 get_hits() const;
+    uint64 get_misses() const;
+
+    /** Computes the key of a file from its name. */
+    static uint64 file_id(const string& file_name);
+
+  private:
+    struct Header;
+    struct Slot;
+
+    string share_name;
+    bool is_owner;
+    int shm_fd;
+    uint64 shm_size;
+    uint8* shm_ptr;
+    uint32 generation;
+
+    Header* header() const { return (Header*)shm_ptr; }
+    Slot* slot(uint32 set, uint32 way) const;
+    uint32 set_of(uint64 file_id, uint32 pos) const;
+};
+
+
+#endif
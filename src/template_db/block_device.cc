@@ -0,0 +1,592 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "block_device.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+
+namespace
+{
+  // Writes the buffers iov to consecutive bytes from offset on, but skips the
+  // first skip bytes. Partial writes are continued.
+  void pwritev_all(int fd, const struct iovec* iov_begin, uint32 iov_count, uint64 offset,
+                   uint64 skip, const string& name, const string& caller_id)
+  {
+    vector< struct iovec > iov(iov_begin, iov_begin + iov_count);
+    vector< struct iovec >::size_type iov_it = 0;
+    uint64 written = skip;
+    while (iov_it < iov.size())
+    {
+      // Skip what has been written completely and adjust a partially written vector.
+      while (iov_it < iov.size() && written >= iov[iov_it].iov_len)
+      {
+        written -= iov[iov_it].iov_len;
+        offset += iov[iov_it].iov_len;
+        ++iov_it;
+      }
+      if (iov_it == iov.size())
+        break;
+      if (written > 0)
+      {
+        iov[iov_it].iov_base = (uint8*)iov[iov_it].iov_base + written;
+        iov[iov_it].iov_len -= written;
+        offset += written;
+      }
+
+      ssize_t result = pwritev(fd, &iov[iov_it], min(iov.size() - iov_it, (size_t)IOV_MAX), offset);
+      if (result <= 0)
+        throw File_Error(errno, name, caller_id);
+      written = result;
+    }
+  }
+
+
+  uint64 run_length(const Block_Device_Run& run)
+  {
+    uint64 length = 0;
+    for (vector< struct iovec >::const_iterator it = run.iov.begin(); it != run.iov.end(); ++it)
+      length += it->iov_len;
+    return length;
+  }
+
+
+  uint64 file_size(int fd, const string& name, const string& caller_id)
+  {
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0)
+      throw File_Error(errno, name, caller_id);
+    return stat_buf.st_size;
+  }
+
+
+  //---------------------------------------------------------------------------
+
+  class Posix_Block_Device : public Block_Device
+  {
+    public:
+      Posix_Block_Device(const string& name, bool writeable, const string& caller_id);
+      virtual ~Posix_Block_Device();
+
+      virtual uint64 size(const string& caller_id) const;
+      virtual void read(uint64 offset, void* buf, uint64 size, const string& caller_id);
+      virtual void write(const vector< Block_Device_Run >& runs, const string& caller_id);
+      virtual void advise(uint64 offset, uint64 length);
+      virtual uint8* map(uint64& size);
+
+    protected:
+      Raw_File file;
+      uint8* mapped_data;
+      uint64 mapped_size;
+  };
+
+
+  Posix_Block_Device::Posix_Block_Device
+      (const string& name, bool writeable, const string& caller_id)
+    : Block_Device(name), file(name, writeable ? O_RDWR|O_CREAT : O_RDONLY, S_666, caller_id),
+      mapped_data(0), mapped_size(0) {}
+
+
+  Posix_Block_Device::~Posix_Block_Device()
+  {
+    if (mapped_data)
+      munmap(mapped_data, mapped_size);
+  }
+
+
+  uint64 Posix_Block_Device::size(const string& caller_id) const
+  {
+    return file_size(file.fd(), name, caller_id);
+  }
+
+
+  void Posix_Block_Device::read(uint64 offset, void* buf, uint64 size, const string& caller_id)
+  {
+    while (size > 0)
+    {
+      ssize_t result = pread(file.fd(), buf, size, offset);
+      if (result <= 0)
+        throw File_Error(errno, name, caller_id);
+      buf = (uint8*)buf + result;
+      offset += result;
+      size -= result;
+    }
+  }
+
+
+  void Posix_Block_Device::write(const vector< Block_Device_Run >& runs, const string& caller_id)
+  {
+    for (vector< Block_Device_Run >::const_iterator it = runs.begin(); it != runs.end(); ++it)
+    {
+      if (!it->iov.empty())
+        pwritev_all(file.fd(), &it->iov[0], it->iov.size(), it->offset, 0, name, caller_id);
+    }
+  }
+
+
+  void Posix_Block_Device::advise(uint64 offset, uint64 length)
+  {
+    posix_fadvise(file.fd(), offset, length, POSIX_FADV_WILLNEED);
+  }
+
+
+  uint8* Posix_Block_Device::map(uint64& size)
+  {
+    if (!mapped_data)
+    {
+      mapped_size = file_size(file.fd(), name, "Posix_Block_Device::map");
+      void* ptr = (mapped_size > 0 ?
+          mmap(0, mapped_size, PROT_READ, MAP_SHARED, file.fd(), 0) : MAP_FAILED);
+      if (ptr == MAP_FAILED)
+      {
+        mapped_size = 0;
+        return 0;
+      }
+      mapped_data = (uint8*)ptr;
+    }
+    size = mapped_size;
+    return mapped_data;
+  }
+
+
+  //---------------------------------------------------------------------------
+
+  map< string, vector< uint8 > >& memory_files()
+  {
+    static map< string, vector< uint8 > > files;
+    return files;
+  }
+
+
+  class Memory_Block_Device : public Block_Device
+  {
+    public:
+      Memory_Block_Device(const string& name, bool writeable, const string& caller_id);
+
+      virtual uint64 size(const string& caller_id) const { return content->size(); }
+      virtual void read(uint64 offset, void* buf, uint64 size, const string& caller_id);
+      virtual void write(const vector< Block_Device_Run >& runs, const string& caller_id);
+      virtual uint8* map(uint64& size);
+
+    private:
+      vector< uint8 >* content;
+  };
+
+
+  Memory_Block_Device::Memory_Block_Device
+      (const string& name, bool writeable, const string& caller_id) : Block_Device(name)
+  {
+    if (!writeable && memory_files().find(name) == memory_files().end())
+      throw File_Error(ENOENT, name, caller_id);
+    content = &memory_files()[name];
+  }
+
+
+  void Memory_Block_Device::read(uint64 offset, void* buf, uint64 size, const string& caller_id)
+  {
+    if (offset + size > content->size())
+      throw File_Error(0, name, caller_id);
+    memcpy(buf, &(*content)[offset], size);
+  }
+
+
+  void Memory_Block_Device::write(const vector< Block_Device_Run >& runs, const string& caller_id)
+  {
+    for (vector< Block_Device_Run >::const_iterator it = runs.begin(); it != runs.end(); ++it)
+    {
+      uint64 offset = it->offset;
+      if (offset + run_length(*it) > content->size())
+        content->resize(offset + run_length(*it), 0);
+      for (vector< struct iovec >::const_iterator iov_it = it->iov.begin();
+          iov_it != it->iov.end(); ++iov_it)
+      {
+        memcpy(&(*content)[offset], iov_it->iov_base, iov_it->iov_len);
+        offset += iov_it->iov_len;
+      }
+    }
+  }
+
+
+  uint8* Memory_Block_Device::map(uint64& size)
+  {
+    size = content->size();
+    return (size > 0 ? &(*content)[0] : 0);
+  }
+
+
+  //---------------------------------------------------------------------------
+
+  const uint64 DIRECT_ALIGNMENT = 4096;
+
+  inline uint64 align_down(uint64 pos) { return pos & ~(DIRECT_ALIGNMENT - 1); }
+  inline uint64 align_up(uint64 pos) { return align_down(pos + DIRECT_ALIGNMENT - 1); }
+
+
+  class Direct_Block_Device : public Block_Device
+  {
+    public:
+      Direct_Block_Device(const string& name, bool writeable, const string& caller_id);
+      virtual ~Direct_Block_Device();
+
+      virtual uint64 size(const string& caller_id) const { return file_size(fd, name, caller_id); }
+      virtual void read(uint64 offset, void* buf, uint64 size, const string& caller_id);
+      virtual void write(const vector< Block_Device_Run >& runs, const string& caller_id);
+
+    private:
+      int fd;
+      uint8* bounce;
+      uint64 bounce_size;
+
+      void reserve_bounce(uint64 size, const string& caller_id);
+      // Reads the aligned range into the bounce buffer. Beyond the end of the
+      // file the bounce buffer is filled with zeros.
+      uint64 read_aligned(uint64 begin, uint64 end, uint8* target, const string& caller_id);
+  };
+
+
+  Direct_Block_Device::Direct_Block_Device
+      (const string& name, bool writeable, const string& caller_id)
+    : Block_Device(name), fd(-1), bounce(0), bounce_size(0)
+  {
+    int oflag = writeable ? O_RDWR|O_CREAT : O_RDONLY;
+    fd = open64(name.c_str(), oflag|O_DIRECT, S_666);
+    // Some file systems, e.g. tmpfs, do not support O_DIRECT.
+    if (fd < 0 && errno == EINVAL)
+      fd = open64(name.c_str(), oflag, S_666);
+    if (fd < 0)
+      throw File_Error(errno, name, caller_id);
+    if (writeable)
+      fchmod(fd, S_666);
+  }
+
+
+  Direct_Block_Device::~Direct_Block_Device()
+  {
+    free(bounce);
+    close(fd);
+  }
+
+
+  void Direct_Block_Device::reserve_bounce(uint64 size, const string& caller_id)
+  {
+    if (size <= bounce_size)
+      return;
+    free(bounce);
+    bounce = 0;
+    bounce_size = 0;
+    void* ptr = 0;
+    if (posix_memalign(&ptr, DIRECT_ALIGNMENT, size) != 0)
+      throw File_Error(ENOMEM, name, caller_id);
+    bounce = (uint8*)ptr;
+    bounce_size = size;
+  }
+
+
+  uint64 Direct_Block_Device::read_aligned
+      (uint64 begin, uint64 end, uint8* target, const string& caller_id)
+  {
+    uint64 pos = begin;
+    while (pos < end)
+    {
+      ssize_t result = pread(fd, target + (pos - begin), end - pos, pos);
+      if (result < 0)
+        throw File_Error(errno, name, caller_id);
+      if (result == 0)
+        break;
+      pos += result;
+    }
+    memset(target + (pos - begin), 0, end - pos);
+    return pos;
+  }
+
+
+  void Direct_Block_Device::read(uint64 offset, void* buf, uint64 size, const string& caller_id)
+  {
+    uint64 begin = align_down(offset);
+    uint64 end = align_up(offset + size);
+    reserve_bounce(end - begin, caller_id);
+    if (read_aligned(begin, end, bounce, caller_id) < offset + size)
+      throw File_Error(0, name, caller_id);
+    memcpy(buf, bounce + (offset - begin), size);
+  }
+
+
+  void Direct_Block_Device::write(const vector< Block_Device_Run >& runs, const string& caller_id)
+  {
+    for (vector< Block_Device_Run >::const_iterator it = runs.begin(); it != runs.end(); ++it)
+    {
+      uint64 length = run_length(*it);
+      if (length == 0)
+        continue;
+      uint64 begin = align_down(it->offset);
+      uint64 end = align_up(it->offset + length);
+      reserve_bounce(end - begin, caller_id);
+
+      // Keep the bytes of partially overwritten sectors.
+      if (begin < it->offset)
+        read_aligned(begin, begin + DIRECT_ALIGNMENT, bounce, caller_id);
+      if (it->offset + length < end && (end - DIRECT_ALIGNMENT > begin || begin == it->offset))
+        read_aligned(end - DIRECT_ALIGNMENT, end, bounce + (end - DIRECT_ALIGNMENT - begin), caller_id);
+
+      uint8* target = bounce + (it->offset - begin);
+      for (vector< struct iovec >::const_iterator iov_it = it->iov.begin();
+          iov_it != it->iov.end(); ++iov_it)
+      {
+        memcpy(target, iov_it->iov_base, iov_it->iov_len);
+        target += iov_it->iov_len;
+      }
+
+      uint64 old_size = file_size(fd, name, caller_id);
+      struct iovec vec;
+      vec.iov_base = bounce;
+      vec.iov_len = end - begin;
+      pwritev_all(fd, &vec, 1, begin, 0, name, caller_id);
+
+      // The padding of the last sector must not extend the file.
+      uint64 new_size = max(old_size, it->offset + length);
+      if (end > new_size && ftruncate64(fd, new_size) != 0)
+        throw File_Error(errno, name, caller_id);
+    }
+  }
+
+
+  //---------------------------------------------------------------------------
+
+  class Uring_Block_Device : public Posix_Block_Device
+  {
+    public:
+      Uring_Block_Device(const string& name, bool writeable, const string& caller_id);
+      virtual ~Uring_Block_Device();
+
+      // Reads stay synchronous: a single blocking request gains nothing from a ring.
+      virtual void write(const vector< Block_Device_Run >& runs, const string& caller_id);
+
+    private:
+      struct Request
+      {
+        uint64 offset;
+        const struct iovec* iov;
+        uint32 iov_count;
+        uint64 length;
+        int64 result;
+      };
+
+      int ring_fd;
+      uint32 ring_entries;
+      void* sq_ring;
+      uint64 sq_ring_size;
+      void* cq_ring;
+      uint64 cq_ring_size;
+      struct io_uring_sqe* sqes;
+      uint64 sqes_size;
+
+      volatile uint32* sq_tail;
+      volatile uint32* sq_mask;
+      volatile uint32* sq_array;
+      volatile uint32* cq_head;
+      volatile uint32* cq_tail;
+      volatile uint32* cq_mask;
+      struct io_uring_cqe* cqes;
+
+      void close_ring();
+      void submit_and_wait(Request* begin, uint32 count, const string& caller_id);
+  };
+
+
+  Uring_Block_Device::Uring_Block_Device
+      (const string& name, bool writeable, const string& caller_id)
+    : Posix_Block_Device(name, writeable, caller_id), ring_fd(-1), ring_entries(0),
+      sq_ring(MAP_FAILED), sq_ring_size(0), cq_ring(MAP_FAILED), cq_ring_size(0),
+      sqes((struct io_uring_sqe*)MAP_FAILED), sqes_size(0)
+  {
+    if (!writeable)
+      return;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, 64, &params);
+    if (ring_fd < 0)
+      return;
+
+    ring_entries = params.sq_entries;
+    sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(uint32);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+    sq_ring = mmap(0, sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    cq_ring = mmap(0, cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                   ring_fd, IORING_OFF_CQ_RING);
+    sqes = (struct io_uring_sqe*)mmap(0, sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                                      ring_fd, IORING_OFF_SQES);
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED)
+    {
+      close_ring();
+      return;
+    }
+
+    sq_tail = (uint32*)((uint8*)sq_ring + params.sq_off.tail);
+    sq_mask = (uint32*)((uint8*)sq_ring + params.sq_off.ring_mask);
+    sq_array = (uint32*)((uint8*)sq_ring + params.sq_off.array);
+    cq_head = (uint32*)((uint8*)cq_ring + params.cq_off.head);
+    cq_tail = (uint32*)((uint8*)cq_ring + params.cq_off.tail);
+    cq_mask = (uint32*)((uint8*)cq_ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe*)((uint8*)cq_ring + params.cq_off.cqes);
+  }
+
+
+  Uring_Block_Device::~Uring_Block_Device()
+  {
+    close_ring();
+  }
+
+
+  void Uring_Block_Device::close_ring()
+  {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqes_size);
+    if (cq_ring != MAP_FAILED)
+      munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED)
+      munmap(sq_ring, sq_ring_size);
+    sqes = (struct io_uring_sqe*)MAP_FAILED;
+    cq_ring = MAP_FAILED;
+    sq_ring = MAP_FAILED;
+    if (ring_fd >= 0)
+      close(ring_fd);
+    ring_fd = -1;
+  }
+
+
+  void Uring_Block_Device::submit_and_wait(Request* begin, uint32 count, const string& caller_id)
+  {
+    uint32 tail = *sq_tail;
+    for (uint32 i = 0; i < count; ++i)
+    {
+      uint32 idx = tail & *sq_mask;
+      struct io_uring_sqe* sqe = &sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->fd = file.fd();
+      sqe->off = begin[i].offset;
+      sqe->addr = (uint64)begin[i].iov;
+      sqe->len = begin[i].iov_count;
+      sqe->user_data = i;
+      sq_array[idx] = idx;
+      ++tail;
+    }
+    __sync_synchronize();
+    *sq_tail = tail;
+    __sync_synchronize();
+
+    uint32 submitted = 0;
+    uint32 completed = 0;
+    while (completed < count)
+    {
+      int result = syscall(__NR_io_uring_enter, ring_fd, count - submitted, count - completed,
+                           IORING_ENTER_GETEVENTS, 0, 0);
+      if (result < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw File_Error(errno, name, caller_id);
+      }
+      submitted += result;
+
+      uint32 head = *cq_head;
+      __sync_synchronize();
+      while (head != *cq_tail)
+      {
+        struct io_uring_cqe* cqe = &cqes[head & *cq_mask];
+        begin[cqe->user_data].result = cqe->res;
+        ++head;
+        ++completed;
+      }
+      __sync_synchronize();
+      *cq_head = head;
+    }
+  }
+
+
+  void Uring_Block_Device::write(const vector< Block_Device_Run >& runs, const string& caller_id)
+  {
+    if (ring_fd < 0)
+    {
+      Posix_Block_Device::write(runs, caller_id);
+      return;
+    }
+
+    vector< Request > requests;
+    for (vector< Block_Device_Run >::const_iterator it = runs.begin(); it != runs.end(); ++it)
+    {
+      uint64 offset = it->offset;
+      for (uint32 i = 0; i < it->iov.size(); i += IOV_MAX)
+      {
+        Request request;
+        request.offset = offset;
+        request.iov = &it->iov[i];
+        request.iov_count = min(it->iov.size() - i, (size_t)IOV_MAX);
+        request.length = 0;
+        for (uint32 j = 0; j < request.iov_count; ++j)
+          request.length += request.iov[j].iov_len;
+        request.result = 0;
+        requests.push_back(request);
+        offset += request.length;
+      }
+    }
+
+    for (uint32 i = 0; i < requests.size(); i += ring_entries)
+      submit_and_wait(&requests[i], min((uint32)requests.size() - i, ring_entries), caller_id);
+
+    // Complete short writes synchronously.
+    for (vector< Request >::const_iterator it = requests.begin(); it != requests.end(); ++it)
+    {
+      if (it->result < 0)
+        throw File_Error(-it->result, name, caller_id);
+      if ((uint64)it->result < it->length)
+        pwritev_all(file.fd(), it->iov, it->iov_count, it->offset, it->result, name, caller_id);
+    }
+  }
+}
+
+
+Block_Device* new_block_device
+    (uint32 io_backend, const string& name, bool writeable, const string& caller_id)
+{
+  if (io_backend == Block_Device::POSIX_IO)
+    return new Posix_Block_Device(name, writeable, caller_id);
+  else if (io_backend == Block_Device::MEMORY_IO)
+    return new Memory_Block_Device(name, writeable, caller_id);
+  else if (io_backend == Block_Device::DIRECT_IO)
+    return new Direct_Block_Device(name, writeable, caller_id);
+  else if (io_backend == Block_Device::URING_IO)
+    return new Uring_Block_Device(name, writeable, caller_id);
+  throw File_Error(0, name, caller_id + "::unknown io backend");
+}
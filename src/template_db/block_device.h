@@ -0,0 +1,95 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___TEMPLATE_DB__BLOCK_DEVICE_H
+#define DE__OSM3S___TEMPLATE_DB__BLOCK_DEVICE_H
+
+#include "types.h"
+
+#include <sys/uio.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/** A sequence of buffers that is written to consecutive bytes from offset on. */
+struct Block_Device_Run
+{
+  Block_Device_Run(uint64 offset_) : offset(offset_) {}
+
+  uint64 offset;
+  vector< struct iovec > iov;
+};
+
+
+/** The interface through which File_Blocks and Random_File access their data
+    files. Which implementation is used is selected per file by
+    File_Properties::get_io_backend().
+
+    All methods throw a File_Error with the given caller_id on failure. Opening
+    a file that does not exist without O_CREAT throws with error number ENOENT
+    for every implementation. */
+class Block_Device
+{
+  Block_Device(const Block_Device&);
+  Block_Device& operator=(const Block_Device&);
+
+  public:
+    // pread and pwritev on a plain file descriptor.
+    static const uint32 POSIX_IO = 0;
+    // The file content is kept in the memory of this process only. It survives
+    // closing the device, but not the process. Intended for tests and benchmarks.
+    static const uint32 MEMORY_IO = 1;
+    // The file is opened with O_DIRECT, bypassing the page cache. Unaligned
+    // requests are served through an aligned bounce buffer.
+    static const uint32 DIRECT_IO = 2;
+    // Like POSIX_IO, but all runs of a write are submitted at once to an
+    // io_uring. Falls back to POSIX_IO if the kernel does not offer io_uring.
+    static const uint32 URING_IO = 3;
+
+    Block_Device(const string& name_) : name(name_) {}
+    virtual ~Block_Device() {}
+
+    const string& get_name() const { return name; }
+
+    virtual uint64 size(const string& caller_id) const = 0;
+    virtual void read(uint64 offset, void* buf, uint64 size, const string& caller_id) = 0;
+    virtual void write(const vector< Block_Device_Run >& runs, const string& caller_id) = 0;
+
+    // Only a hint that the given range will be read soon.
+    virtual void advise(uint64 offset, uint64 length) {}
+
+    // Returns a read-only mapping of the whole file and sets size to its length,
+    // or returns 0 if the device cannot be mapped. The mapping is valid until
+    // the device is destroyed or written to.
+    virtual uint8* map(uint64& size) { return 0; }
+
+  protected:
+    string name;
+};
+
+
+/** Opens the file name with the implementation io_backend. The returned object
+    goes into the ownership of the caller. */
+Block_Device* new_block_device
+    (uint32 io_backend, const string& name, bool writeable, const string& caller_id);
+
+
+#endif
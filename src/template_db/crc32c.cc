@@ -0,0 +1,130 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+
+namespace
+{
+  const uint32 CRC32C_POLYNOMIAL = 0x82f63b78;
+  
+  // Tables for slicing by eight: table[k][b] is the CRC of byte b followed by k zero bytes.
+  struct Crc32c_Tables
+  {
+    Crc32c_Tables()
+    {
+      for (uint32 i = 0; i < 256; ++i)
+      {
+        uint32 crc = i;
+        for (int j = 0; j < 8; ++j)
+          crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLYNOMIAL : 0);
+        table[0][i] = crc;
+      }
+      for (uint32 i = 0; i < 256; ++i)
+      {
+        for (int k = 1; k < 8; ++k)
+          table[k][i] = (table[k-1][i] >> 8) ^ table[0][table[k-1][i] & 0xff];
+      }
+    }
+    
+    uint32 table[8][256];
+  };
+  
+  
+  uint32 crc32c_software(const uint8* data, uint64 size, uint32 crc)
+  {
+    static Crc32c_Tables tables;
+    const uint32 (*table)[256] = tables.table;
+    
+    while (size > 0 && ((unsigned long)data & 7))
+    {
+      crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xff];
+      --size;
+    }
+    while (size >= 8)
+    {
+      uint32 low, high;
+      memcpy(&low, data, 4);
+      memcpy(&high, data + 4, 4);
+      low ^= crc;
+      crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff]
+          ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24]
+          ^ table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff]
+          ^ table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+      data += 8;
+      size -= 8;
+    }
+    while (size > 0)
+    {
+      crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xff];
+      --size;
+    }
+    return crc;
+  }
+  
+  
+#if defined(__x86_64__)
+  __attribute__((target("sse4.2")))
+  uint32 crc32c_sse42(const uint8* data, uint64 size, uint32 crc)
+  {
+    while (size > 0 && ((unsigned long)data & 7))
+    {
+      crc = _mm_crc32_u8(crc, *data++);
+      --size;
+    }
+    uint64 crc64 = crc;
+    while (size >= 8)
+    {
+      crc64 = _mm_crc32_u64(crc64, *(const uint64*)data);
+      data += 8;
+      size -= 8;
+    }
+    crc = crc64;
+    while (size > 0)
+    {
+      crc = _mm_crc32_u8(crc, *data++);
+      --size;
+    }
+    return crc;
+  }
+  
+  
+  bool has_sse42()
+  {
+    static bool result = __builtin_cpu_supports("sse4.2");
+    return result;
+  }
+#endif
+}
+
+
+uint32 crc32c(const void* data, uint64 size, uint32 crc)
+{
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (has_sse42())
+    return ~crc32c_sse42((const uint8*)data, size, crc);
+#endif
+  return ~crc32c_software((const uint8*)data, size, crc);
+}
@@ -0,0 +1,31 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___TEMPLATE_DB__CRC32C_H
+#define DE__OSM3S___TEMPLATE_DB__CRC32C_H
+
+#include "types.h"
+
+
+/** Computes the CRC-32C (Castagnoli) of size bytes at data. To checksum data
+    in pieces, pass the result for the previous pieces as crc. The SSE 4.2
+    instruction is used if the processor offers it. */
+uint32 crc32c(const void* data, uint64 size, uint32 crc = 0);
+
+
+#endif
@@ -20,6 +20,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/select.h>
@@ -29,6 +30,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <deque>
 #include <cstdlib>
 #include <cstring>
@@ -85,6 +87,23 @@ string getcwd()
   return result;
 }
 
+string block_cache_share_name(const string& dispatcher_share_name)
+{
+  return dispatcher_share_name + "_block_cache";
+}
+
+string index_image_share_name(const string& dispatcher_share_name)
+{
+  return dispatcher_share_name + "_index";
+}
+
+// The generation counter follows db_dir and shadow_name in the shared memory.
+uint32 generation_offset(uint32 db_dir_size, uint32 shadow_name_size)
+{
+  return (5*sizeof(uint32) + db_dir_size + shadow_name_size + sizeof(uint32) - 1)
+      /sizeof(uint32)*sizeof(uint32);
+}
+
 void millisleep(uint32 milliseconds)
 {
   struct timeval timeout_;
@@ -93,6 +112,16 @@ void millisleep(uint32 milliseconds)
   select(FD_SETSIZE, NULL, NULL, NULL, &timeout_);
 }
 
+uint64 milliseconds_since(const struct timeval& start)
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+  int64 elapsed = ((int64)now.tv_sec - start.tv_sec)*1000
+      + ((int64)now.tv_usec - start.tv_usec)/1000;
+  return elapsed > 0 ? elapsed : 0;
+}
+
+
 struct sockaddr_un
 {
   unsigned short sun_family;
@@ -136,12 +165,13 @@ vector< uint32 > Blocking_Client_Socket::get_arguments(int num_arguments)
     // Wait for each argument up to 0.1 seconds
     result.push_back(0);
     int bytes_read = recv(socket_descriptor, &result.back(), sizeof(uint32), 0);
-    uint counter = 0;
-    while (bytes_read == -1 && counter <= 100)
+    if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
     {
-      bytes_read = recv(socket_descriptor, &result.back(), sizeof(uint32), 0);
-      millisleep(1);
-      ++counter;
+      struct pollfd poll_fd;
+      poll_fd.fd = socket_descriptor;
+      poll_fd.events = POLLIN;
+      if (poll(&poll_fd, 1, 100) > 0)
+        bytes_read = recv(socket_descriptor, &result.back(), sizeof(uint32), 0);
     }
     if (bytes_read == 0)
     {
@@ -215,10 +245,40 @@ Dispatcher::Dispatcher
       total_available_space(total_available_space_),
       total_available_time_units(total_available_time_units_),
       logger(logger_),
-      pending_commit(false)
+      pending_commit(false),
+      block_cache(0),
+      index_image(0),
+      max_queue_wait(15000),
+      num_admitted_readers(0),
+      total_queue_wait(0),
+      max_observed_queue_wait(0),
+      num_queue_timeouts(0)
 {
   signal(SIGPIPE, SIG_IGN);
   
+  metrics.declare("overpass_dispatcher_connections", "gauge",
+      "Open client connections.");
+  metrics.declare("overpass_dispatcher_readers", "gauge",
+      "Registered reading processes, by whether they still read the index.");
+  metrics.declare("overpass_dispatcher_waiting_readers", "gauge",
+      "Read requests waiting for free resources.");
+  metrics.declare("overpass_dispatcher_admitted_total", "counter",
+      "Read requests admitted.");
+  metrics.declare("overpass_dispatcher_rejected_total", "counter",
+      "Read requests rejected, by reason.");
+  metrics.declare("overpass_dispatcher_queue_wait_seconds", "histogram",
+      "Time admitted read requests have waited for free resources.");
+  metrics.declare("overpass_dispatcher_space_bytes", "gauge",
+      "Memory available to and claimed by the reading processes.");
+  metrics.declare("overpass_dispatcher_time_units", "gauge",
+      "Time units available to and claimed by the reading processes.");
+  metrics.declare("overpass_dispatcher_commit_pending", "gauge",
+      "1 if a commit waits for processes that read the index.");
+  metrics.declare("overpass_dispatcher_commit_duration_seconds", "histogram",
+      "Duration of copying the shadow files onto the main index files.");
+  metrics.declare("overpass_dispatcher_block_cache_lookups_total", "counter",
+      "Lookups in the shared block cache, by result.");
+  
   // get the absolute pathname of the current directory
   if (db_dir.substr(0, 1) != "/")
     db_dir = getcwd() + db_dir_;
@@ -244,7 +304,7 @@ Dispatcher::Dispatcher
   if (chmod(socket_name.c_str(), S_666) == -1)
     throw File_Error
         (errno, socket_name, "Dispatcher_Server::8");
-  if (listen(socket_descriptor, max_num_reading_processes) == -1)
+  if (listen(socket_descriptor, max< uint >(max_num_reading_processes, SOMAXCONN)) == -1)
     throw File_Error
         (errno, socket_name, "Dispatcher_Server::5");
   
@@ -287,6 +347,10 @@ Dispatcher::Dispatcher
   // Set command state to zero.
   *(uint32*)dispatcher_shm_ptr = 0;
   
+  // Generations must not repeat those of an earlier instance.
+  *(uint32*)(dispatcher_shm_ptr + generation_offset(db_dir.size(), shadow_name.size()))
+      = time(NULL);
+  
   if (file_exists(shadow_name))
   {
     copy_shadows_to_mains();
@@ -295,10 +359,16 @@ Dispatcher::Dispatcher
   remove_shadows();
   remove((shadow_name + ".lock").c_str());
   set_current_footprints();
+  publish_index_image();
+  
+  // A block cache left over by a crashed instance must not be used by any client.
+  shm_unlink(block_cache_share_name(dispatcher_share_name).c_str());
 }
 
 Dispatcher::~Dispatcher()
 {
+  delete index_image;
+  delete block_cache;
   close(socket_descriptor);
   munmap((void*)dispatcher_shm_ptr, SHM_SIZE + db_dir.size() + shadow_name.size());
   shm_unlink(dispatcher_share_name.c_str());
@@ -358,6 +428,8 @@ void Dispatcher::write_commit(pid_t pid)
 
   if (logger)
     logger->write_commit(pid);
+  struct timeval start_time;
+  gettimeofday(&start_time, 0);
   try
   {
     Raw_File shadow_file(shadow_name, O_RDWR|O_CREAT|O_EXCL, S_666, "write_commit:1");
@@ -370,10 +442,17 @@ void Dispatcher::write_commit(pid_t pid)
     return;
   }
   
+  if (block_cache)
+    block_cache->increment_generation();
+  
   remove(shadow_name.c_str());
   remove_shadows();
   remove((shadow_name + ".lock").c_str());
   set_current_footprints();
+  publish_index_image();
+  
+  metrics.observe("overpass_dispatcher_commit_duration_seconds",
+      milliseconds_since(start_time)/1000., Metrics::seconds_buckets());
 }
 
 void Dispatcher::request_read_and_idx(pid_t pid, uint32 max_allowed_time, uint64 max_allowed_space,
@@ -486,6 +565,25 @@ void Dispatcher::remove_shadows()
   }
 }
 
+void Dispatcher::publish_index_image()
+{
+  // A new image means a new state of the database.
+  ++*(uint32*)(dispatcher_shm_ptr + generation_offset(db_dir.size(), shadow_name.size()));
+  
+  // Clients fall back to reading the index files if there is no image.
+  delete index_image;
+  index_image = 0;
+  try
+  {
+    index_image = new Index_Image(index_image_share_name(dispatcher_share_name), db_dir,
+				  controlled_files);
+  }
+  catch (File_Error e)
+  {
+    cerr<<"File_Error "<<e.error_number<<' '<<strerror(e.error_number)<<' '<<e.filename<<' '<<e.origin<<'\n';
+  }
+}
+
 void Dispatcher::set_current_footprints()
 {
   for (vector< File_Properties* >::size_type i = 0;
@@ -587,77 +685,133 @@ vector< Dispatcher::pid_t > Dispatcher::write_index_of_empty_blocks()
 
 void Dispatcher::standby_loop(uint64 milliseconds)
 {
-  uint32 counter = 0;
+  struct timeval start_time;
+  gettimeofday(&start_time, 0);
+  
+  struct timeval last_metrics_time = start_time;
   uint32 idle_counter = 0;
   uint32 last_pid = 0;
-  while ((milliseconds == 0) || (counter < milliseconds/100))
+  vector< struct pollfd > poll_fds;
+  vector< pid_t > poll_pids;
+  deque< pid_t > ready_pids;
+  while ((milliseconds == 0) || (milliseconds_since(start_time) < milliseconds))
   {
-    struct sockaddr_un sockaddr_un_dummy;
-    uint sockaddr_un_dummy_size = sizeof(sockaddr_un_dummy);
-    int socket_fd = accept(socket_descriptor, (sockaddr*)&sockaddr_un_dummy,
-			   (socklen_t*)&sockaddr_un_dummy_size);
-    if (socket_fd == -1)
-    {
-      if (errno != EAGAIN && errno != EWOULDBLOCK)
-	throw File_Error
-	    (errno, "(socket)", "Dispatcher_Server::6");
-    }
-    else
-    {
-      if (fcntl(socket_fd, F_SETFL, O_RDWR|O_NONBLOCK) == -1)
-	throw File_Error
-	    (errno, "(socket)", "Dispatcher_Server::7");  
-      started_connections.push_back(socket_fd);
-    }
-
-    // associate to a new connection the pid of the sender
-    for (vector< int >::iterator it = started_connections.begin();
-        it != started_connections.end(); ++it)
+    if (ready_pids.empty())
     {
-      pid_t pid;
-      int bytes_read = recv(*it, &pid, sizeof(pid_t), 0);
-      if (bytes_read == -1)
-	;
-      else
+      // Sleep until one of the sockets becomes readable. Connections that still have
+      // a command pending are served at once. The shared memory command path has
+      // no means to wake us up, hence it is looked at least every 100 milliseconds.
+      poll_fds.clear();
+      poll_pids.clear();
+      bool command_pending = false;
+      
+      struct pollfd poll_fd;
+      poll_fd.fd = socket_descriptor;
+      poll_fd.events = POLLIN;
+      poll_fd.revents = 0;
+      poll_fds.push_back(poll_fd);
+      for (vector< int >::const_iterator it = started_connections.begin();
+          it != started_connections.end(); ++it)
+      {
+        poll_fd.fd = *it;
+        poll_fds.push_back(poll_fd);
+      }
+      for (map< pid_t, Blocking_Client_Socket* >::const_iterator
+          it = connection_per_pid.base_map().begin();
+          it != connection_per_pid.base_map().end(); ++it)
       {
+        poll_fd.fd = it->second->descriptor();
+        poll_fds.push_back(poll_fd);
+        poll_pids.push_back(it->first);
+        if (it->second->command_pending())
+          command_pending = true;
+      }
+      
+      int timeout = (command_pending ? 0 : 100);
+      uint64 elapsed = milliseconds_since(start_time);
+      if (milliseconds > 0)
+        timeout = (elapsed < milliseconds ? min< uint64 >(timeout, milliseconds - elapsed) : 0);
+      if (poll(&poll_fds[0], poll_fds.size(), timeout) == -1 && errno != EINTR)
+        throw File_Error
+	    (errno, "(socket)", "Dispatcher_Server::9");
+      
+      // associate to a new connection the pid of the sender
+      vector< int >::size_type num_started = started_connections.size();
+      for (vector< int >::size_type i = num_started; i > 0; --i)
+      {
+        if (poll_fds[i].revents == 0)
+	  continue;
+	
+	pid_t pid;
+	int bytes_read = recv(started_connections[i-1], &pid, sizeof(pid_t), 0);
+	if (bytes_read == -1)
+	  continue;
+	
 	if (bytes_read != 0)
-	  connection_per_pid.set(pid, new Blocking_Client_Socket(*it));
+	  connection_per_pid.set(pid, new Blocking_Client_Socket(started_connections[i-1]));
 	else
-	  close(*it);
+	  close(started_connections[i-1]);
 	
-	*it = started_connections.back();
+	started_connections[i-1] = started_connections.back();
 	started_connections.pop_back();
-	break;
+      }
+      
+      // accept all new connections. Their pids are read as soon as they have arrived.
+      while (poll_fds[0].revents & POLLIN)
+      {
+        struct sockaddr_un sockaddr_un_dummy;
+        uint sockaddr_un_dummy_size = sizeof(sockaddr_un_dummy);
+        int socket_fd = accept(socket_descriptor, (sockaddr*)&sockaddr_un_dummy,
+			       (socklen_t*)&sockaddr_un_dummy_size);
+        if (socket_fd == -1)
+        {
+          if (errno != EAGAIN && errno != EWOULDBLOCK)
+	    throw File_Error
+	        (errno, "(socket)", "Dispatcher_Server::6");
+	  break;
+        }
+        if (fcntl(socket_fd, F_SETFL, O_RDWR|O_NONBLOCK) == -1)
+	  throw File_Error
+	      (errno, "(socket)", "Dispatcher_Server::7");  
+        started_connections.push_back(socket_fd);
+      }
+      
+      // queue the connections with input round robin, starting after the last served pid
+      vector< pid_t >::size_type first
+          = upper_bound(poll_pids.begin(), poll_pids.end(), last_pid) - poll_pids.begin();
+      for (vector< pid_t >::size_type i = 0; i < poll_pids.size(); ++i)
+      {
+        vector< pid_t >::size_type j = (first + i) % poll_pids.size();
+        Blocking_Client_Socket* connection = connection_per_pid.get(poll_pids[j]);
+        if (connection != 0
+            && (poll_fds[1 + num_started + j].revents != 0 || connection->command_pending()))
+	  ready_pids.push_back(poll_pids[j]);
       }
     }
     
-    uint32 command = 0;
-    uint32 client_pid = 0;
+    // Resources may have been freed by the last command, and waiting requests may have timed out.
+    if (!waiting_readers.empty())
+      admit_waiting_readers();
     
-    // poll all open connections round robin
-    for (map< pid_t, Blocking_Client_Socket* >::const_iterator
-        it = connection_per_pid.base_map().upper_bound(last_pid);
-        it != connection_per_pid.base_map().end(); ++it)
+    if (milliseconds_since(last_metrics_time) >= 1000)
     {
-      command = it->second->get_command();
-      if (command != 0)
-      {
-	client_pid = it->first;
-	break;
-      }
+      write_metrics();
+      gettimeofday(&last_metrics_time, 0);
     }
-    if (command == 0)
+    
+    uint32 command = 0;
+    uint32 client_pid = 0;
+    
+    while (command == 0 && !ready_pids.empty())
     {
-      for (map< pid_t, Blocking_Client_Socket* >::const_iterator it = connection_per_pid.base_map().begin();
-          it != connection_per_pid.base_map().upper_bound(last_pid); ++it)
+      Blocking_Client_Socket* connection = connection_per_pid.get(ready_pids.front());
+      if (connection != 0)
       {
-        command = it->second->get_command();
+        command = connection->get_command();
         if (command != 0)
-        {
-	  client_pid = it->first;
-	  break;
-        }
+	  client_pid = ready_pids.front();
       }
+      ready_pids.pop_front();
     }
     if (command != 0)
       last_pid = client_pid;
@@ -669,9 +823,7 @@ void Dispatcher::standby_loop(uint64 milliseconds)
     
     if (*(uint32*)dispatcher_shm_ptr == 0 && command == 0)
     {
-      ++counter;
       ++idle_counter;
-      millisleep(idle_counter < 10 ? idle_counter*10 : 100);
       continue;
     }
     
@@ -748,19 +900,7 @@ void Dispatcher::standby_loop(uint64 milliseconds)
 	vector< uint32 > arguments = connection_per_pid.get(client_pid)->get_arguments(4);
 	if (arguments.size() < 4)
 	{
-	  connection_per_pid.get(client_pid)->send_result(0);
-	  continue;
-	}
-	
-	if (processes_reading.size() >= max_num_reading_processes)
-	{
-	  check_and_purge();
-	  connection_per_pid.get(client_pid)->send_result(0);
-	  continue;
-	}
-	
-	if (pending_commit)
-	{
+	  metrics.add("overpass_dispatcher_rejected_total", 1, "reason=\"malformed\"");
 	  connection_per_pid.get(client_pid)->send_result(0);
 	  continue;
 	}
@@ -769,28 +909,35 @@ void Dispatcher::standby_loop(uint64 milliseconds)
 	uint64 max_allowed_space = (((uint64)arguments[2])<<32 | arguments[1]);
 	uint32 client_token = arguments[3];
 	
-	if (max_allowed_space > (total_available_space - total_claimed_space())/2)
+	// Requests that could not even run on an idle server are rejected at once.
+	if (max_allowed_space > total_available_space/2
+	    || max_allowed_time > total_available_time_units/2)
 	{
+	  metrics.add("overpass_dispatcher_rejected_total", 1, "reason=\"too_large\"");
 	  connection_per_pid.get(client_pid)->send_result(0);
 	  continue;
 	}
 	
-	if (max_allowed_time > (total_available_time_units - total_claimed_time_units())/2)
+	for (deque< Waiting_Reader >::iterator it = waiting_readers.begin();
+	    it != waiting_readers.end(); ++it)
 	{
-	  connection_per_pid.get(client_pid)->send_result(0);
-	  continue;
+	  if (it->pid == client_pid)
+	  {
+	    waiting_readers.erase(it);
+	    break;
+	  }
 	}
 	
-	if (rate_limit > 0 && client_token > 0
-            && Reader_Entry::active_client_tokens[client_token] >= rate_limit)
-	{
-	  connection_per_pid.get(client_pid)->send_result(RATE_LIMITED);
-	  continue;
-	}
+	if (processes_reading.size() >= max_num_reading_processes)
+	  check_and_purge();
 	
-	request_read_and_idx(client_pid, max_allowed_time, max_allowed_space, client_token);
-	connection_per_pid.get(client_pid)->send_result(command);
-	*(uint32*)(dispatcher_shm_ptr + 2*sizeof(uint32)) = client_pid;
+	// The answer is sent by admit_waiting_readers once the request fits.
+	struct timeval arrival;
+	gettimeofday(&arrival, 0);
+	waiting_readers.push_back(Waiting_Reader(client_pid, max_allowed_time, max_allowed_space,
+	    client_token, client_token == 0 ? PRIORITY_INTERNAL : PRIORITY_PUBLIC, arrival));
+	connection_per_pid.get(client_pid)->defer();
+	admit_waiting_readers();
       }
       else if (command == READ_IDX_FINISHED)
       {
@@ -876,7 +1023,6 @@ void Dispatcher::standby_loop(uint64 milliseconds)
     {
       cerr<<"File_Error "<<e.error_number<<' '<<strerror(e.error_number)<<' '<<e.filename<<' '<<e.origin<<'\n';
       
-      counter += 30;
       millisleep(3000);
   
       // Set command state to zero.
@@ -885,6 +1031,21 @@ void Dispatcher::standby_loop(uint64 milliseconds)
   }
 }
 
+void Dispatcher::set_block_cache_size(uint64 size)
+{
+  delete block_cache;
+  block_cache = 0;
+  if (size == 0)
+    return;
+  
+  uint32 slot_size = 0;
+  for (vector< File_Properties* >::const_iterator it = controlled_files.begin();
+      it != controlled_files.end(); ++it)
+    slot_size = max(slot_size, (*it)->get_block_size());
+  block_cache = new Shared_Block_Cache
+      (block_cache_share_name(dispatcher_share_name), size, slot_size);
+}
+
 void Dispatcher::output_status()
 {
   try
@@ -933,17 +1094,67 @@ void Dispatcher::output_status()
 	  <<' '<<processes_reading[*it].max_time<<'\n';
     }
     
+    set< pid_t > waiting_pids;
+    for (deque< Waiting_Reader >::const_iterator it = waiting_readers.begin();
+        it != waiting_readers.end(); ++it)
+    {
+      status<<"waiting\t"<<it->pid<<' '<<it->priority_class<<' '<<it->client_token
+          <<' '<<it->max_space<<' '<<it->max_time<<' '<<milliseconds_since(it->arrival)<<'\n';
+      waiting_pids.insert(it->pid);
+    }
+    
     for (map< pid_t, Blocking_Client_Socket* >::const_iterator it = connection_per_pid.base_map().begin();
 	 it != connection_per_pid.base_map().end(); ++it)
     {
       if (processes_reading_idx.find(it->first) == processes_reading_idx.end()
-	  && collected_pids.find(it->first) == collected_pids.end())
+	  && collected_pids.find(it->first) == collected_pids.end()
+	  && waiting_pids.find(it->first) == waiting_pids.end())
 	status<<"pending\t"<<it->first<<'\n';
     }
+    
+    status<<"queue "<<waiting_readers.size()<<' '<<num_admitted_readers
+        <<' '<<(num_admitted_readers > 0 ? total_queue_wait/num_admitted_readers : 0)
+        <<' '<<max_observed_queue_wait<<' '<<num_queue_timeouts<<'\n';
+    
+    if (block_cache)
+      status<<"block_cache "<<block_cache->get_slot_count()<<' '<<block_cache->get_slot_size()
+          <<' '<<block_cache->get_generation()
+          <<' '<<block_cache->get_hits()<<' '<<block_cache->get_misses()<<'\n';
   }
   catch (...) {}
 }
 
+void Dispatcher::write_metrics()
+{
+  metrics.set("overpass_dispatcher_connections",
+      started_connections.size() + connection_per_pid.base_map().size());
+  metrics.set("overpass_dispatcher_readers", processes_reading_idx.size(), "state=\"index\"");
+  metrics.set("overpass_dispatcher_readers",
+      processes_reading.size() - processes_reading_idx.size(), "state=\"data\"");
+  metrics.set("overpass_dispatcher_waiting_readers", waiting_readers.size());
+  metrics.set("overpass_dispatcher_space_bytes", total_available_space, "kind=\"available\"");
+  metrics.set("overpass_dispatcher_space_bytes", total_claimed_space(), "kind=\"claimed\"");
+  metrics.set("overpass_dispatcher_time_units", total_available_time_units, "kind=\"available\"");
+  metrics.set("overpass_dispatcher_time_units", total_claimed_time_units(), "kind=\"claimed\"");
+  metrics.set("overpass_dispatcher_commit_pending", pending_commit ? 1 : 0);
+  if (block_cache)
+  {
+    metrics.set("overpass_dispatcher_block_cache_lookups_total", block_cache->get_hits(),
+        "result=\"hit\"");
+    metrics.set("overpass_dispatcher_block_cache_lookups_total", block_cache->get_misses(),
+        "result=\"miss\"");
+  }
+  
+  try
+  {
+    metrics.write(shadow_name + ".metrics");
+  }
+  catch (File_Error e)
+  {
+    cerr<<"File_Error "<<e.error_number<<' '<<strerror(e.error_number)<<' '<<e.filename<<' '<<e.origin<<'\n';
+  }
+}
+
 void Idx_Footprints::set_current_footprint(const vector< bool >& footprint)
 {
   current_footprint = footprint;
@@ -1001,6 +1212,140 @@ uint64 Dispatcher::total_claimed_time_units() const
   return result;
 }
 
+bool Dispatcher::rate_limited(const Waiting_Reader& reader) const
+{
+  if (rate_limit == 0 || reader.client_token == 0)
+    return false;
+  map< uint32, uint >::const_iterator it = Reader_Entry::active_client_tokens.find(reader.client_token);
+  return it != Reader_Entry::active_client_tokens.end() && it->second >= rate_limit;
+}
+
+bool Dispatcher::can_admit(const Waiting_Reader& reader) const
+{
+  return !pending_commit
+      && !rate_limited(reader)
+      && processes_reading.size() < max_num_reading_processes
+      && reader.max_space <= (total_available_space - total_claimed_space())/2
+      && reader.max_time <= (total_available_time_units - total_claimed_time_units())/2;
+}
+
+double Dispatcher::claimed_share(uint32 client_token) const
+{
+  // The cost of a process is the larger of its shares of the total space and time.
+  double result = 0;
+  for (map< pid_t, Reader_Entry >::const_iterator it = processes_reading.begin();
+      it != processes_reading.end(); ++it)
+  {
+    if (it->second.client_token == client_token)
+      result += max((double)it->second.max_space/max(total_available_space, (uint64)1),
+          (double)it->second.max_time/max(total_available_time_units, (uint64)1));
+  }
+  return result;
+}
+
+namespace
+{
+  struct Waiting_Reader_Order
+  {
+    Waiting_Reader_Order(const map< uint32, double >& share_per_token_)
+        : share_per_token(share_per_token_) {}
+    
+    bool operator()(const Waiting_Reader* lhs, const Waiting_Reader* rhs) const
+    {
+      if (lhs->priority_class != rhs->priority_class)
+        return lhs->priority_class < rhs->priority_class;
+      double lhs_share = share_per_token.find(lhs->client_token)->second;
+      double rhs_share = share_per_token.find(rhs->client_token)->second;
+      if (lhs_share != rhs_share)
+        return lhs_share < rhs_share;
+      if (lhs->arrival.tv_sec != rhs->arrival.tv_sec)
+        return lhs->arrival.tv_sec < rhs->arrival.tv_sec;
+      return lhs->arrival.tv_usec < rhs->arrival.tv_usec;
+    }
+    
+    const map< uint32, double >& share_per_token;
+  };
+}
+
+void Dispatcher::admit_waiting_readers()
+{
+  // Drop requests whose client has gone and reject those that have waited too long.
+  for (deque< Waiting_Reader >::iterator it = waiting_readers.begin(); it != waiting_readers.end(); )
+  {
+    Blocking_Client_Socket* connection = connection_per_pid.get(it->pid);
+    if (connection == 0)
+      it = waiting_readers.erase(it);
+    else if (milliseconds_since(it->arrival) >= max_queue_wait)
+    {
+      bool limited = rate_limited(*it);
+      metrics.add("overpass_dispatcher_rejected_total", 1,
+          limited ? "reason=\"rate_limited\"" : "reason=\"timeout\"");
+      connection->send_result(limited ? RATE_LIMITED : 0);
+      ++num_queue_timeouts;
+      it = waiting_readers.erase(it);
+    }
+    else
+      ++it;
+  }
+  
+  // Serve the priority classes in order. Within a class, the client token with the least
+  // resources in use goes first, and ties are broken by arrival. Smaller requests may pass
+  // a request that does not fit yet, unless that request has already waited for a third of
+  // max_queue_wait. From then on, the resources are kept free for it. Requests held back
+  // only by the rate limit of their client token never block the others.
+  bool admitted = true;
+  while (admitted && !waiting_readers.empty())
+  {
+    admitted = false;
+    
+    map< uint32, double > share_per_token;
+    vector< const Waiting_Reader* > order;
+    for (deque< Waiting_Reader >::const_iterator it = waiting_readers.begin();
+        it != waiting_readers.end(); ++it)
+    {
+      if (share_per_token.find(it->client_token) == share_per_token.end())
+        share_per_token[it->client_token] = claimed_share(it->client_token);
+      order.push_back(&*it);
+    }
+    stable_sort(order.begin(), order.end(), Waiting_Reader_Order(share_per_token));
+    
+    for (vector< const Waiting_Reader* >::const_iterator it = order.begin(); it != order.end(); ++it)
+    {
+      if (!can_admit(**it))
+      {
+        if (!rate_limited(**it) && milliseconds_since((*it)->arrival) >= max_queue_wait/3)
+          break;
+        continue;
+      }
+      
+      pid_t pid = (*it)->pid;
+      uint64 waited = milliseconds_since((*it)->arrival);
+      request_read_and_idx(pid, (*it)->max_time, (*it)->max_space, (*it)->client_token);
+      connection_per_pid.get(pid)->send_result(REQUEST_READ_AND_IDX);
+      *(uint32*)(dispatcher_shm_ptr + 2*sizeof(uint32)) = pid;
+      
+      ++num_admitted_readers;
+      total_queue_wait += waited;
+      max_observed_queue_wait = max(max_observed_queue_wait, waited);
+      metrics.add("overpass_dispatcher_admitted_total", 1);
+      metrics.observe("overpass_dispatcher_queue_wait_seconds", waited/1000.,
+          Metrics::seconds_buckets());
+      
+      for (deque< Waiting_Reader >::iterator wit = waiting_readers.begin();
+          wit != waiting_readers.end(); ++wit)
+      {
+        if (wit->pid == pid)
+        {
+          waiting_readers.erase(wit);
+          break;
+        }
+      }
+      admitted = true;
+      break;
+    }
+  }
+}
+
 void Dispatcher::check_and_purge()
 {
   set< pid_t > collected_pids;
@@ -1045,7 +1390,7 @@ void Dispatcher::check_and_purge()
 
 Dispatcher_Client::Dispatcher_Client
     (string dispatcher_share_name_)
-    : dispatcher_share_name(dispatcher_share_name_)
+    : dispatcher_share_name(dispatcher_share_name_), block_cache(0), index_image(0)
 {
   signal(SIGPIPE, SIG_IGN);
   
@@ -1068,8 +1413,20 @@ Dispatcher_Client::Dispatcher_Client
       + db_dir.size()), *(uint32*)(dispatcher_shm_ptr + db_dir.size() +
 		       4*sizeof(uint32)));
 
+  connect_socket();
+  
+  // The block cache is optional. Hence the client works without if it is absent.
+  try
+  {
+    block_cache = new Shared_Block_Cache(block_cache_share_name(dispatcher_share_name));
+  }
+  catch (File_Error e) {}
+}
+
+void Dispatcher_Client::connect_socket()
+{
   // initialize the socket for the client
-  string socket_name = db_dir + dispatcher_share_name_;
+  string socket_name = db_dir + dispatcher_share_name;
   socket_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
   if (socket_descriptor == -1)
     throw File_Error
@@ -1089,7 +1446,10 @@ Dispatcher_Client::Dispatcher_Client
 
 Dispatcher_Client::~Dispatcher_Client()
 {
-  close(socket_descriptor);
+  delete index_image;
+  delete block_cache;
+  if (socket_descriptor != -1)
+    close(socket_descriptor);
   munmap((void*)dispatcher_shm_ptr,
 	 Dispatcher::SHM_SIZE + db_dir.size() + shadow_name.size());
   close(dispatcher_shm_fd);
@@ -1213,29 +1573,45 @@ void Dispatcher_Client::request_read_and_idx(uint32 max_allowed_time, uint64 max
 					     uint32 client_token)
 {
   *(uint32*)(dispatcher_shm_ptr + 2*sizeof(uint32)) = 0;
+  if (socket_descriptor == -1)
+    connect_socket();
   
-  uint counter = 0;
-  uint32 ack = 0;
-  while (++counter <= 50)
+  // The dispatcher keeps the request waiting until enough resources are free. Hence
+  // the answer is either the admission or a final rejection.
+  send_message(Dispatcher::REQUEST_READ_AND_IDX,
+	       "Dispatcher_Client::request_read_and_idx::socket::1");
+  send_message(max_allowed_time, "Dispatcher_Client::request_read_and_idx::socket::2");
+  send_message(max_allowed_space, "Dispatcher_Client::request_read_and_idx::socket::3");
+  send_message(client_token, "Dispatcher_Client::request_read_and_idx::socket::4");
+  
+  uint32 ack = ack_arrived();
+  if (ack != 0 && ack != Dispatcher::RATE_LIMITED)
   {
-    send_message(Dispatcher::REQUEST_READ_AND_IDX,
-		 "Dispatcher_Client::request_read_and_idx::socket::1");
-    send_message(max_allowed_time, "Dispatcher_Client::request_read_and_idx::socket::2");
-    send_message(max_allowed_space, "Dispatcher_Client::request_read_and_idx::socket::3");
-    send_message(client_token, "Dispatcher_Client::request_read_and_idx::socket::4");
+    if (block_cache)
+      block_cache->refresh_generation();
     
-    ack = ack_arrived();
-    if (ack != 0 && ack != Dispatcher::RATE_LIMITED)
-      return;
-    
-    millisleep(300);
+    // The image cannot change while this process is registered as reading the index.
+    delete index_image;
+    index_image = 0;
+    try
+    {
+      index_image = new Index_Image(index_image_share_name(dispatcher_share_name));
+    }
+    catch (File_Error e) {}
+    return;
   }
+  
   if (ack == Dispatcher::RATE_LIMITED)
     throw File_Error(0, dispatcher_share_name, "Dispatcher_Client::request_read_and_idx::rate_limited");
   else
     throw File_Error(0, dispatcher_share_name, "Dispatcher_Client::request_read_and_idx::timeout");
 }
 
+uint32 Dispatcher_Client::get_generation()
+{
+  return *(uint32*)(dispatcher_shm_ptr + generation_offset(db_dir.size(), shadow_name.size()));
+}
+
 void Dispatcher_Client::read_idx_finished()
 {
   *(uint32*)(dispatcher_shm_ptr + 2*sizeof(uint32)) = 0;
@@ -1261,7 +1637,12 @@ void Dispatcher_Client::read_finished()
     send_message(Dispatcher::READ_FINISHED, "Dispatcher_Client::read_finished::socket");
     
     if (ack_arrived())
+    {
+      // The dispatcher has dropped the connection.
+      close(socket_descriptor);
+      socket_descriptor = -1;
       return;
+    }
   }
   throw File_Error(0, dispatcher_share_name, "Dispatcher_Client::read_finished::timeout");
 }
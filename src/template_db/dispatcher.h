@@ -19,8 +19,14 @@
 #ifndef DE__OSM3S___TEMPLATE_DB__DISPATCHER_H
 #define DE__OSM3S___TEMPLATE_DB__DISPATCHER_H
 
+#include "block_cache.h"
+#include "index_image.h"
+#include "metrics.h"
 #include "types.h"
 
+#include <sys/time.h>
+
+#include <deque>
 #include <map>
 #include <set>
 #include <vector>
@@ -74,10 +80,18 @@ struct Blocking_Client_Socket
   vector< uint32 > get_arguments(int num_arguments);
   void clear_state();
   void send_result(uint32 result);
+  // Keeps the current command unanswered without processing it again. The client stays blocked
+  // until send_result is called.
+  void defer() { if (state == processing_command) state = deferred; }
   ~Blocking_Client_Socket();
+  
+  int descriptor() const { return socket_descriptor; }
+  // True if a command has been received but not yet answered or the client has hung up.
+  bool command_pending() const { return state == processing_command || state == disconnected; }
+  
 private:
   int socket_descriptor;
-  enum { waiting, processing_command, disconnected } state;
+  enum { waiting, processing_command, deferred, disconnected } state;
   uint32 last_command;
 };
 
@@ -158,12 +172,29 @@ struct Reader_Entry
 };
 
 
+/* A request for reading that waits in the dispatcher for enough free resources. */
+struct Waiting_Reader
+{
+  Waiting_Reader(uint pid_, uint32 max_time_, uint64 max_space_, uint32 client_token_,
+                 uint priority_class_, const struct timeval& arrival_)
+    : pid(pid_), max_time(max_time_), max_space(max_space_), client_token(client_token_),
+      priority_class(priority_class_), arrival(arrival_) {}
+  
+  uint pid;
+  uint32 max_time;
+  uint64 max_space;
+  uint32 client_token;
+  uint priority_class;
+  struct timeval arrival;
+};
+
+
 class Dispatcher
 {
   public:
     typedef uint pid_t;
     
-    static const int SHM_SIZE = 3*sizeof(uint32) + 2*sizeof(uint32);//20+12+2*(256+4);
+    static const int SHM_SIZE = 3*sizeof(uint32) + 2*sizeof(uint32) + 2*sizeof(uint32);//20+12+2*(256+4);
     static const int OFFSET_BACK = 20;
     static const int OFFSET_DB_1 = OFFSET_BACK+12;
     static const int OFFSET_DB_2 = OFFSET_DB_1+(256+4);
@@ -193,7 +224,8 @@ class Dispatcher
     
     /** Opens a shared memory for dispatcher communication. Furthermore,
       * detects whether idx or idy are valid, clears to idx if necessary,
-      * and loads them into the shared memory idx_share_name. */
+      * and loads them into the shared memory index_image_share_name(dispatcher_share_name).
+      * The parameter index_share_name is unused. */
     Dispatcher(string dispatcher_share_name,
 	       string index_share_name,
 	       string shadow_name,
@@ -218,11 +250,17 @@ class Dispatcher
     
     /** Copies the shadow files onto the main index files. A lock prevents
         that incomplete copies after a crash may leave the database in an
-	unstable state. Removes the mutex for the write process. */
+	unstable state. Publishes a new index image. Removes the mutex for the write process. */
     void write_commit(pid_t pid);
     
     /** Read operations: --------------------------------------------------- */
 
+    /** The priority classes for reading processes. Processes without a client token
+        are started locally, e.g. by monitoring or maintenance scripts, and always
+        take precedence over public requests. */
+    static const uint PRIORITY_INTERNAL = 0;
+    static const uint PRIORITY_PUBLIC = 1;
+    
     /** Request the index for a read operation and registers the reading process.
         Reading the index files should be taking a quick copy, because if any process
 	is in this state, write_commits are blocked. */
@@ -252,9 +290,21 @@ class Dispatcher
         into shadow_name.status. */
     void output_status();
     
+    /** Writes counters and gauges of the dispatcher in the Prometheus text format
+        into shadow_name.metrics. The standby_loop calls this once per second. */
+    void write_metrics();
+    
     /** Set the limit of simultaneous queries from a single IP address. */
     void set_rate_limit(uint rate_limit_) { rate_limit = rate_limit_; }
     
+    /** Set how long a request for reading may wait for free resources
+        before it is rejected. */
+    void set_max_queue_wait(uint32 milliseconds) { max_queue_wait = milliseconds; }
+    
+    /** Creates a shared block cache of the given size in bytes for the reading
+        processes. Its hits and misses are reported by output_status. */
+    void set_block_cache_size(uint64 size);
+    
   private:
     vector< File_Properties* > controlled_files;
     vector< Idx_Footprints > data_footprints;
@@ -276,8 +326,18 @@ class Dispatcher
     Connection_Per_Pid_Map connection_per_pid;
     set< pid_t > disconnected;
     bool pending_commit;
+    Shared_Block_Cache* block_cache;
+    Index_Image* index_image;
+    deque< Waiting_Reader > waiting_readers;
+    uint32 max_queue_wait;
+    uint64 num_admitted_readers;
+    uint64 total_queue_wait;
+    uint64 max_observed_queue_wait;
+    uint64 num_queue_timeouts;
+    Metrics metrics;
     
     void copy_shadows_to_mains();
+    void publish_index_image();
     void copy_mains_to_shadows();
     void remove_shadows();
     void set_current_footprints();
@@ -285,6 +345,11 @@ class Dispatcher
     void check_and_purge();
     uint64 total_claimed_space() const;
     uint64 total_claimed_time_units() const;
+    
+    bool rate_limited(const Waiting_Reader& reader) const;
+    bool can_admit(const Waiting_Reader& reader) const;
+    double claimed_share(uint32 client_token) const;
+    void admit_waiting_readers();
 };
 
 
@@ -320,7 +385,8 @@ class Dispatcher_Client
     database. Can be safely called multiple times for the same process. */
     void read_idx_finished();
     
-    /** Unregisteres a reading process. */
+    /** Unregisteres a reading process. The dispatcher then closes the connection,
+    but a later request_read_and_idx connects again. */
     void read_finished();
     
     /** Other operations: -------------------------------------------------- */
@@ -346,14 +412,29 @@ class Dispatcher_Client
     const string& get_db_dir() { return db_dir; }
     const string& get_shadow_name() { return shadow_name; }
     
+    /** Returns the block cache of the dispatcher or null if it runs without. */
+    Shared_Block_Cache* get_block_cache() { return block_cache; }
+    
+    /** Returns the index image attached by the last request_read_and_idx
+        or null if none is available. */
+    const Index_Image* get_index_image() { return index_image; }
+    
+    /** Returns the generation of the database. It changes with every commit and
+        every restart of the dispatcher. Hence a process that is registered as reading
+        can tell by it whether its data from an earlier registration is still valid. */
+    uint32 get_generation();
+    
   private:
     string dispatcher_share_name;
     int dispatcher_shm_fd;
     volatile uint8* dispatcher_shm_ptr;
     string db_dir, shadow_name;
     int socket_descriptor;
+    Shared_Block_Cache* block_cache;
+    Index_Image* index_image;
     
     uint32 ack_arrived();
+    void connect_socket();
     
     template< class TObject >
     void send_message(TObject message, string source_pos);
@@ -362,5 +443,11 @@ class Dispatcher_Client
 
 void millisleep(uint32 milliseconds);
 
+uint64 milliseconds_since(const struct timeval& start);
+
+string block_cache_share_name(const string& dispatcher_share_name);
+
+string index_image_share_name(const string& dispatcher_share_name);
+
 
 #endif
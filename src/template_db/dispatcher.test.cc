@@ -179,12 +179,32 @@ struct Test_File : File_Properties
     return IntIndex::max_size_of();
   }
   
+  uint32 get_compression_factor() const
+  {
+    return 1;
+  }
+  
+  uint32 get_compression_method() const
+  {
+    return File_Blocks_Index_Base::NO_COMPRESSION;
+  }
+  
+  uint32 get_io_backend() const
+  {
+    return Block_Device::POSIX_IO;
+  }
+  
+  uint32 get_checksum_method() const
+  {
+    return File_Blocks_Index_Base::NO_CHECKSUM;
+  }
+  
   File_Blocks_Index_Base* new_data_index
-      (bool writeable, bool use_shadow, string db_dir, string file_name_extension)
-      const
+      (bool writeable, bool use_shadow, string db_dir, string file_name_extension,
+       const Index_Image* index_image) const
   {
     return new File_Blocks_Index< IntIndex >
-        (*this, writeable, use_shadow, db_dir, file_name_extension);
+        (*this, writeable, use_shadow, db_dir, file_name_extension, index_image);
   }
   
   string basename, basedir;
@@ -19,14 +19,22 @@
 #ifndef DE__OSM3S___TEMPLATE_DB__FILE_BLOCKS_H
 #define DE__OSM3S___TEMPLATE_DB__FILE_BLOCKS_H
 
+#include "block_cache.h"
+#include "block_device.h"
+#include "crc32c.h"
 #include "file_blocks_index.h"
 #include "types.h"
+#include "zlib_wrapper.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
-#include <list>
+#include <cstring>
 #include <vector>
 
 /** Declarations: -----------------------------------------------------------*/
@@ -38,8 +46,8 @@ template< class TIndex >
 struct File_Blocks_Basic_Iterator
 {
   File_Blocks_Basic_Iterator
-  (const typename list< File_Block_Index_Entry< TIndex > >::iterator& begin,
-   const typename list< File_Block_Index_Entry< TIndex > >::iterator& end)
+  (const File_Blocks_Index_Iterator< TIndex >& begin,
+   const File_Blocks_Index_Iterator< TIndex >& end)
     : block_begin(begin), block_it(begin), block_end(end), is_empty(false) {}
     
   File_Blocks_Basic_Iterator(const File_Blocks_Basic_Iterator& a)
@@ -48,9 +56,9 @@ struct File_Blocks_Basic_Iterator
     
   int block_type() const;
    
-  typename list< File_Block_Index_Entry< TIndex > >::iterator block_begin;
-  typename list< File_Block_Index_Entry< TIndex > >::iterator block_it;
-  typename list< File_Block_Index_Entry< TIndex > >::iterator block_end;
+  File_Blocks_Index_Iterator< TIndex > block_begin;
+  File_Blocks_Index_Iterator< TIndex > block_it;
+  File_Blocks_Index_Iterator< TIndex > block_end;
   bool is_empty;
 };
 
@@ -58,8 +66,8 @@ template< class TIndex >
 struct File_Blocks_Flat_Iterator : File_Blocks_Basic_Iterator< TIndex >
 {
   File_Blocks_Flat_Iterator
-  (const typename list< File_Block_Index_Entry< TIndex > >::iterator& begin,
-   const typename list< File_Block_Index_Entry< TIndex > >::iterator& end)
+  (const File_Blocks_Index_Iterator< TIndex >& begin,
+   const File_Blocks_Index_Iterator< TIndex >& end)
     : File_Blocks_Basic_Iterator< TIndex >(begin, end) {}
   
   File_Blocks_Flat_Iterator(const File_Blocks_Flat_Iterator& a)
@@ -79,8 +87,8 @@ struct File_Blocks_Discrete_Iterator : File_Blocks_Basic_Iterator< TIndex >
 {
   File_Blocks_Discrete_Iterator
       (TIterator const& index_it_, TIterator const& index_end_,
-       const typename list< File_Block_Index_Entry< TIndex > >::iterator& begin,
-       const typename list< File_Block_Index_Entry< TIndex > >::iterator& end)
+       const File_Blocks_Index_Iterator< TIndex >& begin,
+       const File_Blocks_Index_Iterator< TIndex >& end)
     : File_Blocks_Basic_Iterator< TIndex >(begin, end),
       index_lower(index_it_), index_upper(index_it_), index_end(index_end_),
       just_inserted(false)
@@ -89,7 +97,7 @@ struct File_Blocks_Discrete_Iterator : File_Blocks_Basic_Iterator< TIndex >
   }
   
   File_Blocks_Discrete_Iterator
-      (const typename list< File_Block_Index_Entry< TIndex > >::iterator& end)
+      (const File_Blocks_Index_Iterator< TIndex >& end)
     : File_Blocks_Basic_Iterator< TIndex >(end, end) {}
   
   File_Blocks_Discrete_Iterator(const File_Blocks_Discrete_Iterator& a)
@@ -121,8 +129,8 @@ template< class TIndex, class TRangeIterator >
 struct File_Blocks_Range_Iterator : File_Blocks_Basic_Iterator< TIndex >
 {
   File_Blocks_Range_Iterator
-      (const typename list< File_Block_Index_Entry< TIndex > >::iterator& begin,
-       const typename list< File_Block_Index_Entry< TIndex > >::iterator& end,
+      (const File_Blocks_Index_Iterator< TIndex >& begin,
+       const File_Blocks_Index_Iterator< TIndex >& end,
        const TRangeIterator& index_it_,  const TRangeIterator& index_end_)
     : File_Blocks_Basic_Iterator< TIndex >(begin, end),
       index_it(index_it_), index_end(index_end_)
@@ -131,7 +139,7 @@ struct File_Blocks_Range_Iterator : File_Blocks_Basic_Iterator< TIndex >
   }
   
   File_Blocks_Range_Iterator
-      (const typename list< File_Block_Index_Entry< TIndex > >::iterator& end)
+      (const File_Blocks_Index_Iterator< TIndex >& end)
     : File_Blocks_Basic_Iterator< TIndex >(end, end) {}
   
   File_Blocks_Range_Iterator(const File_Blocks_Range_Iterator& a)
@@ -176,6 +184,22 @@ public:
   void* read_block(const File_Blocks_Basic_Iterator< TIndex >& it) const;  
   void* read_block
       (const File_Blocks_Basic_Iterator< TIndex >& it, void* buffer) const;
+  
+  // Returns a pointer to the block. If the data file is memory mapped, the
+  // pointer refers to the read-only mapping and buffer is not touched.
+  // Otherwise the block is read into buffer. sequential selects the madvise
+  // hint for the mapping.
+  uint8* access_block
+      (const File_Blocks_Basic_Iterator< TIndex >& it, void* buffer, bool sequential) const;
+  
+  bool is_mapped() const { return mapped_data != 0; }
+  
+  // Keeps ahead a copy of the reading iterator current up to prefetch depth
+  // blocks in front of it and announces the blocks it passes to the kernel.
+  // Each call accounts for one block consumed by current. distance holds the
+  // number of announced but not yet consumed blocks between calls.
+  template< class TFile_Iterator >
+  void prefetch(const TFile_Iterator& current, TFile_Iterator& ahead, uint32& distance) const;
       
   uint32 answer_size(const Flat_Iterator& it) const
   {
@@ -194,6 +218,10 @@ public:
       (const Discrete_Iterator& it, void* buf, uint32 max_keysize);
   Discrete_Iterator replace_block(Discrete_Iterator it, void* buf, uint32 max_keysize);
   
+  // Writes all blocks that are still held back in memory. This happens
+  // automatically when too many blocks are pending and in the destructor.
+  void flush();
+  
   const File_Blocks_Index< TIndex >& get_index() const { return *index; }
   
 private:
@@ -206,8 +234,37 @@ private:
   Discrete_Iterator* discrete_end_it;
   Range_Iterator* range_end_it;
 
-  Raw_File data_file;
+  Block_Device* data_file;
   Void_Pointer< void > buffer;
+  uint64 unit_size;
+  uint32 compression_buffer_size;
+  Void_Pointer< uint8 > compression_buffer;
+  Shared_Block_Cache* block_cache;
+  uint64 cache_file_id;
+  uint8* mapped_data;
+  uint64 mapped_size;
+  uint32 prefetch_depth;
+  
+  // Written blocks are held back in memory until flush. Meanwhile their index
+  // entries carry PENDING plus the number of the pending block as position.
+  static const uint32 PENDING = 0x80000000;
+  static const uint64 MAX_PENDING_BYTES = 64*1024*1024;
+  struct Pending_Block
+  {
+    uint32 size;
+    uint8* data;
+  };
+  vector< Pending_Block > pending;
+  uint64 pending_bytes;
+  
+  bool verify_checksums;
+  
+  void read_block_data(uint32 pos, uint32 size, uint32 checksum, void* buffer) const;
+  void verify_checksum(uint32 pos, const void* data, uint64 length, uint32 checksum) const;
+  void advise_block(uint32 pos, uint32 size) const;
+  void write_block_data(void* buf, uint32& pos, uint32& size, uint32& checksum);
+  vector< uint32 > allocate_pending(const vector< uint32 >& order);
+  void write_sorted(const vector< pair< uint32, uint32 > >& pos_and_block);
 };
 
 /** Implementation File_Blocks_Basic_Iterator: ------------------------------*/
@@ -217,8 +274,7 @@ int File_Blocks_Basic_Iterator< TIndex >::block_type() const
 {
   if ((block_it == block_end) || (is_empty))
     return File_Block_Index_Entry< TIndex >::EMPTY;
-  typename list< File_Block_Index_Entry< TIndex > >::const_iterator
-      it(block_it);
+  File_Blocks_Index_Iterator< TIndex > it(block_it);
   if (block_it == block_begin)
   {
     if (++it == block_end)
@@ -284,8 +340,7 @@ bool File_Blocks_Flat_Iterator< TIndex >::is_out_of_range(const TIndex& index)
     return false;
   if (index < this->block_it->index)
     return true;
-  typename list< File_Block_Index_Entry< TIndex > >::iterator
-      next_it(this->block_it);
+  File_Blocks_Index_Iterator< TIndex > next_it(this->block_it);
   if (++next_it == this->block_end)
     return false;
   if (!(index < next_it->index))
@@ -368,21 +423,22 @@ void File_Blocks_Discrete_Iterator< TIndex, TIterator >::find_next_block()
       ++index_upper;
   }
   
-  typename list< File_Block_Index_Entry< TIndex > >::const_iterator
-  next_block(this->block_it);
+  // Skip by binary search all blocks that are followed by a block with an
+  // index not greater than *index_lower.
+  File_Blocks_Index_Iterator< TIndex > next_block(this->block_it);
   ++next_block;
-  while ((next_block != this->block_end) &&
-    (!(*index_lower < next_block->index)))
+  next_block = next_block.upper_bound(*index_lower);
+  File_Blocks_Index_Iterator< TIndex > last_block(next_block);
+  --last_block;
+  File_Blocks_Index_Iterator< TIndex > match(this->block_it.lower_bound(*index_lower));
+  if (match.position() < last_block.position() && match->index == *index_lower)
   {
-    if (this->block_it->index == *index_lower)
-    {
-      // We have found a relevant block that is a segment
-      ++index_upper;
-      return;
-    }
-    ++(this->block_it);
-    ++next_block;
+    // We have found a relevant block that is a segment
+    this->block_it = match;
+    ++index_upper;
+    return;
   }
+  this->block_it = last_block;
   
   if (next_block == this->block_end)
   {
@@ -456,18 +512,21 @@ void File_Blocks_Range_Iterator< TIndex, TRangeIterator >::find_next_block()
       return;
     }
     
-    typename list< File_Block_Index_Entry< TIndex > >::const_iterator
-    next_block(this->block_it);
+    // Skip by binary search all blocks that are followed by a block with an
+    // index not greater than the lower bound of the range.
+    File_Blocks_Index_Iterator< TIndex > next_block(this->block_it);
     ++next_block;
-    while ((next_block != this->block_end) &&
-      (!(index_it.lower_bound() < next_block->index)))
+    next_block = next_block.upper_bound(index_it.lower_bound());
+    File_Blocks_Index_Iterator< TIndex > last_block(next_block);
+    --last_block;
+    File_Blocks_Index_Iterator< TIndex > match(this->block_it.lower_bound(index_it.lower_bound()));
+    if (match.position() < last_block.position())
     {
-      if (!(this->block_it->index < index_it.lower_bound()))
-	// We have found a relevant block that is a segment
-	return;
-      ++(this->block_it);
-      ++next_block;
+      // We have found a relevant block that is a segment
+      this->block_it = match;
+      return;
     }
+    this->block_it = last_block;
     
     if ((this->block_type() != File_Block_Index_Entry< TIndex >::LAST_SEGMENT)
       || (!(this->block_it->index < index_it.lower_bound())))
@@ -488,25 +547,50 @@ File_Blocks< TIndex, TIterator, TRangeIterator >::File_Blocks
      block_size(index->get_block_size()),
      writeable(index->writeable()),
      read_count_(0),
-     data_file(index->get_data_file_name(),
-	       writeable ? O_RDWR|O_CREAT : O_RDONLY,
-	       S_666, "File_Blocks::File_Blocks::1"),
-     buffer(index->get_block_size())
+     data_file(new_block_device(index->get_io_backend(), index->get_data_file_name(),
+         writeable, "File_Blocks::File_Blocks::1")),
+     buffer(index->get_block_size()),
+     unit_size(index->get_unit_size()),
+     compression_buffer_size(index->get_compression_method() == File_Blocks_Index_Base::NO_COMPRESSION ?
+         0 : (compressBound(block_size) + unit_size - 1)/unit_size*unit_size),
+     compression_buffer(compression_buffer_size),
+     block_cache(writeable ? 0 : index->block_cache),
+     cache_file_id(block_cache ? Shared_Block_Cache::file_id(index->get_data_file_name()) : 0),
+     mapped_data(0), mapped_size(0),
+     prefetch_depth(writeable ? 0 : index->prefetch_depth),
+     pending_bytes(0),
+     verify_checksums(index->verify_checksums
+         && index->get_checksum_method() != File_Blocks_Index_Base::NO_CHECKSUM)
 {
   // cerr<<"  "<<index->get_data_file_name()<<'\n'; //Debug
   
+  // Compressed blocks must be decoded anyway, hence only plain files are mapped.
+  // If the mapping fails, we silently fall back to reading.
+  if (!writeable && index->use_mmap
+      && index->get_compression_method() == File_Blocks_Index_Base::NO_COMPRESSION)
+  {
+    mapped_data = data_file->map(mapped_size);
+    if (!mapped_data)
+      mapped_size = 0;
+  }
+  
   // prepare standard iterators
-  flat_end_it = new Flat_Iterator(index->blocks.end(), index->blocks.end());
-  discrete_end_it = new Discrete_Iterator(index->blocks.end());
-  range_end_it = new Range_Iterator(index->blocks.end());
+  flat_end_it = new Flat_Iterator(index->blocks_end(), index->blocks_end());
+  discrete_end_it = new Discrete_Iterator(index->blocks_end());
+  range_end_it = new Range_Iterator(index->blocks_end());
 }
 
 template< class TIndex, class TIterator, class TRangeIterator >
 File_Blocks< TIndex, TIterator, TRangeIterator >::~File_Blocks()
 {
+  flush();
+  
   delete flat_end_it;
   delete discrete_end_it;
   delete range_end_it;
+  
+  // This also releases the mapping.
+  delete data_file;
 
   // cerr<<"~ "<<index->get_data_file_name()<<'\n'; //Debug
 }
@@ -515,7 +599,7 @@ template< class TIndex, class TIterator, class TRangeIterator >
 typename File_Blocks< TIndex, TIterator, TRangeIterator >::Flat_Iterator
     File_Blocks< TIndex, TIterator, TRangeIterator >::flat_begin()
 {
-  return Flat_Iterator(index->blocks.begin(), index->blocks.end());
+  return Flat_Iterator(index->blocks_begin(), index->blocks_end());
 }
 
 template< class TIndex, class TIterator, class TRangeIterator >
@@ -524,7 +608,7 @@ typename File_Blocks< TIndex, TIterator, TRangeIterator >::Discrete_Iterator
     (const TIterator& begin, const TIterator& end)
 {
   return File_Blocks_Discrete_Iterator< TIndex, TIterator >
-      (begin, end, index->blocks.begin(), index->blocks.end());
+      (begin, end, index->blocks_begin(), index->blocks_end());
 }
 
 template< class TIndex, class TIterator, class TRangeIterator >
@@ -532,17 +616,66 @@ typename File_Blocks< TIndex, TIterator, TRangeIterator >::Range_Iterator
 File_Blocks< TIndex, TIterator, TRangeIterator >::range_begin(const TRangeIterator& begin, const TRangeIterator& end)
 {
   return File_Blocks_Range_Iterator< TIndex, TRangeIterator >
-      (index->blocks.begin(), index->blocks.end(), begin, end);
+      (index->blocks_begin(), index->blocks_end(), begin, end);
+}
+
+template< class TIndex, class TIterator, class TRangeIterator >
+void File_Blocks< TIndex, TIterator, TRangeIterator >::read_block_data
+    (uint32 pos, uint32 size, uint32 checksum, void* buffer) const
+{
+  if (block_cache && block_cache->lookup(cache_file_id, pos, buffer, block_size))
+    return;
+  
+  if (pos & PENDING)
+  {
+    const Pending_Block& block = pending[pos & ~PENDING];
+    if (index->get_compression_method() == File_Blocks_Index_Base::NO_COMPRESSION)
+      memcpy(buffer, block.data, block_size);
+    else
+      Zlib_Inflate().decompress(block.data, block.size*unit_size, buffer, block_size);
+    return;
+  }
+  
+  if (index->get_compression_method() == File_Blocks_Index_Base::NO_COMPRESSION)
+  {
+    data_file->read((uint64)pos*unit_size, buffer, block_size, "File_Blocks::read_block_data::2");
+    __sync_fetch_and_add(&global_read_bytes(), block_size);
+    if (verify_checksums)
+      verify_checksum(pos, buffer, block_size, checksum);
+  }
+  else
+  {
+    if (size*unit_size > compression_buffer_size)
+      throw File_Error(pos, index->get_data_file_name(),
+		       "File_Blocks::read_block_data: compressed block too large");
+    data_file->read((uint64)pos*unit_size, compression_buffer.ptr, size*unit_size,
+                    "File_Blocks::read_block_data::3");
+    __sync_fetch_and_add(&global_read_bytes(), (uint64)size*unit_size);
+    if (verify_checksums)
+      verify_checksum(pos, compression_buffer.ptr, size*unit_size, checksum);
+    Zlib_Inflate().decompress(compression_buffer.ptr, size*unit_size, buffer, block_size);
+  }
+  
+  if (block_cache)
+    block_cache->insert(cache_file_id, pos, buffer);
+}
+
+template< class TIndex, class TIterator, class TRangeIterator >
+void File_Blocks< TIndex, TIterator, TRangeIterator >::verify_checksum
+    (uint32 pos, const void* data, uint64 length, uint32 checksum) const
+{
+  if (crc32c(data, length) != checksum)
+    throw File_Error(pos, index->get_data_file_name(),
+		     "File_Blocks::verify_checksum: checksum mismatch");
 }
 
 template< class TIndex, class TIterator, class TRangeIterator >
 void* File_Blocks< TIndex, TIterator, TRangeIterator >::read_block
     (const File_Blocks_Basic_Iterator< TIndex >& it) const
 {
-  data_file.seek((int64)(it.block_it->pos)*(block_size), "File_Blocks::read_block::1");
-  data_file.read((uint8*)buffer.ptr, block_size, "File_Blocks::read_block::2");
+  read_block_data(it.block_it->pos, it.block_it->size, it.block_it->checksum, buffer.ptr);
   ++read_count_;
-  ++global_read_counter();
+  __sync_fetch_and_add(&global_read_counter(), 1);
   return buffer.ptr;
 }
 
@@ -550,17 +683,101 @@ template< class TIndex, class TIterator, class TRangeIterator >
 void* File_Blocks< TIndex, TIterator, TRangeIterator >::read_block
     (const File_Blocks_Basic_Iterator< TIndex >& it, void* buffer) const
 {
-  data_file.seek((int64)(it.block_it->pos)*(block_size), "File_Blocks::read_block::3");
-  data_file.read((uint8*)buffer, block_size, "File_Blocks::read_block::4");
+  read_block_data(it.block_it->pos, it.block_it->size, it.block_it->checksum, buffer);
   if (!(it.block_it->index ==
         TIndex(((uint8*)buffer)+(sizeof(uint32)+sizeof(uint32)))))
     throw File_Error(it.block_it->pos, index->get_data_file_name(),
 		     "File_Blocks::read_block: Index inconsistent");
   ++read_count_;
-  ++global_read_counter();
+  __sync_fetch_and_add(&global_read_counter(), 1);
   return buffer;
 }
 
+template< class TIndex, class TIterator, class TRangeIterator >
+uint8* File_Blocks< TIndex, TIterator, TRangeIterator >::access_block
+    (const File_Blocks_Basic_Iterator< TIndex >& it, void* buffer, bool sequential) const
+{
+  if (!mapped_data)
+    return (uint8*)read_block(it, buffer);
+  
+  uint64 offset = ((uint64)it.block_it->pos)*block_size;
+  if (offset + block_size > mapped_size)
+    throw File_Error(it.block_it->pos, index->get_data_file_name(),
+		     "File_Blocks::access_block: block beyond end of file");
+  
+  // Besides the hint for the access pattern: the block is used completely,
+  // so let the kernel fetch it in one go.
+  static const uint64 page_mask = ~(uint64)(sysconf(_SC_PAGESIZE) - 1);
+  uint8* page_begin = mapped_data + (offset & page_mask);
+  uint64 length = mapped_data + offset + block_size - page_begin;
+  madvise(page_begin, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  madvise(page_begin, length, MADV_WILLNEED);
+  
+  __sync_fetch_and_add(&global_read_bytes(), block_size);
+  
+  uint8* block = mapped_data + offset;
+  if (verify_checksums)
+    verify_checksum(it.block_it->pos, block, block_size, it.block_it->checksum);
+  if (!(it.block_it->index == TIndex(block + (sizeof(uint32)+sizeof(uint32)))))
+    throw File_Error(it.block_it->pos, index->get_data_file_name(),
+		     "File_Blocks::access_block: Index inconsistent");
+  ++read_count_;
+  __sync_fetch_and_add(&global_read_counter(), 1);
+  return block;
+}
+
+template< class TIndex, class TIterator, class TRangeIterator >
+template< class TFile_Iterator >
+void File_Blocks< TIndex, TIterator, TRangeIterator >::prefetch
+    (const TFile_Iterator& current, TFile_Iterator& ahead, uint32& distance) const
+{
+  if (prefetch_depth == 0)
+    return;
+  
+  if (distance > 0)
+    --distance;
+  if (current.block_it == current.block_end)
+    return;
+  
+  // The reading iterator may have caught up with or jumped over the blocks
+  // announced so far.
+  if (!(ahead.block_it == ahead.block_end)
+      && ahead.block_it.position() <= current.block_it.position())
+  {
+    ahead = current;
+    distance = 0;
+  }
+  
+  while (distance < prefetch_depth && !(ahead.block_it == ahead.block_end))
+  {
+    ++ahead;
+    if (ahead.block_it == ahead.block_end)
+      break;
+    if (ahead.block_type() == File_Block_Index_Entry< TIndex >::EMPTY)
+      continue;
+    advise_block(ahead.block_it->pos, ahead.block_it->size);
+    ++distance;
+  }
+}
+
+template< class TIndex, class TIterator, class TRangeIterator >
+void File_Blocks< TIndex, TIterator, TRangeIterator >::advise_block(uint32 pos, uint32 size) const
+{
+  uint64 offset = ((uint64)pos)*unit_size;
+  uint64 length = ((uint64)size)*unit_size;
+  if (mapped_data)
+  {
+    if (offset + length > mapped_size)
+      return;
+    static const uint64 page_mask = ~(uint64)(sysconf(_SC_PAGESIZE) - 1);
+    uint8* page_begin = mapped_data + (offset & page_mask);
+    madvise(page_begin, mapped_data + offset + length - page_begin, MADV_WILLNEED);
+  }
+  else
+    // Only a hint: the kernel starts to read the range in the background.
+    data_file->advise(offset, length);
+}
+
 template< class TIndex, class TIterator, class TRangeIterator >
 uint32 File_Blocks< TIndex, TIterator, TRangeIterator >::answer_size
     (const Discrete_Iterator& it) const
@@ -590,37 +807,25 @@ typename File_Blocks< TIndex, TIterator, TRangeIterator >::Discrete_Iterator
   if (buf == 0)
     return it;
   
-  uint32 pos;
-  if (this->index->void_blocks.empty())
-  {
-    pos = this->index->block_count;
-    ++(this->index->block_count);
-  }
-  else
-  {
-    pos = index->void_blocks.back();
-    this->index->void_blocks.pop_back();
-  }
-  
+  uint32 pos = 0, size = 0, checksum = 0;
   // cerr<<dec<<pos<<"\t0x"; //Debug
   // for (uint i = 0; i < TIndex::size_of(((uint8*)buf)+(sizeof(uint32)+sizeof(uint32))); ++i)
   //   cerr<<' '<<hex<<setw(2)<<setfill('0')
   //       <<int(*(((uint8*)buf)+(sizeof(uint32)+sizeof(uint32))+i)); // Debug
   // cerr<<'\n';
   
-  data_file.seek(((int64)pos)*block_size, "File_Blocks::insert_block::1");
-  data_file.write((uint8*)buf, block_size, "File_Blocks::insert_block::2");
+  write_block_data(buf, pos, size, checksum);
   
   TIndex index(((uint8*)buf)+(sizeof(uint32)+sizeof(uint32)));
-  File_Block_Index_Entry< TIndex > entry(index, pos, max_keysize);
+  File_Block_Index_Entry< TIndex > entry(index, pos, size, max_keysize, checksum);
   Discrete_Iterator return_it(it);
   if (return_it.block_it == return_it.block_begin)
   {
-    return_it.block_it = this->index->blocks.insert(return_it.block_it, entry);
+    return_it.block_it = this->index->insert_entry(return_it.block_it, entry);
     return_it.block_begin = return_it.block_it;
   }
   else
-    return_it.block_it = this->index->blocks.insert(return_it.block_it, entry);
+    return_it.block_it = this->index->insert_entry(return_it.block_it, entry);
   return_it.just_inserted = true;
   return_it.is_empty = it.is_empty;
   return return_it;
@@ -633,18 +838,7 @@ typename File_Blocks< TIndex, TIterator, TRangeIterator >::Discrete_Iterator
 {
   if (buf != 0)
   {
-    if (this->index->void_blocks.empty())
-    {
-      it.block_it->pos = this->index->block_count;
-      ++(this->index->block_count);
-    }
-    else
-    {
-      it.block_it->pos = this->index->void_blocks.back();
-      this->index->void_blocks.pop_back();
-    }
-    data_file.seek(((int64)it.block_it->pos)*block_size, "File_Blocks::replace_block::1");
-    data_file.write((uint8*)buf, block_size, "File_Blocks::replace_block::2");
+    write_block_data(buf, it.block_it->pos, it.block_it->size, it.block_it->checksum);
     
     it.block_it->index = TIndex((uint8*)buf+(sizeof(uint32)+sizeof(uint32)));
     it.block_it->max_keysize = max_keysize;
@@ -657,13 +851,189 @@ typename File_Blocks< TIndex, TIterator, TRangeIterator >::Discrete_Iterator
     ++return_it;
     if (it.block_it == it.block_begin)
     {
-      it.block_it = index->blocks.erase(it.block_it);
+      it.block_it = index->erase_entry(it.block_it);
       it.block_begin = it.block_it;
     }
     else
-      it.block_it = index->blocks.erase(it.block_it);
+      it.block_it = index->erase_entry(it.block_it);
+    // The entries behind the erased one have moved one position to the front.
+    if (return_it.block_it != return_it.block_end
+        && it.block_it.position() < return_it.block_it.position())
+      --return_it.block_it;
     return return_it;
   }
 }
 
+template< class TIndex, class TIterator, class TRangeIterator >
+void File_Blocks< TIndex, TIterator, TRangeIterator >::write_block_data
+    (void* buf, uint32& pos, uint32& size, uint32& checksum)
+{
+  // Only the net size of the block as stored in its first four bytes is meaningful.
+  uint32 net_size = *(uint32*)buf;
+  if (net_size > block_size)
+    net_size = block_size;
+  
+  const uint8* data = (const uint8*)buf;
+  if (index->get_compression_method() == File_Blocks_Index_Base::NO_COMPRESSION)
+    size = 1;
+  else
+  {
+    uint32 compressed_size = Zlib_Deflate().compress
+        (buf, net_size, compression_buffer.ptr, compression_buffer_size);
+    size = (compressed_size + unit_size - 1)/unit_size;
+    memset(compression_buffer.ptr + compressed_size, 0, size*unit_size - compressed_size);
+    data = compression_buffer.ptr;
+  }
+  if (index->get_checksum_method() == File_Blocks_Index_Base::CRC32C_CHECKSUM)
+    checksum = crc32c(data, size*unit_size);
+  
+  __sync_fetch_and_add(&global_write_statistics().blocks, 1);
+  __sync_fetch_and_add(&global_write_statistics().net_bytes, net_size);
+  
+  // A block that has not yet reached the disk is simply replaced.
+  if (pos & PENDING)
+  {
+    Pending_Block& block = pending[pos & ~PENDING];
+    pending_bytes -= block.size*unit_size;
+    block.data = (uint8*)realloc(block.data, size*unit_size);
+    block.size = size;
+    memcpy(block.data, data, size*unit_size);
+    pending_bytes += size*unit_size;
+    __sync_fetch_and_add(&global_write_statistics().superseded, 1);
+    return;
+  }
+  
+  if (pending_bytes + size*unit_size > MAX_PENDING_BYTES)
+    flush();
+  
+  Pending_Block block;
+  block.size = size;
+  block.data = (uint8*)malloc(size*unit_size);
+  memcpy(block.data, data, size*unit_size);
+  pos = PENDING | pending.size();
+  pending.push_back(block);
+  pending_bytes += size*unit_size;
+}
+
+template< class TIndex, class TIterator, class TRangeIterator >
+void File_Blocks< TIndex, TIterator, TRangeIterator >::flush()
+{
+  if (pending.empty())
+    return;
+  
+  // Allocate the blocks in the order of their indexes, such that neighbouring
+  // blocks of the index are likely neighbours in the file. Pending blocks
+  // that have lost their index entry are dropped.
+  vector< uint32 > order;
+  for (File_Blocks_Index_Iterator< TIndex > it = index->blocks_begin(); it != index->blocks_end(); ++it)
+  {
+    if (it->pos & PENDING)
+      order.push_back(it->pos & ~PENDING);
+  }
+  __sync_fetch_and_add(&global_write_statistics().superseded, pending.size() - order.size());
+  
+  vector< uint32 > new_pos = allocate_pending(order);
+  vector< uint32 > pos_per_block(pending.size(), 0);
+  vector< pair< uint32, uint32 > > pos_and_block;
+  for (vector< uint32 >::size_type i = 0; i < order.size(); ++i)
+  {
+    pos_per_block[order[i]] = new_pos[i];
+    pos_and_block.push_back(make_pair(new_pos[i], order[i]));
+  }
+  
+  for (File_Blocks_Index_Iterator< TIndex > it = index->blocks_begin(); it != index->blocks_end(); ++it)
+  {
+    if (it->pos & PENDING)
+      it->pos = pos_per_block[it->pos & ~PENDING];
+  }
+  
+  sort(pos_and_block.begin(), pos_and_block.end());
+  write_sorted(pos_and_block);
+  
+  for (typename vector< Pending_Block >::iterator it = pending.begin(); it != pending.end(); ++it)
+    free(it->data);
+  pending.clear();
+  pending_bytes = 0;
+}
+
+// Returns the positions for the pending blocks in order. Runs of void blocks
+// are used from the end of the file, as the void blocks always have been.
+// Within a run, the blocks are placed one after another at its end, such
+// that they form a contiguous range. The remaining blocks are appended.
+template< class TIndex, class TIterator, class TRangeIterator >
+vector< uint32 > File_Blocks< TIndex, TIterator, TRangeIterator >::allocate_pending
+    (const vector< uint32 >& order)
+{
+  vector< uint32 >& void_blocks = this->index->void_blocks;
+  sort(void_blocks.begin(), void_blocks.end());
+  
+  vector< uint32 > result(order.size(), 0);
+  vector< uint32 >::size_type order_it = 0;
+  vector< uint32 >::size_type void_end = void_blocks.size();
+  vector< uint32 > remaining;
+  while (void_end > 0 && order_it < order.size())
+  {
+    vector< uint32 >::size_type run_begin = void_end - 1;
+    while (run_begin > 0 && void_blocks[run_begin - 1] + 1 == void_blocks[run_begin])
+      --run_begin;
+    uint32 run_length = void_end - run_begin;
+    
+    uint32 used = 0;
+    vector< uint32 >::size_type first = order_it;
+    while (order_it < order.size() && used + pending[order[order_it]].size <= run_length)
+      used += pending[order[order_it++]].size;
+    uint32 pos = void_blocks[void_end - 1] + 1 - used;
+    for (vector< uint32 >::size_type i = first; i < order_it; ++i)
+    {
+      result[i] = pos;
+      pos += pending[order[i]].size;
+    }
+    
+    // The unused void blocks are collected in descending order.
+    for (vector< uint32 >::size_type i = void_end - used; i > run_begin; --i)
+      remaining.push_back(void_blocks[i - 1]);
+    void_end = run_begin;
+  }
+  for (vector< uint32 >::size_type i = void_end; i > 0; --i)
+    remaining.push_back(void_blocks[i - 1]);
+  reverse(remaining.begin(), remaining.end());
+  void_blocks.swap(remaining);
+  
+  for (; order_it < order.size(); ++order_it)
+  {
+    result[order_it] = this->index->block_count;
+    this->index->block_count += pending[order[order_it]].size;
+  }
+  if (this->index->block_count >= PENDING)
+    throw File_Error(0, index->get_data_file_name(), "File_Blocks::flush: data file too large");
+  
+  return result;
+}
+
+// Writes the pending blocks sorted by their positions. Blocks that follow
+// each other immediately in the file are passed to the device as one run.
+template< class TIndex, class TIterator, class TRangeIterator >
+void File_Blocks< TIndex, TIterator, TRangeIterator >::write_sorted
+    (const vector< pair< uint32, uint32 > >& pos_and_block)
+{
+  vector< Block_Device_Run > runs;
+  uint32 end = 0;
+  for (vector< pair< uint32, uint32 > >::const_iterator it = pos_and_block.begin();
+      it != pos_and_block.end(); ++it)
+  {
+    if (runs.empty() || it->first != end)
+      runs.push_back(Block_Device_Run(((uint64)it->first)*unit_size));
+    const Pending_Block& block = pending[it->second];
+    struct iovec vec;
+    vec.iov_base = block.data;
+    vec.iov_len = block.size*unit_size;
+    runs.back().iov.push_back(vec);
+    end = it->first + block.size;
+    __sync_fetch_and_add(&global_write_statistics().written_bytes, vec.iov_len);
+  }
+  
+  data_file->write(runs, "File_Blocks::write_sorted::1");
+  __sync_fetch_and_add(&global_write_statistics().write_calls, runs.size());
+}
+
 #endif
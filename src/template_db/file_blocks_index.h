@@ -19,13 +19,15 @@
 #ifndef DE__OSM3S___TEMPLATE_DB__FILE_BLOCKS_INDEX_H
 #define DE__OSM3S___TEMPLATE_DB__FILE_BLOCKS_INDEX_H
 
+#include "block_device.h"
+#include "index_image.h"
 #include "types.h"
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
-#include <list>
 #include <vector>
 
 /** Declarations: -----------------------------------------------------------*/
@@ -40,36 +42,151 @@ struct File_Block_Index_Entry
   static const int SEGMENT = 3;
   static const int LAST_SEGMENT = 4;
   
-  File_Block_Index_Entry(const TIndex& i, uint32 pos_, uint32 max_keysize_)
-    : index(i), pos(pos_), max_keysize(max_keysize_) {}
+  File_Block_Index_Entry(const TIndex& i, uint32 pos_, uint32 size_, uint32 max_keysize_,
+                         uint32 checksum_ = 0)
+    : index(i), pos(pos_), size(size_), max_keysize(max_keysize_), checksum(checksum_) {}
   
   TIndex index;
   uint32 pos;
+  uint32 size;
   uint32 max_keysize;
+  // The checksum of the block as stored in the data file, if the index has checksums.
+  uint32 checksum;
+};
+
+template< class TIndex >
+struct File_Block_Index_Entry_Less
+{
+  bool operator()(const File_Block_Index_Entry< TIndex >& a, const TIndex& b) const
+  { return a.index < b; }
+  bool operator()(const TIndex& a, const File_Block_Index_Entry< TIndex >& b) const
+  { return a < b.index; }
+};
+
+/** Iterator over the sorted array of block index entries. Unlike a plain
+    vector iterator it survives insertions and erasures: it keeps its position,
+    and the end iterator always refers to the current end of the array. */
+template< class TIndex >
+struct File_Blocks_Index_Iterator
+{
+  typedef File_Block_Index_Entry< TIndex > Entry;
+  static const uint32 END = 0xffffffff;
+  
+  File_Blocks_Index_Iterator() : blocks(0), pos(END) {}
+  File_Blocks_Index_Iterator(vector< Entry >* blocks_, uint32 pos_)
+    : blocks(blocks_), pos(pos_ < blocks_->size() ? pos_ : END) {}
+  
+  Entry& operator*() const { return (*blocks)[pos]; }
+  Entry* operator->() const { return &(*blocks)[pos]; }
+  
+  File_Blocks_Index_Iterator& operator++()
+  {
+    if (++pos >= blocks->size())
+      pos = END;
+    return *this;
+  }
+  
+  File_Blocks_Index_Iterator& operator--()
+  {
+    pos = (pos == END ? blocks->size() : pos) - 1;
+    return *this;
+  }
+  
+  bool operator==(const File_Blocks_Index_Iterator& a) const { return pos == a.pos; }
+  bool operator!=(const File_Blocks_Index_Iterator& a) const { return pos != a.pos; }
+  
+  uint32 position() const { return (pos == END ? blocks->size() : pos); }
+  
+  // Binary search from this position to the end for the first entry whose index
+  // is not less than index.
+  File_Blocks_Index_Iterator lower_bound(const TIndex& index) const
+  {
+    return File_Blocks_Index_Iterator(blocks, std::lower_bound
+        (blocks->begin() + position(), blocks->end(), index, File_Block_Index_Entry_Less< TIndex >())
+        - blocks->begin());
+  }
+  
+  // Binary search from this position to the end for the first entry whose index
+  // is greater than index.
+  File_Blocks_Index_Iterator upper_bound(const TIndex& index) const
+  {
+    return File_Blocks_Index_Iterator(blocks, std::upper_bound
+        (blocks->begin() + position(), blocks->end(), index, File_Block_Index_Entry_Less< TIndex >())
+        - blocks->begin());
+  }
+  
+  vector< Entry >* blocks;
+  uint32 pos;
 };
 
 template< class TIndex >
 struct File_Blocks_Index : public File_Blocks_Index_Base
 {
   public:
+    // The index file of a compressed or checksummed data file starts with a
+    // header of five uint32: magic, version, compression method, compression
+    // factor and checksum method. Each entry then carries its size in units
+    // after its position and its checksum, if any, after the size.
+    // The header of version 7512 lacks the checksum method and its entries
+    // have no checksums. Index files without header are uncompressed and have
+    // neither sizes nor checksums.
+    static const uint32 FILE_FORMAT_MAGIC = 0x4f53334d;
+    static const uint32 FILE_FORMAT_VERSION = 7513;
+    static const uint32 FILE_FORMAT_VERSION_WITHOUT_CHECKSUMS = 7512;
+    static const uint32 HEADER_SIZE = 5*sizeof(uint32);
+    
     File_Blocks_Index(const File_Properties& file_prop,
 		      bool writeable, bool use_shadow,
-		      string db_dir, string file_name_extension);
+		      string db_dir, string file_name_extension,
+		      const Index_Image* index_image = 0);
     virtual ~File_Blocks_Index();
     bool writeable() const { return (empty_index_file_name != ""); }
     const string& file_name_extension() const { return file_name_extension_; }
     
     string get_data_file_name() const { return data_file_name; }
     uint64 get_block_size() const { return block_size_; }
+    uint32 get_compression_method() const { return compression_method; }
+    uint32 get_compression_factor() const { return compression_factor; }
+    uint32 get_io_backend() const { return io_backend; }
+    uint32 get_checksum_method() const { return checksum_method; }
+    vector< Block_Location > get_block_locations() const;
+    // The size of the units in which block positions and sizes are counted.
+    uint64 get_unit_size() const { return block_size_/compression_factor; }
+    
+    File_Blocks_Index_Iterator< TIndex > blocks_begin()
+    { return File_Blocks_Index_Iterator< TIndex >(&blocks, 0); }
+    File_Blocks_Index_Iterator< TIndex > blocks_end()
+    { return File_Blocks_Index_Iterator< TIndex >(&blocks, File_Blocks_Index_Iterator< TIndex >::END); }
+    
+    // Inserts entry before it and returns the iterator to the new entry.
+    File_Blocks_Index_Iterator< TIndex > insert_entry
+        (const File_Blocks_Index_Iterator< TIndex >& it, const File_Block_Index_Entry< TIndex >& entry)
+    {
+      uint32 pos = it.position();
+      blocks.insert(blocks.begin() + pos, entry);
+      return File_Blocks_Index_Iterator< TIndex >(&blocks, pos);
+    }
+    
+    // Erases the entry at it and returns the iterator to the following entry.
+    File_Blocks_Index_Iterator< TIndex > erase_entry(const File_Blocks_Index_Iterator< TIndex >& it)
+    {
+      uint32 pos = it.position();
+      blocks.erase(blocks.begin() + pos);
+      return File_Blocks_Index_Iterator< TIndex >(&blocks, pos);
+    }
     
   private:
     string index_file_name;
     string empty_index_file_name;
     string data_file_name;
     string file_name_extension_;
+    uint32 compression_method;
+    uint32 compression_factor;
+    uint32 io_backend;
+    uint32 checksum_method;
     
   public:
-    list< File_Block_Index_Entry< TIndex > > blocks;
+    vector< File_Block_Index_Entry< TIndex > > blocks;
     vector< uint32 > void_blocks;
     uint32 block_count;
     uint64 block_size_;
@@ -84,7 +201,7 @@ vector< bool > get_data_index_footprint(const File_Properties& file_prop,
 template< class TIndex >
 File_Blocks_Index< TIndex >::File_Blocks_Index
     (const File_Properties& file_prop, bool writeable, bool use_shadow,
-     string db_dir, string file_name_extension) :
+     string db_dir, string file_name_extension, const Index_Image* index_image) :
      index_file_name(db_dir + file_prop.get_file_name_trunk()
          + file_name_extension + file_prop.get_data_suffix()
          + file_prop.get_index_suffix()
@@ -95,53 +212,119 @@ File_Blocks_Index< TIndex >::File_Blocks_Index
      data_file_name(db_dir + file_prop.get_file_name_trunk()
          + file_name_extension + file_prop.get_data_suffix()),
      file_name_extension_(file_name_extension),
+     compression_method(file_prop.get_compression_method()),
+     compression_factor(file_prop.get_compression_factor()),
+     io_backend(file_prop.get_io_backend()),
+     checksum_method(file_prop.get_checksum_method()),
      block_count(0),
      block_size_(file_prop.get_block_size())
 {
-  try
+  uint32 index_size = 0;
+  Void_Pointer< uint8 > index_buf(0);
+  const uint8* image_data = 0;
+  uint64 data_file_size = 0;
+  bool from_image = (index_image && !writeable && !use_shadow
+      && index_image->lookup(index_file_name, image_data, index_size, data_file_size));
+  // The index types take a non-const pointer but never write through it.
+  uint8* index_data = (uint8*)image_data;
+  if (!from_image)
+  {
+    try
+    {
+      Raw_File source_file(index_file_name, O_RDONLY, S_666,
+			   "File_Blocks_Index::File_Blocks_Index::3");
+			 
+      // read index file
+      index_size = source_file.size("File_Blocks_Index::File_Blocks_Index::4");
+      index_buf.ptr = (uint8*)realloc(index_buf.ptr, index_size);
+      source_file.read(index_buf.ptr, index_size, "File_Blocks_Index::File_Blocks_Index::5");
+    }
+    catch (File_Error e)
+    {
+      if (e.error_number != 2)
+        throw e;
+    }
+    index_data = index_buf.ptr;
+  }
+  
+  // An existing index determines the format, otherwise the file properties do.
+  uint32 pos(0);
+  bool has_header = (compression_method != NO_COMPRESSION || checksum_method != NO_CHECKSUM);
+  if (index_size >= 4*sizeof(uint32) && *(uint32*)index_data == FILE_FORMAT_MAGIC)
   {
-    Raw_File val_file(data_file_name, O_RDONLY, S_666, "File_Blocks_Index::File_Blocks_Index::1");
-    block_count = val_file.size("File_Blocks_Index::File_Blocks_Index::2")/block_size_;
+    uint32 version = *(uint32*)(index_data + 4);
+    compression_method = *(uint32*)(index_data + 8);
+    compression_factor = *(uint32*)(index_data + 12);
+    if (version == FILE_FORMAT_VERSION_WITHOUT_CHECKSUMS)
+    {
+      checksum_method = NO_CHECKSUM;
+      pos = 4*sizeof(uint32);
+    }
+    else if (version == FILE_FORMAT_VERSION && index_size >= HEADER_SIZE)
+    {
+      checksum_method = *(uint32*)(index_data + 16);
+      pos = HEADER_SIZE;
+    }
+    else
+      throw File_Error(0, index_file_name, "File_Blocks_Index: unsupported index file version");
+    has_header = true;
   }
-  catch (File_Error e)
+  else if (index_size > 0)
   {
-    if (e.error_number != 2)
-      throw e;
-    block_count = 0;
+    compression_method = NO_COMPRESSION;
+    checksum_method = NO_CHECKSUM;
+    has_header = false;
   }
+  if (compression_method == NO_COMPRESSION || compression_factor == 0)
+    compression_factor = 1;
   
-  vector< bool > is_referred(block_count, false);
-  
-  try
+  if (from_image)
+    block_count = data_file_size/get_unit_size();
+  else
   {
-    Raw_File source_file(index_file_name, O_RDONLY, S_666,
-			 "File_Blocks_Index::File_Blocks_Index::3");
-			 
-    // read index file
-    uint32 index_size = source_file.size("File_Blocks_Index::File_Blocks_Index::4");
-    Void_Pointer< uint8 > index_buf(index_size);
-    source_file.read(index_buf.ptr, index_size, "File_Blocks_Index::File_Blocks_Index::5");
-    
-    uint32 pos(0);
-    while (pos < index_size)
+    try
+    {
+      Block_Device* val_file = new_block_device
+          (io_backend, data_file_name, false, "File_Blocks_Index::File_Blocks_Index::1");
+      block_count = val_file->size("File_Blocks_Index::File_Blocks_Index::2")/get_unit_size();
+      delete val_file;
+    }
+    catch (File_Error e)
     {
-      TIndex index(index_buf.ptr+pos);
-      File_Block_Index_Entry< TIndex >
-          entry(index,
-	  *(uint32*)(index_buf.ptr + (pos + TIndex::size_of(index_buf.ptr+pos))),
-	  *(uint32*)(index_buf.ptr + (pos + TIndex::size_of(index_buf.ptr+pos) + 4)));
-      blocks.push_back(entry);
-      if (entry.pos > block_count)
-	throw File_Error(0, index_file_name, "File_Blocks_Index: bad pos in index file");
-      else
-	is_referred[entry.pos] = true;
-      pos += TIndex::size_of(index_buf.ptr+pos) + 2*sizeof(uint32);
+      if (e.error_number != 2)
+        throw e;
+      block_count = 0;
     }
   }
-  catch (File_Error e)
+  
+  vector< bool > is_referred(block_count, false);
+  
+  while (pos < index_size)
   {
-    if (e.error_number != 2)
-      throw e;
+    TIndex index(index_data+pos);
+    pos += TIndex::size_of(index_data+pos);
+    uint32 block_pos = *(uint32*)(index_data + pos);
+    pos += sizeof(uint32);
+    uint32 block_units = 1;
+    if (has_header)
+    {
+      block_units = *(uint32*)(index_data + pos);
+      pos += sizeof(uint32);
+    }
+    uint32 checksum = 0;
+    if (checksum_method != NO_CHECKSUM)
+    {
+      checksum = *(uint32*)(index_data + pos);
+      pos += sizeof(uint32);
+    }
+    File_Block_Index_Entry< TIndex >
+        entry(index, block_pos, block_units, *(uint32*)(index_data + pos), checksum);
+    pos += sizeof(uint32);
+    blocks.push_back(entry);
+    if (entry.pos + entry.size > block_count)
+      throw File_Error(0, index_file_name, "File_Blocks_Index: bad pos in index file");
+    for (uint32 i = 0; i < entry.size; ++i)
+      is_referred[entry.pos + i] = true;
   }
   
   //if (writeable)
@@ -181,20 +364,43 @@ File_Blocks_Index< TIndex >::~File_Blocks_Index()
   if (empty_index_file_name == "")
     return;
 
-  uint32 index_size(0), pos(0);
-  for (typename list< File_Block_Index_Entry< TIndex > >::const_iterator
+  // Uncompressed indexes without checksums keep the format without header.
+  bool has_header = (compression_method != NO_COMPRESSION || checksum_method != NO_CHECKSUM);
+  uint32 entry_size = (has_header ? (checksum_method != NO_CHECKSUM ? 4 : 3) : 2)*sizeof(uint32);
+  uint32 index_size(has_header ? HEADER_SIZE : 0), pos(0);
+  for (typename vector< File_Block_Index_Entry< TIndex > >::const_iterator
       it(blocks.begin()); it != blocks.end(); ++it)
-    index_size += 2*sizeof(uint32) + it->index.size_of();
+    index_size += entry_size + it->index.size_of();
   
   Void_Pointer< uint8 > index_buf(index_size);
   
-  for (typename list< File_Block_Index_Entry< TIndex > >::const_iterator
+  if (has_header)
+  {
+    *(uint32*)index_buf.ptr = FILE_FORMAT_MAGIC;
+    *(uint32*)(index_buf.ptr + 4) = FILE_FORMAT_VERSION;
+    *(uint32*)(index_buf.ptr + 8) = compression_method;
+    *(uint32*)(index_buf.ptr + 12) = compression_factor;
+    *(uint32*)(index_buf.ptr + 16) = checksum_method;
+    pos = HEADER_SIZE;
+  }
+  
+  for (typename vector< File_Block_Index_Entry< TIndex > >::const_iterator
       it(blocks.begin()); it != blocks.end(); ++it)
   {
     it->index.to_data(index_buf.ptr+pos);
     pos += it->index.size_of();
     *(uint32*)(index_buf.ptr+pos) = it->pos;
     pos += sizeof(uint32);
+    if (has_header)
+    {
+      *(uint32*)(index_buf.ptr+pos) = it->size;
+      pos += sizeof(uint32);
+    }
+    if (checksum_method != NO_CHECKSUM)
+    {
+      *(uint32*)(index_buf.ptr+pos) = it->checksum;
+      pos += sizeof(uint32);
+    }
     *(uint32*)(index_buf.ptr+pos) = it->max_keysize;
     pos += sizeof(uint32);
   }
@@ -222,6 +428,23 @@ File_Blocks_Index< TIndex >::~File_Blocks_Index()
   catch (File_Error e) {}
 }
 
+template< class TIndex >
+vector< File_Blocks_Index_Base::Block_Location > File_Blocks_Index< TIndex >::get_block_locations() const
+{
+  vector< Block_Location > result;
+  result.reserve(blocks.size());
+  for (typename vector< File_Block_Index_Entry< TIndex > >::const_iterator
+      it(blocks.begin()); it != blocks.end(); ++it)
+  {
+    Block_Location location;
+    location.pos = it->pos;
+    location.size = it->size;
+    location.checksum = it->checksum;
+    result.push_back(location);
+  }
+  return result;
+}
+
 /** Implementation non-members: ---------------------------------------------*/
 
 template< class TIndex >
@@ -0,0 +1,209 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "index_image.h"
+#include "block_device.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstring>
+
+
+namespace
+{
+  const uint32 INDEX_IMAGE_MAGIC = 0x4f534949;
+
+  inline uint64 aligned(uint64 size)
+  {
+    return (size + 7)/8*8;
+  }
+}
+
+
+struct Index_Image::Header
+{
+  uint32 magic;
+  uint32 file_count;
+  uint64 size;
+};
+
+
+// Each entry is followed by the file name and the content of the index file.
+// The next entry starts at the next multiple of eight bytes.
+struct Index_Image::Entry
+{
+  uint32 name_size;
+  uint32 index_size;
+  uint64 data_file_size;
+
+  const char* name() const { return ((const char*)this) + sizeof(Entry); }
+  const uint8* index_data() const { return ((const uint8*)this) + sizeof(Entry) + name_size; }
+  uint64 total_size() const { return aligned(sizeof(Entry) + name_size + index_size); }
+};
+
+
+Index_Image::Index_Image
+    (const string& share_name_, const string& db_dir, const vector< File_Properties* >& files)
+  : share_name(share_name_), is_owner(true), shm_fd(-1), shm_size(0), shm_ptr(0)
+{
+  // Read all files before the segment is created, such that it never becomes
+  // visible in an incomplete state.
+  vector< uint8 > image(sizeof(Header), 0);
+  uint32 file_count = 0;
+  for (vector< File_Properties* >::const_iterator it = files.begin(); it != files.end(); ++it)
+  {
+    string data_file_name = db_dir + (*it)->get_file_name_trunk() + (*it)->get_data_suffix();
+    string index_file_name = data_file_name + (*it)->get_index_suffix();
+    if (!file_exists(index_file_name))
+      continue;
+
+    Raw_File index_file(index_file_name, O_RDONLY, S_666, "Index_Image::1");
+    uint64 index_size = index_file.size("Index_Image::2");
+    uint64 data_file_size = 0;
+    try
+    {
+      Block_Device* data_file = new_block_device
+          ((*it)->get_io_backend(), data_file_name, false, "Index_Image::3");
+      data_file_size = data_file->size("Index_Image::4");
+      delete data_file;
+    }
+    catch (File_Error e)
+    {
+      if (e.error_number != ENOENT)
+        throw e;
+    }
+
+    Entry entry;
+    entry.name_size = index_file_name.size();
+    entry.index_size = index_size;
+    entry.data_file_size = data_file_size;
+
+    uint64 pos = image.size();
+    image.resize(pos + entry.total_size(), 0);
+    memcpy(&image[pos], &entry, sizeof(Entry));
+    memcpy(&image[pos + sizeof(Entry)], index_file_name.data(), entry.name_size);
+    if (index_size > 0)
+      index_file.read(&image[pos + sizeof(Entry) + entry.name_size], index_size, "Index_Image::5");
+    ++file_count;
+  }
+  ((Header*)&image[0])->magic = INDEX_IMAGE_MAGIC;
+  ((Header*)&image[0])->file_count = file_count;
+  ((Header*)&image[0])->size = image.size();
+  shm_size = image.size();
+
+  // An attached process may still use a former image of the same name.
+  // Hence it is unlinked instead of overwritten.
+  shm_unlink(share_name.c_str());
+  attach(O_RDWR|O_CREAT|O_EXCL, "Index_Image::6");
+  memcpy(shm_ptr, &image[0], shm_size);
+}
+
+
+Index_Image::Index_Image(const string& share_name_)
+  : share_name(share_name_), is_owner(false), shm_fd(-1), shm_size(0), shm_ptr(0)
+{
+  attach(O_RDONLY, "Index_Image::7");
+}
+
+
+void Index_Image::attach(int oflag, const string& caller_id)
+{
+  shm_fd = shm_open(share_name.c_str(), oflag, S_666);
+  if (shm_fd < 0)
+    throw File_Error(errno, share_name, caller_id + "::1");
+
+  if (is_owner)
+  {
+    fchmod(shm_fd, S_666);
+    if (ftruncate(shm_fd, shm_size) != 0)
+    {
+      close(shm_fd);
+      shm_unlink(share_name.c_str());
+      throw File_Error(errno, share_name, caller_id + "::2");
+    }
+  }
+  else
+  {
+    struct stat stat_buf;
+    if (fstat(shm_fd, &stat_buf) != 0 || (uint64)stat_buf.st_size < sizeof(Header))
+    {
+      close(shm_fd);
+      throw File_Error(errno, share_name, caller_id + "::3");
+    }
+    shm_size = stat_buf.st_size;
+  }
+
+  void* ptr = mmap(0, shm_size, is_owner ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, shm_fd, 0);
+  if (ptr == MAP_FAILED)
+  {
+    close(shm_fd);
+    if (is_owner)
+      shm_unlink(share_name.c_str());
+    throw File_Error(errno, share_name, caller_id + "::4");
+  }
+  shm_ptr = (uint8*)ptr;
+
+  if (!is_owner && (((Header*)shm_ptr)->magic != INDEX_IMAGE_MAGIC
+      || ((Header*)shm_ptr)->size != shm_size))
+  {
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    throw File_Error(0, share_name, caller_id + "::5");
+  }
+}
+
+
+Index_Image::~Index_Image()
+{
+  munmap(shm_ptr, shm_size);
+  close(shm_fd);
+  if (is_owner)
+    shm_unlink(share_name.c_str());
+}
+
+
+bool Index_Image::lookup(const string& index_file_name,
+    const uint8*& index_data, uint32& index_size, uint64& data_file_size) const
+{
+  uint64 pos = sizeof(Header);
+  for (uint32 i = 0; i < ((Header*)shm_ptr)->file_count; ++i)
+  {
+    const Entry* entry = (const Entry*)(shm_ptr + pos);
+    if (entry->name_size == index_file_name.size()
+        && !memcmp(entry->name(), index_file_name.data(), entry->name_size))
+    {
+      index_data = entry->index_data();
+      index_size = entry->index_size;
+      data_file_size = entry->data_file_size;
+      return true;
+    }
+    pos += entry->total_size();
+  }
+  return false;
+}
+
+
+uint32 Index_Image::get_file_count() const
+{
+  return ((Header*)shm_ptr)->file_count;
+}
@@ -0,0 +1,79 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___TEMPLATE_DB__INDEX_IMAGE_H
+#define DE__OSM3S___TEMPLATE_DB__INDEX_IMAGE_H
+
+#include "types.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/** An immutable copy of the committed data index files of a database in a
+    shared memory segment.
+
+    The dispatcher creates a new image after every write_commit and removes
+    the name of the old one. Processes that still have the old image attached
+    keep a consistent view of the generation they have registered for. Reading
+    processes attach to the image while they are registered as reading the
+    index and take the index files from it instead of opening and reading
+    each of them. */
+class Index_Image
+{
+  Index_Image(const Index_Image&);
+  Index_Image& operator=(const Index_Image&);
+
+  public:
+    /** Creates the shared memory segment share_name from the data index files
+        of files in db_dir. Missing files are skipped. The segment is removed
+        again by the destructor. */
+    Index_Image(const string& share_name, const string& db_dir,
+		const vector< File_Properties* >& files);
+
+    /** Attaches to the existing shared memory segment share_name. */
+    Index_Image(const string& share_name);
+
+    ~Index_Image();
+
+    /** Returns true and sets index_data, index_size and data_file_size if the image
+        contains the index file index_file_name. The data stays valid as long
+        as this object exists. */
+    bool lookup(const string& index_file_name,
+		const uint8*& index_data, uint32& index_size, uint64& data_file_size) const;
+
+    uint32 get_file_count() const;
+    uint64 get_size() const { return shm_size; }
+
+  private:
+    struct Header;
+    struct Entry;
+
+    string share_name;
+    bool is_owner;
+    int shm_fd;
+    uint64 shm_size;
+    uint8* shm_ptr;
+
+    void attach(int oflag, const string& caller_id);
+};
+
+
+#endif
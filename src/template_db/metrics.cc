@@ -0,0 +1,216 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+
+const vector< double >& Metrics::seconds_buckets()
+{
+  static vector< double > bounds;
+  if (bounds.empty())
+  {
+    double values[] = { 0.001, 0.01, 0.1, 0.5, 1, 5, 15, 60, 180, 900 };
+    bounds.assign(values, values + sizeof(values)/sizeof(double));
+  }
+  return bounds;
+}
+
+
+const vector< double >& Metrics::bytes_buckets()
+{
+  static vector< double > bounds;
+  if (bounds.empty())
+  {
+    for (double value = 1024*1024; value <= 16.0*1024*1024*1024; value *= 4)
+      bounds.push_back(value);
+  }
+  return bounds;
+}
+
+
+double& Metrics::Family::sample(const string& key)
+{
+  map< string, uint >::const_iterator it = sample_pos.find(key);
+  if (it != sample_pos.end())
+    return samples[it->second].second;
+
+  sample_pos[key] = samples.size();
+  samples.push_back(make_pair(key, 0.));
+  return samples.back().second;
+}
+
+
+Metrics::Family& Metrics::family(const string& name)
+{
+  map< string, Family >::iterator it = families.find(name);
+  if (it != families.end())
+    return it->second;
+
+  family_order.push_back(name);
+  return families[name];
+}
+
+
+void Metrics::declare(const string& name, const string& type, const string& help)
+{
+  Family& target = family(name);
+  target.type = type;
+  target.help = help;
+}
+
+
+namespace
+{
+  string sample_key(const string& name, const string& labels)
+  {
+    return labels.empty() ? name : name + '{' + labels + '}';
+  }
+
+  string format_value(double value)
+  {
+    ostringstream out;
+    out.precision(15);
+    out<<value;
+    return out.str();
+  }
+}
+
+
+void Metrics::add(const string& name, double value, const string& labels)
+{
+  family(name).sample(sample_key(name, labels)) += value;
+}
+
+
+void Metrics::set(const string& name, double value, const string& labels)
+{
+  family(name).sample(sample_key(name, labels)) = value;
+}
+
+
+void Metrics::observe(const string& name, double value, const vector< double >& bounds,
+                      const string& labels)
+{
+  Family& target = family(name);
+  string separator = labels.empty() ? "" : ",";
+  for (vector< double >::const_iterator it = bounds.begin(); it != bounds.end(); ++it)
+  {
+    double& bucket = target.sample(name + "_bucket{" + labels + separator
+        + "le=\"" + format_value(*it) + "\"}");
+    if (value <= *it)
+      bucket += 1;
+  }
+  target.sample(name + "_bucket{" + labels + separator + "le=\"+Inf\"}") += 1;
+  target.sample(sample_key(name + "_sum", labels)) += value;
+  target.sample(sample_key(name + "_count", labels)) += 1;
+}
+
+
+string Metrics::text() const
+{
+  ostringstream out;
+  for (vector< string >::const_iterator it = family_order.begin(); it != family_order.end(); ++it)
+  {
+    const Family& source = families.find(*it)->second;
+    if (!source.help.empty())
+      out<<"# HELP "<<*it<<' '<<source.help<<'\n';
+    if (!source.type.empty())
+      out<<"# TYPE "<<*it<<' '<<source.type<<'\n';
+    for (vector< pair< string, double > >::const_iterator sit = source.samples.begin();
+        sit != source.samples.end(); ++sit)
+      out<<sit->first<<' '<<format_value(sit->second)<<'\n';
+  }
+  return out.str();
+}
+
+
+void Metrics::write(const string& filename) const
+{
+  string temp_name = filename + ".tmp";
+  {
+    ofstream out(temp_name.c_str());
+    out<<text();
+    if (!out)
+      throw File_Error(errno, temp_name, "Metrics::write::1");
+  }
+  if (rename(temp_name.c_str(), filename.c_str()) != 0)
+    throw File_Error(errno, filename, "Metrics::write::2");
+}
+
+
+void Metrics::parse(const string& text)
+{
+  istringstream in(text);
+  string line;
+  string current;
+  while (getline(in, line))
+  {
+    if (line.substr(0, 7) == "# HELP ")
+    {
+      string::size_type pos = line.find(' ', 7);
+      current = line.substr(7, pos - 7);
+      family(current).help = (pos == string::npos ? "" : line.substr(pos + 1));
+    }
+    else if (line.substr(0, 7) == "# TYPE ")
+    {
+      string::size_type pos = line.find(' ', 7);
+      current = line.substr(7, pos - 7);
+      family(current).type = (pos == string::npos ? "" : line.substr(pos + 1));
+    }
+    else if (!line.empty() && line[0] != '#')
+    {
+      string::size_type pos = line.rfind(' ');
+      if (pos == string::npos)
+        continue;
+      string key = line.substr(0, pos);
+      if (current.empty() || key.compare(0, current.size(), current) != 0)
+        current = key.substr(0, key.find('{'));
+      family(current).sample(key) += atof(line.c_str() + pos + 1);
+    }
+  }
+}
+
+
+void Metrics::merge_into(const string& filename) const
+{
+  Raw_File lock_file(filename + ".lock", O_RDWR|O_CREAT, S_666, "Metrics::merge_into::1");
+  if (flock(lock_file.fd(), LOCK_EX) != 0)
+    throw File_Error(errno, filename + ".lock", "Metrics::merge_into::2");
+
+  Metrics merged;
+  {
+    ifstream in(filename.c_str());
+    ostringstream content;
+    content<<in.rdbuf();
+    merged.parse(content.str());
+  }
+  merged.parse(text());
+  merged.write(filename);
+
+  flock(lock_file.fd(), LOCK_UN);
+}
@@ -0,0 +1,87 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___TEMPLATE_DB__METRICS_H
+#define DE__OSM3S___TEMPLATE_DB__METRICS_H
+
+#include "types.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/** Collects counters, gauges and histograms and writes them as a text file in the
+    Prometheus exposition format. Such a file can be picked up by the textfile collector
+    of the node exporter or be read by any other monitoring tool.
+
+    Labels are passed preformatted, e.g. "statement=\"query\"". Samples keep the order
+    of their first appearance. */
+class Metrics
+{
+public:
+  static const vector< double >& seconds_buckets();
+  static const vector< double >& bytes_buckets();
+
+  /** Declares type ("counter", "gauge" or "histogram") and help text of a metric.
+      Metrics must be declared before values are added. */
+  void declare(const string& name, const string& type, const string& help);
+
+  /** Adds value to a counter. */
+  void add(const string& name, double value, const string& labels = "");
+
+  /** Sets a gauge. */
+  void set(const string& name, double value, const string& labels = "");
+
+  /** Counts value in the histogram with the given upper bucket bounds. */
+  void observe(const string& name, double value, const vector< double >& bounds,
+               const string& labels = "");
+
+  string text() const;
+
+  /** Replaces the file atomically by the current values. Throws File_Error on failure. */
+  void write(const string& filename) const;
+
+  /** Adds the current values to those in the file. This lets short-lived processes
+      accumulate counters and histograms in a common file. The file is locked while
+      it is updated. Gauges are summed as well, hence should not be used here.
+      Throws File_Error on failure. */
+  void merge_into(const string& filename) const;
+
+private:
+  struct Family
+  {
+    string type;
+    string help;
+    vector< pair< string, double > > samples;
+    map< string, uint > sample_pos;
+
+    double& sample(const string& key);
+  };
+
+  vector< string > family_order;
+  map< string, Family > families;
+
+  Family& family(const string& name);
+  void parse(const string& text);
+};
+
+
+#endif
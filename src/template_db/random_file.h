@@ -19,11 +19,14 @@
 #ifndef DE__OSM3S___TEMPLATE_DB__RANDOM_FILE_H
 #define DE__OSM3S___TEMPLATE_DB__RANDOM_FILE_H
 
+#include "block_device.h"
+#include "crc32c.h"
 #include "random_file_index.h"
 #include "types.h"
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
@@ -33,6 +36,9 @@
 
 using namespace std;
 
+/** Reads and writes the values of a map file. The blocks of the map file are
+    kept in a cache of a bounded number of blocks. If the cache is full, the
+    least recently used block is written back if changed and then replaced. */
 template< class TVal >
 struct Random_File
 {
@@ -42,49 +48,81 @@ private:
 public:
   typedef uint32 size_t;
   
-  Random_File(Random_File_Index*);
+  static const uint32 DEFAULT_CACHE_BLOCKS = 16;
+  
+  Random_File(Random_File_Index*, uint32 cache_blocks = DEFAULT_CACHE_BLOCKS);
   ~Random_File();
   
   TVal get(size_t pos);
   void put(size_t pos, const TVal& index);
   
+  // Appends the values at all positions of pos to result, in the same order.
+  // The positions should be sorted. Then each block is read at most once, and
+  // the blocks are read in the order of their position in the map file.
+  void get(const vector< size_t >& pos, vector< TVal >& result);
+  
 private:
-  bool changed;
+  struct Cached_Block
+  {
+    size_t pos;
+    uint32 last_used;
+    bool changed;
+  };
+  
   uint32 index_size;
   
-  Raw_File val_file;
+  Block_Device* val_file;
   Random_File_Index* index;
+  size_t block_size;
+  vector< Cached_Block > cached;
+  map< size_t, uint32 > slot_of;
   Void_Pointer< uint8 > cache;
-  size_t cache_pos, block_size;
+  uint32 use_counter;
   
-  void move_cache_window(size_t pos);
+  uint8* block_data(uint32 slot) { return cache.ptr + (uint64)slot*block_size; }
+  uint32 cache_slot(size_t pos);
+  void read_block(size_t pos, uint8* data);
+  void write_back(vector< uint32 > slots);
 };
 
 /** Implementation Random_File: ---------------------------------------------*/
 
 template< class TVal >
-Random_File< TVal >::Random_File(Random_File_Index* index_)
-  : changed(false), index_size(TVal::max_size_of()),
-  val_file(index_->get_map_file_name(),
-	   index_->writeable() ? O_RDWR|O_CREAT : O_RDONLY,
-	   S_666, "Random_File:3"),
-  index(index_),
-  cache(index_->get_block_size()), cache_pos(index->npos),
-  block_size(index_->get_block_size())
-{}
+Random_File< TVal >::Random_File(Random_File_Index* index_, uint32 cache_blocks)
+  : index_size(TVal::max_size_of()),
+  val_file(new_block_device(index_->get_io_backend(), index_->get_map_file_name(),
+      index_->writeable(), "Random_File:3")),
+  index(index_), block_size(index_->get_block_size()),
+  cached(cache_blocks > 0 ? cache_blocks : 1),
+  cache(cached.size()*index_->get_block_size()), use_counter(0)
+{
+  for (typename vector< Cached_Block >::iterator it = cached.begin(); it != cached.end(); ++it)
+  {
+    it->pos = index->npos;
+    it->last_used = 0;
+    it->changed = false;
+  }
+}
 
 template< class TVal >
 Random_File< TVal >::~Random_File()
 {
-  move_cache_window(index->npos);  
+  vector< uint32 > changed;
+  for (uint32 i = 0; i < cached.size(); ++i)
+  {
+    if (cached[i].changed)
+      changed.push_back(i);
+  }
+  write_back(changed);
+  delete val_file;
   //delete index;
 }
 
 template< class TVal >
 TVal Random_File< TVal >::get(size_t pos)
 {
-  move_cache_window(pos / (block_size/index_size));  
-  return TVal(cache.ptr + (pos % (block_size/index_size))*index_size);
+  uint32 slot = cache_slot(pos / (block_size/index_size));
+  return TVal(block_data(slot) + (pos % (block_size/index_size))*index_size);
 }
 
 template< class TVal >
@@ -93,20 +131,121 @@ void Random_File< TVal >::put(size_t pos, const TVal& val)
   if (!index->writeable())
     throw File_Error(0, index->get_map_file_name(), "Random_File:2");
   
-  move_cache_window(pos / (block_size/index_size));
-  val.to_data(cache.ptr + (pos % (block_size/index_size))*index_size);
-  changed = true;
+  uint32 slot = cache_slot(pos / (block_size/index_size));
+  val.to_data(block_data(slot) + (pos % (block_size/index_size))*index_size);
+  cached[slot].changed = true;
 }
 
 template< class TVal >
-void Random_File< TVal >::move_cache_window(size_t pos)
+void Random_File< TVal >::get(const vector< size_t >& pos, vector< TVal >& result)
 {
-  // The cache already contains the needed position.
-  if ((pos == cache_pos) && (cache_pos != index->npos))
-    return;
+  uint32 entries_per_block = block_size/index_size;
+  
+  // Blocks that are neither cached nor on disk contain only zeros.
+  vector< uint8 > zero(index_size, 0);
+  uint32 offset = result.size();
+  result.resize(offset + pos.size(), TVal((void*)&zero[0]));
+  
+  // Group the positions by their block and resolve what is already cached.
+  vector< pair< size_t, pair< uint32, uint32 > > > to_read;
+  uint32 i = 0;
+  while (i < pos.size())
+  {
+    size_t block = pos[i] / entries_per_block;
+    uint32 end = i+1;
+    while (end < pos.size() && pos[end] / entries_per_block == block)
+      ++end;
+    
+    if (slot_of.find(block) != slot_of.end())
+    {
+      uint8* data = block_data(cache_slot(block));
+      for (uint32 j = i; j < end; ++j)
+        result[offset + j] = TVal(data + (pos[j] % entries_per_block)*index_size);
+    }
+    else if (block < index->blocks.size() && index->blocks[block] != index->npos)
+      to_read.push_back(make_pair(index->blocks[block], make_pair(i, end)));
+    i = end;
+  }
+  
+  // Read the remaining blocks in the order of the map file.
+  sort(to_read.begin(), to_read.end());
+  for (typename vector< pair< size_t, pair< uint32, uint32 > > >::const_iterator
+      it = to_read.begin(); it != to_read.end(); ++it)
+  {
+    uint8* data = block_data(cache_slot(pos[it->second.first] / entries_per_block));
+    for (uint32 j = it->second.first; j < it->second.second; ++j)
+      result[offset + j] = TVal(data + (pos[j] % entries_per_block)*index_size);
+  }
+}
+
+template< class TVal >
+uint32 Random_File< TVal >::cache_slot(size_t pos)
+{
+  typename map< size_t, uint32 >::const_iterator it = slot_of.find(pos);
+  if (it != slot_of.end())
+  {
+    cached[it->second].last_used = ++use_counter;
+    return it->second;
+  }
+  
+  // Replace the least recently used block.
+  uint32 slot = 0;
+  for (uint32 i = 1; i < cached.size(); ++i)
+  {
+    if (cached[i].last_used < cached[slot].last_used)
+      slot = i;
+  }
+  if (cached[slot].changed)
+    write_back(vector< uint32 >(1, slot));
+  if (cached[slot].pos != index->npos)
+    slot_of.erase(cached[slot].pos);
+  
+  read_block(pos, block_data(slot));
+  cached[slot].pos = pos;
+  cached[slot].last_used = ++use_counter;
+  slot_of[pos] = slot;
+  return slot;
+}
 
-  if (changed)
+template< class TVal >
+void Random_File< TVal >::read_block(size_t pos, uint8* data)
+{
+  if ((index->blocks.size() <= pos) || (index->blocks[pos] == index->npos))
   {
+    // Reset the whole block to zero.
+    for (uint32 i = 0; i < block_size; ++i)
+      *(data + i) = 0;
+  }
+  else
+  {
+    val_file->read((uint64)(index->blocks[pos])*block_size, data, block_size, "Random_File:24");
+    if (index->verify_checksums
+        && index->get_checksum_method() != File_Blocks_Index_Base::NO_CHECKSUM
+        && (index->checksums.size() <= pos || crc32c(data, block_size) != index->checksums[pos]))
+      throw File_Error(index->blocks[pos], index->get_map_file_name(),
+                       "Random_File: checksum mismatch");
+  }
+}
+
+template< class TVal >
+void Random_File< TVal >::write_back(vector< uint32 > slots)
+{
+  if (slots.empty())
+    return;
+  
+  // Assign the disk positions in the order of the blocks in the map, such that
+  // the result does not depend on the order of accesses.
+  vector< pair< size_t, uint32 > > pos_and_slot;
+  for (vector< uint32 >::const_iterator it = slots.begin(); it != slots.end(); ++it)
+    pos_and_slot.push_back(make_pair(cached[*it].pos, *it));
+  sort(pos_and_slot.begin(), pos_and_slot.end());
+  
+  vector< pair< uint32, uint32 > > disk_pos_and_slot;
+  for (vector< pair< size_t, uint32 > >::const_iterator it = pos_and_slot.begin();
+      it != pos_and_slot.end(); ++it)
+  {
+    size_t pos = it->first;
+    
     // Find an empty position.
     uint32 disk_pos;
     if (index->void_blocks.empty())
@@ -121,31 +260,33 @@ void Random_File< TVal >::move_cache_window(size_t pos)
     }
     
     // Save the found position to the index.
-    if (index->blocks.size() <= cache_pos)
-      index->blocks.resize(cache_pos+1, index->npos);
-    index->blocks[cache_pos] = disk_pos;
+    if (index->blocks.size() <= pos)
+      index->blocks.resize(pos+1, index->npos);
+    index->blocks[pos] = disk_pos;
+    if (index->get_checksum_method() == File_Blocks_Index_Base::CRC32C_CHECKSUM)
+    {
+      if (index->checksums.size() <= pos)
+        index->checksums.resize(pos+1, 0);
+      index->checksums[pos] = crc32c(block_data(it->second), block_size);
+    }
     
-    // Write the data at the found position.
-    val_file.seek((int64)disk_pos*block_size, "Random_File:21");
-    val_file.write(cache.ptr, block_size, "Random_File:22");
+    disk_pos_and_slot.push_back(make_pair(disk_pos, it->second));
+    cached[it->second].changed = false;
   }
-  changed = false;
   
-  if (pos == index->npos)
-    return;
-  
-  if ((index->blocks.size() <= pos) || (index->blocks[pos] == index->npos))
-  {
-    // Reset the whole cache to zero.
-    for (uint32 i = 0; i < block_size; ++i)
-      *(cache.ptr + i) = 0;
-  }
-  else
+  // Write the data at the found positions, joining adjacent blocks to runs.
+  sort(disk_pos_and_slot.begin(), disk_pos_and_slot.end());
+  vector< Block_Device_Run > runs;
+  for (uint32 i = 0; i < disk_pos_and_slot.size(); ++i)
   {
-    val_file.seek((int64)(index->blocks[pos])*block_size, "Random_File:23");
-    val_file.read(cache.ptr, block_size, "Random_File:24");
+    if (i == 0 || disk_pos_and_slot[i-1].first + 1 != disk_pos_and_slot[i].first)
+      runs.push_back(Block_Device_Run((uint64)disk_pos_and_slot[i].first*block_size));
+    struct iovec vec;
+    vec.iov_base = block_data(disk_pos_and_slot[i].second);
+    vec.iov_len = block_size;
+    runs.back().iov.push_back(vec);
   }
-  cache_pos = pos;
+  val_file->write(runs, "Random_File:22");
 }
 
 #endif
@@ -72,6 +72,8 @@ struct IntIndex
 /* We use our own test settings */
 string BASE_DIRECTORY("./");
 string ID_SUFFIX(".map");
+uint32 CHECKSUM_METHOD(File_Blocks_Index_Base::NO_CHECKSUM);
+uint32 CACHE_BLOCKS(Random_File< IntIndex >::DEFAULT_CACHE_BLOCKS);
 
 struct Test_File : File_Properties
 {
@@ -130,9 +132,29 @@ struct Test_File : File_Properties
     return IntIndex::max_size_of();
   }
   
+  uint32 get_compression_factor() const
+  {
+    return 1;
+  }
+  
+  uint32 get_compression_method() const
+  {
+    return File_Blocks_Index_Base::NO_COMPRESSION;
+  }
+  
+  uint32 get_io_backend() const
+  {
+    return Block_Device::POSIX_IO;
+  }
+  
+  uint32 get_checksum_method() const
+  {
+    return CHECKSUM_METHOD;
+  }
+  
   File_Blocks_Index_Base* new_data_index
-      (bool writeable, bool use_shadow, string db_dir, string file_name_extension)
-      const
+      (bool writeable, bool use_shadow, string db_dir, string file_name_extension,
+       const Index_Image* index_image) const
   {
     throw string();
     return 0;
@@ -155,8 +177,9 @@ void read_test()
     cout<<'\n';
 
     Nonsynced_Transaction transaction(false, false, BASE_DIRECTORY, "");
+    transaction.set_verify_checksums(CHECKSUM_METHOD != File_Blocks_Index_Base::NO_CHECKSUM);
     Test_File tf;
-    Random_File< IntIndex > id_file(transaction.random_index(&tf));
+    Random_File< IntIndex > id_file(transaction.random_index(&tf), CACHE_BLOCKS);
 
     cout<<id_file.get(0).val()<<'\n';
     cout<<id_file.get(1).val()<<'\n';
@@ -173,6 +196,24 @@ void read_test()
     cout<<id_file.get(96).val()<<'\n';
     cout<<id_file.get(112).val()<<'\n';
     
+    Random_File< IntIndex > batch_file(transaction.random_index(&tf), CACHE_BLOCKS);
+    vector< Random_File< IntIndex >::size_t > pos;
+    pos.push_back(0);
+    pos.push_back(1);
+    pos.push_back(2);
+    pos.push_back(3);
+    pos.push_back(5);
+    pos.push_back(6);
+    pos.push_back(8);
+    for (uint32 i = 16; i <= 112; i += 16)
+      pos.push_back(i);
+    vector< IntIndex > values;
+    batch_file.get(pos, values);
+    cout<<"Batched:";
+    for (vector< IntIndex >::const_iterator it = values.begin(); it != values.end(); ++it)
+      cout<<' '<<it->val();
+    cout<<'\n';
+    
     cout<<"This block of read tests is complete.\n";
   }
   catch (File_Error e)
@@ -188,6 +229,13 @@ int main(int argc, char* args[])
   string test_to_execute;
   if (argc > 1)
     test_to_execute = args[1];
+  for (int i = 2; i < argc; ++i)
+  {
+    if (string(args[i]) == "--checksums")
+      CHECKSUM_METHOD = File_Blocks_Index_Base::CRC32C_CHECKSUM;
+    else if (string(args[i]).substr(0, 15) == "--cache-blocks=")
+      CACHE_BLOCKS = atoi(string(args[i]).substr(15).c_str());
+  }
   
   if ((test_to_execute == "") || (test_to_execute == "1"))
     cout<<"** Test the behaviour for an empty file\n";
@@ -210,7 +258,7 @@ int main(int argc, char* args[])
     Nonsynced_Transaction transaction(true, false, BASE_DIRECTORY, "");
     Test_File tf;
     {
-      Random_File< IntIndex > blocks(transaction.random_index(&tf));
+      Random_File< IntIndex > blocks(transaction.random_index(&tf), CACHE_BLOCKS);
     
       blocks.put(2, 12);
       blocks.put(5, 15);
@@ -231,7 +279,7 @@ int main(int argc, char* args[])
   {
     Nonsynced_Transaction transaction(true, false, BASE_DIRECTORY, "");
     Test_File tf;
-    Random_File< IntIndex > blocks(transaction.random_index(&tf));
+    Random_File< IntIndex > blocks(transaction.random_index(&tf), CACHE_BLOCKS);
     
     blocks.put(6, 16);
   }
@@ -250,7 +298,7 @@ int main(int argc, char* args[])
   {
     Nonsynced_Transaction transaction(true, false, BASE_DIRECTORY, "");
     Test_File tf;
-    Random_File< IntIndex > blocks(transaction.random_index(&tf));
+    Random_File< IntIndex > blocks(transaction.random_index(&tf), CACHE_BLOCKS);
     
     blocks.put(2, 32);
   }
@@ -269,7 +317,7 @@ int main(int argc, char* args[])
   {
     Nonsynced_Transaction transaction(true, false, BASE_DIRECTORY, "");
     Test_File tf;
-    Random_File< IntIndex > blocks(transaction.random_index(&tf));
+    Random_File< IntIndex > blocks(transaction.random_index(&tf), CACHE_BLOCKS);
     
     blocks.put(16, 1);
   }
@@ -288,7 +336,7 @@ int main(int argc, char* args[])
   {
     Nonsynced_Transaction transaction(true, false, BASE_DIRECTORY, "");
     Test_File tf;
-    Random_File< IntIndex > blocks(transaction.random_index(&tf));
+    Random_File< IntIndex > blocks(transaction.random_index(&tf), CACHE_BLOCKS);
     
     blocks.put(0, 2);
     blocks.put(32, 3);
@@ -309,7 +357,7 @@ int main(int argc, char* args[])
   {
     Nonsynced_Transaction transaction(true, false, BASE_DIRECTORY, "");
     Test_File tf;
-    Random_File< IntIndex > blocks(transaction.random_index(&tf));
+    Random_File< IntIndex > blocks(transaction.random_index(&tf), CACHE_BLOCKS);
     
     blocks.put(80, 5);
   }
@@ -328,7 +376,7 @@ int main(int argc, char* args[])
   {
     Nonsynced_Transaction transaction(true, false, BASE_DIRECTORY, "");
     Test_File tf;
-    Random_File< IntIndex > blocks(transaction.random_index(&tf));
+    Random_File< IntIndex > blocks(transaction.random_index(&tf), CACHE_BLOCKS);
     
     blocks.put(64, 6);
   }
@@ -19,6 +19,7 @@
 #ifndef DE__OSM3S___TEMPLATE_DB__RANDOM_FILE_INDEX_H
 #define DE__OSM3S___TEMPLATE_DB__RANDOM_FILE_INDEX_H
 
+#include "block_device.h"
 #include "types.h"
 
 #include <unistd.h>
@@ -35,6 +36,15 @@ using namespace std;
 struct Random_File_Index
 {
   public:
+    // The index file of a checksummed map file starts with a header of four
+    // uint32: magic, version, checksum method and a reserved zero. Each entry
+    // then carries the checksum of the block after its position. Index files
+    // without header have no checksums. A position equal to the magic would
+    // require a map file of several terabytes, hence the formats are distinct.
+    static const uint32 FILE_FORMAT_MAGIC = 0x4f53334d;
+    static const uint32 FILE_FORMAT_VERSION = 7513;
+    static const uint32 HEADER_SIZE = 4*sizeof(uint32);
+    
     Random_File_Index(const File_Properties& file_prop,
 		      bool writeable, bool use_shadow, string db_dir);
     ~Random_File_Index();
@@ -42,6 +52,8 @@ struct Random_File_Index
     
     string get_map_file_name() const { return map_file_name; }
     uint64 get_block_size() const { return block_size_; }
+    uint32 get_io_backend() const { return io_backend; }
+    uint32 get_checksum_method() const { return checksum_method; }
     
     typedef uint32 size_t;
     
@@ -49,9 +61,13 @@ struct Random_File_Index
     string index_file_name;
     string empty_index_file_name;
     string map_file_name;
+    uint32 io_backend;
+    uint32 checksum_method;
     
   public:
     vector< size_t > blocks;
+    // Parallel to blocks if the index has checksums.
+    vector< uint32 > checksums;
     vector< size_t > void_blocks;
     size_t block_count;    
     uint64 block_size_;
@@ -59,6 +75,10 @@ struct Random_File_Index
     const size_t npos;
     
     uint count;
+    
+    // If true, Random_File compares the checksum of each block read from the
+    // disk with the index and throws a File_Error on a mismatch.
+    bool verify_checksums;
 };
 
 inline vector< bool > get_map_index_footprint
@@ -78,14 +98,17 @@ inline Random_File_Index::Random_File_Index
         + file_prop.get_shadow_suffix() : ""),
     map_file_name(db_dir + file_prop.get_file_name_trunk()
         + file_prop.get_id_suffix()),
+    io_backend(file_prop.get_io_backend()),
+    checksum_method(file_prop.get_checksum_method()),
     block_count(0),
     block_size_(file_prop.get_map_block_size()),
-    npos(numeric_limits< size_t >::max()), count(0)
+    npos(numeric_limits< size_t >::max()), count(0), verify_checksums(false)
 {
   try
   {
-    Raw_File val_file(map_file_name, O_RDONLY, S_666, "Random_File:8");
-    block_count = val_file.size("Random_File:9")/block_size_;
+    Block_Device* val_file = new_block_device(io_backend, map_file_name, false, "Random_File:8");
+    block_count = val_file->size("Random_File:9")/block_size_;
+    delete val_file;
   }
   catch (File_Error e)
   {
@@ -107,11 +130,27 @@ inline Random_File_Index::Random_File_Index
     Void_Pointer< uint8 > index_buf(index_size);
     source_file.read(index_buf.ptr, index_size, "Random_File:14");
     
+    // An existing index determines the format, otherwise the file properties do.
     uint32 pos = 0;
+    if (index_size >= HEADER_SIZE && *(uint32*)index_buf.ptr == FILE_FORMAT_MAGIC)
+    {
+      if (*(uint32*)(index_buf.ptr + 4) != FILE_FORMAT_VERSION)
+        throw File_Error(0, index_file_name, "Random_File: unsupported index file version");
+      checksum_method = *(uint32*)(index_buf.ptr + 8);
+      pos = HEADER_SIZE;
+    }
+    else if (index_size > 0)
+      checksum_method = File_Blocks_Index_Base::NO_CHECKSUM;
+    
     while (pos < index_size)
     {
       size_t* entry = (size_t*)(index_buf.ptr+pos);
       blocks.push_back(*entry);
+      if (checksum_method != File_Blocks_Index_Base::NO_CHECKSUM)
+      {
+        pos += sizeof(size_t);
+        checksums.push_back(*(uint32*)(index_buf.ptr+pos));
+      }
       if (*entry != npos)
       {
 	if (*entry > block_count)
@@ -165,16 +204,31 @@ inline Random_File_Index::~Random_File_Index()
     return;
 
   // Write index file
-  uint32 index_size = blocks.size()*sizeof(size_t);
+  bool has_checksums = (checksum_method != File_Blocks_Index_Base::NO_CHECKSUM);
+  uint32 index_size = blocks.size()*sizeof(size_t)*(has_checksums ? 2 : 1)
+      + (has_checksums ? HEADER_SIZE : 0);
   uint32 pos = 0;
  
   Void_Pointer< uint8 > index_buf(index_size);
   
-  for (vector< size_t >::const_iterator it(blocks.begin()); it != blocks.end();
-      ++it)
+  if (has_checksums)
+  {
+    *(uint32*)index_buf.ptr = FILE_FORMAT_MAGIC;
+    *(uint32*)(index_buf.ptr + 4) = FILE_FORMAT_VERSION;
+    *(uint32*)(index_buf.ptr + 8) = checksum_method;
+    *(uint32*)(index_buf.ptr + 12) = 0;
+    pos = HEADER_SIZE;
+  }
+  
+  for (vector< size_t >::size_type i = 0; i < blocks.size(); ++i)
   {
-    *(size_t*)(index_buf.ptr+pos) = *it;
+    *(size_t*)(index_buf.ptr+pos) = blocks[i];
     pos += sizeof(size_t);
+    if (has_checksums)
+    {
+      *(uint32*)(index_buf.ptr+pos) = (i < checksums.size() ? checksums[i] : 0);
+      pos += sizeof(uint32);
+    }
   }
 
   Raw_File dest_file(index_file_name, O_RDWR|O_CREAT, S_666, "Random_File:7");
@@ -21,6 +21,8 @@
 
 #include "random_file.h"
 
+#include <pthread.h>
+
 #include <map>
 #include <vector>
 
@@ -49,6 +51,23 @@ class Nonsynced_Transaction : public Transaction
     void flush();
     string get_db_dir() const { return db_dir; }
     
+    // Read-only data indexes created afterwards use this cache for their blocks.
+    void set_block_cache(Shared_Block_Cache* block_cache_) { block_cache = block_cache_; }
+    
+    // Read-only data indexes created afterwards access their data files by mmap.
+    void set_use_mmap(bool use_mmap_) { use_mmap = use_mmap_; }
+    
+    // Read-only data indexes created afterwards announce that many blocks ahead
+    // of discrete and range iterators to the kernel.
+    void set_prefetch_depth(uint32 prefetch_depth_) { prefetch_depth = prefetch_depth_; }
+    
+    // All indexes created afterwards let their files verify the checksums of
+    // the blocks they read.
+    void set_verify_checksums(bool verify_checksums_) { verify_checksums = verify_checksums_; }
+    
+    // Read-only data indexes created afterwards take their content from this image.
+    void set_index_image(const Index_Image* index_image_) { index_image = index_image_; }
+    
   private:
     map< const File_Properties*, File_Blocks_Index_Base* >
       data_files;
@@ -56,17 +75,38 @@ class Nonsynced_Transaction : public Transaction
       random_files;
     bool writeable, use_shadow;
     string file_name_extension, db_dir;
+    Shared_Block_Cache* block_cache;
+    bool use_mmap;
+    uint32 prefetch_depth;
+    bool verify_checksums;
+    const Index_Image* index_image;
+    
+    // Guards the lazy creation of indexes such that the threads of a query can share
+    // the transaction.
+    pthread_mutex_t index_mutex;
+    
+    struct Index_Lock
+    {
+      Index_Lock(pthread_mutex_t& mutex_) : mutex(mutex_) { pthread_mutex_lock(&mutex); }
+      ~Index_Lock() { pthread_mutex_unlock(&mutex); }
+      pthread_mutex_t& mutex;
+    };
 };
 
 inline Nonsynced_Transaction::Nonsynced_Transaction
     (bool writeable_, bool use_shadow_,
      const string& db_dir_, const string& file_name_extension_)
   : writeable(writeable_), use_shadow(use_shadow_),
-    file_name_extension(file_name_extension_), db_dir(db_dir_) {}
+    file_name_extension(file_name_extension_), db_dir(db_dir_), block_cache(0),
+    use_mmap(false), prefetch_depth(0), verify_checksums(false), index_image(0)
+{
+  pthread_mutex_init(&index_mutex, 0);
+}
   
 inline Nonsynced_Transaction::~Nonsynced_Transaction()
 {
   flush();
+  pthread_mutex_destroy(&index_mutex);
 }
 
 inline void Nonsynced_Transaction::flush()
@@ -84,27 +124,40 @@ inline void Nonsynced_Transaction::flush()
 inline File_Blocks_Index_Base* Nonsynced_Transaction::data_index
     (const File_Properties* fp)
 { 
+  Index_Lock lock(index_mutex);
   map< const File_Properties*, File_Blocks_Index_Base* >::iterator
       it = data_files.find(fp);
   if (it != data_files.end())
     return it->second;
 
   File_Blocks_Index_Base* data_index = fp->new_data_index
-      (writeable, use_shadow, db_dir, file_name_extension);
+      (writeable, use_shadow, db_dir, file_name_extension, writeable ? 0 : index_image);
   if (data_index != 0)
+  {
+    data_index->verify_checksums = verify_checksums;
+    if (!writeable)
+    {
+      data_index->block_cache = block_cache;
+      data_index->use_mmap = use_mmap;
+      data_index->prefetch_depth = prefetch_depth;
+    }
     data_files[fp] = data_index;
+  }
   return data_index;
 }
 
 inline Random_File_Index* Nonsynced_Transaction::random_index(const File_Properties* fp)
 { 
+  Index_Lock lock(index_mutex);
   map< const File_Properties*, Random_File_Index* >::iterator
       it = random_files.find(fp);
   if (it != random_files.end())
     return it->second;
   
-  random_files[fp] = new Random_File_Index(*fp, writeable, use_shadow, db_dir);
-  return random_files[fp];
+  Random_File_Index* random_index = new Random_File_Index(*fp, writeable, use_shadow, db_dir);
+  random_index->verify_checksums = verify_checksums;
+  random_files[fp] = random_index;
+  return random_index;
 }
 
 #endif
@@ -25,3 +25,17 @@ int& global_read_counter()
   static int counter = 0;
   return counter;
 }
+
+
+uint64& global_read_bytes()
+{
+  static uint64 bytes = 0;
+  return bytes;
+}
+
+
+Write_Statistics& global_write_statistics()
+{
+  static Write_Statistics statistics;
+  return statistics;
+}
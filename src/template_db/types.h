@@ -68,9 +68,45 @@ struct File_Properties_Exception
   int32 id;
 };
 
+class Index_Image;
+class Shared_Block_Cache;
+
 struct File_Blocks_Index_Base
 {
+  static const uint32 NO_COMPRESSION = 0;
+  static const uint32 ZLIB_COMPRESSION = 1;
+  
+  static const uint32 NO_CHECKSUM = 0;
+  static const uint32 CRC32C_CHECKSUM = 1;
+  
+  // Where a block is stored in the data file and the checksum of the stored bytes.
+  struct Block_Location
+  {
+    uint32 pos;
+    uint32 size;
+    uint32 checksum;
+  };
+  
+  File_Blocks_Index_Base()
+    : block_cache(0), use_mmap(false), prefetch_depth(0), verify_checksums(false) {}
   virtual ~File_Blocks_Index_Base() {}
+  
+  virtual string get_data_file_name() const = 0;
+  virtual uint64 get_unit_size() const = 0;
+  virtual uint32 get_compression_method() const = 0;
+  virtual uint32 get_io_backend() const = 0;
+  virtual uint32 get_checksum_method() const = 0;
+  virtual vector< Block_Location > get_block_locations() const = 0;
+  
+  // If not null, reading File_Blocks look up their blocks in this cache first.
+  Shared_Block_Cache* block_cache;
+  // If true, reading File_Blocks map uncompressed data files into memory.
+  bool use_mmap;
+  // Reading discrete and range iterators announce this many blocks ahead to the kernel.
+  uint32 prefetch_depth;
+  // If true, File_Blocks compare the checksum of each block read from the disk
+  // with the index and throw a File_Error on a mismatch.
+  bool verify_checksums;
 };
 
 struct File_Properties
@@ -86,11 +122,25 @@ struct File_Properties
   virtual vector< bool > get_map_footprint(const string& db_dir) const = 0;
   virtual uint32 id_max_size_of() const = 0;
   
+  // Blocks are stored in units of get_block_size()/get_compression_factor()
+  // bytes if the method is not NO_COMPRESSION. Both values only apply to
+  // newly created files: existing files keep the method of their index.
+  virtual uint32 get_compression_factor() const = 0;
+  virtual uint32 get_compression_method() const = 0;
+  
+  // One of the Block_Device constants. Selects how the data file is accessed.
+  virtual uint32 get_io_backend() const = 0;
+  
+  // One of the File_Blocks_Index_Base checksum methods. Like the compression
+  // method, it only applies to newly created files.
+  virtual uint32 get_checksum_method() const = 0;
+  
   // The returned object is of type File_Blocks_Index< .. >*
-  // and goes into the ownership of the caller.
+  // and goes into the ownership of the caller. If index_image is not null,
+  // a read-only index takes its content from there if possible.
   virtual File_Blocks_Index_Base* new_data_index
-      (bool writeable, bool use_shadow, string db_dir, string file_name_extension)
-      const = 0;
+      (bool writeable, bool use_shadow, string db_dir, string file_name_extension,
+       const Index_Image* index_image) const = 0;
 };
 
 /** Simple RAII class to keep a file descriptor. */
@@ -189,5 +239,28 @@ inline void Raw_File::seek(uint64 pos, string caller_id) const
 
 int& global_read_counter();
 
+/** Counts the bytes read from data files by this process, before decompression. */
+uint64& global_read_bytes();
+
+
+/** Counts the blocks written to data files by this process. Write amplification
+    is the ratio of written_bytes to net_bytes. The counters are updated atomically,
+    as several threads may write at once. */
+struct Write_Statistics
+{
+  Write_Statistics() : blocks(0), superseded(0), net_bytes(0), written_bytes(0), write_calls(0) {}
+  
+  // Blocks passed to the data files and how many of them have been replaced
+  // or dropped before they reached the disk.
+  uint64 blocks;
+  uint64 superseded;
+  // The net size of the passed blocks and the bytes that hit the disk.
+  uint64 net_bytes;
+  uint64 written_bytes;
+  uint64 write_calls;
+};
+
+Write_Statistics& global_write_statistics();
+
 
 #endif
@@ -0,0 +1,89 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "zlib_wrapper.h"
+
+
+Zlib_Deflate::Zlib_Deflate(int level)
+{
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  int ret = deflateInit(&strm, level);
+  if (ret != Z_OK)
+    throw File_Error(ret, "(zlib)", "Zlib_Deflate::Zlib_Deflate");
+}
+
+Zlib_Deflate::~Zlib_Deflate()
+{
+  deflateEnd(&strm);
+}
+
+uint32 Zlib_Deflate::compress(const void* in, uint32 in_size, void* out, uint32 out_buffer_size)
+{
+  int ret = deflateReset(&strm);
+  if (ret != Z_OK)
+    throw File_Error(ret, "(zlib)", "Zlib_Deflate::compress::1");
+
+  strm.next_in = (Bytef*)in;
+  strm.avail_in = in_size;
+  strm.next_out = (Bytef*)out;
+  strm.avail_out = out_buffer_size;
+
+  ret = deflate(&strm, Z_FINISH);
+  if (ret != Z_STREAM_END)
+    throw File_Error(ret, "(zlib)", "Zlib_Deflate::compress::2");
+
+  return out_buffer_size - strm.avail_out;
+}
+
+
+Zlib_Inflate::Zlib_Inflate()
+{
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.next_in = Z_NULL;
+  strm.avail_in = 0;
+  int ret = inflateInit(&strm);
+  if (ret != Z_OK)
+    throw File_Error(ret, "(zlib)", "Zlib_Inflate::Zlib_Inflate");
+}
+
+Zlib_Inflate::~Zlib_Inflate()
+{
+  inflateEnd(&strm);
+}
+
+uint32 Zlib_Inflate::decompress(const void* in, uint32 in_size, void* out, uint32 out_buffer_size)
+{
+  int ret = inflateReset(&strm);
+  if (ret != Z_OK)
+    throw File_Error(ret, "(zlib)", "Zlib_Inflate::decompress::1");
+
+  strm.next_in = (Bytef*)in;
+  strm.avail_in = in_size;
+  strm.next_out = (Bytef*)out;
+  strm.avail_out = out_buffer_size;
+
+  ret = inflate(&strm, Z_FINISH);
+  if (ret != Z_STREAM_END)
+    throw File_Error(ret, "(zlib)", "Zlib_Inflate::decompress::2");
+
+  return out_buffer_size - strm.avail_out;
+}
@@ -0,0 +1,67 @@
+/** Copyright 2008, 2009, 2010, 2011, 2012 Roland Olbricht
+*
+* This file is part of Template_DB.
+*
+* Template_DB is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* Template_DB is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with Template_DB.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DE__OSM3S___TEMPLATE_DB__ZLIB_WRAPPER_H
+#define DE__OSM3S___TEMPLATE_DB__ZLIB_WRAPPER_H
+
+#include "types.h"
+
+#include <zlib.h>
+
+using namespace std;
+
+
+/** Compresses a memory area in one piece. Throws File_Error if zlib reports
+    an error or the output buffer is too small. */
+class Zlib_Deflate
+{
+  Zlib_Deflate(const Zlib_Deflate&);
+  Zlib_Deflate& operator=(const Zlib_Deflate&);
+
+  public:
+    explicit Zlib_Deflate(int level = Z_DEFAULT_COMPRESSION);
+    ~Zlib_Deflate();
+
+    // Returns the number of bytes written to out.
+    uint32 compress(const void* in, uint32 in_size, void* out, uint32 out_buffer_size);
+
+  private:
+    z_stream strm;
+};
+
+
+/** Decompresses a memory area in one piece. Throws File_Error if zlib reports
+    an error or the output buffer is too small. */
+class Zlib_Inflate
+{
+  Zlib_Inflate(const Zlib_Inflate&);
+  Zlib_Inflate& operator=(const Zlib_Inflate&);
+
+  public:
+    Zlib_Inflate();
+    ~Zlib_Inflate();
+
+    // Returns the number of bytes written to out.
+    uint32 decompress(const void* in, uint32 in_size, void* out, uint32 out_buffer_size);
+
+  private:
+    z_stream strm;
+};
+
+
+#endif
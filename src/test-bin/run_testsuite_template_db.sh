@@ -173,8 +173,32 @@ perform_test_loop file_blocks 12
 date +%T
 perform_test_loop block_backend 13
 date +%T
+perform_test_loop block_backend 13 --compressed
+date +%T
+perform_test_loop block_backend 13 --cached
+date +%T
+perform_test_loop block_backend 13 --mapped
+date +%T
+perform_test_loop block_backend 13 --index-image
+date +%T
+perform_test_loop block_backend 13 --prefetch
+date +%T
+perform_test_loop block_backend 13 --memory-io
+date +%T
+perform_test_loop block_backend 13 --direct-io
+date +%T
+perform_test_loop block_backend 13 --uring-io
+date +%T
+perform_test_loop block_backend 13 --checksums
+date +%T
+perform_test_loop block_backend 13 "--compressed --checksums"
+date +%T
 perform_test_loop random_file 8
 date +%T
+perform_test_loop random_file 8 --checksums
+date +%T
+perform_test_loop random_file 8 --cache-blocks=1
+date +%T
 perform_test_loop test_dispatcher 20
 
 dispatcher_client_server 21
@@ -204,4 +204,30 @@ prepare_test_loop polygon_query 5 $DATA_SIZE
 date +%T
 perform_test_loop polygon_query 5 "$DATA_SIZE ../../input/update_database/"
 
+# Repeat the query and union tests with independent statements executed on several threads
+date +%T
+perform_test_loop query 150 "$DATA_SIZE ../../input/update_database/ $NODE_OFFSET 4"
+date +%T
+perform_test_loop union 6 "../../input/update_database/ $NODE_OFFSET 4"
+
+# Repeat the tests that read ways on a database with the compact way encoding
+rm -f input/update_database/*
+$BASEDIR/test-bin/generate_test_file $DATA_SIZE "" $NODE_OFFSET >input/update_database/stdin.log
+$BASEDIR/bin/update_database --db-dir=input/update_database/ --version=mock-up-init --way-encoding=compact <input/update_database/stdin.log
+date +%T
+perform_test_loop print 4 "$DATA_SIZE ../../input/update_database/ $NODE_OFFSET"
+date +%T
+perform_test_loop recurse 28 "$DATA_SIZE ../../input/update_database/ $NODE_OFFSET"
+date +%T
+perform_test_loop bbox_query 8 "$DATA_SIZE ../../input/update_database/"
+
+# Repeat the tests that read tags on a database with dictionary coded keys
+rm -f input/update_database/*
+$BASEDIR/test-bin/generate_test_file $DATA_SIZE "" $NODE_OFFSET >input/update_database/stdin.log
+$BASEDIR/bin/update_database --db-dir=input/update_database/ --version=mock-up-init --tag-encoding=dictionary <input/update_database/stdin.log
+date +%T
+perform_test_loop print 4 "$DATA_SIZE ../../input/update_database/ $NODE_OFFSET"
+date +%T
+perform_test_loop query 150 "$DATA_SIZE ../../input/update_database/ $NODE_OFFSET"
+
 rm -f input/update_database/*